@@ -12,13 +12,11 @@
 	uniform sampler2D				DiffuseTex;
 	uniform sampler2D				NormalTex;
 
-	uniform vec3					ViewPos;
-	uniform vec3					LightDir;
-	uniform vec3					LightIntensity;
 	uniform mat4					LightViewProjs[4];
 
 	uniform float					BlendFactor;	// Fake variable
 	uniform float 					Bias;
+	uniform int						BakedTerrain;	// Terrains are not shadow casters
 
 	out vec4 						FragColor;
 
@@ -87,7 +85,7 @@
 		vec4 diffuse		= textureLod(DiffuseTex,pix,0);
 		float roughness		= normal.w;
 		float specularity	= diffuse.w;
-		vec3 viewDir		= normalize(ViewPos-pos.xyz);
+		vec3 viewDir		= normalize(ViewPos.xyz-pos.xyz);
 
 		// Select cascade
 		// Compute derivates of position in projective light space for small 
@@ -114,8 +112,13 @@
 
 		// Compute radiance
 		float v		= ShadowTest(lposs[cindex].xyz, cindex, Bias);
+
+		// Terrain sun visibility baked into its horizon map, packed into the
+		// position w (see meshterrain.fs)
+		if(BakedTerrain>0 && pos.w<0)
+			v		= min(v, mod(-pos.w-1.f,256.f) / 255.f);
 //		float f		= WangBRDF(viewDir,-LightDir,normal.xyz,roughness,specularity),
-		float f		= CookBRDF(viewDir,-LightDir,normal.xyz,roughness,specularity);
+		float f		= CookBRDF(viewDir,-LightDir.xyz,normal.xyz,roughness,specularity);
 
 		#if DISPLAY_CASCADES
 		vec3 color;
@@ -131,14 +134,14 @@
 			else 
 					color = vec3(1.f,0.f,1.f);
 		}
-		FragColor   = vec4(f*LightIntensity*v*color,1.f);
+		FragColor   = vec4(f*LightIntensity.xyz*v*color,1.f);
 		#else
-		FragColor   = vec4(f*LightIntensity*v*diffuse.xyz,1.f);
+		FragColor   = vec4(f*LightIntensity.xyz*v*diffuse.xyz,1.f);
 		#endif
 
 		#if LIGHTING_ONLY
 		if(gl_FragCoord.x<10000)
-			FragColor= vec4(vec3(f*LightIntensity*v),1.f);
+			FragColor= vec4(vec3(f*LightIntensity.xyz*v),1.f);
 		#endif
 	}
 #endif
@@ -146,16 +149,30 @@
 #ifdef CSM_FILTER
 	uniform sampler2DArray MomentTex;
 	uniform vec2 Direction;
+	uniform int Radius;		// Box of 2*Radius+1 texels
 	in flat int gCascadeLayer;
 	out vec4 FragColor;
 	void main()
 	{
 		vec2 rcpSize	= 1.f/textureSize(MomentTex,0).xy;
-		vec2 coord		= gl_FragCoord.xy;
-		vec2 filtered	= vec2(0);
-		for(int i=-2;i<=2;++i)
-			filtered += textureLod(MomentTex,vec3((coord+i*Direction)*rcpSize,gCascadeLayer),0).xy;
-		FragColor = vec4(filtered*0.2f,0,1);
+		vec2 coord		= gl_FragCoord.xy*rcpSize;
+		vec2 offset		= Direction*rcpSize;
+		vec2 filtered	= textureLod(MomentTex,vec3(coord,gCascadeLayer),0).xy;
+
+		// Pairs of texels are averaged by the bilinear filtering : one
+		// fetch for two texels on each side
+		for(int i=1;i<Radius;i+=2)
+		{
+			float o		= float(i) + 0.5f;
+			filtered   += 2.f * textureLod(MomentTex,vec3(coord+o*offset,gCascadeLayer),0).xy;
+			filtered   += 2.f * textureLod(MomentTex,vec3(coord-o*offset,gCascadeLayer),0).xy;
+		}
+		if((Radius & 1)!=0)
+		{
+			filtered   += textureLod(MomentTex,vec3(coord+Radius*offset,gCascadeLayer),0).xy;
+			filtered   += textureLod(MomentTex,vec3(coord-Radius*offset,gCascadeLayer),0).xy;
+		}
+		FragColor = vec4(filtered/float(2*Radius+1),0,1);
 	}
 #endif
 
@@ -11,10 +11,11 @@ void main()
 
 #ifdef CSM_FILTER
 layout(location = ATTR_POSITION) in  vec2 Position;
+uniform int FirstLayer;
 out int vCascadeLayer;
 void main()
 {
-	vCascadeLayer = gl_InstanceID;
+	vCascadeLayer = FirstLayer + gl_InstanceID;
 	gl_Position  = vec4(Position,0,1);
 }
 #endif
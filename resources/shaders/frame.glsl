@@ -0,0 +1,13 @@
+//------------------------------------------------------------------------------
+// Per frame constants shared by all the programs (see glf::FrameBlock)
+//------------------------------------------------------------------------------
+layout(std140, binding = 0) uniform FrameBlock
+{
+	mat4	View;
+	mat4	Projection;
+	mat4	ViewProj;
+	vec4	ViewPos;			// xyz
+	vec4	LightDir;			// xyz : direction of the light flux
+	vec4	LightIntensity;		// xyz
+	vec4	Time;				// x : seconds, y : frame index
+};
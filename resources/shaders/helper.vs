@@ -1,6 +1,5 @@
 #version 420 core
 
-uniform mat4 Transform;
 uniform mat4 Model;
 
 layout(location = ATTR_POSITION) in vec3 Position;
@@ -9,7 +8,7 @@ layout(location = ATTR_COLOR)    in vec3 Color;
 out vec3 gColor;
 void main()
 {
-	gl_Position = Transform * Model * vec4(Position,1.f);
+	gl_Position = ViewProj * Model * vec4(Position,1.f);
 	gColor		= Color;
 }
 
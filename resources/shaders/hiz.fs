@@ -0,0 +1,50 @@
+#version 420 core
+
+// Max-reduction mip chain of the depth buffer : a texel holds the farthest
+// depth of the texels it covers in the finer levels
+out float FragDepth;
+
+#ifdef HIZ_COPY
+uniform sampler2D DepthTex;
+
+void main()
+{
+	FragDepth = texelFetch(DepthTex,ivec2(gl_FragCoord.xy),0).x;
+}
+#endif
+
+#ifdef HIZ_REDUCE
+uniform sampler2D HiZTex;	// Base level set to the previous level
+uniform ivec2	  Size;		// Size of the written level
+
+void main()
+{
+	ivec2 dst     = ivec2(gl_FragCoord.xy);
+	ivec2 src     = dst * 2;
+	ivec2 srcSize = textureSize(HiZTex,0);
+	ivec2 last    = srcSize - 1;
+
+	float d = max(	max(texelFetch(HiZTex,min(src+ivec2(0,0),last),0).x,
+						texelFetch(HiZTex,min(src+ivec2(1,0),last),0).x),
+					max(texelFetch(HiZTex,min(src+ivec2(0,1),last),0).x,
+						texelFetch(HiZTex,min(src+ivec2(1,1),last),0).x));
+
+	// Odd sizes : the last row/column also covers the remaining texels
+	bool extraX = (srcSize.x & 1)!=0 && dst.x==Size.x-1;
+	bool extraY = (srcSize.y & 1)!=0 && dst.y==Size.y-1;
+	if(extraX)
+	{
+		d = max(d,texelFetch(HiZTex,min(src+ivec2(2,0),last),0).x);
+		d = max(d,texelFetch(HiZTex,min(src+ivec2(2,1),last),0).x);
+	}
+	if(extraY)
+	{
+		d = max(d,texelFetch(HiZTex,min(src+ivec2(0,2),last),0).x);
+		d = max(d,texelFetch(HiZTex,min(src+ivec2(1,2),last),0).x);
+	}
+	if(extraX && extraY)
+		d = max(d,texelFetch(HiZTex,min(src+ivec2(2,2),last),0).x);
+
+	FragDepth = d;
+}
+#endif
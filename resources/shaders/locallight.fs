@@ -0,0 +1,90 @@
+#version 420 core
+
+#ifdef LOCAL_LIGHT
+	uniform sampler2D				PositionTex;
+	uniform sampler2D				DiffuseTex;
+	uniform sampler2D				NormalTex;
+	uniform sampler2DShadow			ShadowTex;		// Atlas of all the lights
+
+	uniform int						LocalType;		// See LocalLight::Type
+	uniform vec3					LocalPosition;
+	uniform vec3					LocalDirection;	// Axis of the spot cone
+	uniform vec3					LocalIntensity;
+	uniform float					LocalRadius;
+	uniform vec2					SpotCosines;	// Of the inner and outer half angles
+
+	uniform int						nFaces;			// 0 without shadow map
+	uniform mat4					FaceViewProjs[6];
+	uniform vec4					FaceRects[6];	// Atlas coordinates (offset.xy, scale.zw)
+	uniform float					NormalOffset;	// Per unit of distance to the light
+
+	out vec4 						FragColor;
+
+	//--------------------------------------------------------------------------
+	// Constants
+	//--------------------------------------------------------------------------
+	#define SPOT					1
+
+	//--------------------------------------------------------------------------
+	// Hardware 2x2 PCF into the tile of the face. The faces of a point light
+	// are the ones of the major axis of the direction from the light, in
+	// the order +x,-x,+y,-y,+z,-z (see ShadowAtlas)
+	float ShadowTest(const vec3 _pos, const vec3 _fromLight)
+	{
+		int face = 0;
+		if(nFaces==6)
+		{
+			vec3 a = abs(_fromLight);
+			if(a.x>=a.y && a.x>=a.z)
+				face = _fromLight.x>0 ? 0 : 1;
+			else if(a.y>=a.z)
+				face = _fromLight.y>0 ? 2 : 3;
+			else
+				face = _fromLight.z>0 ? 4 : 5;
+		}
+
+		vec4 p		= FaceViewProjs[face] * vec4(_pos,1.f);
+		p.xyz		= (p.xyz/p.w)*0.5f + 0.5f;
+
+		// Filtering footprint kept inside of the tile
+		vec4 rect	= FaceRects[face];
+		vec2 texel	= 0.5f / vec2(textureSize(ShadowTex,0));
+		vec2 uv		= clamp(rect.xy + p.xy*rect.zw, rect.xy + texel, rect.xy + rect.zw - texel);
+		return texture(ShadowTex,vec3(uv,p.z));
+	}
+	//--------------------------------------------------------------------------
+	void main()
+	{
+		vec2 pix			= gl_FragCoord.xy / vec2(textureSize(PositionTex,0));
+		vec4 pos			= textureLod(PositionTex,pix,0);
+		vec3 toLight		= LocalPosition - pos.xyz;
+		float dist			= length(toLight);
+		if(dist>=LocalRadius)
+			discard;
+
+		// Inverse square falloff, windowed to reach 0 at the radius
+		vec3 lightDir		= toLight / dist;
+		float x				= dist / LocalRadius;
+		float window		= clamp(1.f - x*x*x*x,0.f,1.f);
+		float attenuation	= window*window / (dist*dist + 1.f);
+		if(LocalType==SPOT)
+			attenuation	   *= smoothstep(SpotCosines.y,SpotCosines.x,dot(-lightDir,LocalDirection));
+		if(attenuation<=0.f)
+			discard;
+
+		vec4 normal			= textureLod(NormalTex,pix,0);
+		vec4 diffuse		= textureLod(DiffuseTex,pix,0);
+		float roughness		= normal.w;
+		float specularity	= diffuse.w;
+		vec3 viewDir		= normalize(ViewPos.xyz-pos.xyz);
+
+		// The receiver is offset along its normal by about a texel of the
+		// tile, which grows with the distance to the light
+		float v				= 1.f;
+		if(nFaces>0)
+			v				= ShadowTest(pos.xyz + normal.xyz*(NormalOffset*dist), -toLight);
+
+		float f				= CookBRDF(viewDir,lightDir,normal.xyz,roughness,specularity);
+		FragColor			= vec4(f*LocalIntensity*attenuation*v*diffuse.xyz,1.f);
+	}
+#endif
@@ -0,0 +1,10 @@
+#version 420 core
+
+#ifdef LOCAL_LIGHT
+layout(location = ATTR_POSITION) in  vec2 Position;
+
+void main()
+{
+	gl_Position  = vec4(Position,0,1);
+}
+#endif
@@ -0,0 +1,9 @@
+#version 420 core
+
+// Never executed : the culling pass discards the rasterization
+out vec4 FragColor;
+
+void main()
+{
+	FragColor = vec4(0);
+}
@@ -0,0 +1,107 @@
+#version 420 core
+
+// One vertex per indirect command, rendered with the rasterizer discarded.
+// The bounds of the command mesh are tested against each volume : the
+// instance count of the command becomes the number of intersected volumes
+// and the volume bits are written into the mask of the command.
+//
+// Two-phase occlusion culling against a single volume : the first phase
+// draws the commands visible at the previous frame, the second one draws
+// the commands which pass the Hi-Z test built from the first phase and
+// were not drawn yet. The second phase records the visibility of the frame
+#define MODE_VOLUMES	0
+#define MODE_PREVIOUS	1
+#define MODE_OCCLUSION	2
+
+uniform samplerBuffer	BoundTex;			// World bound of each mesh : min, max
+uniform isamplerBuffer	CommandMeshTex;		// Mesh of each command
+uniform vec4			Planes[MAX_VOLUMES*6];
+uniform int				nVolumes;
+uniform int				Mode;
+uniform mat4			ViewProj;
+uniform sampler2D		HiZTex;
+uniform int				HiZLevels;
+uniform int				BaseInstance;		// Added to the command index
+
+layout(r32ui) writeonly uniform uimageBuffer CommandImage;	// DrawElementsIndirectCommand as uints
+layout(r32ui) writeonly uniform uimageBuffer MaskImage;
+layout(r32ui) uniform uimageBuffer VisibilityImage;			// Visibility at the last occlusion phase
+
+bool Intersect(int volume, vec3 pMin, vec3 pMax)
+{
+	for(int i=0;i<6;++i)
+	{
+		vec4 plane = Planes[volume*6+i];
+		vec3 p     = mix(pMin,pMax,greaterThan(plane.xyz,vec3(0)));
+		if(dot(plane.xyz,p) + plane.w < 0.f)
+			return false;
+	}
+	return true;
+}
+
+// Conservative : false as soon as the bound crosses the camera plane
+bool Occluded(vec3 pMin, vec3 pMax)
+{
+	vec2  sMin = vec2( 1.f);
+	vec2  sMax = vec2(-1.f);
+	float zMin = 1.f;
+	for(int i=0;i<8;++i)
+	{
+		vec3 corner = mix(pMin,pMax,vec3(i&1,(i>>1)&1,(i>>2)&1));
+		vec4 p      = ViewProj * vec4(corner,1.f);
+		if(p.w<=0.f)
+			return false;
+		vec3 ndc    = p.xyz / p.w;
+		sMin        = min(sMin,ndc.xy);
+		sMax        = max(sMax,ndc.xy);
+		zMin        = min(zMin,ndc.z);
+	}
+	sMin = clamp(sMin*0.5f+0.5f,vec2(0.f),vec2(1.f));
+	sMax = clamp(sMax*0.5f+0.5f,vec2(0.f),vec2(1.f));
+	zMin = zMin*0.5f+0.5f;
+
+	// Level at which the screen rectangle spans at most 2x2 texels
+	vec2 extent = (sMax-sMin) * vec2(textureSize(HiZTex,0));
+	int  level  = int(ceil(log2(max(max(extent.x,extent.y),1.f))));
+	level       = min(level,HiZLevels-1);
+
+	ivec2 size  = textureSize(HiZTex,level);
+	ivec2 t0    = min(ivec2(sMin*vec2(size)),size-1);
+	ivec2 t1    = min(ivec2(sMax*vec2(size)),size-1);
+	float depth = max(	max(texelFetch(HiZTex,ivec2(t0.x,t0.y),level).x,
+							texelFetch(HiZTex,ivec2(t1.x,t0.y),level).x),
+						max(texelFetch(HiZTex,ivec2(t0.x,t1.y),level).x,
+							texelFetch(HiZTex,ivec2(t1.x,t1.y),level).x));
+	return zMin > depth;
+}
+
+void main()
+{
+	int  command = gl_VertexID;
+	int  mesh    = texelFetch(CommandMeshTex,command).x;
+	vec3 pMin    = texelFetch(BoundTex,2*mesh+0).xyz;
+	vec3 pMax    = texelFetch(BoundTex,2*mesh+1).xyz;
+
+	uint mask    = 0u;
+	for(int v=0;v<nVolumes;++v)
+		if(Intersect(v,pMin,pMax))
+			mask |= 1u<<v;
+
+	if(Mode==MODE_PREVIOUS)
+	{
+		if(imageLoad(VisibilityImage,command).x==0u)
+			mask = 0u;
+	}
+	else if(Mode==MODE_OCCLUSION)
+	{
+		bool visible = mask!=0u && !Occluded(pMin,pMax);
+		bool drawn   = imageLoad(VisibilityImage,command).x!=0u;
+		mask         = (visible && !drawn) ? 1u : 0u;
+		imageStore(VisibilityImage,command,uvec4(visible?1u:0u,0,0,0));
+	}
+
+	imageStore(CommandImage,command*5+1,uvec4(bitCount(mask),0,0,0));
+	imageStore(CommandImage,command*5+4,uvec4(uint(BaseInstance+command),0,0,0));
+	imageStore(MaskImage,command,uvec4(mask,0,0,0));
+	gl_Position = vec4(0,0,0,1);
+}
@@ -3,14 +3,13 @@
 #ifdef GBUFFER
 	uniform sampler2D   DiffuseTex;
 	uniform sampler2D   NormalTex;
-	uniform float       Roughness;
-	uniform float       Specularity;
 
 	in  vec3  vPosition;
 	in  vec3  vNormal;
 	in  vec3  vTangent;
 	in  vec2  vTexCoord;
 	in  float vTBNsign;
+	flat in vec2 vMaterial;		// Roughness, specularity
 
 	layout(location = OUT_POSITION, 		index = 0) out vec4 FragPosition;
 	layout(location = OUT_NORMAL_ROUGHNESS, index = 0) out vec4 FragNormal;
@@ -26,8 +25,8 @@
 		// Extract normal and project it in world space
 		vec3 normal  	= texture(NormalTex,vTexCoord).xyz*2.f - 1.f;
 		FragPosition 	= vec4(vPosition,1);
-		FragNormal   	= vec4(normalize(normal.x*vNTangent + normal.y*vNBitangent + normal.z*vNNormal),Roughness);
-		FragDiffuse  	= vec4(texture(DiffuseTex,vTexCoord).xyz,Specularity);
+		FragNormal   	= vec4(normalize(normal.x*vNTangent + normal.y*vNBitangent + normal.z*vNNormal),vMaterial.x);
+		FragDiffuse  	= vec4(texture(DiffuseTex,vTexCoord).xyz,vMaterial.y);
 	}
 #endif
 
@@ -67,3 +66,12 @@
 	}
 	#endif
 #endif
+
+
+#ifdef SHADOW_ATLAS
+	// Depth only
+	void main()
+	{
+
+	}
+#endif
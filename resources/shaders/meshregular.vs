@@ -1,41 +1,84 @@
 #version 420 core
 
 #ifdef GBUFFER
-	uniform mat4 Transform;
-	uniform mat4 Model;
+	// Per instance, or per draw record read at the base instance of the draw
+	layout(location = ATTR_MODEL) 		in  mat4 Model;
+	layout(location = ATTR_MATERIAL) 	in  vec4 Material;	// Generic value for instanced models
 
+	// Quantized vertex (see MeshVertex) : normal and tangent are octahedral
+	// encoded snorm16, the handedness is the lowest bit of Tangent.y
 	layout(location = ATTR_POSITION) 	in  vec3 Position;
-	layout(location = ATTR_NORMAL) 		in  vec3 Normal;
+	layout(location = ATTR_NORMAL) 		in  vec2 Normal;
 	layout(location = ATTR_TEXCOORD) 	in  vec2 TexCoord;
-	layout(location = ATTR_TANGENT) 	in  vec4 Tangent;
+	layout(location = ATTR_TANGENT) 	in  vec2 Tangent;
 
 	out vec3  vPosition;
 	out vec3  vNormal;
 	out vec3  vTangent;
 	out vec2  vTexCoord;
 	out float vTBNsign;
+	flat out vec2 vMaterial;
+
+	vec3 OctDecode(vec2 e)
+	{
+		vec3 v = vec3(e, 1.f - abs(e.x) - abs(e.y));
+		if(v.z < 0.f)
+			v.xy = (1.f - abs(v.yx)) * vec2(v.x>=0.f?1.f:-1.f, v.y>=0.f?1.f:-1.f);
+		return normalize(v);
+	}
 
 	void main()
 	{
 		// Do not support non uniform scale
 		mat3 model3x3= mat3(Model);
-		gl_Position  = Transform * Model * vec4(Position,1.f);
+		gl_Position  = ViewProj * Model * vec4(Position,1.f);
 		vPosition	 = (Model * vec4(Position,1.f)).xyz;
-		vNormal	 	 = model3x3 * Normal;
-		vTangent 	 = model3x3 * Tangent.xyz;
-		vTBNsign	 = Tangent.w;
+		vNormal	 	 = model3x3 * OctDecode(Normal);
+		vTangent 	 = model3x3 * OctDecode(Tangent);
+		vTBNsign	 = (int(round(Tangent.y*32767.f)) & 1) != 0 ? -1.f : 1.f;
 		vTexCoord 	 = TexCoord;
+		vMaterial	 = Material.xy;
 	}
 #endif
 
 
 #ifdef CSM_BUILDER
 	uniform mat4 View;
+	#ifdef INSTANCED
+	layout(location = ATTR_MODEL) 		in  mat4 Model;		// Per instance
+	#else
 	uniform mat4 Model;
-	layout(location = ATTR_POSITION) in  vec3 Position;
+	#endif
+	layout(location = ATTR_POSITION) 	in  vec3 Position;
+	layout(location = ATTR_LAYER_MASK) 	in  uint LayerMask;	// Cascades touched by the mesh
+
+	flat out int vLayer;
 
 	void main()
 	{
+		#ifdef INSTANCED
+		// Each instance is a (transformation, cascade) pair, its mask has a
+		// single bit
+		vLayer		 = findLSB(LayerMask);
+		#else
+		// Instance i is rendered into the cascade of the i-th bit of the mask
+		uint mask = LayerMask;
+		for(int i=0;i<gl_InstanceID;++i)
+			mask &= mask - 1u;
+		vLayer		 = findLSB(mask);
+		#endif
 		gl_Position  = View * Model * vec4(Position,1.f);
 	}
 #endif
+
+
+#ifdef SHADOW_ATLAS
+	uniform mat4 LightViewProj;		// Of the atlas tile
+	uniform mat4 Model;
+	layout(location = ATTR_POSITION) 	in  vec3 Position;
+
+	void main()
+	{
+		gl_Position  = LightViewProj * Model * vec4(Position,1.f);
+	}
+#endif
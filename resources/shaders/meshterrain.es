@@ -1,7 +1,6 @@
 #version 420 core
 
 #ifdef GBUFFER
-	uniform mat4		Transform;
 	uniform ivec2		TileCount;
 	uniform float		HeightFactor;
 	uniform sampler2D	HeightTex;
@@ -26,7 +25,7 @@
 		vec4 pos	= interpolate(gl_in[0].gl_Position, gl_in[1].gl_Position, gl_in[2].gl_Position, gl_in[3].gl_Position);
 		pos.z		+= HeightFactor * textureLod(HeightTex,coord,0).x;
 		ePosition	= vec3(pos.xy,pos.z);
-		gl_Position	= Transform * vec4(pos.xy,pos.zw);
+		gl_Position	= ViewProj * vec4(pos.xy,pos.zw);
 		eTexCoord	= coord;
 	}
 #endif
@@ -3,6 +3,7 @@
 #ifdef GBUFFER
 	uniform sampler2D   DiffuseTex;
 	uniform sampler2D   NormalTex;
+	uniform sampler2D   OcclusionTex;	// Horizons toward +x, +y, -x, -y
 	uniform float       Roughness;
 	uniform float       Specularity;
 	uniform float       TileFactor;
@@ -14,9 +15,24 @@
 	layout(location = OUT_NORMAL_ROUGHNESS, index = 0) out vec4 FragNormal;
 	layout(location = OUT_DIFFUSE_SPECULAR, index = 0) out vec4 FragDiffuse;
 
+	//--------------------------------------------------------------------------
+	// Ambient and sun visibilities of the baked horizons (sines of their
+	// elevations), packed into a negative w for the SSAO and CSM passes :
+	// -(1 + 256*ambient + sun), both quantized to 8 bits
+	float PackVisibility(in vec4 horizons)
+	{
+		float ambient	= 1.f - dot(horizons*horizons,vec4(0.25f));
+		vec3 sun		= -LightDir.xyz;
+		vec2 azimuth	= sun.xy / max(length(sun.xy),1e-4f);
+		vec4 weights	= max(vec4(azimuth,-azimuth),vec4(0));
+		float horizon	= dot(weights,horizons) / max(dot(weights,vec4(1)),1e-4f);
+		float visibility= smoothstep(horizon-0.05f,horizon+0.05f,sun.z);
+		return -(1.f + 256.f*round(ambient*255.f) + round(visibility*255.f));
+	}
+	//--------------------------------------------------------------------------
 	void main()
 	{
-		FragPosition 	= vec4(ePosition,1);
+		FragPosition 	= vec4(ePosition,PackVisibility(texture(OcclusionTex,eTexCoord)));
 		vec3 normal  	= textureLod(NormalTex,eTexCoord,0).xyz*2.f - 1.f;
 		FragNormal		= vec4(normalize(normal),Roughness);
 		FragDiffuse		= vec4(texture(DiffuseTex,eTexCoord*TileFactor).xyz,Specularity);
@@ -2,6 +2,7 @@
 
 #ifdef CSM_BUILDER
 	uniform int   nCascades;
+	uniform int   CascadeMask;	// Rebuilt cascades
 	uniform mat4  Projections[MAX_CASCADES];
 	uniform float Nears[MAX_CASCADES];
 	uniform float Fars[MAX_CASCADES];
@@ -14,6 +15,8 @@
 	{
 		for(int layer=0;layer<nCascades;++layer)
 		{
+			if((CascadeMask & (1<<layer))==0)
+				continue;
 			gl_Layer = layer;
 			for(int i=0; i<3;++i)
 			{
@@ -1,33 +1,31 @@
 #version 420 core
 
-#ifdef GBUFFER
+#if (defined GBUFFER && !defined CAPTURED)
 	uniform sampler2D	HeightTex;
-	uniform mat4		Transform;
 	uniform vec3		TileOffset;
 	uniform vec2		TileSize;
 	uniform ivec2		TileCount;
 	uniform float		HeightFactor;
 
 	layout(location = ATTR_POSITION) in vec2 Position;
+	layout(location = ATTR_TILE)     in ivec2 Tile;		// Per instance, visible tiles only
 	out ivec2 vTileCoord;
 	out vec2  vTexCoord;
 	out vec3  vProjPosition;
 
 	void main()
 	{
-		ivec2 tileCoord;
-		tileCoord.x			= gl_InstanceID % TileCount.x;
-		tileCoord.y			= gl_InstanceID / TileCount.x;
+		ivec2 tileCoord		= Tile;
 		float height		= HeightFactor * textureLod(HeightTex,vec2((Position.x+tileCoord.x)/float(TileCount.x),(Position.y+tileCoord.y)/float(TileCount.y)),0).x;
 		vec4 worldPosition	= vec4(TileOffset.x + (Position.x+tileCoord.x)*TileSize.x,TileOffset.y + (Position.y+tileCoord.y)*TileSize.y,TileOffset.z,1);
 		gl_Position			= worldPosition;
 		vTileCoord			= tileCoord;
-		vec4 tmp 			= Transform * vec4(worldPosition.xy,worldPosition.z+height,1);
+		vec4 tmp 			= ViewProj * vec4(worldPosition.xy,worldPosition.z+height,1);
 		vProjPosition		= tmp.xyz / tmp.w;
 	}
 #endif
 
-#ifdef CSM_BUILDER
+#if (defined CSM_BUILDER && !defined CAPTURED)
 	uniform sampler2D	HeightTex;
 	uniform mat4		View;
 	uniform mat4		Projections[MAX_CASCADES];
@@ -37,15 +35,14 @@
 	uniform float		HeightFactor;
 
 	layout(location = ATTR_POSITION) in vec2 Position;
+	layout(location = ATTR_TILE)     in ivec2 Tile;		// Per instance, visible tiles only
 	out ivec2 vTileCoord;
 	out vec2  vTexCoord;
 	out vec3  vProjPosition;
 
 	void main()
 	{
-		ivec2 tileCoord;
-		tileCoord.x			= gl_InstanceID % TileCount.x;
-		tileCoord.y			= gl_InstanceID / TileCount.x;
+		ivec2 tileCoord		= Tile;
 		float height		= HeightFactor * textureLod(HeightTex,vec2((Position.x+tileCoord.x)/float(TileCount.x),(Position.y+tileCoord.y)/float(TileCount.y)),0).x;
 		vec4 worldPosition	= vec4(TileOffset.x + (Position.x+tileCoord.x)*TileSize.x,TileOffset.y + (Position.y+tileCoord.y)*TileSize.y,TileOffset.z,1);
 		gl_Position			= worldPosition;
@@ -54,3 +51,29 @@
 		vProjPosition		= tmp.xyz / tmp.w;
 	}
 #endif
+
+// Terrain tessellated once per frame (see TerrainCapture), world positions
+#if (defined GBUFFER && defined CAPTURED)
+	layout(location = ATTR_POSITION) in vec3 Position;
+	layout(location = ATTR_TEXCOORD) in vec2 TexCoord;
+	out vec3 ePosition;
+	out vec2 eTexCoord;
+
+	void main()
+	{
+		ePosition			= Position;
+		eTexCoord			= TexCoord;
+		gl_Position			= ViewProj * vec4(Position,1);
+	}
+#endif
+
+#if (defined CSM_BUILDER && defined CAPTURED)
+	uniform mat4		View;
+
+	layout(location = ATTR_POSITION) in vec3 Position;
+
+	void main()
+	{
+		gl_Position			= View * vec4(Position,1);
+	}
+#endif
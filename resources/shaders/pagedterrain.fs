@@ -0,0 +1,35 @@
+#version 420 core
+
+#ifdef GBUFFER
+	uniform sampler2DArray	HeightPages;
+	uniform sampler2DArray	DiffusePages;
+	uniform float			HeightFactor;
+	uniform float			PageSize;
+	uniform float			Roughness;
+	uniform float			Specularity;
+
+	in  vec3  ePosition;
+	in  vec3  eTexCoord;
+	flat in vec2 eTexelSize;
+
+	layout(location = OUT_POSITION, 		index = 0) out vec4 FragPosition;
+	layout(location = OUT_NORMAL_ROUGHNESS, index = 0) out vec4 FragNormal;
+	layout(location = OUT_DIFFUSE_SPECULAR, index = 0) out vec4 FragDiffuse;
+
+	void main()
+	{
+		// Central differences of the page heights
+		float texel		= 1.0 / (PageSize+1.0);
+		float hl		= textureLod(HeightPages,eTexCoord-vec3(texel,0,0),0).x;
+		float hr		= textureLod(HeightPages,eTexCoord+vec3(texel,0,0),0).x;
+		float hb		= textureLod(HeightPages,eTexCoord-vec3(0,texel,0),0).x;
+		float ht		= textureLod(HeightPages,eTexCoord+vec3(0,texel,0),0).x;
+		vec3 normal		= vec3(	HeightFactor*(hl-hr) * eTexelSize.y,
+								HeightFactor*(hb-ht) * eTexelSize.x,
+								2.0*eTexelSize.x*eTexelSize.y);
+
+		FragPosition 	= vec4(ePosition,1);
+		FragNormal		= vec4(normalize(normal),Roughness);
+		FragDiffuse		= vec4(texture(DiffusePages,eTexCoord).xyz,Specularity);
+	}
+#endif
@@ -0,0 +1,64 @@
+#version 420 core
+
+// Quadrant of a paged terrain node (see PagedTerrain). The unit grid is
+// placed with the per instance node, its odd vertices morph onto the grid
+// of the parent level before the end of the range of the node level
+uniform sampler2DArray	HeightPages;
+uniform vec3			TerrainOffset;
+uniform vec2			TerrainSize;
+uniform float			HeightFactor;
+uniform float			GridResolution;
+uniform float			PageSize;
+
+layout(location = ATTR_POSITION)       in vec2 Position;
+layout(location = ATTR_TERRAIN_NODE)   in vec4 Node;	// Per instance, xy : origin, zw : size
+layout(location = ATTR_TERRAIN_NODE+1) in vec4 Page;	// xy : origin into the page, z : scale, w : layer
+layout(location = ATTR_TERRAIN_NODE+2) in vec4 Morph;	// xy : morph distances, zw : texel size
+
+//------------------------------------------------------------------------------
+vec3 PageCoord(in vec2 grid)
+{
+	// Texel centers of the (PageSize+1)^2 samples
+	return vec3(((Page.xy + grid*Page.z)*PageSize + 0.5) / (PageSize+1.0), Page.w);
+}
+//------------------------------------------------------------------------------
+vec4 WorldPosition(out vec3 coord)
+{
+	vec2 grid			= Position;
+	float height		= HeightFactor * textureLod(HeightPages,PageCoord(grid),0).x;
+	vec3 world			= vec3(Node.xy + grid*Node.zw, TerrainOffset.z + height);
+	float morph			= clamp((distance(world,ViewPos.xyz) - Morph.x) / (Morph.y - Morph.x),0.0,1.0);
+	grid			   -= fract(grid*GridResolution*0.5) * 2.0/GridResolution * morph;
+
+	// Nodes at the border of the terrain overlap its extent
+	vec2 xy				= clamp(Node.xy + grid*Node.zw, TerrainOffset.xy, TerrainOffset.xy + TerrainSize);
+	grid				= (xy - Node.xy) / Node.zw;
+	coord				= PageCoord(grid);
+	return vec4(xy, TerrainOffset.z + HeightFactor * textureLod(HeightPages,coord,0).x, 1);
+}
+
+#ifdef GBUFFER
+	out vec3 ePosition;
+	out vec3 eTexCoord;
+	flat out vec2 eTexelSize;
+
+	void main()
+	{
+		vec4 pos			= WorldPosition(eTexCoord);
+		ePosition			= pos.xyz;
+		eTexelSize			= Morph.zw;
+		gl_Position			= ViewProj * pos;
+	}
+#endif
+
+// Morphed with the camera distance like the G-buffer pass, View is the
+// camera one of frame.glsl
+#ifdef CSM_BUILDER
+	uniform mat4		LightView;
+
+	void main()
+	{
+		vec3 coord;
+		gl_Position			= LightView * WorldPosition(coord);
+	}
+#endif
@@ -0,0 +1,85 @@
+#version 420 core
+
+// Sample distribution of the view for the cascaded shadow maps. A fragment
+// reduces SDSM_TILE x SDSM_TILE texels of the previous level, all the
+// layers with min :
+//	layer 0     : view depth range of the samples (near, -far)
+//	layer 1 + c : light space bounds of the samples of the cascade c
+//	              (min x, min y, -max x, -max y)
+// Blocks without sample keep SDSM_EMPTY
+#define SDSM_LAYERS		5
+#define SDSM_EMPTY		vec4(1e30)
+
+layout(location = 0) out vec4 FragData[SDSM_LAYERS];
+
+void Write(vec4 _data[SDSM_LAYERS])
+{
+	FragData[0] = _data[0];
+	FragData[1] = _data[1];
+	FragData[2] = _data[2];
+	FragData[3] = _data[3];
+	FragData[4] = _data[4];
+}
+
+#ifdef SDSM_FIRST
+uniform sampler2D	PositionTex;				// World space, w = 0 without sample
+uniform mat4		View;
+uniform mat4		LightView;
+uniform float		SplitFars[SDSM_LAYERS-1];	// View depths of the far planes of the cascades
+uniform int			nCascades;
+
+void main()
+{
+	vec4 data[SDSM_LAYERS];
+	for(int l=0;l<SDSM_LAYERS;++l)
+		data[l] = SDSM_EMPTY;
+
+	ivec2 src  = ivec2(gl_FragCoord.xy) * SDSM_TILE;
+	ivec2 size = textureSize(PositionTex,0);
+	for(int y=0;y<SDSM_TILE;++y)
+	for(int x=0;x<SDSM_TILE;++x)
+	{
+		ivec2 p = src + ivec2(x,y);
+		if(p.x>=size.x || p.y>=size.y)
+			continue;
+		vec4 position = texelFetch(PositionTex,p,0);
+		if(position.w==0)
+			continue;
+
+		float depth = -(View * vec4(position.xyz,1)).z;
+		data[0] = min(data[0],vec4(depth,-depth,0,0));
+
+		// Samples beyond the last split belong to the last cascade
+		int c = 0;
+		while(c<nCascades-1 && depth>SplitFars[c])
+			++c;
+		vec2 light = (LightView * vec4(position.xyz,1)).xy;
+		data[1+c] = min(data[1+c],vec4(light,-light));
+	}
+	Write(data);
+}
+#endif
+
+#ifdef SDSM_REDUCE
+uniform sampler2DArray ReduceTex;	// Previous level
+
+void main()
+{
+	vec4 data[SDSM_LAYERS];
+	for(int l=0;l<SDSM_LAYERS;++l)
+		data[l] = SDSM_EMPTY;
+
+	ivec2 src  = ivec2(gl_FragCoord.xy) * SDSM_TILE;
+	ivec2 size = textureSize(ReduceTex,0).xy;
+	for(int y=0;y<SDSM_TILE;++y)
+	for(int x=0;x<SDSM_TILE;++x)
+	{
+		ivec2 p = src + ivec2(x,y);
+		if(p.x>=size.x || p.y>=size.y)
+			continue;
+		for(int l=0;l<SDSM_LAYERS;++l)
+			data[l] = min(data[l],texelFetch(ReduceTex,ivec3(p,l),0));
+	}
+	Write(data);
+}
+#endif
@@ -14,16 +14,27 @@
 	uniform float			Radius;
 	uniform int				nSamples;
 	uniform vec2			Samples[32];
+	uniform int				BakedTerrain;
 
 	out vec4 				FragColor;
 
 	void main()
 	{
 		vec2 pix	= gl_FragCoord.xy / vec2(textureSize(PositionTex,0));
-		vec2 theta	= texture(RotationTex,pix).xy;
 		vec4 c		= texture(PositionTex,pix);
+
+		// Terrain ambient visibility baked into its horizon map, packed into
+		// the position w (see meshterrain.fs)
+		if(BakedTerrain>0 && c.w<0)
+		{
+			float A		= floor((-c.w-1.f)/256.f) / 255.f;
+			FragColor	= vec4(A,A,A,A);
+			return;
+		}
+
+		vec2 theta	= texture(RotationTex,pix).xy;
 		vec3 vn		= normalize( (View * vec4(texture(NormalTex,pix).xyz,0)).xyz );
-	 	vec3 vc		= (View * c).xyz;
+	 	vec3 vc		= (View * vec4(c.xyz,float(c.w!=0))).xyz;
 		float r 	= Radius * abs(Near/vc.z);
 		float A 	= 0;
 		mat2 rot 	= mat2(theta.x,theta.y,-theta.y,theta.x);
@@ -32,7 +43,7 @@
 		{
 			vec2 samp	= pix + (rot*Samples[i])*r;
 			vec4 p		= texture(PositionTex,samp);
-			vec3 v		= (View * p).xyz - vc;
+			vec3 v		= (View * vec4(p.xyz,float(p.w!=0))).xyz - vc;
 			A 			+= max(0.f,dot(v,vn) + v.z*Beta)  / (dot(v,v) + Epsilon);
 		}
 
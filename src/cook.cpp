@@ -0,0 +1,65 @@
+//------------------------------------------------------------------------------
+// Scene cooker : converts a scene file and the models it references into a
+// pack loaded by glf::io::LoadScene, or a height map and its diffuse map
+// into the tiled pyramid of a paged terrain
+//
+// pbc-cook [-v] scene.json [scene.pack]
+// pbc-cook [-v] -terrain height.png diffuse.png folder [pageSize]
+//------------------------------------------------------------------------------
+#include <glf/io/pack.hpp>
+#include <glf/io/pyramid.hpp>
+#include <glf/io/file.hpp>
+#include <glf/utils.hpp>
+#include <GLFW/glfw3.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+	bool verbose = false;
+	bool terrain = false;
+	std::vector<std::string> args;
+	for(int i=1;i<argc;++i)
+	{
+		if(strcmp(argv[i],"-v")==0)
+			verbose = true;
+		else if(strcmp(argv[i],"-terrain")==0)
+			terrain = true;
+		else
+			args.push_back(argv[i]);
+	}
+	if(terrain ? (args.size()<3 || args.size()>4) : (args.empty() || args.size()>2))
+	{
+		glf::Info("Usage : pbc-cook [-v] scene.json [scene.pack]");
+		glf::Info("        pbc-cook [-v] -terrain height.png diffuse.png folder [pageSize]");
+		return 1;
+	}
+
+	if(terrain)
+	{
+		int pageSize = args.size()>3 ? atoi(args[3].c_str()) : 256;
+		if(!glfwInit())
+			return 1;
+		bool cooked = glf::io::CookPyramid(args[0],args[1],args[2],pageSize,verbose);
+		glfwTerminate();
+		return cooked?0:1;
+	}
+
+	// Scenes are also looked up into the scene directory, so that
+	// "pbc-cook desert.json" works from the binary directory like PBC
+	std::string sceneFile = args[0];
+	long long modified, size;
+	if(!glf::io::FileStatus(sceneFile,modified,size))
+		sceneFile = glf::directory::SceneDirectory + sceneFile;
+	std::string packFile = args.size()>1 ? args[1] : glf::io::PackFilename(sceneFile);
+
+	if(!glfwInit())
+		return 1;
+	bool cooked = glf::io::CookScene(sceneFile,packFile,verbose);
+	glfwTerminate();
+
+	return cooked?0:1;
+}
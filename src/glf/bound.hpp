@@ -120,6 +120,61 @@ namespace glf
 
 		return bbox;
 	}
+	//-------------------------------------------------------------------------
+	// Clipping planes of a view projection matrix. Normals point inward and
+	// are normalized, so that dot(normal,p)+w is a signed distance
+	struct Frustum
+	{
+		glm::vec4 planes[6];
+	};
+	//-------------------------------------------------------------------------
+	inline Frustum ExtractFrustum(const glm::mat4& _viewProj)
+	{
+		glm::vec4 row0(_viewProj[0][0],_viewProj[1][0],_viewProj[2][0],_viewProj[3][0]);
+		glm::vec4 row1(_viewProj[0][1],_viewProj[1][1],_viewProj[2][1],_viewProj[3][1]);
+		glm::vec4 row2(_viewProj[0][2],_viewProj[1][2],_viewProj[2][2],_viewProj[3][2]);
+		glm::vec4 row3(_viewProj[0][3],_viewProj[1][3],_viewProj[2][3],_viewProj[3][3]);
+
+		Frustum frustum;
+		frustum.planes[0] = row3 + row0;	// Left
+		frustum.planes[1] = row3 - row0;	// Right
+		frustum.planes[2] = row3 + row1;	// Bottom
+		frustum.planes[3] = row3 - row1;	// Top
+		frustum.planes[4] = row3 + row2;	// Near
+		frustum.planes[5] = row3 - row2;	// Far
+		for(int i=0;i<6;++i)
+			frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+		return frustum;
+	}
+	//-------------------------------------------------------------------------
+	// Conservative tests : false only if the bound is outside of a plane
+	inline bool Intersect(	const Frustum& 		_frustum,
+							const BBox& 		_bound)
+	{
+		for(int i=0;i<6;++i)
+		{
+			const glm::vec4& plane = _frustum.planes[i];
+			glm::vec3 p(plane.x>0 ? _bound.pMax.x : _bound.pMin.x,
+						plane.y>0 ? _bound.pMax.y : _bound.pMin.y,
+						plane.z>0 ? _bound.pMax.z : _bound.pMin.z);
+			if(glm::dot(glm::vec3(plane),p) + plane.w < 0.f)
+				return false;
+		}
+		return true;
+	}
+	//-------------------------------------------------------------------------
+	inline bool Intersect(	const Frustum& 		_frustum,
+							const glm::vec3& 	_center,
+							float 				_radius)
+	{
+		for(int i=0;i<6;++i)
+		{
+			const glm::vec4& plane = _frustum.planes[i];
+			if(glm::dot(glm::vec3(plane),_center) + plane.w < -_radius)
+				return false;
+		}
+		return true;
+	}
 }
 
 #endif
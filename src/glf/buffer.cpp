@@ -2,9 +2,46 @@
 // Includes
 //------------------------------------------------------------------------------
 #include <glf/buffer.hpp>
+#include <GLFW/glfw3.h>
 
 namespace glf
 {
+	namespace
+	{
+		//----------------------------------------------------------------------
+		// glMultiDrawElementsIndirect is core since 4.3 and is not exposed by
+		// the bundled GLEW, it is loaded on first use. NULL if not supported
+		typedef void (GLAPIENTRY * MultiDrawElementsIndirectProc)(GLenum, GLenum, const GLvoid*, GLsizei, GLsizei);
+		MultiDrawElementsIndirectProc LoadMultiDrawElementsIndirect()
+		{
+			static bool loaded = false;
+			static MultiDrawElementsIndirectProc proc = NULL;
+			if(!loaded)
+			{
+				loaded = true;
+				if(glfwExtensionSupported("GL_ARB_multi_draw_indirect"))
+					proc = (MultiDrawElementsIndirectProc)glfwGetProcAddress("glMultiDrawElementsIndirect");
+				else if(GLEW_AMD_multi_draw_indirect)
+					proc = (MultiDrawElementsIndirectProc)glMultiDrawElementsIndirectAMD;
+			}
+			return proc;
+		}
+	}
+	//--------------------------------------------------------------------------
+	void MultiDrawElementsIndirect(	GLenum _primitiveType,
+									GLenum _indexType,
+									int _first,
+									int _count)
+	{
+		MultiDrawElementsIndirectProc multiDraw = LoadMultiDrawElementsIndirect();
+		if(multiDraw)
+			multiDraw(_primitiveType,_indexType,GLF_BUFFER_OFFSET(_first*sizeof(DrawElementsIndirectCommand)),_count,0);
+		else
+		{
+			for(int i=_first;i<_first+_count;++i)
+				glDrawElementsIndirect(_primitiveType,_indexType,GLF_BUFFER_OFFSET(i*sizeof(DrawElementsIndirectCommand)));
+		}
+	}
 	//--------------------------------------------------------------------------
 	namespace semantic
 	{
@@ -14,6 +51,11 @@ namespace glf
 		GLint Tangent 	= 3;
 		GLint Color	 	= 4;
 		GLint Bitangent	= 5;
+		GLint LayerMask	= 6;
+		GLint Model		= 7;
+		GLint Material	= 11;
+		GLint Tile		= 12;
+		GLint TerrainNode= 13;
 	};
 	//--------------------------------------------------------------------------
 	VertexArray::VertexArray()
@@ -55,6 +97,58 @@ namespace glf
 		glBindVertexArray(0);
 	}
 	//--------------------------------------------------------------------------
+	void VertexArray::DrawElements(	GLenum _primitiveType,
+									GLenum _indexType,
+									int _count,
+									int _first,
+									int _baseVertex) const
+	{
+		int indexSize = _indexType==GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+		glBindVertexArray(id);
+		if(_baseVertex==0)
+			glDrawElements(_primitiveType, _count, _indexType, GLF_BUFFER_OFFSET(_first*indexSize) );
+		else
+			glDrawElementsBaseVertex(_primitiveType, _count, _indexType, GLF_BUFFER_OFFSET(_first*indexSize), _baseVertex);
+		glBindVertexArray(0);
+	}
+	//--------------------------------------------------------------------------
+	void VertexArray::DrawElementsInstanced(	GLenum _primitiveType,
+												GLenum _indexType,
+												int _count,
+												int _first,
+												int _baseVertex,
+												int _primCount,
+												int _baseInstance) const
+	{
+		int indexSize = _indexType==GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+		glBindVertexArray(id);
+		if(_baseInstance!=0)
+			glDrawElementsInstancedBaseVertexBaseInstance(_primitiveType, _count, _indexType, GLF_BUFFER_OFFSET(_first*indexSize), _primCount, _baseVertex, _baseInstance);
+		else
+			glDrawElementsInstancedBaseVertex(_primitiveType, _count, _indexType, GLF_BUFFER_OFFSET(_first*indexSize), _primCount, _baseVertex);
+		glBindVertexArray(0);
+	}
+	//--------------------------------------------------------------------------
+	void VertexArray::AddInstancedMatrix(	const VertexBuffer<glm::mat4>::Buffer& _buffer,
+											GLint _location,
+											int _first)
+	{
+		AddInstancedVectors(_buffer,_location,4,0,_first);
+	}
+	//--------------------------------------------------------------------------
+	void VertexArray::MultiDrawElements(	GLenum _primitiveType,
+											GLenum _indexType,
+											const IndirectElementBuffer& _commands,
+											int _first,
+											int _count) const
+	{
+		glBindVertexArray(id);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER,_commands.id);
+			MultiDrawElementsIndirect(_primitiveType,_indexType,_first,_count);
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+		glBindVertexArray(0);
+	}
+	//--------------------------------------------------------------------------
 	void VertexArray::Draw(		GLenum _primitiveType, 
 								int _count,
 								int _first,
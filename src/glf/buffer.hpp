@@ -18,6 +18,11 @@ namespace glf
 		extern GLint Tangent;
 		extern GLint Color;
 		extern GLint Bitangent;
+		extern GLint LayerMask;
+		extern GLint Model;		// Matrix, uses 4 locations
+		extern GLint Material;
+		extern GLint Tile;		// Terrain tile coordinates
+		extern GLint TerrainNode;// Paged terrain node, uses 3 locations
 	};
 	//--------------------------------------------------------------------------
 	template<GLenum B, typename T>
@@ -39,6 +44,10 @@ namespace glf
 		inline void 	Unlock(		);
 		inline void 	Fill(		T* _data, 
 									int _count);
+		// Overwrites a range without reallocating the buffer
+		inline void 	Update(		const T* _data, 
+									int _count,
+									int _first);
 
 	private:
 		// Forbiddent methods
@@ -71,8 +80,16 @@ namespace glf
 		GLuint primCount;
 		GLuint firstIndex;
 		GLint  baseVertex;
-		GLuint reservedMustBeZero;
+		GLuint baseInstance;		// Must be zero before GL 4.2
 	};
+	//--------------------------------------------------------------------------
+	// Draws _count commands of the buffer bound to GL_DRAW_INDIRECT_BUFFER
+	// with the bound vertex array, starting at the _first one. Falls back
+	// to one indirect draw per command without multi draw indirect
+	void MultiDrawElementsIndirect(	GLenum _primitiveType,
+									GLenum _indexType,
+									int _first,
+									int _count);
 
 	//-------------------------------------------------------------------------
 	// GL Buffer definition
@@ -116,6 +133,7 @@ namespace glf
 	typedef IBuffer<GL_DRAW_INDIRECT_BUFFER,DrawArraysIndirectCommand>		IndirectArrayBuffer;
 	typedef IBuffer<GL_DRAW_INDIRECT_BUFFER,DrawElementsIndirectCommand>	IndirectElementBuffer;
 	typedef IBuffer<GL_ELEMENT_ARRAY_BUFFER,unsigned int>		IndexBuffer;
+	typedef IBuffer<GL_ELEMENT_ARRAY_BUFFER,unsigned short>		IndexBuffer16;
 	typedef IBuffer<GL_ATOMIC_COUNTER_BUFFER,unsigned int>		AtomicCounterBuffer;
 	//--------------------------------------------------------------------------
 	typedef VertexBuffer<float>::Buffer							VertexBuffer1F;
@@ -138,6 +156,36 @@ namespace glf
 						bool     			_normalize=false,
 						int	 				_offset=0);
 
+		// Integer per instance attribute : instances of a draw read the
+		// element _first + (base instance of the draw) + instance / _divisor
+		template<typename T>
+		void AddInstanced(const T& 			_buffer,
+						GLint    			_location, 
+						int      			_nComponents,
+						GLenum   			_componentType,
+						int					_divisor,
+						int					_first=0);
+
+		// Per instance matrix on 4 consecutive locations : instance i of a
+		// draw reads the matrix _first + (base instance of the draw) + i
+		void AddInstancedMatrix(const VertexBuffer<glm::mat4>::Buffer& _buffer,
+						GLint				_location,
+						int					_first);
+
+		// Per instance float vectors on _nVectors consecutive locations, at
+		// _offset bytes in the records of the buffer : instance i of a draw
+		// reads the record _first + (base instance of the draw) + i
+		template<typename T>
+		void AddInstancedVectors(const T&	_buffer,
+						GLint				_location,
+						int					_nVectors,
+						int					_offset,
+						int					_first);
+
+		// Attaches an index buffer to the vertex array, used by DrawElements
+		template<typename T>
+		void SetIndices(const T&			_buffer);
+
 		// Regular drawing functions
 		void Draw( 		GLenum				_primitiveType,
 						const IndexBuffer&	_buffer) const;
@@ -148,6 +196,26 @@ namespace glf
 		void Draw(		GLenum				_primitiveType, 
 						int					_count,
 						int					_first=0) const;
+		void DrawElements(GLenum			_primitiveType,
+						GLenum				_indexType,
+						int					_count,
+						int					_first,
+						int					_baseVertex=0) const;
+		void DrawElementsInstanced(GLenum	_primitiveType,
+						GLenum				_indexType,
+						int					_count,
+						int					_first,
+						int					_baseVertex,
+						int					_primCount,
+						int					_baseInstance=0) const;
+
+		// Multi drawing function : draws _count commands of the indirect
+		// buffer, starting at the _first one
+		void MultiDrawElements(GLenum		_primitiveType,
+						GLenum				_indexType,
+						const IndirectElementBuffer& _commands,
+						int					_first,
+						int					_count) const;
 
 		// Instanced drawing functions
 		void Draw(		GLenum 				_primitiveType,
@@ -94,6 +94,16 @@ namespace glf
 		glBufferData(B,_count*sizeof(T),(void*)_data,update);
 	}
 	//-------------------------------------------------------------------------
+	template<GLenum B, typename T>
+	void IBuffer<B,T>::Update(const T* _data, int _count, int _first)
+	{	
+		assert(!lock);
+
+		assert(_first+_count<=count);
+		glBindBuffer(B,id);
+		glBufferSubData(B,_first*sizeof(T),_count*sizeof(T),(const void*)_data);
+	}
+	//-------------------------------------------------------------------------
 	template<typename T>
 	void VertexArray::Add(		//typename const VertexBuffer<T>::Buffer& _buffer,
 								const T& 	_buffer,
@@ -118,5 +128,65 @@ namespace glf
 		assert(glf::CheckError("VertexArray::Add"));
 	}
 	//-------------------------------------------------------------------------
+	template<typename T>
+	void VertexArray::AddInstanced(	const T& 	_buffer,
+									GLint    	_location, 
+									int      	_nComponents,
+									GLenum   	_componentType,
+									int			_divisor,
+									int			_first)
+	{
+		glBindVertexArray(id);
+			glBindBuffer(GL_ARRAY_BUFFER, _buffer.id);
+				glVertexAttribIPointer(	_location, 
+										_nComponents, 
+										_componentType, 
+										sizeof(typename T::DataType), 
+										GLF_BUFFER_OFFSET(_first*sizeof(typename T::DataType)));
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glVertexAttribDivisor(_location, _divisor);
+			glEnableVertexAttribArray(_location);
+		glBindVertexArray(0);
+
+		assert(glf::CheckError("VertexArray::AddInstanced"));
+	}
+	//-------------------------------------------------------------------------
+	template<typename T>
+	void VertexArray::AddInstancedVectors(	const T& 	_buffer,
+											GLint		_location,
+											int			_nVectors,
+											int			_offset,
+											int			_first)
+	{
+		int stride = sizeof(typename T::DataType);
+		glBindVertexArray(id);
+			glBindBuffer(GL_ARRAY_BUFFER, _buffer.id);
+			for(int c=0;c<_nVectors;++c)
+			{
+				glVertexAttribPointer(	_location+c,
+										4,
+										GL_FLOAT,
+										false,
+										stride,
+										GLF_BUFFER_OFFSET(_first*stride + _offset + c*sizeof(glm::vec4)));
+				glVertexAttribDivisor(_location+c, 1);
+				glEnableVertexAttribArray(_location+c);
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+
+		assert(glf::CheckError("VertexArray::AddInstancedVectors"));
+	}
+	//-------------------------------------------------------------------------
+	template<typename T>
+	void VertexArray::SetIndices(const T& _buffer)
+	{
+		glBindVertexArray(id);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffer.id);
+		glBindVertexArray(0);
+
+		assert(glf::CheckError("VertexArray::SetIndices"));
+	}
+	//-------------------------------------------------------------------------
 }
 
@@ -0,0 +1,858 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/bvh.hpp>
+#include <glf/scene.hpp>
+#include <glf/culling.hpp>
+#include <glf/rng.hpp>
+#include <glf/utils.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define BVH_BINS					16
+#define BVH_LEAF_ITEMS				4		// Larger ranges are always split
+#define BVH_MAX_DEPTH				64		// Median splits below
+#define BVH_STACK_SIZE				128
+#define BVH_PARALLEL_ITEMS			16384	// Smaller subtrees are built by one thread
+
+namespace glf
+{
+	namespace
+	{
+		//----------------------------------------------------------------------
+		struct Bin
+		{
+			Bin():count(0) {}
+			BBox						bound;
+			int							count;
+		};
+		//----------------------------------------------------------------------
+		// Build records are partitioned in place instead of item indices, so
+		// that binning reads them in order
+		struct Primitive
+		{
+			BBox						bound;
+			glm::vec3					centroid;
+			int							item;
+		};
+		//----------------------------------------------------------------------
+		// Primitives [begin,end) under a node, with their bound and the bound of
+		// their centroids
+		struct Range
+		{
+			int							node;
+			int							begin;
+			int							end;
+			int							depth;
+			BBox						bound;
+			BBox						centroids;
+		};
+		//----------------------------------------------------------------------
+		inline float HalfArea(const BBox& _bound)
+		{
+			glm::vec3 e = _bound.pMax - _bound.pMin;
+			return e.x*e.y + e.y*e.z + e.z*e.x;
+		}
+		//----------------------------------------------------------------------
+		inline bool Overlap(const BBox& _a, const BBox& _b)
+		{
+			return	_a.pMin.x<=_b.pMax.x && _a.pMax.x>=_b.pMin.x &&
+					_a.pMin.y<=_b.pMax.y && _a.pMax.y>=_b.pMin.y &&
+					_a.pMin.z<=_b.pMax.z && _a.pMax.z>=_b.pMin.z;
+		}
+		//----------------------------------------------------------------------
+		// Slab test with a precomputed inverse direction, clipped to [0,_tMax]
+		inline bool IntersectRay(const BBox& _bound,
+								const glm::vec3& _origin,
+								const glm::vec3& _invDir,
+								float _tMax,
+								float& _t)
+		{
+			float t0 = 0.f;
+			float t1 = _tMax;
+			for(int i=0;i<3;++i)
+			{
+				float tNear = (_bound.pMin[i] - _origin[i]) * _invDir[i];
+				float tFar  = (_bound.pMax[i] - _origin[i]) * _invDir[i];
+				if(tNear > tFar) std::swap(tNear,tFar);
+				t0 = tNear > t0 ? tNear : t0;
+				t1 = tFar  < t1 ? tFar  : t1;
+				if(t0 > t1) return false;
+			}
+			_t = t0;
+			return true;
+		}
+		//----------------------------------------------------------------------
+		// Tests the bound against the planes of _mask. Returns false if it is
+		// outside of one of them, and removes from _mask the planes it is
+		// entirely inside of
+		inline bool IntersectPlanes(const Frustum& _frustum,
+								const BBox& _bound,
+								unsigned int& _mask)
+		{
+			for(int i=0;i<6;++i)
+			{
+				if((_mask & (1u<<i))==0)
+					continue;
+				const glm::vec4& plane = _frustum.planes[i];
+				glm::vec3 p(plane.x>0 ? _bound.pMax.x : _bound.pMin.x,
+							plane.y>0 ? _bound.pMax.y : _bound.pMin.y,
+							plane.z>0 ? _bound.pMax.z : _bound.pMin.z);
+				if(glm::dot(glm::vec3(plane),p) + plane.w < 0.f)
+					return false;
+				glm::vec3 n(plane.x>0 ? _bound.pMin.x : _bound.pMax.x,
+							plane.y>0 ? _bound.pMin.y : _bound.pMax.y,
+							plane.z>0 ? _bound.pMin.z : _bound.pMax.z);
+				if(glm::dot(glm::vec3(plane),n) + plane.w >= 0.f)
+					_mask &= ~(1u<<i);
+			}
+			return true;
+		}
+		//----------------------------------------------------------------------
+		class Builder
+		{
+		public:
+			Builder(std::vector<Primitive>& _primitives):
+			primitives(_primitives)
+			{
+
+			}
+			//------------------------------------------------------------------
+			// Returns false if the range has to be a leaf
+			bool Split(const Range& _range, Range& _left, Range& _right, bool _parallel)
+			{
+				int count = _range.end - _range.begin;
+				if(count<=1)
+					return false;
+
+				glm::vec3 extent = _range.centroids.pMax - _range.centroids.pMin;
+				if(_range.depth<BVH_MAX_DEPTH && (extent.x>0.f || extent.y>0.f || extent.z>0.f))
+				{
+					glm::vec3 scale;
+					for(int a=0;a<3;++a)
+						scale[a] = extent[a]>0.f ? BVH_BINS*(1.f-1e-4f)/extent[a] : 0.f;
+
+					Bin bins[3][BVH_BINS];
+					BinItems(_range,scale,bins,_parallel);
+
+					// Sweeps the planes between bins, the cost of a split is
+					// the surface area heuristic without its constant terms
+					float bestCost  = FLT_MAX;
+					int   bestAxis  = -1;
+					int   bestPlane = -1;
+					for(int a=0;a<3;++a)
+					{
+						if(extent[a]<=0.f)
+							continue;
+
+						float rightAreas[BVH_BINS];
+						int   rightCounts[BVH_BINS];
+						BBox  acc;
+						int   n = 0;
+						for(int b=BVH_BINS-1;b>0;--b)
+						{
+							if(bins[a][b].count>0)
+								acc.Add(bins[a][b].bound);
+							n             += bins[a][b].count;
+							rightCounts[b] = n;
+							rightAreas[b]  = n>0 ? HalfArea(acc) : 0.f;
+						}
+
+						acc = BBox();
+						n   = 0;
+						for(int b=0;b<BVH_BINS-1;++b)
+						{
+							if(bins[a][b].count>0)
+								acc.Add(bins[a][b].bound);
+							n += bins[a][b].count;
+							if(n==0 || rightCounts[b+1]==0)
+								continue;
+							float cost = n*HalfArea(acc) + rightCounts[b+1]*rightAreas[b+1];
+							if(cost<bestCost)
+							{
+								bestCost  = cost;
+								bestAxis  = a;
+								bestPlane = b+1;
+							}
+						}
+					}
+
+					if(bestAxis>=0)
+					{
+						// Unit traversal and intersection costs
+						float area = HalfArea(_range.bound);
+						if(count<=BVH_LEAF_ITEMS && count*area<=area+bestCost)
+							return false;
+
+						Primitive* first = &primitives[0];
+						Primitive* mid   = std::partition(first+_range.begin,first+_range.end,
+														  SplitPredicate(bestAxis,_range.centroids.pMin[bestAxis],scale[bestAxis],bestPlane));
+
+						_left  = Child(_range,_range.begin,int(mid-first));
+						_right = Child(_range,int(mid-first),_range.end);
+						Fill(_left);
+						Fill(_right);
+						return true;
+					}
+				}
+
+				// All centroids are at the same place, or the tree is too
+				// deep : median split along the largest extent
+				if(count<=BVH_LEAF_ITEMS)
+					return false;
+				int axis = extent.x>=extent.y && extent.x>=extent.z ? 0 : (extent.y>=extent.z ? 1 : 2);
+				int mid  = _range.begin + count/2;
+				std::nth_element(&primitives[0]+_range.begin,&primitives[0]+mid,&primitives[0]+_range.end,
+								 MedianPredicate(axis));
+				_left  = Child(_range,_range.begin,mid);
+				_right = Child(_range,mid,_range.end);
+				Fill(_left);
+				Fill(_right);
+				return true;
+			}
+			//------------------------------------------------------------------
+			// Builds the subtree of a range into _nodes, _nodes[0] being
+			// its root. Child indices are relative to _nodes
+			void BuildSubtree(const Range& _root, std::vector<SceneBVH::Node>& _nodes)
+			{
+				std::vector<Range> stack(1,_root);
+				stack[0].node = 0;
+				_nodes.push_back(SceneBVH::Node());
+				while(!stack.empty())
+				{
+					Range range = stack.back();
+					stack.pop_back();
+
+					Range left, right;
+					if(Split(range,left,right,false))
+					{
+						left.node  = int(_nodes.size());
+						right.node = left.node+1;
+						_nodes.resize(_nodes.size()+2);
+						SetNode(_nodes[range.node],range,left.node);
+						stack.push_back(left);
+						stack.push_back(right);
+					}
+					else
+						SetNode(_nodes[range.node],range,-1);
+				}
+			}
+			//------------------------------------------------------------------
+			static void SetNode(SceneBVH::Node& _node, const Range& _range, int _child)
+			{
+				_node.bound = _range.bound;
+				_node.child = _child;
+				_node.first = _range.begin;
+				_node.count = _range.end - _range.begin;
+			}
+			//------------------------------------------------------------------
+			void Fill(Range& _range) const
+			{
+				_range.bound     = BBox();
+				_range.centroids = BBox();
+				for(int i=_range.begin;i<_range.end;++i)
+				{
+					_range.bound.Add(primitives[i].bound);
+					_range.centroids.Add(primitives[i].centroid);
+				}
+			}
+
+		private:
+			//------------------------------------------------------------------
+			struct SplitPredicate
+			{
+				SplitPredicate(int _axis, float _min, float _scale, int _plane):
+				axis(_axis),min(_min),scale(_scale),plane(_plane) {}
+				bool operator()(const Primitive& _p) const
+				{
+					return BinIndex(_p.centroid[axis],min,scale) < plane;
+				}
+				int axis; float min; float scale; int plane;
+			};
+			//------------------------------------------------------------------
+			struct MedianPredicate
+			{
+				MedianPredicate(int _axis):axis(_axis) {}
+				bool operator()(const Primitive& _a, const Primitive& _b) const
+				{
+					return _a.centroid[axis] < _b.centroid[axis];
+				}
+				int axis;
+			};
+			//------------------------------------------------------------------
+			static inline int BinIndex(float _c, float _min, float _scale)
+			{
+				return std::min(int((_c-_min)*_scale),BVH_BINS-1);
+			}
+			//------------------------------------------------------------------
+			static Range Child(const Range& _parent, int _begin, int _end)
+			{
+				Range range;
+				range.node  = -1;
+				range.begin = _begin;
+				range.end   = _end;
+				range.depth = _parent.depth+1;
+				return range;
+			}
+			//------------------------------------------------------------------
+			void BinChunk(	const Range& _range,
+							const glm::vec3& _scale,
+							int _begin,
+							int _end,
+							Bin _bins[3][BVH_BINS]) const
+			{
+				for(int i=_begin;i<_end;++i)
+				{
+					const Primitive& p = primitives[i];
+					for(int a=0;a<3;++a)
+					{
+						Bin& bin = _bins[a][BinIndex(p.centroid[a],_range.centroids.pMin[a],_scale[a])];
+						bin.bound.Add(p.bound);
+						++bin.count;
+					}
+				}
+			}
+			//------------------------------------------------------------------
+			void BinItems(	const Range& _range,
+							const glm::vec3& _scale,
+							Bin _bins[3][BVH_BINS],
+							bool _parallel) const
+			{
+				#ifdef _OPENMP
+				int count   = _range.end - _range.begin;
+				int nChunks = omp_get_max_threads();
+				if(_parallel && nChunks>1 && count>=BVH_PARALLEL_ITEMS)
+				{
+					// One set of bins per chunk, merged afterward
+					typedef Bin ChunkBins[3][BVH_BINS];
+					std::vector<Bin> chunkBins(nChunks*3*BVH_BINS);
+					#pragma omp parallel for schedule(static,1)
+					for(int k=0;k<nChunks;++k)
+					{
+						int begin = _range.begin + int((long long)(count)*k/nChunks);
+						int end   = _range.begin + int((long long)(count)*(k+1)/nChunks);
+						BinChunk(_range,_scale,begin,end,*reinterpret_cast<ChunkBins*>(&chunkBins[k*3*BVH_BINS]));
+					}
+					for(int k=0;k<nChunks;++k)
+					for(int a=0;a<3;++a)
+					for(int b=0;b<BVH_BINS;++b)
+					{
+						const Bin& bin = chunkBins[(k*3+a)*BVH_BINS+b];
+						if(bin.count==0)
+							continue;
+						_bins[a][b].bound.Add(bin.bound);
+						_bins[a][b].count += bin.count;
+					}
+					return;
+				}
+				#endif
+				BinChunk(_range,_scale,_range.begin,_range.end,_bins);
+			}
+
+		private:
+			std::vector<Primitive>&			primitives;
+		};
+		//----------------------------------------------------------------------
+		// Largest first, so that big subtrees do not end the parallel loop
+		struct LargerRange
+		{
+			bool operator()(const Range& _a, const Range& _b) const
+			{
+				return _a.end-_a.begin > _b.end-_b.begin;
+			}
+		};
+		//----------------------------------------------------------------------
+		void ItemBounds(const SceneManager& _scene, std::vector<BBox>& _bounds)
+		{
+			int nObjects = int(_scene.oBounds.size());
+			_bounds.resize(nObjects + _scene.tBounds.size());
+			for(int i=0;i<nObjects;++i)
+				_bounds[i] = Transform(_scene.oBounds[i],_scene.transformations[i]);
+			std::copy(_scene.tBounds.begin(),_scene.tBounds.end(),_bounds.begin()+nObjects);
+		}
+	}
+	//--------------------------------------------------------------------------
+	SceneBVH::SceneBVH()
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	int SceneBVH::Count() const
+	{
+		return int(bounds.size());
+	}
+	//--------------------------------------------------------------------------
+	int SceneBVH::NodeCount() const
+	{
+		return int(nodes.size());
+	}
+	//--------------------------------------------------------------------------
+	void SceneBVH::Build(				const SceneManager& _scene)
+	{
+		std::vector<BBox> sceneBounds;
+		ItemBounds(_scene,sceneBounds);
+		Build(sceneBounds);
+	}
+	//--------------------------------------------------------------------------
+	void SceneBVH::Build(				const std::vector<BBox>& _bounds)
+	{
+		nodes.clear();
+		int count = int(_bounds.size());
+		bounds.resize(count);
+		items.resize(count);
+		if(count==0)
+			return;
+
+		std::vector<Primitive> primitives(count);
+		Range root;
+		root.node  = 0;
+		root.begin = 0;
+		root.end   = count;
+		root.depth = 0;
+		for(int i=0;i<count;++i)
+		{
+			primitives[i].bound    = _bounds[i];
+			primitives[i].centroid = 0.5f*(_bounds[i].pMin + _bounds[i].pMax);
+			primitives[i].item     = i;
+			root.bound.Add(_bounds[i]);
+			root.centroids.Add(primitives[i].centroid);
+		}
+
+		// Top of the tree : ranges are split one after the other, with
+		// parallel binning, until they are small enough to be subtrees
+		int nThreads = 1;
+		#ifdef _OPENMP
+		nThreads = omp_get_max_threads();
+		#endif
+		Builder builder(primitives);
+		std::vector<Range> ranges(1,root);
+		std::vector<Range> subtrees;
+		nodes.push_back(Node());
+		while(!ranges.empty())
+		{
+			Range range = ranges.back();
+			ranges.pop_back();
+			if(nThreads==1 || range.end-range.begin<BVH_PARALLEL_ITEMS)
+			{
+				subtrees.push_back(range);
+				continue;
+			}
+
+			Range left, right;
+			if(builder.Split(range,left,right,true))
+			{
+				left.node  = int(nodes.size());
+				right.node = left.node+1;
+				nodes.resize(nodes.size()+2);
+				Builder::SetNode(nodes[range.node],range,left.node);
+				ranges.push_back(left);
+				ranges.push_back(right);
+			}
+			else
+				Builder::SetNode(nodes[range.node],range,-1);
+		}
+
+		// Subtrees work on disjoint item ranges
+		std::sort(subtrees.begin(),subtrees.end(),LargerRange());
+		int nSubtrees = int(subtrees.size());
+		std::vector< std::vector<Node> > subtreeNodes(nSubtrees);
+		#pragma omp parallel for schedule(dynamic,1) if(nSubtrees>1)
+		for(int s=0;s<nSubtrees;++s)
+			builder.BuildSubtree(subtrees[s],subtreeNodes[s]);
+
+		// Appends the subtrees, their roots replace the nodes of the ranges
+		for(int s=0;s<nSubtrees;++s)
+		{
+			const std::vector<Node>& local = subtreeNodes[s];
+			int offset = int(nodes.size()) - 1;
+			for(unsigned int i=0;i<local.size();++i)
+			{
+				Node node = local[i];
+				if(node.child>=0)
+					node.child += offset;
+				if(i==0)
+					nodes[subtrees[s].node] = node;
+				else
+					nodes.push_back(node);
+			}
+		}
+
+		for(int i=0;i<count;++i)
+		{
+			items[i]  = primitives[i].item;
+			bounds[i] = primitives[i].bound;
+		}
+	}
+	//--------------------------------------------------------------------------
+	void SceneBVH::Refit(				const SceneManager& _scene)
+	{
+		std::vector<BBox> sceneBounds;
+		ItemBounds(_scene,sceneBounds);
+		Refit(sceneBounds);
+	}
+	//--------------------------------------------------------------------------
+	void SceneBVH::Refit(				const std::vector<BBox>& _bounds)
+	{
+		assert(_bounds.size()==bounds.size());
+		int count = int(bounds.size());
+		#pragma omp parallel for if(count>=BVH_PARALLEL_ITEMS)
+		for(int i=0;i<count;++i)
+			bounds[i] = _bounds[items[i]];
+
+		// Leaves are independent, inner nodes are updated after their
+		// children
+		int nNodes = int(nodes.size());
+		#pragma omp parallel for if(nNodes>=BVH_PARALLEL_ITEMS)
+		for(int i=0;i<nNodes;++i)
+		{
+			Node& node = nodes[i];
+			if(node.child>=0)
+				continue;
+			node.bound = BBox();
+			for(int j=node.first;j<node.first+node.count;++j)
+				node.bound.Add(bounds[j]);
+		}
+		for(int i=nNodes-1;i>=0;--i)
+		{
+			Node& node = nodes[i];
+			if(node.child>=0)
+				node.bound = Add(nodes[node.child].bound,nodes[node.child+1].bound);
+		}
+	}
+	//--------------------------------------------------------------------------
+	int SceneBVH::Cull(					const Frustum& _frustum,
+										std::vector<int>& _items) const
+	{
+		if(nodes.empty())
+			return 0;
+
+		// Planes a node is entirely inside of are not tested for its
+		// descendants, whose items are all visible once none remains
+		int stackNodes[BVH_STACK_SIZE];
+		unsigned int stackMasks[BVH_STACK_SIZE];
+		int top    = 0;
+		int nItems = 0;
+		stackNodes[top]   = 0;
+		stackMasks[top++] = 0x3F;
+		while(top>0)
+		{
+			--top;
+			const Node& node  = nodes[stackNodes[top]];
+			unsigned int mask = stackMasks[top];
+			if(!IntersectPlanes(_frustum,node.bound,mask))
+				continue;
+
+			if(mask==0)
+			{
+				_items.insert(_items.end(),items.begin()+node.first,items.begin()+node.first+node.count);
+				nItems += node.count;
+			}
+			else if(node.child<0)
+			{
+				for(int i=node.first;i<node.first+node.count;++i)
+				{
+					unsigned int itemMask = mask;
+					if(IntersectPlanes(_frustum,bounds[i],itemMask))
+					{
+						_items.push_back(items[i]);
+						++nItems;
+					}
+				}
+			}
+			else
+			{
+				assert(top+2<=BVH_STACK_SIZE);
+				stackNodes[top]   = node.child;
+				stackMasks[top++] = mask;
+				stackNodes[top]   = node.child+1;
+				stackMasks[top++] = mask;
+			}
+		}
+		return nItems;
+	}
+	//--------------------------------------------------------------------------
+	int SceneBVH::Overlap(				const BBox& _bound,
+										std::vector<int>& _items) const
+	{
+		if(nodes.empty())
+			return 0;
+
+		int stack[BVH_STACK_SIZE];
+		int top    = 0;
+		int nItems = 0;
+		stack[top++] = 0;
+		while(top>0)
+		{
+			const Node& node = nodes[stack[--top]];
+			if(!glf::Overlap(node.bound,_bound))
+				continue;
+
+			if(node.child<0)
+			{
+				for(int i=node.first;i<node.first+node.count;++i)
+				{
+					if(glf::Overlap(bounds[i],_bound))
+					{
+						_items.push_back(items[i]);
+						++nItems;
+					}
+				}
+			}
+			else
+			{
+				assert(top+2<=BVH_STACK_SIZE);
+				stack[top++] = node.child;
+				stack[top++] = node.child+1;
+			}
+		}
+		return nItems;
+	}
+	//--------------------------------------------------------------------------
+	int SceneBVH::Raycast(				const glm::vec3& _origin,
+										const glm::vec3& _direction,
+										float& _t) const
+	{
+		if(nodes.empty())
+			return -1;
+
+		// Nearest child first, nodes farther than the closest hit are skipped
+		glm::vec3 invDir = 1.f / _direction;
+		int   stackNodes[BVH_STACK_SIZE];
+		float stackDists[BVH_STACK_SIZE];
+		int   top  = 0;
+		int   hit  = -1;
+		float tHit = _t;
+		float t;
+		if(!IntersectRay(nodes[0].bound,_origin,invDir,tHit,t))
+			return -1;
+		stackNodes[top]   = 0;
+		stackDists[top++] = t;
+		while(top>0)
+		{
+			--top;
+			if(stackDists[top]>tHit)
+				continue;
+			const Node& node = nodes[stackNodes[top]];
+
+			if(node.child<0)
+			{
+				for(int i=node.first;i<node.first+node.count;++i)
+				{
+					if(IntersectRay(bounds[i],_origin,invDir,tHit,t) && (hit<0 || t<tHit))
+					{
+						hit  = items[i];
+						tHit = t;
+					}
+				}
+				continue;
+			}
+
+			float t0, t1;
+			bool hit0 = IntersectRay(nodes[node.child  ].bound,_origin,invDir,tHit,t0);
+			bool hit1 = IntersectRay(nodes[node.child+1].bound,_origin,invDir,tHit,t1);
+			assert(top+2<=BVH_STACK_SIZE);
+			if(hit0 && hit1)
+			{
+				int nearChild = t0<=t1 ? node.child : node.child+1;
+				stackNodes[top]   = nearChild==node.child ? node.child+1 : node.child;
+				stackDists[top++] = std::max(t0,t1);
+				stackNodes[top]   = nearChild;
+				stackDists[top++] = std::min(t0,t1);
+			}
+			else if(hit0 || hit1)
+			{
+				stackNodes[top]   = hit0 ? node.child : node.child+1;
+				stackDists[top++] = hit0 ? t0 : t1;
+			}
+		}
+
+		if(hit>=0)
+			_t = tHit;
+		return hit;
+	}
+	//--------------------------------------------------------------------------
+	namespace
+	{
+		//----------------------------------------------------------------------
+		// Boxes on a ground of constant density, with a few large ones
+		void SyntheticScene(int _nObjects, float _side, std::vector<BBox>& _bounds)
+		{
+			RNG rng(7);
+			_bounds.resize(_nObjects);
+			for(int i=0;i<_nObjects;++i)
+			{
+				glm::vec3 center(	_side*rng.RandomFloat(),
+									_side*rng.RandomFloat(),
+									4.f*rng.RandomFloat());
+				float size = rng.RandomFloat()<0.01f ? 40.f : 0.5f + 4.5f*rng.RandomFloat();
+				glm::vec3 half(size*(0.5f+rng.RandomFloat()),size*(0.5f+rng.RandomFloat()),size);
+				_bounds[i].pMin = center - 0.5f*half;
+				_bounds[i].pMax = center + 0.5f*half;
+			}
+		}
+		//----------------------------------------------------------------------
+		template<typename T>
+		bool SameItems(std::vector<T> _a, std::vector<T> _b)
+		{
+			std::sort(_a.begin(),_a.end());
+			std::sort(_b.begin(),_b.end());
+			return _a==_b;
+		}
+	}
+	//--------------------------------------------------------------------------
+	bool BenchmarkSceneBVH(				int _nObjects)
+	{
+		// Constant density of about one object per 100 m2
+		float side = 10.f*sqrtf(float(_nObjects));
+		std::vector<BBox> sceneBounds;
+		SyntheticScene(_nObjects,side,sceneBounds);
+
+		SceneBVH bvh;
+		double start = glfwGetTime();
+		bvh.Build(sceneBounds);
+		double buildTime = glfwGetTime() - start;
+
+		// Every object moves a little
+		RNG rng(13);
+		std::vector<BBox> movedBounds(sceneBounds);
+		for(int i=0;i<_nObjects;++i)
+		{
+			glm::vec3 offset(rng.RandomFloat()-0.5f,rng.RandomFloat()-0.5f,0.f);
+			movedBounds[i].pMin += offset;
+			movedBounds[i].pMax += offset;
+		}
+		start = glfwGetTime();
+		bvh.Refit(movedBounds);
+		double refitTime = glfwGetTime() - start;
+
+		// Frustum queries from cameras on the ground, timed against the SSE
+		// scan of the G-buffer culling and checked against Intersect
+		BoundsSoA soa;
+		soa.Set(movedBounds);
+		int nViews = 64;
+		std::vector<Frustum> frustums(nViews);
+		glm::mat4 proj = glm::perspective(60.f,16.f/9.f,0.1f,500.f);
+		for(int k=0;k<nViews;++k)
+		{
+			glm::vec3 eye(side*rng.RandomFloat(),side*rng.RandomFloat(),2.f);
+			float angle = 2.f*float(M_PI)*rng.RandomFloat();
+			frustums[k] = ExtractFrustum(proj * glm::lookAt(eye,eye+glm::vec3(cosf(angle),sinf(angle),-0.1f),glm::vec3(0,0,1)));
+		}
+
+		bool identical = true;
+		std::vector<int> bvhItems, scanItems;
+		long long nCulled = 0;
+		double bvhCullTime = 0, scanCullTime = 0;
+		for(int k=0;k<nViews;++k)
+		{
+			bvhItems.clear();
+			scanItems.clear();
+			start = glfwGetTime();
+			nCulled += bvh.Cull(frustums[k],bvhItems);
+			bvhCullTime += glfwGetTime() - start;
+			start = glfwGetTime();
+			soa.Cull(frustums[k],scanItems);
+			scanCullTime += glfwGetTime() - start;
+			scanItems.clear();
+			for(int i=0;i<_nObjects;++i)
+				if(Intersect(frustums[k],movedBounds[i]))
+					scanItems.push_back(i);
+			identical &= SameItems(bvhItems,scanItems);
+		}
+
+		// Rays toward the ground from above, the linear scan only runs on
+		// a subset for the largest scenes
+		int nRays     = 100000;
+		int nScanRays = std::max(1,std::min(nRays,int(1e8/std::max(_nObjects,1))));
+		std::vector<glm::vec3> origins(nRays), directions(nRays);
+		for(int r=0;r<nRays;++r)
+		{
+			origins[r]    = glm::vec3(side*rng.RandomFloat(),side*rng.RandomFloat(),50.f);
+			directions[r] = glm::normalize(glm::vec3(rng.RandomFloat()-0.5f,rng.RandomFloat()-0.5f,-1.f));
+		}
+		int nHits = 0;
+		std::vector<float> bvhDists(nScanRays), scanDists(nScanRays);
+		start = glfwGetTime();
+		for(int r=0;r<nRays;++r)
+		{
+			float t = FLT_MAX;
+			if(bvh.Raycast(origins[r],directions[r],t)>=0)
+				++nHits;
+			if(r<nScanRays)
+				bvhDists[r] = t;
+		}
+		double bvhRayTime = glfwGetTime() - start;
+		start = glfwGetTime();
+		for(int r=0;r<nScanRays;++r)
+		{
+			glm::vec3 invDir = 1.f / directions[r];
+			float tHit = FLT_MAX, t;
+			for(int i=0;i<_nObjects;++i)
+				if(IntersectRay(movedBounds[i],origins[r],invDir,tHit,t) && t<tHit)
+					tHit = t;
+			scanDists[r] = tHit;
+		}
+		double scanRayTime = glfwGetTime() - start;
+		identical &= bvhDists==scanDists;
+
+		// Box queries of about 20 m
+		int nBoxes     = 10000;
+		int nScanBoxes = std::max(1,std::min(nBoxes,int(1e8/std::max(_nObjects,1))));
+		long long nOverlaps = 0;
+		std::vector<BBox> queries(nBoxes);
+		for(int b=0;b<nBoxes;++b)
+		{
+			glm::vec3 p(side*rng.RandomFloat(),side*rng.RandomFloat(),0.f);
+			queries[b].pMin = p;
+			queries[b].pMax = p + glm::vec3(20.f,20.f,10.f);
+		}
+		std::vector< std::vector<int> > bvhOverlaps(nScanBoxes);
+		start = glfwGetTime();
+		for(int b=0;b<nBoxes;++b)
+		{
+			bvhItems.clear();
+			nOverlaps += bvh.Overlap(queries[b],bvhItems);
+			if(b<nScanBoxes)
+				bvhOverlaps[b] = bvhItems;
+		}
+		double bvhBoxTime = glfwGetTime() - start;
+		double scanBoxTime = 0;
+		for(int b=0;b<nScanBoxes;++b)
+		{
+			scanItems.clear();
+			start = glfwGetTime();
+			for(int i=0;i<_nObjects;++i)
+				if(Overlap(movedBounds[i],queries[b]))
+					scanItems.push_back(i);
+			scanBoxTime += glfwGetTime() - start;
+			identical &= SameItems(bvhOverlaps[b],scanItems);
+		}
+
+		int nThreads = 1;
+		#ifdef _OPENMP
+		nThreads = omp_get_max_threads();
+		#endif
+		glf::Info("Scene BVH       : %d objects, %d nodes, %d threads",_nObjects,bvh.NodeCount(),nThreads);
+		glf::Info("Build           : %8.2f ms (%6.2f Mobjects/s)",buildTime*1000.0,_nObjects*1e-6/buildTime);
+		glf::Info("Refit           : %8.2f ms",refitTime*1000.0);
+		glf::Info("Frustum queries : %8.3f ms BVH, %8.3f ms scan (%.1f visible)",
+											bvhCullTime*1000.0/nViews,scanCullTime*1000.0/nViews,double(nCulled)/nViews);
+		glf::Info("Ray queries     : %8.2f Mrays/s BVH, %8.4f Mrays/s scan (%d%% hits)",
+											nRays*1e-6/bvhRayTime,nScanRays*1e-6/scanRayTime,int(100.0*nHits/nRays));
+		glf::Info("Box queries     : %8.2f Kqueries/s BVH, %8.4f Kqueries/s scan (%.1f overlaps)",
+											nBoxes*1e-3/bvhBoxTime,nScanBoxes*1e-3/scanBoxTime,double(nOverlaps)/nBoxes);
+		glf::Info("Identical output: %s",identical?"yes":"no");
+
+		return identical;
+	}
+}
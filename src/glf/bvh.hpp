@@ -0,0 +1,70 @@
+#ifndef GLF_BVH_HPP
+#define GLF_BVH_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/bound.hpp>
+#include <vector>
+
+namespace glf
+{
+	class SceneManager;
+
+	//--------------------------------------------------------------------------
+	// Bounding volume hierarchy over the bounds of the scene items. It is
+	// built top-down with a binned surface area heuristic : the top of the
+	// tree is split with parallel binning, then subtrees are built in
+	// parallel (OpenMP). Items of a scene are its objects (oBounds
+	// transformed by their transformation) followed by its terrains
+	// (tBounds) : item i >= oBounds.size() is terrain i-oBounds.size().
+	// Refit updates the bounds without changing the topology, rebuild when
+	// the items moved far from their layout at build time
+	class SceneBVH
+	{
+	public:
+										SceneBVH();
+		void							Build(			const std::vector<BBox>& _bounds);
+		void							Build(			const SceneManager& _scene);
+		// Same number of items as the last build
+		void							Refit(			const std::vector<BBox>& _bounds);
+		void							Refit(			const SceneManager& _scene);
+		int								Count() const;
+		int								NodeCount() const;
+
+		// Append the items intersecting the frustum (same conservative test
+		// as Intersect(Frustum,BBox)) or overlapping the box, in no
+		// particular order, and return their number
+		int								Cull(			const Frustum& _frustum,
+														std::vector<int>& _items) const;
+		int								Overlap(		const BBox& _bound,
+														std::vector<int>& _items) const;
+
+		// Returns the item of the nearest bound hit by the ray within _t
+		// (-1 if none) and updates _t to its entry distance (0 when the
+		// origin is inside). Used for picking
+		int								Raycast(		const glm::vec3& _origin,
+														const glm::vec3& _direction,
+														float& _t) const;
+
+		struct Node
+		{
+			BBox						bound;
+			int							child;		// Left child, right one follows. -1 for leaves
+			int							first;		// Items of the subtree
+			int							count;
+		};
+	private:
+		std::vector<Node>				nodes;		// Children are stored after their parent
+		std::vector<int>				items;
+		std::vector<BBox>				bounds;		// Of the items, in leaf order
+	};
+
+	//--------------------------------------------------------------------------
+	// Build, refit and query throughput of the hierarchy on a synthetic
+	// scene of _nObjects boxes, against linear scans. Returns false if the
+	// queries do not find the same items
+	bool BenchmarkSceneBVH(				int _nObjects);
+}
+
+#endif
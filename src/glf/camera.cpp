@@ -231,6 +231,13 @@ namespace glf
 		speed = _speed;
 	}
 	//-------------------------------------------------------------------------
+	void FlyingCamera::Place(const glm::vec3& _eye, const glm::vec3& _direction, const glm::vec3& _up)
+	{
+		center		= _eye;
+		direction	= glm::normalize(_direction);
+		up			= glm::normalize(_up);
+	}
+	//-------------------------------------------------------------------------
 	glm::vec3 FlyingCamera::Eye() const
 	{
 		return center;
@@ -73,6 +73,10 @@ namespace glf
 			virtual glm::vec3   Center(		) const;
 			virtual glm::vec3   Up(			) const;
 			void 				Speed(		float _speed);
+			// Moves the camera to a given pose, e.g. a recorded camera path key
+			void				Place(		const glm::vec3& _eye,
+											const glm::vec3& _direction,
+											const glm::vec3& _up);
 			virtual void		MouseEvent(	int _x, int _y, Mouse::Button _b, Mouse::State _s);
 			virtual void		MoveEvent(	float _x, float _y);
 			virtual void		KeyboardEvent(Keyboard::Key _k) override;
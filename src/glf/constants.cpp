@@ -0,0 +1,116 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/constants.hpp>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	FrameConstants::FrameConstants():
+	frame(0)
+	{
+		buffer.Allocate(1,GL_STREAM_DRAW);
+	}
+	//--------------------------------------------------------------------------
+	void FrameConstants::Update(	const glm::mat4& _projection,
+									const glm::mat4& _view,
+									const glm::vec3& _viewPos,
+									const glm::vec3& _lightDir,
+									const glm::vec3& _lightIntensity)
+	{
+		block.view				= _view;
+		block.projection		= _projection;
+		block.viewProj			= _projection * _view;
+		block.viewPos			= glm::vec4(_viewPos,1.f);
+		block.lightDir			= glm::vec4(_lightDir,0.f);
+		block.lightIntensity	= glm::vec4(_lightIntensity,0.f);
+		block.time				= glm::vec4(float(glfwGetTime()),float(frame++),0.f,0.f);
+
+		// Respecified every frame, which orphans the previous storage
+		buffer.Fill(&block,1);
+		glBindBufferBase(GL_UNIFORM_BUFFER,FRAME_BLOCK_BINDING,buffer.id);
+		glf::CheckError("FrameConstants::Update");
+	}
+	//--------------------------------------------------------------------------
+	DrawRecordRing::DrawRecordRing():
+	capacity(0),
+	region(0)
+	{
+		for(int i=0;i<DRAW_RING_FRAMES;++i)
+			fences[i] = 0;
+	}
+	//--------------------------------------------------------------------------
+	DrawRecordRing::~DrawRecordRing()
+	{
+		for(int i=0;i<DRAW_RING_FRAMES;++i)
+			if(fences[i]!=0)
+				glDeleteSync(fences[i]);
+	}
+	//--------------------------------------------------------------------------
+	bool DrawRecordRing::Supported()
+	{
+		return GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+	}
+	//--------------------------------------------------------------------------
+	DrawRecord* DrawRecordRing::Map(int _count)
+	{
+		assert(_count>0);
+		region = (region+1) % DRAW_RING_FRAMES;
+
+		// Reallocation orphans the storage read by the pending draws
+		if(_count>capacity)
+		{
+			capacity = std::max(_count,2*capacity);
+			buffer.Allocate(DRAW_RING_FRAMES*capacity,GL_STREAM_DRAW);
+			for(int i=0;i<DRAW_RING_FRAMES;++i)
+			{
+				if(fences[i]!=0)
+					glDeleteSync(fences[i]);
+				fences[i] = 0;
+			}
+		}
+
+		if(fences[region]!=0)
+		{
+			while(glClientWaitSync(fences[region],GL_SYNC_FLUSH_COMMANDS_BIT,1000000)==GL_TIMEOUT_EXPIRED);
+			glDeleteSync(fences[region]);
+			fences[region] = 0;
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER,buffer.id);
+		void* records = glMapBufferRange(	GL_ARRAY_BUFFER,
+											region*capacity*sizeof(DrawRecord),
+											_count*sizeof(DrawRecord),
+											GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		assert(records!=NULL);
+		glf::CheckError("DrawRecordRing::Map");
+		return (DrawRecord*)records;
+	}
+	//--------------------------------------------------------------------------
+	void DrawRecordRing::Unmap()
+	{
+		glBindBuffer(GL_ARRAY_BUFFER,buffer.id);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER,0);
+	}
+	//--------------------------------------------------------------------------
+	int DrawRecordRing::Base() const
+	{
+		return region*capacity;
+	}
+	//--------------------------------------------------------------------------
+	void DrawRecordRing::Bind(VertexArray& _primitive) const
+	{
+		// Reallocations keep the buffer name, the arrays stay valid
+		_primitive.AddInstancedVectors(buffer,semantic::Model,4,0,0);
+		_primitive.AddInstancedVectors(buffer,semantic::Material,1,sizeof(glm::mat4),0);
+	}
+	//--------------------------------------------------------------------------
+	void DrawRecordRing::Fence()
+	{
+		assert(fences[region]==0);
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef GLF_CONSTANTS_HPP
+#define GLF_CONSTANTS_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/buffer.hpp>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define FRAME_BLOCK_BINDING				0	// See frame.glsl
+#define DRAW_RING_FRAMES				3	// Frames in flight of the draw records
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	// Constants shared by the programs including frame.glsl (std140 layout)
+	struct FrameBlock
+	{
+		glm::mat4						view;
+		glm::mat4						projection;
+		glm::mat4						viewProj;
+		glm::vec4						viewPos;		// xyz
+		glm::vec4						lightDir;		// xyz : direction of the light flux
+		glm::vec4						lightIntensity;	// xyz
+		glm::vec4						time;			// x : seconds, y : frame index
+	};
+	//--------------------------------------------------------------------------
+	// Uniform buffer of the frame block, updated once per frame and bound to
+	// FRAME_BLOCK_BINDING for all the programs
+	class FrameConstants
+	{
+	public:
+										FrameConstants();
+		void							Update(			const glm::mat4& _projection,
+														const glm::mat4& _view,
+														const glm::vec3& _viewPos,
+														const glm::vec3& _lightDir,
+														const glm::vec3& _lightIntensity);
+	private:
+										FrameConstants(	const FrameConstants&);
+		FrameConstants&					operator=(		const FrameConstants&);
+	public:
+		FrameBlock						block;
+	private:
+		UniformBuffer<FrameBlock>::Buffer buffer;
+		int								frame;
+	};
+	//--------------------------------------------------------------------------
+	// Per draw constants, read as per instance attributes (ATTR_MODEL and
+	// ATTR_MATERIAL) at the base instance of the draw
+	struct DrawRecord
+	{
+		glm::mat4						model;
+		glm::vec4						material;		// x : roughness, y : specularity, z : material (mesh) index
+	};
+	//--------------------------------------------------------------------------
+	// Ring of draw records over DRAW_RING_FRAMES frames. A frame maps its
+	// region unsynchronized once the fence of the draws which last read it
+	// is signaled, so the CPU only waits when the GPU is DRAW_RING_FRAMES
+	// frames behind. The per draw attributes of the vertex arrays are
+	// pointed once at the start of the ring, a draw selects its record with
+	// its base instance offset by Base (GL 4.2 or ARB_base_instance)
+	class DrawRecordRing
+	{
+	public:
+										DrawRecordRing();
+										~DrawRecordRing();
+		static bool						Supported();
+		// Region of the next frame, for _count records
+		DrawRecord*						Map(			int _count);
+		void							Unmap();
+		// Base instance of the first record of the frame
+		int								Base() const;
+		void							Bind(			VertexArray& _primitive) const;
+		// After the last draw reading the region of the frame
+		void							Fence();
+	private:
+										DrawRecordRing(	const DrawRecordRing&);
+		DrawRecordRing&					operator=(		const DrawRecordRing&);
+		VertexBuffer<DrawRecord>::Buffer buffer;
+		GLsync							fences[DRAW_RING_FRAMES];
+		int								capacity;		// Records per region
+		int								region;
+	};
+}
+
+#endif
@@ -5,22 +5,227 @@
 #include <glf/window.hpp>
 #include <glf/geometry.hpp>
 #include <glf/debug.hpp>
+#include <glf/sdsm.hpp>
 #include <glm/gtx/transform.hpp>
 
 //-----------------------------------------------------------------------------
 // Constants
 //-----------------------------------------------------------------------------
-#define CONSTANT_K_EVSM			50.f
-#define ALIGN_CSM_WITH_CAMERA	1
-#define ENABLE_SHADOW_SSM		0
-#define ENABLE_SHADOW_VSM		0
-#define ENABLE_SHADOW_EVSM		1
-#if (ENABLE_SHADOW_SSM + ENABLE_SHADOW_VSM + ENABLE_SHADOW_EVSM != 1) 
-#	error("Invalid selection of shadow techniques") 
+#define ENABLE_HALF_MOMENTS		0		// RG16F moments, with a smaller EVSM exponent
+#if ENABLE_HALF_MOMENTS
+#	define CONSTANT_K_EVSM		5.54f	// exp(2k) has to fit a half float
+#	define MOMENT_FORMAT		GL_RG16F
+#else
+#	define CONSTANT_K_EVSM		50.f
+#	define MOMENT_FORMAT		GL_RG32F
 #endif
+#define ALIGN_CSM_WITH_CAMERA	1
+#define CSM_SLICED_CASCADE		2		// First cascade updated in round robin
+#define SDSM_DEPTH_MARGIN		0.1f	// Of the sample depth range, for the camera motion
+#define SDSM_BOUND_MARGIN		0.1f	// Of the sample x/y bounds
 
 namespace glf
 {
+	//-------------------------------------------------------------------------
+	namespace
+	{
+		const char* techniqueNames[] = { "SSM", "VSM", "EVSM" };
+		//---------------------------------------------------------------------
+		inline int BitCount(unsigned int _v)
+		{
+			int count = 0;
+			for(;_v!=0;_v&=_v-1)
+				++count;
+			return count;
+		}
+		//---------------------------------------------------------------------
+		// Per draw state of the render queue draws
+		struct CasterDrawState
+		{
+			const CSMBuilder::RegularRenderer*	renderer;
+			const SceneManager*				scene;
+			const std::vector<unsigned int>*	masks;	// NULL with per instance masks
+		};
+		//---------------------------------------------------------------------
+		void SetCasterState(				int _mesh,
+											void* _data)
+		{
+			const CasterDrawState& state = *(const CasterDrawState*)_data;
+			if(state.masks!=NULL)
+				glVertexAttribI4ui(semantic::LayerMask, (*state.masks)[_mesh], 0, 0, 0);
+			glProgramUniformMatrix4fv(state.renderer->program.id, state.renderer->modelVar, 1, GL_FALSE, &state.scene->transformations[_mesh][0][0]);
+		}
+		//---------------------------------------------------------------------
+		// Distance to the light of a caster, from the scene bound in light
+		// space : casters are drawn front to back
+		float LightDepth(					const glm::mat4& _lightView,
+											const BBox& _sceneLight,
+											const BBox& _bound)
+		{
+			glm::vec4 center = _lightView * glm::vec4((_bound.pMin+_bound.pMax)*0.5f,1.f);
+			return _sceneLight.pMax.z - center.z;
+		}
+		//---------------------------------------------------------------------
+		// Cascades of _mask whose caster volume touches a regular mesh or an
+		// instance : their receivers need the terrain casters, whatever the
+		// horizon maps of the terrains
+		unsigned int MeshCascades(			const SceneManager& _scene,
+											const Frustum* _volumes,
+											int _nCascades,
+											unsigned int _mask)
+		{
+			unsigned int mask = 0;
+			for(unsigned int o=0;o<_scene.shadowMeshes.size() && mask!=_mask;++o)
+			{
+				BBox bound = Transform(_scene.oBounds[o],_scene.transformations[o]);
+				for(int c=0;c<_nCascades;++c)
+					if((_mask & ~mask & (1u<<c))!=0 && Intersect(_volumes[c],bound))
+						mask |= 1u<<c;
+			}
+			for(unsigned int m=0;m<_scene.instancedModels.size() && mask!=_mask;++m)
+			{
+				const InstancedModel& model = _scene.instancedModels[m];
+				for(unsigned int i=0;i<model.bounds.size() && mask!=_mask;++i)
+					for(int c=0;c<_nCascades;++c)
+						if((_mask & ~mask & (1u<<c))!=0 && Intersect(_volumes[c],model.bounds[i]))
+							mask |= 1u<<c;
+			}
+			return mask;
+		}
+		//---------------------------------------------------------------------
+		// Volume intersecting no bound, for the cascades which are not rebuilt
+		Frustum EmptyFrustum()
+		{
+			Frustum frustum;
+			for(int i=0;i<6;++i)
+				frustum.planes[i] = glm::vec4(0,0,0,-1);
+			return frustum;
+		}
+		//---------------------------------------------------------------------
+		// Selects the cascades to rebuild from their split spheres in light
+		// space, and updates the covered squares of the selected ones. A
+		// split out of its square forces the rebuild, a split out of half
+		// the guard band (or much smaller than its square) only requests
+		// it : near cascades are rebuilt at once, the far ones one per frame
+		unsigned int ScheduleCascades(		CSMLight& _light,
+											const glm::vec2* _centers,
+											const float* _radii)
+		{
+			if(!_light.caching || _light.direction!=_light.cacheDirection)
+				_light.cacheValid = 0;
+
+			unsigned int forced = 0;
+			unsigned int wanted = 0;
+			for(int i=0;i<_light.nCascades;++i)
+			{
+				unsigned int bit = 1u<<i;
+				if((_light.cacheValid & bit)==0)
+				{
+					forced |= bit;
+					continue;
+				}
+				float distance = glm::length(_centers[i] - _light.cacheCenters[i]);
+				float radius   = _light.cacheRadii[i];
+				if(distance + _radii[i] > radius)
+					forced |= bit;
+				else if(distance + _radii[i]*(1.f + 0.5f*_light.guardBand) > radius || _radii[i]*(1.f + _light.guardBand) < 0.5f*radius)
+					wanted |= bit;
+			}
+
+			unsigned int sliced  = ~((1u<<CSM_SLICED_CASCADE)-1u);
+			unsigned int rebuild = forced | (wanted & ~sliced);
+			for(int i=0;i<_light.nCascades && (wanted & sliced)!=0;++i)
+			{
+				int c = (_light.cacheNext + i) % _light.nCascades;
+				if((wanted & sliced & (1u<<c))!=0)
+				{
+					rebuild |= 1u<<c;
+					_light.cacheNext = c + 1;
+					break;
+				}
+			}
+
+			// Squares are quantized to 1/16 of their octave and their
+			// centers snapped to their texels, so that rebuilt cascades
+			// keep the same texel grid
+			for(int i=0;i<_light.nCascades;++i)
+			{
+				if((rebuild & (1u<<i))==0)
+					continue;
+				float radius = _radii[i] * (1.f + _light.guardBand);
+				float step   = exp2f(floorf(log2f(radius)) - 4.f);
+				radius       = ceilf(radius / step) * step;
+				float texel  = 2.f * radius / float(_light.depthTexs.size.x);
+				_light.cacheCenters[i] = glm::floor(_centers[i] / texel + 0.5f) * texel;
+				_light.cacheRadii[i]   = radius;
+			}
+			_light.cacheValid	   |= rebuild;
+			_light.cacheDirection	= _light.direction;
+			return rebuild;
+		}
+		//---------------------------------------------------------------------
+		// Light space x/y bound of the samples of the cascades of the last
+		// reduction overlapping the split [_near,_far], in the current light
+		// view. The light direction is the same : the bounds are prisms
+		// along it, only moved in the light plane. False without sample
+		bool SampleBound(					const SampleDistribution& _samples,
+											float _near,
+											float _far,
+											const glm::mat4& _lightView,
+											glm::vec2& _min,
+											glm::vec2& _max)
+		{
+			glm::vec4 bound(1e30f,1e30f,-1e30f,-1e30f);
+			float cascadeNear = 0.f;
+			for(int c=0;c<_samples.nCascades;++c)
+			{
+				float cascadeFar = c==_samples.nCascades-1 ? 1e30f : _samples.splitFars[c];
+				glm::vec4 b = _samples.bounds[c];
+				if(cascadeNear<_far && cascadeFar>_near && b.x<=b.z && b.y<=b.w)
+					bound = glm::vec4(glm::min(glm::vec2(bound),glm::vec2(b)),glm::max(glm::vec2(bound.z,bound.w),glm::vec2(b.z,b.w)));
+				cascadeNear = cascadeFar;
+			}
+			if(bound.x>bound.z || bound.y>bound.w)
+				return false;
+
+			glm::mat4 toLight = _lightView * glm::inverse(_samples.lightView);
+			_min = glm::vec2( 1e30f);
+			_max = glm::vec2(-1e30f);
+			for(int c=0;c<4;++c)
+			{
+				glm::vec2 corner((c&1)!=0 ? bound.z : bound.x, (c&2)!=0 ? bound.w : bound.y);
+				glm::vec2 p = glm::vec2(toLight * glm::vec4(corner,0,1));
+				_min = glm::min(_min,p);
+				_max = glm::max(_max,p);
+			}
+			glm::vec2 margin = (_max - _min) * SDSM_BOUND_MARGIN;
+			_min -= margin;
+			_max += margin;
+			return true;
+		}
+		//---------------------------------------------------------------------
+		// Screen triangles of the moment filter, one instance per rebuilt
+		// cascade
+		void DrawCascades(					const VertexArray& _vao,
+											const CSMBuilder::MomentFilter& _filter,
+											unsigned int _mask,
+											int _nCascades)
+		{
+			if(_mask==(1u<<_nCascades)-1u)
+			{
+				glProgramUniform1i(_filter.program.id, _filter.firstLayerVar, 0);
+				_vao.Draw(GL_TRIANGLES,3,0,_nCascades);
+				return;
+			}
+			for(int c=0;c<_nCascades;++c)
+			{
+				if((_mask & (1u<<c))==0)
+					continue;
+				glProgramUniform1i(_filter.program.id, _filter.firstLayerVar, c);
+				_vao.Draw(GL_TRIANGLES,3,0,1);
+			}
+		}
+	}
 	//-------------------------------------------------------------------------
 	// Corner0 : -1 -1 
 	// Corner1 :  1 -1 
@@ -54,10 +259,22 @@ namespace glf
 		_corner3 = center + (_camUp * hHeight) - (right * hWidth);
 	}
 	//-------------------------------------------------------------------------
-	CSMLight::CSMLight(int _w, int _h,int _nCascades):
+	const char* shadow::Name(int _technique)
+	{
+		assert(_technique>=0 && _technique<shadow::MAX);
+		return techniqueNames[_technique];
+	}
+	//-------------------------------------------------------------------------
+	CSMLight::CSMLight(int _w, int _h,int _nCascades,int _technique):
+	technique(-1),
 	direction(0,0,-1),
 	intensity(1.f,1.f,1.f),
-	nCascades(_nCascades)
+	nCascades(_nCascades),
+	caching(true),
+	guardBand(0.2f),
+	cacheDirection(0,0,0),
+	cacheValid(0),
+	cacheNext(CSM_SLICED_CASCADE)
 	{
 		glf::Info("CSMLight::CSMLight");
 		assert(nCascades<=4);
@@ -66,75 +283,115 @@ namespace glf
 		viewprojs	= new glm::mat4[nCascades];
 		nearPlanes	= new float[nCascades];
 		farPlanes	= new float[nCascades];
+		cacheCenters= new glm::vec2[nCascades];
+		cacheRadii	= new float[nCascades];
+		layerFBOs	= new GLuint[nCascades];
 
 		depthTexs.Allocate(GL_DEPTH_COMPONENT32F,_w,_h,nCascades);
 		depthTexs.SetFiltering(GL_LINEAR,GL_LINEAR);
 		depthTexs.SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
 		depthTexs.SetCompare(GL_COMPARE_REF_TO_TEXTURE,GL_LEQUAL);
 
-		#if (ENABLE_SHADOW_VSM || ENABLE_SHADOW_EVSM)
-		momentTexs.Allocate(GL_RG32F,_w,_h,nCascades);
 		momentTexs.SetFiltering(GL_LINEAR,GL_LINEAR);
 		momentTexs.SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
-
-		tmpTexs.Allocate(GL_RG32F,_w,_h,nCascades);
 		tmpTexs.SetFiltering(GL_LINEAR,GL_LINEAR);
 		tmpTexs.SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
 
-		filterTexs.Allocate(GL_RG32F,_w,_h,nCascades);
-		filterTexs.SetFiltering(GL_LINEAR,GL_LINEAR);
-		filterTexs.SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
-		#endif
-
 		glGenFramebuffers(1, &depthFBO);
-		glBindFramebuffer(GL_FRAMEBUFFER,depthFBO);
-		#if ENABLE_SHADOW_SSM
-		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexs.id, 0);
-		glDrawBuffer(GL_NONE);
-		glReadBuffer(GL_NONE);
-		#else
-		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,momentTexs.id, 0);
-		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexs.id, 0);
-		glDrawBuffer(GL_COLOR_ATTACHMENT0);
-		#endif
-		glBindFramebuffer(GL_FRAMEBUFFER,0);
-		glf::CheckFramebuffer(depthFBO);
-
-		#if (ENABLE_SHADOW_VSM || ENABLE_SHADOW_EVSM)
+		glGenFramebuffers(nCascades, layerFBOs);
 		glGenFramebuffers(1, &tmpFBO);
-		glBindFramebuffer(GL_FRAMEBUFFER,tmpFBO);
-		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,tmpTexs.id, 0);
-		glDrawBuffer(GL_COLOR_ATTACHMENT0);
-		glBindFramebuffer(GL_FRAMEBUFFER,0);
-		glf::CheckFramebuffer(tmpFBO);
-
 		glGenFramebuffers(1, &filterFBO);
-		glBindFramebuffer(GL_FRAMEBUFFER,filterFBO);
-		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,filterTexs.id, 0);
-		glDrawBuffer(GL_COLOR_ATTACHMENT0);
-		glBindFramebuffer(GL_FRAMEBUFFER,0);
-		glf::CheckFramebuffer(filterFBO);
-		#endif
+		SetTechnique(_technique);
 
 		// Default init
 		for(int i=0;i<nCascades;++i)
 		{
 			nearPlanes[i] = 0.1f;
 			farPlanes[i]  = 100.f;
+			cacheCenters[i] = glm::vec2(0);
+			cacheRadii[i]   = 0.f;
 		}
 		glf::CheckError("CSMLight::CSMLight");
 	}
 	//-------------------------------------------------------------------------
 	CSMLight::~CSMLight()
 	{
+		glDeleteFramebuffers(nCascades,layerFBOs);
+		delete[] layerFBOs;
+		delete[] cacheRadii;
+		delete[] cacheCenters;
 		delete[] farPlanes;
 		delete[] nearPlanes;
 		delete[] viewprojs;
 		delete[] projs;
 		glDeleteFramebuffers(1,&depthFBO);
-		#if (ENABLE_SHADOW_VSM || ENABLE_SHADOW_EVSM)
+		glDeleteFramebuffers(1,&tmpFBO);
 		glDeleteFramebuffers(1,&filterFBO);
-		#endif
+	}
+	//-------------------------------------------------------------------------
+	void CSMLight::SetTechnique(	int _technique)
+	{
+		assert(_technique>=0 && _technique<shadow::MAX);
+		if(_technique==technique)
+			return;
+		technique = _technique;
+
+		// SSM only renders the depths, the moment storage is released
+		bool moments = technique!=shadow::SSM;
+		int w = moments ? depthTexs.size.x : 0;
+		int h = moments ? depthTexs.size.y : 0;
+		momentTexs.Allocate(MOMENT_FORMAT,w,h,moments ? nCascades : 0);
+		tmpTexs.Allocate(MOMENT_FORMAT,w,h,moments ? nCascades : 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER,depthFBO);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,moments ? momentTexs.id : 0, 0);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexs.id, 0);
+		glDrawBuffer(moments ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+		glReadBuffer(moments ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER,0);
+		glf::CheckFramebuffer(depthFBO);
+
+		for(int i=0;i<nCascades;++i)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER,layerFBOs[i]);
+			if(moments)
+				glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,momentTexs.id, 0, i);
+			else
+				glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, 0, 0);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexs.id, 0, i);
+			glDrawBuffer(moments ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+			glReadBuffer(moments ? GL_COLOR_ATTACHMENT0 : GL_NONE);
+			glBindFramebuffer(GL_FRAMEBUFFER,0);
+			glf::CheckFramebuffer(layerFBOs[i]);
+		}
+
+		if(moments)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER,tmpFBO);
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,tmpTexs.id, 0);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0);
+			glBindFramebuffer(GL_FRAMEBUFFER,0);
+			glf::CheckFramebuffer(tmpFBO);
+
+			// The vertical pass filters back into the moments, without the
+			// depth attachment
+			glBindFramebuffer(GL_FRAMEBUFFER,filterFBO);
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,momentTexs.id, 0);
+			glDrawBuffer(GL_COLOR_ATTACHMENT0);
+			glBindFramebuffer(GL_FRAMEBUFFER,0);
+			glf::CheckFramebuffer(filterFBO);
+		}
+
+		Invalidate();
+		glf::CheckError("CSMLight::SetTechnique");
+	}
+	//-------------------------------------------------------------------------
+	size_t CSMLight::MemoryBytes() const
+	{
+		size_t momentBytes = MOMENT_FORMAT==GL_RG16F ? 4 : 8;
+		size_t depthTexels = size_t(depthTexs.size.x) * depthTexs.size.y * nCascades;
+		size_t momentTexels= size_t(momentTexs.size.x) * momentTexs.size.y * nCascades;
+		return depthTexels * 4 + 2 * momentTexels * momentBytes;
 	}
 	//-------------------------------------------------------------------------
 	void CSMLight::SetDirection(	const glm::vec3& _direction)
@@ -145,94 +402,354 @@ namespace glf
 	void CSMLight::SetIntensity(	const glm::vec3& _intensity)
 	{
 		intensity = _intensity;
+	}
+	//-------------------------------------------------------------------------
+	void CSMLight::Invalidate()
+	{
+		cacheValid = 0;
+	}
+	//-------------------------------------------------------------------------
+	void CSMLight::Invalidate(		const BBox& _bound)
+	{
+		if(_bound.pMin.x>_bound.pMax.x)
+			return;
+
+		// The cached squares are in the light space of the cache, which
+		// does not depend on the camera
+		BBox lightBound = Transform(_bound,view);
+		for(int i=0;i<nCascades;++i)
+		{
+			glm::vec2 center = cacheCenters[i];
+			float radius     = cacheRadii[i];
+			if(	lightBound.pMin.x<center.x+radius && lightBound.pMax.x>center.x-radius &&
+				lightBound.pMin.y<center.y+radius && lightBound.pMax.y>center.y-radius)
+				cacheValid &= ~(1u<<i);
+		}
+	}
+	//-------------------------------------------------------------------------
+	CSMBuilder::Variant::Variant():
+	regularRenderer("CSMBuilder::RegularRenderer"),
+	instancedRenderer("CSMBuilder::InstancedRenderer")
+	{
+
 	}
 	//-------------------------------------------------------------------------
 	CSMBuilder::CSMBuilder():
-	maxCascades(4)
+	maxCascades(4),
+	rebuildMask(0),
+	filterRadius(2),
+	nInstancedArrays(0)
 	{
 		CreateScreenTriangle(vbo);
 		vao.Add(vbo,semantic::Position,2,GL_FLOAT);
 
+		for(int t=0;t<shadow::MAX;++t)
+			variants[t] = NULL;
+	}
+	//-------------------------------------------------------------------------
+	CSMBuilder::~CSMBuilder()
+	{
+		for(int t=0;t<shadow::MAX;++t)
+			delete variants[t];
+	}
+	//-------------------------------------------------------------------------
+	CSMBuilder::Variant& CSMBuilder::Programs(int _technique)
+	{
+		assert(_technique>=0 && _technique<shadow::MAX);
+		if(variants[_technique]!=NULL)
+			return *variants[_technique];
+		glf::Info("CSMBuilder::Programs (%s)",shadow::Name(_technique));
+		variants[_technique] = new Variant();
+		Variant& variant = *variants[_technique];
+
 		// Program regular mesh
 		ProgramOptions regularOptions = ProgramOptions::CreateVSOptions();
 		regularOptions.AddDefine<int>("CSM_BUILDER", 1);
-		#if   ENABLE_SHADOW_SSM
-		regularOptions.AddDefine<int>("SSM", 1);
-		#elif ENABLE_SHADOW_VSM
-		regularOptions.AddDefine<int>("VSM", 1);
-		#elif ENABLE_SHADOW_EVSM
-		regularOptions.AddDefine<int>("EVSM", 1);
+		regularOptions.AddDefine<int>(shadow::Name(_technique), 1);
 		regularOptions.AddDefine<float>("K_EVSM_VALUE", CONSTANT_K_EVSM);
-		#endif
 		regularOptions.AddDefine<int>("MAX_CASCADES",maxCascades);
-		regularRenderer.program.Compile(regularOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.vs")),
+		variant.regularRenderer.program.Compile(regularOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.vs")),
 										regularOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.gs")),
 										regularOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.fs")));
 
-		regularRenderer.projVar 		= regularRenderer.program["Projections[0]"].location;
-		regularRenderer.viewVar 		= regularRenderer.program["View"].location;
-		regularRenderer.modelVar 		= regularRenderer.program["Model"].location;
-		regularRenderer.nCascadesVar	= regularRenderer.program["nCascades"].location;
+		variant.regularRenderer.projVar 		= variant.regularRenderer.program["Projections[0]"].location;
+		variant.regularRenderer.viewVar 		= variant.regularRenderer.program["View"].location;
+		variant.regularRenderer.modelVar 		= variant.regularRenderer.program["Model"].location;
+
+		// Program instanced mesh, the model matrix is an attribute
+		ProgramOptions instancedOptions = regularOptions;
+		instancedOptions.AddDefine<int>("INSTANCED",1);
+		variant.instancedRenderer.program.Compile(instancedOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.vs")),
+										instancedOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.gs")),
+										instancedOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.fs")));
+
+		variant.instancedRenderer.projVar 		= variant.instancedRenderer.program["Projections[0]"].location;
+		variant.instancedRenderer.viewVar 		= variant.instancedRenderer.program["View"].location;
+		variant.instancedRenderer.modelVar 		= -1;
 
 		// Program terrain mesh
 		ProgramOptions terrainOptions = ProgramOptions::CreateVSOptions();
 		terrainOptions.AddDefine<int>("CSM_BUILDER", 1);
-		#if   ENABLE_SHADOW_SSM
-		terrainOptions.AddDefine<int>("SSM", 1);
-		#elif ENABLE_SHADOW_VSM
-		terrainOptions.AddDefine<int>("VSM", 1);
-		#elif ENABLE_SHADOW_EVSM
-		terrainOptions.AddDefine<int>("EVSM", 1);
+		terrainOptions.AddDefine<int>(shadow::Name(_technique), 1);
 		terrainOptions.AddDefine<float>("K_EVSM_VALUE", CONSTANT_K_EVSM);
-		#endif
 		terrainOptions.AddDefine<int>("MAX_CASCADES",maxCascades);
-		terrainRenderer.program.Compile(terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.vs")),
+		variant.terrainRenderer.program.Compile(terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.vs")),
 										terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.cs")),
 										terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.es")),
 										terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.gs")),
 										terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.fs")));
 
-		terrainRenderer.projVar 		= terrainRenderer.program["Projections[0]"].location;
-		terrainRenderer.viewVar 		= terrainRenderer.program["View"].location;
-		terrainRenderer.nCascadesVar	= terrainRenderer.program["nCascades"].location;
+		variant.terrainRenderer.projVar 		= variant.terrainRenderer.program["Projections[0]"].location;
+		variant.terrainRenderer.viewVar 		= variant.terrainRenderer.program["View"].location;
+		variant.terrainRenderer.nCascadesVar	= variant.terrainRenderer.program["nCascades"].location;
+		variant.terrainRenderer.cascadeMaskVar	= variant.terrainRenderer.program["CascadeMask"].location;
+
+		variant.terrainRenderer.heightTexUnit	= variant.terrainRenderer.program["HeightTex"].unit;
+		variant.terrainRenderer.tileSizeVar		= variant.terrainRenderer.program["TileSize"].location;
+		variant.terrainRenderer.tileCountVar	= variant.terrainRenderer.program["TileCount"].location;
+		variant.terrainRenderer.tileOffsetVar	= variant.terrainRenderer.program["TileOffset"].location;
+		variant.terrainRenderer.projFactorVar	= variant.terrainRenderer.program["ProjFactor"].location;
+		variant.terrainRenderer.tessFactorVar	= variant.terrainRenderer.program["TessFactor"].location;
+		variant.terrainRenderer.heightFactorVar	= variant.terrainRenderer.program["HeightFactor"].location;
+
+		glProgramUniform1i(variant.terrainRenderer.program.id, variant.terrainRenderer.program["HeightTex"].location,  variant.terrainRenderer.heightTexUnit);
+
+		// Program paged terrain, same geometry and fragment stages. The eye
+		// driving the morphing comes from the frame block
+		ProgramOptions pagedOptions = terrainOptions;
+		pagedOptions.Include(LoadFile(directory::ShaderDirectory + "frame.glsl"));
+		variant.pagedRenderer.program.Compile(	pagedOptions.Append(LoadFile(directory::ShaderDirectory + "pagedterrain.vs")),
+										pagedOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.gs")),
+										pagedOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.fs")));
 
-		terrainRenderer.heightTexUnit	= terrainRenderer.program["HeightTex"].unit;
-		terrainRenderer.tileSizeVar		= terrainRenderer.program["TileSize"].location;
-		terrainRenderer.tileCountVar	= terrainRenderer.program["TileCount"].location;
-		terrainRenderer.tileOffsetVar	= terrainRenderer.program["TileOffset"].location;
-		terrainRenderer.projFactorVar	= terrainRenderer.program["ProjFactor"].location;
-		terrainRenderer.tessFactorVar	= terrainRenderer.program["TessFactor"].location;
-		terrainRenderer.heightFactorVar	= terrainRenderer.program["HeightFactor"].location;
+		variant.pagedRenderer.projVar 			= variant.pagedRenderer.program["Projections[0]"].location;
+		variant.pagedRenderer.viewVar 			= variant.pagedRenderer.program["LightView"].location;
+		variant.pagedRenderer.nCascadesVar		= variant.pagedRenderer.program["nCascades"].location;
+		variant.pagedRenderer.cascadeMaskVar	= variant.pagedRenderer.program["CascadeMask"].location;
+		variant.pagedRenderer.heightPagesUnit	= variant.pagedRenderer.program["HeightPages"].unit;
+		variant.pagedRenderer.terrainOffsetVar	= variant.pagedRenderer.program["TerrainOffset"].location;
+		variant.pagedRenderer.terrainSizeVar	= variant.pagedRenderer.program["TerrainSize"].location;
+		variant.pagedRenderer.heightFactorVar	= variant.pagedRenderer.program["HeightFactor"].location;
+		variant.pagedRenderer.gridResolutionVar	= variant.pagedRenderer.program["GridResolution"].location;
+		variant.pagedRenderer.pageSizeVar		= variant.pagedRenderer.program["PageSize"].location;
 
-		glProgramUniform1i(terrainRenderer.program.id, terrainRenderer.program["HeightTex"].location,  terrainRenderer.heightTexUnit);
+		glProgramUniform1i(variant.pagedRenderer.program.id, variant.pagedRenderer.program["HeightPages"].location,  variant.pagedRenderer.heightPagesUnit);
 
+		// Program captured terrain mesh, same geometry and fragment stages
+		terrainOptions.AddDefine<int>("CAPTURED", 1);
+		variant.capturedRenderer.program.Compile(	terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.vs")),
+											terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.gs")),
+											terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.fs")));
 
-		// Program filter moments
+		variant.capturedRenderer.projVar 		= variant.capturedRenderer.program["Projections[0]"].location;
+		variant.capturedRenderer.viewVar 		= variant.capturedRenderer.program["View"].location;
+		variant.capturedRenderer.nCascadesVar	= variant.capturedRenderer.program["nCascades"].location;
+		variant.capturedRenderer.cascadeMaskVar	= variant.capturedRenderer.program["CascadeMask"].location;
+
+		// Program filter moments, SSM has no moments to filter
+		if(_technique==shadow::SSM)
+		{
+			glf::CheckError("CSMBuilder::Programs");
+			return variant;
+		}
 		ProgramOptions filterOptions = ProgramOptions::CreateVSOptions();
-		#if   ENABLE_SHADOW_SSM
-		filterOptions.AddDefine<int>("SSM", 1);
-		#elif ENABLE_SHADOW_VSM
-		filterOptions.AddDefine<int>("VSM", 1);
-		#elif ENABLE_SHADOW_EVSM
-		filterOptions.AddDefine<int>("EVSM", 1);
-		#endif
+		filterOptions.AddDefine<int>(shadow::Name(_technique), 1);
 		filterOptions.AddDefine<int>("CSM_FILTER",1);
 		filterOptions.AddDefine<int>("MAX_CASCADES",maxCascades);
-		momentFilter.program.Compile(	filterOptions.Append(LoadFile(directory::ShaderDirectory + "csm.vs")),
+		variant.momentFilter.program.Compile(	filterOptions.Append(LoadFile(directory::ShaderDirectory + "csm.vs")),
 										filterOptions.Append(LoadFile(directory::ShaderDirectory + "csm.gs")),
 										filterOptions.Append(LoadFile(directory::ShaderDirectory + "csm.fs")));
 
-		momentFilter.directionVar  = momentFilter.program["Direction"].location;
-		momentFilter.momentTexUnit = momentFilter.program["MomentTex"].unit;
-		glProgramUniform1i(momentFilter.program.id, momentFilter.program["MomentTex"].location, momentFilter.momentTexUnit);
+		variant.momentFilter.directionVar  = variant.momentFilter.program["Direction"].location;
+		variant.momentFilter.firstLayerVar = variant.momentFilter.program["FirstLayer"].location;
+		variant.momentFilter.radiusVar     = variant.momentFilter.program["Radius"].location;
+		variant.momentFilter.momentTexUnit = variant.momentFilter.program["MomentTex"].unit;
+		glProgramUniform1i(variant.momentFilter.program.id, variant.momentFilter.program["MomentTex"].location, variant.momentFilter.momentTexUnit);
+
+		glf::CheckError("CSMBuilder::Programs");
+		return variant;
+	}
+	//-------------------------------------------------------------------------
+	void CSMBuilder::Cull(	const CSMLight&		_light,
+							const Frustum*		_casterVolumes,
+							const SceneManager& _scene)
+	{
+		// Shadow meshes share the bounds of the regular meshes
+		#if ENABLE_GPU_CULLING
+		if(gpuCuller.Count()!=int(_scene.shadowCommandMeshes.size()))
+		{
+			std::vector<DrawElementsIndirectCommand> commands;
+			IndirectCommands(_scene.shadowMeshes,_scene.shadowCommandMeshes,commands);
+			gpuCuller.Set(_scene.oBounds,_scene.shadowCommandMeshes,commands);
+		}
+		gpuCuller.Cull(_casterVolumes,_light.nCascades);
+		return;
+		#endif
+
+		int nMeshes = int(_scene.shadowMeshes.size());
+		#if ENABLE_CASTER_CULLING
+		if(casterBounds.Count()!=int(_scene.oBounds.size()))
+			casterBounds.Set(_scene.oBounds);
+
+		casterMasks.assign(nMeshes,0);
+		for(int c=0;c<_light.nCascades;++c)
+		{
+			if((rebuildMask & (1u<<c))==0)
+				continue;
+			casterVisibles.clear();
+			casterBounds.Cull(_casterVolumes[c],casterVisibles);
+			for(unsigned int i=0;i<casterVisibles.size();++i)
+				casterMasks[casterVisibles[i]] |= 1u<<c;
+		}
+		#else
+		casterMasks.assign(nMeshes,rebuildMask);
+		#endif
+
+		int nLayers = 0;
+		for(int i=0;i<nMeshes;++i)
+			nLayers += BitCount(casterMasks[i]);
+		glf::manager::timings->SetCounter(counter::CsmCasterLayers,nLayers);
+
+		#if ENABLE_GEOMETRY_ARENA
+		// Visible commands of each batch. The base instance of a command
+		// selects its layer mask (the divisor is larger than any instance count)
+		bool layerMasks = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+		casterBatches.clear();
+		casterCommands.clear();
+		casterCommandMasks.clear();
+		for(unsigned int b=0;b<_scene.shadowBatches.size();++b)
+		{
+			MeshBatch batch     = _scene.shadowBatches[b];
+			batch.firstCommand  = int(casterCommands.size());
+			int lastCommand     = _scene.shadowBatches[b].firstCommand + _scene.shadowBatches[b].countCommands;
+			for(int c=_scene.shadowBatches[b].firstCommand;c<lastCommand;++c)
+			{
+				int mesh          = _scene.shadowCommandMeshes[c];
+				unsigned int mask = casterMasks[mesh];
+				if(mask==0)
+					continue;
+				if(!layerMasks)
+					mask = rebuildMask;
+				DrawElementsIndirectCommand command = IndirectCommand(_scene.shadowMeshes[mesh]);
+				command.primCount    = BitCount(mask);
+				command.baseInstance = layerMasks ? GLuint(casterCommands.size()) : 0;
+				casterCommands.push_back(command);
+				casterCommandMasks.push_back(mask);
+			}
+			batch.countCommands = int(casterCommands.size()) - batch.firstCommand;
+			if(batch.countCommands>0)
+				casterBatches.push_back(batch);
+		}
+
+		// Respecified every frame, which orphans the previous storage
+		if(!casterCommands.empty())
+		{
+			if(casterCommandBuffer.count<nMeshes)
+			{
+				casterCommandBuffer.Allocate(nMeshes,GL_STREAM_DRAW);
+				casterMaskBuffer.Allocate(nMeshes,GL_STREAM_DRAW);
+			}
+			casterCommandBuffer.Fill(&casterCommands[0],int(casterCommands.size()));
+			casterMaskBuffer.Fill(&casterCommandMasks[0],int(casterCommandMasks.size()));
+		}
+		#endif
+	}
+	//-------------------------------------------------------------------------
+	void CSMBuilder::DrawInstances(	const CSMLight&		_light,
+									const Frustum*		_casterVolumes,
+									const SceneManager& _scene)
+	{
+		// One instance per transformation and cascade, the geometry shader
+		// routes it to the layer of its single mask bit
+		Variant& variant = Programs(_light.technique);
+		int nModels = int(_scene.instancedModels.size());
+		instanceTransforms.clear();
+		instanceLayers.clear();
+		instanceFirsts.resize(nModels+1);
+		for(int m=0;m<nModels;++m)
+		{
+			const InstancedModel& model = _scene.instancedModels[m];
+			instanceFirsts[m] = int(instanceTransforms.size());
+			for(unsigned int i=0;i<model.transforms.size();++i)
+			{
+				#if ENABLE_CASTER_CULLING
+				unsigned int mask = 0;
+				for(int c=0;c<_light.nCascades;++c)
+					if((rebuildMask & (1u<<c))!=0 && Intersect(_casterVolumes[c],model.bounds[i]))
+						mask |= 1u<<c;
+				#else
+				unsigned int mask = rebuildMask;
+				#endif
+				while(mask!=0)
+				{
+					instanceTransforms.push_back(model.transforms[i]);
+					instanceLayers.push_back(mask & ~(mask-1u));
+					mask &= mask-1u;
+				}
+			}
+		}
+		instanceFirsts[nModels] = int(instanceTransforms.size());
+		if(instanceTransforms.empty())
+			return;
+
+		// Respecified every frame, which orphans the previous storage
+		int nInstances = int(instanceTransforms.size());
+		if(instanceBuffer.count<nInstances)
+		{
+			instanceBuffer.Allocate(nInstances,GL_STREAM_DRAW);
+			instanceLayerBuffer.Allocate(nInstances,GL_STREAM_DRAW);
+		}
+		instanceBuffer.Fill(&instanceTransforms[0],nInstances);
+		instanceLayerBuffer.Fill(&instanceLayers[0],nInstances);
+
+		// The arrays of the models read the buffers from their start, set
+		// once. Draws select their first instance with the base instance
+		for(;nInstancedArrays<nModels;++nInstancedArrays)
+		{
+			VertexArray* primitive = _scene.instancedModels[nInstancedArrays].shadowMeshes[0].primitive;
+			primitive->AddInstancedMatrix(instanceBuffer,semantic::Model,0);
+			primitive->AddInstanced(instanceLayerBuffer,semantic::LayerMask,1,GL_UNSIGNED_INT,1,0);
+		}
+
+		#if !ENABLE_RENDER_QUEUE
+		glUseProgram(variant.instancedRenderer.program.id);
+		#endif
+		glProgramUniformMatrix4fv(variant.instancedRenderer.program.id, variant.instancedRenderer.projVar, _light.nCascades, GL_FALSE, &_light.projs[0][0][0]);
+		glProgramUniformMatrix4fv(variant.instancedRenderer.program.id, variant.instancedRenderer.viewVar, 1, 				 GL_FALSE, &_light.view[0][0]);
+		for(int m=0;m<nModels;++m)
+		{
+			int count = instanceFirsts[m+1] - instanceFirsts[m];
+			if(count==0)
+				continue;
+			const InstancedModel& model = _scene.instancedModels[m];
+			for(unsigned int i=0;i<model.shadowMeshes.size();++i)
+			{
+				#if ENABLE_RENDER_QUEUE
+				RenderQueue::Draw draw = QueueDraw(model.shadowMeshes[i],variant.instancedRenderer.program.id,0,count);
+				draw.baseInstance = instanceFirsts[m];
+				queue.Push(1,0.f,draw);
+				#else
+				model.shadowMeshes[i].Draw(count,instanceFirsts[m]);
+				#endif
+			}
+		}
+		#if ENABLE_RENDER_QUEUE
+		queue.Submit(NULL,NULL);
+		#endif
+		glf::CheckError("CSMBuilder::Draw::Instances");
 	}
 	//-------------------------------------------------------------------------
 	void CSMBuilder::Draw(	CSMLight&			_light,
 							const Camera&		_camera,
 							float 				_cascadeAlpha,
 							float 				_blendFactor,
-							const SceneManager& _scene)
+							const SceneManager& _scene,
+							TerrainCapture*		_capture,
+							float				_shadowTessScale,
+							bool				_terrainCasters,
+							const SampleDistribution* _samples)
 	{
+		Variant& variant = Programs(_light.technique);
 
 		// Extract camera near/far
 		float n = _camera.Near();
@@ -243,7 +760,9 @@ namespace glf
 		glm::vec3 camPos	= _camera.Eye();
 		glm::vec3 camDir	=  glm::normalize(_camera.Center()-camPos);
 		glm::vec3 camUp		= _camera.Up();
+		#if !ENABLE_CSM_CACHE || ENABLE_CSM_HELPERS
 		glm::vec3 camRight	=  glm::normalize(glm::cross(camDir,camUp));
+		#endif
 		float camFov		= _camera.VFov();
 		float camRatio		= _camera.Ratio();
 
@@ -259,16 +778,49 @@ namespace glf
 		n 					= std::max(n,-sceneView.pMax.z);
 		f 					= std::min(f,-sceneView.pMin.z);
 
+		#if ENABLE_SDSM
+		// Depth range of the visible samples
+		bool samples = _samples!=NULL && _samples->valid && _samples->minDepth<=_samples->maxDepth;
+		if(samples)
+		{
+			float sampleNear = std::max(n,_samples->minDepth*(1.f-SDSM_DEPTH_MARGIN));
+			float sampleFar	 = std::min(f,_samples->maxDepth*(1.f+SDSM_DEPTH_MARGIN));
+			if(sampleNear<sampleFar)
+			{
+				n = sampleNear;
+				f = sampleFar;
+			}
+		}
+		#endif
+
 		// Compute lightView matrix (CSM is aligned with camera)
+		#if ENABLE_CSM_CACHE
+		// Independent of the camera, the cascades only move with their
+		// split spheres and can be reused across frames
+		glm::vec3 lightTar	= glm::vec3(0);
+		glm::vec3 lightDir	= _light.direction;
+		glm::vec3 lightUp	= fabs(lightDir.z)>0.9f ? glm::vec3(0,1,0) : glm::vec3(0,0,1);
+		#else
 		glm::vec3 lightTar	= camPos;
 		glm::vec3 lightDir	= _light.direction;
 		glm::vec3 lightUp	= -camRight;
 		if(fabs(glm::dot(lightUp,lightDir))>0.9f) lightUp = camUp;
+		#endif
 		glm::vec3 lightRight= glm::normalize(glm::cross(lightDir,lightUp));
 		lightUp				= glm::normalize(glm::cross(lightRight,lightDir));
 		_light.view			= glm::lookAt(lightTar,lightTar+lightDir,lightUp);
 		_light.camView		= camView;
 
+		#if ENABLE_SDSM
+		// The sample bounds are only reused with the same light direction
+		if(samples)
+		{
+			const glm::mat4& sampleView = _samples->lightView;
+			glm::vec3 sampleDir(-sampleView[0][2],-sampleView[1][2],-sampleView[2][2]);
+			samples = glm::dot(sampleDir,lightDir)>0.9999f;
+		}
+		#endif
+
 		#if ENABLE_CSM_HELPERS
 		glf::manager::helpers->CreateReferential(lightRight,lightUp,-lightDir,1.f,glm::translate(camPos.x,camPos.y,camPos.z));
 		#endif
@@ -289,6 +841,14 @@ namespace glf
 		glf::manager::helpers->CreateBound(c0,c1,c2,c3);
 		#endif
 
+		// Volumes in which a caster can shadow the receivers of a cascade
+		Frustum casterVolumes[4];
+		assert(_light.nCascades<=4);
+		#if ENABLE_CSM_CACHE
+		glm::vec2 splitCenters[4];
+		float splitRadii[4];
+		#endif
+
 		// For each cascade
 		float previousFar	= n;
 		for(int i=0;i<_light.nCascades;++i)
@@ -331,6 +891,51 @@ namespace glf
 			boundSplit.Add(glm::vec3(c11_v));
 			boundSplit.Add(glm::vec3(c12_v));
 			boundSplit.Add(glm::vec3(c13_v));
+			#if !ENABLE_CSM_CACHE
+			float receiverMinZ = boundSplit.pMin.z;
+			#endif
+
+			#if ENABLE_SDSM
+			// The part of the split without receiver needs no shadow
+			glm::vec2 sampleMin, sampleMax;
+			bool sampleSplit = samples && SampleBound(*_samples,previousFar,camSpaceZ,_light.view,sampleMin,sampleMax);
+			if(sampleSplit)
+			{
+				sampleMin = glm::max(sampleMin,glm::vec2(boundSplit.pMin));
+				sampleMax = glm::min(sampleMax,glm::vec2(boundSplit.pMax));
+				sampleSplit = sampleMin.x<sampleMax.x && sampleMin.y<sampleMax.y;
+			}
+			if(sampleSplit)
+			{
+				boundSplit.pMin = glm::vec3(sampleMin,boundSplit.pMin.z);
+				boundSplit.pMax = glm::vec3(sampleMax,boundSplit.pMax.z);
+			}
+			#endif
+
+			#if ENABLE_CSM_CACHE
+			// Bounding sphere of the split, whose radius does not change
+			// with the camera orientation
+			glm::vec3 corners[8] = {	glm::vec3(c00_v), glm::vec3(c01_v), glm::vec3(c02_v), glm::vec3(c03_v),
+										glm::vec3(c10_v), glm::vec3(c11_v), glm::vec3(c12_v), glm::vec3(c13_v) };
+			glm::vec3 center(0);
+			for(int c=0;c<8;++c)
+				center += corners[c] * 0.125f;
+			float radius = 0.f;
+			for(int c=0;c<8;++c)
+				radius = glm::max(radius,glm::length(corners[c]-center));
+			splitCenters[i]	= glm::vec2(center);
+			splitRadii[i]	= radius;
+			#if ENABLE_SDSM
+			// Square around the sample bound instead, which changes with
+			// the camera orientation
+			if(sampleSplit)
+			{
+				glm::vec2 extent= (sampleMax - sampleMin) * 0.5f;
+				splitCenters[i]	= (sampleMin + sampleMax) * 0.5f;
+				splitRadii[i]	= std::max(extent.x,extent.y);
+			}
+			#endif
+			#endif
 
 			// Extract min-max Z-range in light space (take in accound scene bounds)
 			boundSplit.pMin.x = glm::max(sceneLight.pMin.x, boundSplit.pMin.x);	
@@ -352,6 +957,7 @@ namespace glf
 			previousFar			= camSpaceZ;
 			//glf::Info("CamZ : %f",camSpaceZ);
 
+			#if !ENABLE_CSM_CACHE
 			// Compute the light projection based on split AABB
 			// Inverse z because of the light view matrix which has negative z
 			_light.projs[i]		= glm::ortho(boundSplit.pMin.x,  boundSplit.pMax.x,
@@ -359,6 +965,14 @@ namespace glf
 											-boundSplit.pMax.z, -boundSplit.pMin.z);
 			_light.viewprojs[i]	= _light.projs[i] * _light.view;
 
+			// Casters have to overlap the split in x/y and to be above its
+			// farthest receivers : the split volume is extended toward the light
+			glm::mat4 casterProj= glm::ortho(boundSplit.pMin.x,  boundSplit.pMax.x,
+											 boundSplit.pMin.y,  boundSplit.pMax.y,
+											-boundSplit.pMax.z, -glm::min(receiverMinZ,boundSplit.pMax.z));
+			casterVolumes[i]	= ExtractFrustum(casterProj * _light.view);
+			#endif
+
 			#if ENABLE_CSM_HELPERS
 			glm::mat4 invViewProj = glm::inverse(_light.viewprojs[i]);
 			glf::manager::helpers->CreateBound(	glm::vec3(invViewProj * glm::vec4(-1,-1,-1, 1)),
@@ -373,73 +987,252 @@ namespace glf
 			#endif
 		}
 
+		unsigned int allCascades = (1u<<_light.nCascades)-1u;
+		#if ENABLE_CSM_CACHE
+		// Cached cascades keep their projection and are culled out of all
+		// the caster passes. Rebuilt ones cover their whole square, with
+		// the receivers and casters of the scene depth range
+		rebuildMask = ScheduleCascades(_light,splitCenters,splitRadii);
+		for(int i=0;i<_light.nCascades;++i)
+		{
+			if((rebuildMask & (1u<<i))==0)
+			{
+				casterVolumes[i] = EmptyFrustum();
+				continue;
+			}
+			glm::vec2 center	= _light.cacheCenters[i];
+			float radius		= _light.cacheRadii[i];
+			_light.projs[i]		= glm::ortho(center.x - radius, center.x + radius,
+											 center.y - radius, center.y + radius,
+											-sceneLight.pMax.z, -sceneLight.pMin.z);
+			_light.viewprojs[i]	= _light.projs[i] * _light.view;
+			casterVolumes[i]	= ExtractFrustum(_light.viewprojs[i]);
+		}
+		glf::manager::timings->SetCounter(counter::CsmRebuiltCascades,BitCount(rebuildMask));
+		#else
+		rebuildMask = allCascades;
+		#endif
+
 		// Render cascaded shadow maps 
 		assert(_light.nCascades<=maxCascades);
 		glViewport(0,0,_light.depthTexs.size.x,_light.depthTexs.size.y);
-		glBindFramebuffer(GL_FRAMEBUFFER,_light.depthFBO);
 
-		#if ENABLE_SHADOW_SSM
-		glClear(GL_DEPTH_BUFFER_BIT);
-		#else
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		#endif
+		// Cleared all at once or layer by layer
+		GLbitfield clearBits = GL_DEPTH_BUFFER_BIT;
+		if(_light.technique!=shadow::SSM)
+			clearBits |= GL_COLOR_BUFFER_BIT;
+		if(rebuildMask==allCascades)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER,_light.depthFBO);
+			glClear(clearBits);
+		}
+		else
+		{
+			for(int i=0;i<_light.nCascades;++i)
+			{
+				if((rebuildMask & (1u<<i))==0)
+					continue;
+				glBindFramebuffer(GL_FRAMEBUFFER,_light.layerFBOs[i]);
+				glClear(clearBits);
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER,_light.depthFBO);
+		}
+
 		// Regular renderer
 		glf::manager::timings->StartSection(glf::section::CsmBuilderRegular);
+		if(!_scene.shadowMeshes.empty() && rebuildMask!=0)
 		{
-			glUseProgram(regularRenderer.program.id);
-			glProgramUniform1i(regularRenderer.program.id, 			regularRenderer.nCascadesVar,	_light.nCascades);
-			glProgramUniformMatrix4fv(regularRenderer.program.id, 	regularRenderer.projVar,  		_light.nCascades, 	GL_FALSE, &_light.projs[0][0][0]);
-			glProgramUniformMatrix4fv(regularRenderer.program.id, 	regularRenderer.viewVar,  		1, 					GL_FALSE, &_light.view[0][0]);
+			Cull(_light,casterVolumes,_scene);
+
+			#if !ENABLE_RENDER_QUEUE
+			glUseProgram(variant.regularRenderer.program.id);
+			#endif
+			glProgramUniformMatrix4fv(variant.regularRenderer.program.id, 	variant.regularRenderer.projVar,  		_light.nCascades, 	GL_FALSE, &_light.projs[0][0][0]);
+			glProgramUniformMatrix4fv(variant.regularRenderer.program.id, 	variant.regularRenderer.viewVar,  		1, 					GL_FALSE, &_light.view[0][0]);
 
+			#if ENABLE_GEOMETRY_ARENA
+			// One instanced multi draw per transformation. Without base
+			// instance, every instance reads the generic full mask
+			#if ENABLE_GPU_CULLING
+			bool layerMasks = true;
+			const std::vector<MeshBatch>& batches = _scene.shadowBatches;
+			const IndirectElementBuffer& commands = gpuCuller.commands;
+			const VertexBuffer<unsigned int>::Buffer& masks = gpuCuller.masks;
+			#else
+			bool layerMasks = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+			const std::vector<MeshBatch>& batches = casterBatches;
+			const IndirectElementBuffer& commands = casterCommandBuffer;
+			const VertexBuffer<unsigned int>::Buffer& masks = casterMaskBuffer;
+			#endif
+			if(!layerMasks)
+				glVertexAttribI4ui(semantic::LayerMask, rebuildMask, 0, 0, 0);
+			const VertexArray* maskedVAO = NULL;
+			for(unsigned int b=0;b<batches.size();++b)
+			{
+				const MeshBatch& batch = batches[b];
+				if(layerMasks && batch.primitive!=maskedVAO)
+				{
+					batch.primitive->AddInstanced(masks,semantic::LayerMask,1,GL_UNSIGNED_INT,maxCascades);
+					maskedVAO = batch.primitive;
+				}
+				#if ENABLE_RENDER_QUEUE
+				// Mask attributes are set above, before the queue keeps the
+				// vertex arrays bound
+				BBox bound = Transform(_scene.oBounds[batch.mesh],_scene.transformations[batch.mesh]);
+				queue.Push(0,LightDepth(_light.view,sceneLight,bound),QueueDraw(batch,commands,variant.regularRenderer.program.id));
+				#else
+				glProgramUniformMatrix4fv(variant.regularRenderer.program.id, variant.regularRenderer.modelVar, 1, GL_FALSE, &_scene.transformations[batch.mesh][0][0]);
+				batch.primitive->MultiDrawElements(GL_TRIANGLES,batch.indexType,commands,batch.firstCommand,batch.countCommands);
+				#endif
+			}
+			#if ENABLE_RENDER_QUEUE
+			CasterDrawState state;
+			state.renderer = &variant.regularRenderer;
+			state.scene    = &_scene;
+			state.masks    = NULL;
+			queue.Submit(SetCasterState,&state);
+			#endif
+			#else
 			for(unsigned int o=0;o<_scene.shadowMeshes.size();++o)
 			{
-				glProgramUniformMatrix4fv(regularRenderer.program.id, regularRenderer.modelVar, 1, GL_FALSE, &_scene.transformations[o][0][0]);
-				_scene.shadowMeshes[o].Draw();
+				unsigned int mask = casterMasks[o];
+				if(mask==0)
+					continue;
+				#if ENABLE_RENDER_QUEUE
+				BBox bound = Transform(_scene.oBounds[o],_scene.transformations[o]);
+				queue.Push(0,LightDepth(_light.view,sceneLight,bound),QueueDraw(_scene.shadowMeshes[o],variant.regularRenderer.program.id,o,BitCount(mask)));
+				#else
+				glVertexAttribI4ui(semantic::LayerMask, mask, 0, 0, 0);
+				glProgramUniformMatrix4fv(variant.regularRenderer.program.id, variant.regularRenderer.modelVar, 1, GL_FALSE, &_scene.transformations[o][0][0]);
+				_scene.shadowMeshes[o].Draw(BitCount(mask));
+				#endif
 			}
+			#if ENABLE_RENDER_QUEUE
+			CasterDrawState state;
+			state.renderer = &variant.regularRenderer;
+			state.scene    = &_scene;
+			state.masks    = &casterMasks;
+			queue.Submit(SetCasterState,&state);
+			#endif
+			#endif
 			glf::CheckError("CSMBuilder::Draw::Regulars");
 		}
+		if(!_scene.instancedModels.empty() && rebuildMask!=0)
+			DrawInstances(_light,casterVolumes,_scene);
 		glf::manager::timings->EndSection(glf::section::CsmBuilderRegular);
 
 		// Terrain renderer
 		glf::manager::timings->StartSection(glf::section::CsmBuilderTerrain);
+		// Without terrain casters, the terrains still cast into the cascades
+		// holding meshes, which do not read the horizon maps
+		unsigned int terrainMask = rebuildMask;
+		Frustum terrainVolumes[4];
+		if(!_terrainCasters && !_scene.terrainMeshes.empty())
+			terrainMask = MeshCascades(_scene,casterVolumes,_light.nCascades,rebuildMask);
+		for(int i=0;i<_light.nCascades;++i)
+			terrainVolumes[i] = (terrainMask & (1u<<i))!=0 ? casterVolumes[i] : EmptyFrustum();
+		int nTerrainCascades = terrainMask!=0 ? _light.nCascades : 0;
+		if(_capture!=NULL && !_scene.terrainMeshes.empty())
 		{
-			glUseProgram(terrainRenderer.program.id);
-			glProgramUniform1i(terrainRenderer.program.id, 			terrainRenderer.nCascadesVar,	_light.nCascades);
-			glProgramUniformMatrix4fv(terrainRenderer.program.id, 	terrainRenderer.projVar,  		_light.nCascades, 	GL_FALSE, &_light.projs[0][0][0]);
-			glProgramUniformMatrix4fv(terrainRenderer.program.id, 	terrainRenderer.viewVar,  		1, 					GL_FALSE, &_light.view[0][0]);
+			// Tessellation of the frame, shared with the G-buffer. The camera
+			// drives the level of detail of the shadow casters too
+			_capture->Capture(	_scene.terrainMeshes,
+								ExtractFrustum(_camera.Projection() * camView),
+								terrainVolumes,
+								nTerrainCascades,
+								_shadowTessScale);
+		}
+		if(_capture!=NULL && !_scene.terrainMeshes.empty() && terrainMask!=0)
+		{
+
+			glUseProgram(variant.capturedRenderer.program.id);
+			glProgramUniform1i(variant.capturedRenderer.program.id, 		variant.capturedRenderer.nCascadesVar,	_light.nCascades);
+			glProgramUniform1i(variant.capturedRenderer.program.id, 		variant.capturedRenderer.cascadeMaskVar,int(terrainMask));
+			glProgramUniformMatrix4fv(variant.capturedRenderer.program.id, 	variant.capturedRenderer.projVar,  		_light.nCascades, 	GL_FALSE, &_light.projs[0][0][0]);
+			glProgramUniformMatrix4fv(variant.capturedRenderer.program.id, 	variant.capturedRenderer.viewVar,  		1, 					GL_FALSE, &_light.view[0][0]);
+			for(unsigned int o=0;o<_scene.terrainMeshes.size();++o)
+				_capture->Draw(o,true);
+			glf::CheckError("CSMBuilder::Draw::CapturedTerrains");
+		}
+		int nTiles = _capture!=NULL ? 0 : terrainTiles.Cull(_scene.terrainMeshes,terrainVolumes,nTerrainCascades);
+		#if ENABLE_TERRAIN_CULLING
+		if(_capture==NULL)
+			glf::manager::timings->SetCounter(counter::CsmTerrainTiles,nTiles);
+		#endif
+		if(nTiles>0)
+		{
+			glUseProgram(variant.terrainRenderer.program.id);
+			glProgramUniform1i(variant.terrainRenderer.program.id, 			variant.terrainRenderer.nCascadesVar,	_light.nCascades);
+			glProgramUniform1i(variant.terrainRenderer.program.id, 			variant.terrainRenderer.cascadeMaskVar,	int(terrainMask));
+			glProgramUniformMatrix4fv(variant.terrainRenderer.program.id, 	variant.terrainRenderer.projVar,  		_light.nCascades, 	GL_FALSE, &_light.projs[0][0][0]);
+			glProgramUniformMatrix4fv(variant.terrainRenderer.program.id, 	variant.terrainRenderer.viewVar,  		1, 					GL_FALSE, &_light.view[0][0]);
 
 			for(unsigned int o=0;o<_scene.terrainMeshes.size();++o)
 			{
+				if(terrainTiles.Count(o)==0)
+					continue;
 				const TerrainMesh& mesh = _scene.terrainMeshes[o];
-				glProgramUniform3f(terrainRenderer.program.id, 		terrainRenderer.tileOffsetVar,	mesh.tileOffset.x, mesh.tileOffset.y, mesh.tileOffset.z);
-				glProgramUniform2i(terrainRenderer.program.id, 		terrainRenderer.tileCountVar,	mesh.tileCount.x,  mesh.tileCount.y);
-				glProgramUniform2f(terrainRenderer.program.id, 		terrainRenderer.tileSizeVar,	mesh.tileSize.x,   mesh.tileSize.y);
-				glProgramUniform1f(terrainRenderer.program.id, 		terrainRenderer.tessFactorVar,	mesh.tessFactor);
-				glProgramUniform1f(terrainRenderer.program.id, 		terrainRenderer.heightFactorVar,mesh.heightFactor);
-				glProgramUniform1f(terrainRenderer.program.id, 		terrainRenderer.projFactorVar,	mesh.projFactor);
-
-				mesh.heightTex->Bind(terrainRenderer.heightTexUnit);
-				_scene.terrainMeshes[o].Draw();
+				glProgramUniform3f(variant.terrainRenderer.program.id, 		variant.terrainRenderer.tileOffsetVar,	mesh.tileOffset.x, mesh.tileOffset.y, mesh.tileOffset.z);
+				glProgramUniform2i(variant.terrainRenderer.program.id, 		variant.terrainRenderer.tileCountVar,	mesh.tileCount.x,  mesh.tileCount.y);
+				glProgramUniform2f(variant.terrainRenderer.program.id, 		variant.terrainRenderer.tileSizeVar,	mesh.tileSize.x,   mesh.tileSize.y);
+				glProgramUniform1f(variant.terrainRenderer.program.id, 		variant.terrainRenderer.tessFactorVar,	mesh.tessFactor);
+				glProgramUniform1f(variant.terrainRenderer.program.id, 		variant.terrainRenderer.heightFactorVar,mesh.heightFactor);
+				glProgramUniform1f(variant.terrainRenderer.program.id, 		variant.terrainRenderer.projFactorVar,	mesh.projFactor);
+
+				mesh.heightTex->Bind(variant.terrainRenderer.heightTexUnit);
+				terrainTiles.Draw(mesh,o);
 			}
 			glf::CheckError("CSMBuilder::Draw::Terrains");
 		}
+
+		// Paged terrains, nodes selected for the camera by their last update
+		int nNodes = pagedNodes.Cull(_scene.pagedTerrains,casterVolumes,_light.nCascades);
+		#if ENABLE_PAGED_TERRAIN
+		glf::manager::timings->SetCounter(counter::CsmPagedNodes,nNodes);
+		#endif
+		if(nNodes>0)
+		{
+			glUseProgram(variant.pagedRenderer.program.id);
+			glProgramUniform1i(variant.pagedRenderer.program.id, 			variant.pagedRenderer.nCascadesVar,		_light.nCascades);
+			glProgramUniform1i(variant.pagedRenderer.program.id, 			variant.pagedRenderer.cascadeMaskVar,	int(rebuildMask));
+			glProgramUniformMatrix4fv(variant.pagedRenderer.program.id, 	variant.pagedRenderer.projVar,  		_light.nCascades, 	GL_FALSE, &_light.projs[0][0][0]);
+			glProgramUniformMatrix4fv(variant.pagedRenderer.program.id, 	variant.pagedRenderer.viewVar,  		1, 					GL_FALSE, &_light.view[0][0]);
+
+			for(unsigned int o=0;o<_scene.pagedTerrains.size();++o)
+			{
+				if(pagedNodes.Count(o)==0)
+					continue;
+				PagedTerrain& terrain = *_scene.pagedTerrains[o];
+				glProgramUniform3f(variant.pagedRenderer.program.id, 		variant.pagedRenderer.terrainOffsetVar,	terrain.terrainOffset.x, terrain.terrainOffset.y, terrain.terrainOffset.z);
+				glProgramUniform2f(variant.pagedRenderer.program.id, 		variant.pagedRenderer.terrainSizeVar,	terrain.terrainSize.x, terrain.terrainSize.y);
+				glProgramUniform1f(variant.pagedRenderer.program.id, 		variant.pagedRenderer.heightFactorVar,	terrain.heightFactor);
+				glProgramUniform1f(variant.pagedRenderer.program.id, 		variant.pagedRenderer.gridResolutionVar,float(terrain.gridResolution));
+				glProgramUniform1f(variant.pagedRenderer.program.id, 		variant.pagedRenderer.pageSizeVar,		float(terrain.PageSize()));
+
+				terrain.heightPages.Bind(variant.pagedRenderer.heightPagesUnit);
+				pagedNodes.Draw(terrain,o);
+			}
+			glf::CheckError("CSMBuilder::Draw::PagedTerrains");
+		}
 		glf::manager::timings->EndSection(glf::section::CsmBuilderTerrain);
 
 		// Filter shadow map with VSM or EVSM
 		glf::manager::timings->StartSection(glf::section::CsmBuilderFilter);
-		#if (ENABLE_SHADOW_VSM || ENABLE_SHADOW_EVSM)
-		glUseProgram(momentFilter.program.id);
-
-		glBindFramebuffer(GL_FRAMEBUFFER,_light.tmpFBO);
-		_light.momentTexs.Bind(momentFilter.momentTexUnit);
-		glProgramUniform2f(momentFilter.program.id, momentFilter.directionVar, 1, 0);
-		vao.Draw(GL_TRIANGLES,3,0,_light.nCascades); // Instanced screen triangles for each cascade
-
-		glBindFramebuffer(GL_FRAMEBUFFER,_light.filterFBO);
-		_light.tmpTexs.Bind(momentFilter.momentTexUnit);
-		glProgramUniform2f(momentFilter.program.id, momentFilter.directionVar, 0, 1);
-		vao.Draw(GL_TRIANGLES,3,0,_light.nCascades); // Instanced screen triangles for each cascade
-		#endif
+		if(_light.technique!=shadow::SSM)
+		{
+			glUseProgram(variant.momentFilter.program.id);
+			glProgramUniform1i(variant.momentFilter.program.id, variant.momentFilter.radiusVar, filterRadius);
+
+			glBindFramebuffer(GL_FRAMEBUFFER,_light.tmpFBO);
+			_light.momentTexs.Bind(variant.momentFilter.momentTexUnit);
+			glProgramUniform2f(variant.momentFilter.program.id, variant.momentFilter.directionVar, 1, 0);
+			DrawCascades(vao,variant.momentFilter,rebuildMask,_light.nCascades);
+
+			glBindFramebuffer(GL_FRAMEBUFFER,_light.filterFBO);
+			_light.tmpTexs.Bind(variant.momentFilter.momentTexUnit);
+			glProgramUniform2f(variant.momentFilter.program.id, variant.momentFilter.directionVar, 0, 1);
+			DrawCascades(vao,variant.momentFilter,rebuildMask,_light.nCascades);
+		}
 		glf::manager::timings->EndSection(glf::section::CsmBuilderFilter);
 
 		glBindFramebuffer(GL_FRAMEBUFFER,0);
@@ -448,76 +1241,86 @@ namespace glf
 		glf::CheckError("CSMBuilder::Draw");
 	}
 	//-------------------------------------------------------------------------
-	CSMRenderer::CSMRenderer(int _w, int _h):
-	program("CSMRenderer")
+	CSMRenderer::CSMRenderer(int _w, int _h)
 	{
+		for(int t=0;t<shadow::MAX;++t)
+			variants[t] = NULL;
+	}
+	//-------------------------------------------------------------------------
+	CSMRenderer::~CSMRenderer()
+	{
+		for(int t=0;t<shadow::MAX;++t)
+			delete variants[t];
+	}
+	//-------------------------------------------------------------------------
+	CSMRenderer::Variant& CSMRenderer::Programs(int _technique)
+	{
+		assert(_technique>=0 && _technique<shadow::MAX);
+		if(variants[_technique]!=NULL)
+			return *variants[_technique];
+		glf::Info("CSMRenderer::Programs (%s)",shadow::Name(_technique));
+		variants[_technique] = new Variant();
+		Variant& variant = *variants[_technique];
+		Program& program = variant.program;
+
 		ProgramOptions options = ProgramOptions::CreateVSOptions();
-		#if   ENABLE_SHADOW_SSM
-		options.AddDefine<int>("SSM", 1);
-		#elif ENABLE_SHADOW_VSM
-		options.AddDefine<int>("VSM", 1);
-		#elif ENABLE_SHADOW_EVSM
-		options.AddDefine<int>("EVSM", 1);
+		options.AddDefine<int>(shadow::Name(_technique), 1);
 		options.AddDefine<float>("K_EVSM_VALUE", CONSTANT_K_EVSM);
-		#endif
 		options.AddDefine<int>("CSM_RENDERER",1);
 		options.AddDefine<int>("LIGHTING_ONLY",ENABLE_LIGHTING_ONLY);
 		options.Include(LoadFile(directory::ShaderDirectory + "brdf.fs"));
+		options.Include(LoadFile(directory::ShaderDirectory + "frame.glsl"));
 		program.Compile(options.Append(LoadFile(directory::ShaderDirectory + "csm.vs")),
 						options.Append(LoadFile(directory::ShaderDirectory + "csm.fs")));
 
-		viewPosVar 			= program["ViewPos"].location;
-		lightDirVar 		= program["LightDir"].location;
-		lightViewProjsVar	= program["LightViewProjs[0]"].location;
-		lightIntensityVar	= program["LightIntensity"].location;
-		biasVar				= program["Bias"].location;
-		nCascadesVar		= program["nCascades"].location;
+		variant.lightViewProjsVar	= program["LightViewProjs[0]"].location;
+		variant.biasVar				= program["Bias"].location;
+		variant.nCascadesVar		= program["nCascades"].location;
+		variant.bakedTerrainVar		= program["BakedTerrain"].location;
 
-		blendFactorVar		= program["BlendFactor"].location;
+		variant.blendFactorVar		= program["BlendFactor"].location;
 
-		positionTexUnit		= program["PositionTex"].unit;
-		diffuseTexUnit		= program["DiffuseTex"].unit;
-		normalTexUnit		= program["NormalTex"].unit;
-		shadowTexUnit		= program["ShadowTex"].unit;
+		variant.positionTexUnit		= program["PositionTex"].unit;
+		variant.diffuseTexUnit		= program["DiffuseTex"].unit;
+		variant.normalTexUnit		= program["NormalTex"].unit;
+		variant.shadowTexUnit		= program["ShadowTex"].unit;
 
-		glProgramUniform1i(program.id, program["PositionTex"].location,	positionTexUnit);
-		glProgramUniform1i(program.id, program["ShadowTex"].location,	shadowTexUnit);
-		glProgramUniform1i(program.id, program["DiffuseTex"].location,	diffuseTexUnit);
-		glProgramUniform1i(program.id, program["NormalTex"].location,	normalTexUnit);
+		glProgramUniform1i(program.id, program["PositionTex"].location,	variant.positionTexUnit);
+		glProgramUniform1i(program.id, program["ShadowTex"].location,	variant.shadowTexUnit);
+		glProgramUniform1i(program.id, program["DiffuseTex"].location,	variant.diffuseTexUnit);
+		glProgramUniform1i(program.id, program["NormalTex"].location,	variant.normalTexUnit);
 
-		glf::CheckError("CSMRenderer::Create");
+		glf::CheckError("CSMRenderer::Programs");
+		return variant;
 	}
 	//-------------------------------------------------------------------------
 	void CSMRenderer::Draw(	const CSMLight&	_light,
 							const GBuffer&	_gbuffer,
-							const glm::vec3&_viewPos,
 							float 			_blendFactor,
 							float 			_bias,
-							RenderTarget&	_target)
+							RenderTarget&	_target,
+							bool			_bakedTerrain)
 	{
-		glUseProgram(program.id);
+		const Variant& variant = Programs(_light.technique);
+		GLuint program = variant.program.id;
+		glUseProgram(program);
 
-		glProgramUniform1f(program.id,			blendFactorVar,			_blendFactor);
+		glProgramUniform1f(program,			variant.blendFactorVar,		_blendFactor);
 
-		glProgramUniform1f(program.id,			biasVar,			_bias);
-		glProgramUniform1i(program.id,			nCascadesVar,		_light.nCascades);
-		glProgramUniform3f(program.id,			viewPosVar,			_viewPos.x, _viewPos.y, _viewPos.z);
-		glProgramUniform3f(program.id,			lightDirVar,		_light.direction.x, _light.direction.y, _light.direction.z);
-		glProgramUniformMatrix4fv(program.id,	lightViewProjsVar,	_light.nCascades, 	GL_FALSE, &_light.viewprojs[0][0][0]);
-		glProgramUniform3f(program.id,			lightIntensityVar,	_light.intensity.x,	_light.intensity.y,	_light.intensity.z);
+		glProgramUniform1f(program,			variant.biasVar,			_bias);
+		glProgramUniform1i(program,			variant.nCascadesVar,		_light.nCascades);
+		glProgramUniform1i(program,			variant.bakedTerrainVar,	_bakedTerrain?1:0);
+		glProgramUniformMatrix4fv(program,	variant.lightViewProjsVar,	_light.nCascades, 	GL_FALSE, &_light.viewprojs[0][0][0]);
 
-		#if ENABLE_SHADOW_SSM
-		_light.depthTexs.Bind(shadowTexUnit);
-		#else
-		//_light.momentTexs.Bind(shadowTexUnit);
-		_light.filterTexs.Bind(shadowTexUnit);
-		#endif
-		_gbuffer.positionTex.Bind(positionTexUnit);
-		_gbuffer.diffuseTex.Bind(diffuseTexUnit);
-		_gbuffer.normalTex.Bind(normalTexUnit);
+		if(_light.technique==shadow::SSM)
+			_light.depthTexs.Bind(variant.shadowTexUnit);
+		else
+			_light.momentTexs.Bind(variant.shadowTexUnit);
+		_gbuffer.positionTex.Bind(variant.positionTexUnit);
+		_gbuffer.diffuseTex.Bind(variant.diffuseTexUnit);
+		_gbuffer.normalTex.Bind(variant.normalTexUnit);
 		_target.Draw();
 
 		glf::CheckError("CSMRenderer::Draw");
 	}
 }
-
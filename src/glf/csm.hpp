@@ -10,23 +10,47 @@
 #include <glf/helper.hpp>
 #include <glf/pass.hpp>
 #include <glf/gbuffer.hpp>
+#include <glf/culling.hpp>
 
 namespace glf
 {
+	class SampleDistribution;
+
+	//-------------------------------------------------------------------------
+	// Shadow map filtering techniques, selected at runtime
+	namespace shadow
+	{
+		enum Technique { SSM, VSM, EVSM, MAX };
+		// Also the define of the technique in the shaders
+		const char* Name(				int _technique);
+	}
 	//-------------------------------------------------------------------------
 	class CSMLight
 	{
 	public:
 					CSMLight(		int _w, 
 									int _h,
-									int _nCascades);
+									int _nCascades,
+									int _technique=shadow::EVSM);
 				   ~CSMLight();
 		void		SetIntensity(	const glm::vec3& _intensity);
 		void		SetDirection(	const glm::vec3& _direction);
+		// Allocates the textures of the technique (the moments are only
+		// needed by VSM and EVSM) and invalidates the cascades
+		void		SetTechnique(	int _technique);
+		// Drops the cached cascades, all rebuilt by the next draw. Needed
+		// when the shadow casters change
+		void		Invalidate(		);
+		// Drops the cached cascades whose square overlaps _bound (world
+		// space), for casters changing in place
+		void		Invalidate(		const BBox& _bound);
+		// Texture memory of the cascades
+		size_t		MemoryBytes(	) const;
 	private:
  					CSMLight(		const CSMLight&);
  		CSMLight	operator=(		const CSMLight&);
 	public:
+		int							technique;
 		glm::vec3 					direction;	// Light direction points the direction of the light flux
 		glm::mat4					view;		// View matrix (center on cam pos)
 		glm::mat4					camView;	// Camera view matrix used to generated the current CSM
@@ -37,36 +61,74 @@ namespace glf
 		glm::vec3		 			intensity;
 		int							nCascades;
 		TextureArray2D				depthTexs;
-		TextureArray2D				tmpTexs;	// Store linear moment for VSM and EVSM
-		TextureArray2D				momentTexs;	// Store linear moment for VSM and EVSM
-		TextureArray2D				filterTexs;	// Store filtered linear moment for VSM and EVSM
+		TextureArray2D				tmpTexs;	// Store linear moment for VSM and EVSM, empty for SSM
+		TextureArray2D				momentTexs;	// Store linear moment for VSM and EVSM, filtered in place, empty for SSM
 		GLuint						tmpFBO;
 		GLuint						depthFBO;
 		GLuint						filterFBO;
+		GLuint*						layerFBOs;	// Single cascade of the depth FBO, to clear it alone
+
+		// Cascade cache (ENABLE_CSM_CACHE). A cascade covers a square of
+		// its split bounding sphere radius extended by the guard band, in
+		// light space, and is reused while the split stays inside
+		bool						caching;
+		float						guardBand;	// Relative to the split radius
+		glm::vec2*					cacheCenters;
+		float*						cacheRadii;	// Half size of the covered squares
+		glm::vec3					cacheDirection;
+		unsigned int				cacheValid;	// Cascades holding a cached map
+		int							cacheNext;	// Next far cascade of the round robin
 	};
 	//-------------------------------------------------------------------------
 	class CSMBuilder
 	{
 	public:
 					CSMBuilder(		);
+				   ~CSMBuilder(		);
+		// With _capture, the terrains are tessellated once for the frame
+		// (view and caster tiles) and the captures are drawn in all the
+		// cascades. The G-buffer reuses the view ones. With ENABLE_CSM_CACHE
+		// and _light.caching, only the cascades whose split left their
+		// guard band are rendered, the far ones one per frame. Without
+		// _terrainCasters, the terrains (but the paged ones) are only drawn
+		// in the cascades holding meshes or instances : the shadows on the
+		// terrains come from their horizon maps.
+		// With ENABLE_SDSM and _samples, the splits cover the depth range
+		// of the visible samples and the cascades their x/y bounds (of the
+		// previous frame, extended by a margin)
 		void		Draw(			CSMLight&						_light,
 									const Camera&					_camera,
 									float 							_cascadeAlpha,
 									float 							_blendFactor,
+									const SceneManager& 			_scene,
+									TerrainCapture*					_capture=NULL,
+									float							_shadowTessScale=1.f,
+									bool							_terrainCasters=true,
+									const SampleDistribution*		_samples=NULL);
+		// Draws the instanced models with one instance per transformation
+		// and cascade it touches
+		void		DrawInstances(	const CSMLight&				_light,
+							const Frustum*				_casterVolumes,
+							const SceneManager& 		_scene);
+		// Computes the rebuilt cascades touched by each shadow caster and,
+		// with the geometry arena, the instanced commands of the visible
+		// casters (or runs the GPU culling pass on the scene commands)
+		void		Cull(			const CSMLight&					_light,
+									const Frustum*					_casterVolumes,
 									const SceneManager& 			_scene);
 	private:
  					CSMBuilder(		const CSMBuilder&);
  		CSMBuilder	operator=(		const CSMBuilder&);
 	public:
 
+		// The model matrix is a per instance attribute for instanced models
 		struct RegularRenderer
 		{
-									RegularRenderer():program("CSMBuilder::RegularRenderer"){}
+									RegularRenderer(const std::string& _name):program(_name){}
 			Program 				program;
 			GLint 					projVar;
 			GLint 					viewVar;
 			GLint 					modelVar;
-			GLint 					nCascadesVar;
 		};
 
 		struct TerrainRenderer
@@ -76,6 +138,7 @@ namespace glf
 			GLint 					projVar;
 			GLint 					viewVar;
 			GLint 					nCascadesVar;
+			GLint 					cascadeMaskVar;
 
 			GLint					heightTexUnit;
 			GLint 					tileSizeVar;
@@ -86,52 +149,130 @@ namespace glf
 			GLint					heightFactorVar;
 		};
 
+		// Terrains tessellated by a TerrainCapture, in world space
+		struct CapturedTerrainRenderer
+		{
+									CapturedTerrainRenderer():program("CSMBuilder::CapturedTerrainRenderer"){}
+			Program 				program;
+			GLint 					projVar;
+			GLint 					viewVar;
+			GLint 					nCascadesVar;
+			GLint 					cascadeMaskVar;
+		};
+
+		// Paged terrains, morphed with the camera distance
+		struct PagedTerrainRenderer
+		{
+									PagedTerrainRenderer():program("CSMBuilder::PagedTerrainRenderer"){}
+			Program 				program;
+			GLint 					projVar;
+			GLint 					viewVar;
+			GLint 					nCascadesVar;
+			GLint 					cascadeMaskVar;
+
+			GLint					heightPagesUnit;
+			GLint					terrainOffsetVar;
+			GLint					terrainSizeVar;
+			GLint					heightFactorVar;
+			GLint					gridResolutionVar;
+			GLint					pageSizeVar;
+		};
+
 		struct MomentFilter
 		{
 									MomentFilter():program("CSMBuilder::MomentFilter"){}
 			Program 				program;
 			GLint 					momentTexUnit;
 			GLint 					directionVar;
+			GLint 					firstLayerVar;
+			GLint 					radiusVar;
+		};
+
+		// Programs of a shadow technique
+		struct Variant
+		{
+									Variant();
+			RegularRenderer			regularRenderer;
+			RegularRenderer			instancedRenderer;
+			TerrainRenderer			terrainRenderer;
+			CapturedTerrainRenderer	capturedRenderer;
+			PagedTerrainRenderer	pagedRenderer;
+			MomentFilter			momentFilter;
 		};
+		// Compiled on the first draw with the technique
+		Variant&	Programs(		int _technique);
 
 		int							maxCascades;
-		RegularRenderer				regularRenderer;
-		TerrainRenderer				terrainRenderer;
-		MomentFilter				momentFilter;
+		unsigned int				rebuildMask;	// Cascades rendered by the current draw
+		int							filterRadius;	// Of the moment box filter, in texels
+		Variant*					variants[shadow::MAX];
 
 		VertexBuffer2F				vbo;
 		VertexArray					vao;
+
+		// Shadow caster culling. Each caster is drawn with one instance per
+		// cascade it touches, the instance reading its layer mask
+		BoundsSoA					casterBounds;
+		std::vector<int>			casterVisibles;
+		std::vector<unsigned int>	casterMasks;	// Cascade bits of each mesh
+		std::vector<MeshBatch>		casterBatches;
+		std::vector<DrawElementsIndirectCommand> casterCommands;
+		std::vector<unsigned int>	casterCommandMasks;
+		IndirectElementBuffer		casterCommandBuffer;
+		VertexBuffer<unsigned int>::Buffer casterMaskBuffer;
+		GPUCuller					gpuCuller;
+		RenderQueue					queue;			// Caster draws sorted by state
+		TerrainTiles				terrainTiles;	// Overlapping a caster volume
+		PagedTerrainNodes			pagedNodes;		// Overlapping a caster volume
+
+		// Instanced models. Each instance is a transformation and a single
+		// cascade bit, streamed every frame
+		std::vector<glm::mat4>		instanceTransforms;
+		std::vector<unsigned int>	instanceLayers;
+		std::vector<int>			instanceFirsts;	// First one of each model
+		VertexBuffer<glm::mat4>::Buffer instanceBuffer;
+		VertexBuffer<unsigned int>::Buffer instanceLayerBuffer;
+		int							nInstancedArrays;	// Models reading the instance buffers
 	};
 	//-------------------------------------------------------------------------
+	// The view position, light direction and intensity are read from the
+	// frame block (see FrameConstants)
 	class CSMRenderer
 	{
 	public:
 					CSMRenderer(	int _w, 
 									int _h);
+				   ~CSMRenderer(	);
 		void 		Draw(			const CSMLight&	_light,
 									const GBuffer&	_gbuffer,
-									const glm::vec3&_viewPos,
 									float 			_blendFactor,
 									float 			_bias,
-									RenderTarget&	_target);
+									RenderTarget&	_target,
+									bool			_bakedTerrain=false);
 	private:
  					CSMRenderer(	const CSMRenderer&);
  		CSMRenderer	operator=(		const CSMRenderer&);
 	public:
-		GLint 						positionTexUnit;
-		GLint 						diffuseTexUnit;
-		GLint 						normalTexUnit;
-		GLint 						shadowTexUnit;
-
-		GLint						blendFactorVar;
-		GLint						viewPosVar;
-		GLint						lightDirVar;
-		GLint 						lightViewProjsVar;
-		GLint						lightIntensityVar;
-		GLint						biasVar;
-		GLint						nCascadesVar;
-
-		Program 					program;
+		// Program of a shadow technique, compiled on its first draw
+		struct Variant
+		{
+									Variant():program("CSMRenderer"){}
+			GLint 					positionTexUnit;
+			GLint 					diffuseTexUnit;
+			GLint 					normalTexUnit;
+			GLint 					shadowTexUnit;
+
+			GLint					blendFactorVar;
+			GLint 					lightViewProjsVar;
+			GLint					biasVar;
+			GLint					nCascadesVar;
+			GLint					bakedTerrainVar;
+
+			Program 				program;
+		};
+		Variant&	Programs(		int _technique);
+
+		Variant*					variants[shadow::MAX];
 	};
 }
 
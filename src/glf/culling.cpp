@@ -0,0 +1,354 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/culling.hpp>
+#include <glf/utils.hpp>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=1)
+	#define GLF_CULLING_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define GLF_CULLING_SSE 0
+#endif
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	BoundsSoA::BoundsSoA():
+	count(0)
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	void BoundsSoA::Set(const std::vector<BBox>& _bounds)
+	{
+		count = int(_bounds.size());
+		int padded = (count+3) & ~3;
+
+		// Padding boxes are inverted : their positive vertex is always
+		// behind a plane
+		float big = std::numeric_limits<float>::max();
+		for(int c=0;c<3;++c)
+		{
+			pMin[c].assign(padded, big);
+			pMax[c].assign(padded,-big);
+		}
+		for(int i=0;i<count;++i)
+		{
+			for(int c=0;c<3;++c)
+			{
+				pMin[c][i] = _bounds[i].pMin[c];
+				pMax[c][i] = _bounds[i].pMax[c];
+			}
+		}
+	}
+	//--------------------------------------------------------------------------
+	int BoundsSoA::Count() const
+	{
+		return count;
+	}
+	//--------------------------------------------------------------------------
+	int BoundsSoA::Cull(				const Frustum& _frustum,
+										std::vector<int>& _visibles) const
+	{
+		if(count==0)
+			return 0;
+
+		// The positive vertex only depends on the plane normal, so its
+		// coordinates are picked per plane instead of per box
+		const float* px[6];
+		const float* py[6];
+		const float* pz[6];
+		for(int p=0;p<6;++p)
+		{
+			const glm::vec4& plane = _frustum.planes[p];
+			px[p] = plane.x>0 ? &pMax[0][0] : &pMin[0][0];
+			py[p] = plane.y>0 ? &pMax[1][0] : &pMin[1][0];
+			pz[p] = plane.z>0 ? &pMax[2][0] : &pMin[2][0];
+		}
+
+		int padded   = int(pMin[0].size());
+		int nVisible = 0;
+		#if GLF_CULLING_SSE
+		__m128 nx[6], ny[6], nz[6], nw[6];
+		for(int p=0;p<6;++p)
+		{
+			nx[p] = _mm_set1_ps(_frustum.planes[p].x);
+			ny[p] = _mm_set1_ps(_frustum.planes[p].y);
+			nz[p] = _mm_set1_ps(_frustum.planes[p].z);
+			nw[p] = _mm_set1_ps(_frustum.planes[p].w);
+		}
+		__m128 zero = _mm_setzero_ps();
+		for(int i=0;i<padded;i+=4)
+		{
+			__m128 inside = _mm_cmpeq_ps(zero,zero);
+			for(int p=0;p<6;++p)
+			{
+				__m128 d = _mm_add_ps(	_mm_add_ps(_mm_mul_ps(nx[p],_mm_loadu_ps(px[p]+i)),
+												   _mm_mul_ps(ny[p],_mm_loadu_ps(py[p]+i))),
+										_mm_add_ps(_mm_mul_ps(nz[p],_mm_loadu_ps(pz[p]+i)),
+												   nw[p]));
+				inside = _mm_and_ps(inside,_mm_cmpge_ps(d,zero));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for(int k=0;mask!=0;++k,mask>>=1)
+			{
+				if(mask & 1)
+				{
+					_visibles.push_back(i+k);
+					++nVisible;
+				}
+			}
+		}
+		#else
+		for(int i=0;i<count;++i)
+		{
+			bool inside = true;
+			for(int p=0;p<6 && inside;++p)
+			{
+				const glm::vec4& plane = _frustum.planes[p];
+				inside = plane.x*px[p][i] + plane.y*py[p][i] + plane.z*pz[p][i] + plane.w >= 0.f;
+			}
+			if(inside)
+			{
+				_visibles.push_back(i);
+				++nVisible;
+			}
+		}
+		#endif
+		return nVisible;
+	}
+	//--------------------------------------------------------------------------
+	GPUCuller::GPUCuller():
+	count(0),
+	program("GPUCuller"),
+	lastMode(VOLUMES),
+	current(0),
+	nVisibles(-1)
+	{
+		for(int r=0;r<CULLING_READBACK_FRAMES;++r)
+			readbacks[r].fence = 0;
+
+		GLuint ids[5];
+		glGenTextures(5,ids);
+		boundTexID		= ids[0];
+		commandMeshTexID= ids[1];
+		commandTexID	= ids[2];
+		maskTexID		= ids[3];
+		visibilityTexID	= ids[4];
+	}
+	//--------------------------------------------------------------------------
+	GPUCuller::~GPUCuller()
+	{
+		GLuint ids[5] = {boundTexID,commandMeshTexID,commandTexID,maskTexID,visibilityTexID};
+		glDeleteTextures(5,ids);
+		for(int r=0;r<CULLING_READBACK_FRAMES;++r)
+			if(readbacks[r].fence!=0)
+				glDeleteSync(readbacks[r].fence);
+	}
+	//--------------------------------------------------------------------------
+	int GPUCuller::Count() const
+	{
+		return count;
+	}
+	//--------------------------------------------------------------------------
+	void GPUCuller::Set(				const std::vector<BBox>& _bounds,
+										const std::vector<int>& _commandMeshes,
+										std::vector<DrawElementsIndirectCommand>& _commands)
+	{
+		assert(_commandMeshes.size()==_commands.size());
+		count = _bounds.empty() ? 0 : int(_commands.size());
+		if(count==0)
+			return;
+
+		// Compiled on first use : the pass is only needed with GPU culling
+		if(!program.compiled)
+		{
+			ProgramOptions options = ProgramOptions::CreateVSOptions();
+			options.AddDefine<int>("MAX_VOLUMES",MAX_CULLING_VOLUMES);
+			program.Compile(options.Append(LoadFile(directory::ShaderDirectory + "meshculling.vs")),
+							LoadFile(directory::ShaderDirectory + "meshculling.fs"));
+
+			planesVar			= program["Planes[0]"].location;
+			nVolumesVar			= program["nVolumes"].location;
+			modeVar				= program["Mode"].location;
+			viewProjVar			= program["ViewProj"].location;
+			hizLevelsVar		= program["HiZLevels"].location;
+			baseInstanceVar		= program["BaseInstance"].location;
+			hizTexUnit			= program["HiZTex"].unit;
+			visibilityImageUnit	= program["VisibilityImage"].unit;
+			boundTexUnit		= program["BoundTex"].unit;
+			commandMeshTexUnit	= program["CommandMeshTex"].unit;
+			commandImageUnit	= program["CommandImage"].unit;
+			maskImageUnit		= program["MaskImage"].unit;
+			glProgramUniform1i(program.id, program["BoundTex"].location,		boundTexUnit);
+			glProgramUniform1i(program.id, program["CommandMeshTex"].location,	commandMeshTexUnit);
+			glProgramUniform1i(program.id, program["CommandImage"].location,	commandImageUnit);
+			glProgramUniform1i(program.id, program["MaskImage"].location,		maskImageUnit);
+			glProgramUniform1i(program.id, program["HiZTex"].location,			hizTexUnit);
+			glProgramUniform1i(program.id, program["VisibilityImage"].location,	visibilityImageUnit);
+		}
+
+		// Static inputs
+		std::vector<glm::vec4> bounds(2*_bounds.size());
+		for(unsigned int i=0;i<_bounds.size();++i)
+		{
+			bounds[2*i+0] = glm::vec4(_bounds[i].pMin,0.f);
+			bounds[2*i+1] = glm::vec4(_bounds[i].pMax,0.f);
+		}
+		boundBuffer.Allocate(int(bounds.size()),GL_STATIC_DRAW);
+		boundBuffer.Fill(&bounds[0],int(bounds.size()));
+
+		std::vector<int> commandMeshes(_commandMeshes);
+		commandMeshBuffer.Allocate(count,GL_STATIC_DRAW);
+		commandMeshBuffer.Fill(&commandMeshes[0],count);
+
+		// Commands are rewritten by the pass, the base instance of a
+		// command selects its mask
+		for(int i=0;i<count;++i)
+			_commands[i].baseInstance = i;
+		commands.Allocate(count,GL_DYNAMIC_DRAW);
+		commands.Fill(&_commands[0],count);
+		masks.Allocate(count,GL_DYNAMIC_DRAW);
+
+		// Everything is drawn by the first phase of the first frame
+		std::vector<unsigned int> visibles(count,1);
+		visibility.Allocate(count,GL_DYNAMIC_DRAW);
+		visibility.Fill(&visibles[0],count);
+
+		// Texture views of the buffers
+		GLuint textures[5]	= {boundTexID,commandMeshTexID,commandTexID,maskTexID,visibilityTexID};
+		GLenum formats[5]	= {GL_RGBA32F,GL_R32I,GL_R32UI,GL_R32UI,GL_R32UI};
+		GLuint buffers[5]	= {boundBuffer.id,commandMeshBuffer.id,commands.id,masks.id,visibility.id};
+		for(int i=0;i<5;++i)
+		{
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+		glf::CheckError("GPUCuller::Set");
+	}
+	//--------------------------------------------------------------------------
+	void GPUCuller::Cull(				const Frustum* _volumes,
+										int _nVolumes)
+	{
+		Run(VOLUMES,_volumes,_nVolumes);
+	}
+	//--------------------------------------------------------------------------
+	void GPUCuller::CullPrevious(		const Frustum& _frustum)
+	{
+		Run(PREVIOUS,&_frustum,1);
+	}
+	//--------------------------------------------------------------------------
+	void GPUCuller::CullOccluded(		const Frustum& _frustum,
+										const glm::mat4& _viewProj,
+										const Texture2D& _hizTex)
+	{
+		if(count==0)
+			return;
+		glProgramUniformMatrix4fv(program.id, viewProjVar, 1, GL_FALSE, &_viewProj[0][0]);
+		glProgramUniform1i(program.id, hizLevelsVar, _hizTex.levels);
+		_hizTex.Bind(hizTexUnit);
+		Run(OCCLUSION,&_frustum,1);
+	}
+	//--------------------------------------------------------------------------
+	void GPUCuller::SetBaseInstance(	int _base)
+	{
+		if(count==0)
+			return;
+		glProgramUniform1i(program.id, baseInstanceVar, _base);
+	}
+	//--------------------------------------------------------------------------
+	void GPUCuller::Run(				Mode _mode,
+										const Frustum* _volumes,
+										int _nVolumes)
+	{
+		assert(_nVolumes<=MAX_CULLING_VOLUMES);
+		if(count==0)
+			return;
+
+		glUseProgram(program.id);
+		glProgramUniform4fv(program.id, planesVar, 6*_nVolumes, &_volumes[0].planes[0][0]);
+		glProgramUniform1i(program.id, nVolumesVar, _nVolumes);
+		glProgramUniform1i(program.id, modeVar, int(_mode));
+
+		glActiveTexture(GL_TEXTURE0 + boundTexUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, boundTexID);
+		glActiveTexture(GL_TEXTURE0 + commandMeshTexUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, commandMeshTexID);
+		glBindImageTexture(commandImageUnit, commandTexID, 0, false, 0, GL_WRITE_ONLY, GL_R32UI);
+		glBindImageTexture(maskImageUnit,    maskTexID,    0, false, 0, GL_WRITE_ONLY, GL_R32UI);
+		glBindImageTexture(visibilityImageUnit, visibilityTexID, 0, false, 0, GL_READ_WRITE, GL_R32UI);
+
+		glEnable(GL_RASTERIZER_DISCARD);
+		vao.Draw(GL_POINTS,count,0);
+		glDisable(GL_RASTERIZER_DISCARD);
+		lastMode = _mode;
+
+		// Commands and masks are read by the following draws, visibility by
+		// the next culling pass
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glf::CheckError("GPUCuller::Cull");
+	}
+	//--------------------------------------------------------------------------
+	void GPUCuller::ReadVisibles()
+	{
+		if(count==0)
+			return;
+
+		// A copy still in flight after CULLING_READBACK_FRAMES frames is
+		// dropped
+		current = (current + 1) % CULLING_READBACK_FRAMES;
+		Readback& readback = readbacks[current];
+		if(readback.fence!=0)
+			glDeleteSync(readback.fence);
+		if(readback.buffer.count<count)
+			readback.buffer.Allocate(count,GL_STREAM_READ);
+
+		const VertexBuffer<unsigned int>::Buffer& source = lastMode==OCCLUSION ? visibility : masks;
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_COPY_READ_BUFFER,source.id);
+		glBindBuffer(GL_COPY_WRITE_BUFFER,readback.buffer.id);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,0,count*sizeof(unsigned int));
+		glBindBuffer(GL_COPY_READ_BUFFER,0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER,0);
+		readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+		glf::CheckError("GPUCuller::ReadVisibles");
+	}
+	//--------------------------------------------------------------------------
+	int GPUCuller::Visibles()
+	{
+		// Newest first, the older copies are dropped once a newer one is
+		// read
+		for(int i=0;i<CULLING_READBACK_FRAMES;++i)
+		{
+			Readback& readback = readbacks[(current - i + CULLING_READBACK_FRAMES) % CULLING_READBACK_FRAMES];
+			if(readback.fence==0)
+				continue;
+			GLenum status = glClientWaitSync(readback.fence,0,0);
+			if(status!=GL_ALREADY_SIGNALED && status!=GL_CONDITION_SATISFIED)
+				continue;
+
+			int n = std::min(count,readback.buffer.count);
+			const unsigned int* data = readback.buffer.Lock(GL_READ_ONLY);
+			nVisibles = 0;
+			for(int c=0;c<n;++c)
+				nVisibles += data[c]!=0 ? 1 : 0;
+			readback.buffer.Unlock();
+
+			for(int j=i;j<CULLING_READBACK_FRAMES;++j)
+			{
+				Readback& older = readbacks[(current - j + CULLING_READBACK_FRAMES) % CULLING_READBACK_FRAMES];
+				if(older.fence!=0)
+					glDeleteSync(older.fence);
+				older.fence = 0;
+			}
+			glf::CheckError("GPUCuller::Visibles");
+			break;
+		}
+		return nVisibles;
+	}
+}
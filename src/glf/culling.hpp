@@ -0,0 +1,129 @@
+#ifndef GLF_CULLING_HPP
+#define GLF_CULLING_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/bound.hpp>
+#include <glf/buffer.hpp>
+#include <glf/wrapper.hpp>
+#include <glf/texture.hpp>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+// Maximum number of frustums tested by one GPU culling pass (CSM cascades)
+#define MAX_CULLING_VOLUMES				4
+// Visible counts of the GPU culling in flight
+#define CULLING_READBACK_FRAMES			3
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	// Bounding boxes stored as structure of arrays, padded to a multiple of 4
+	// so that the culling kernel tests 4 boxes at once with SSE. Padding
+	// boxes are empty and never reported as visible
+	class BoundsSoA
+	{
+	public:
+										BoundsSoA();
+		void							Set(			const std::vector<BBox>& _bounds);
+		int								Count() const;
+
+		// Appends the indices of the boxes intersecting the frustum in
+		// increasing order and returns their number (same conservative test
+		// as Intersect(Frustum,BBox))
+		int								Cull(			const Frustum& _frustum,
+														std::vector<int>& _visibles) const;
+	private:
+		int								count;
+		std::vector<float>				pMin[3];
+		std::vector<float>				pMax[3];
+	};
+	//--------------------------------------------------------------------------
+	// GPU culling of indirect commands, without any per object CPU work.
+	// A vertex only pass runs once per command and rewrites its instance
+	// count with the number of volumes its mesh bound intersects (0 when
+	// culled). The volume mask of each command is written alongside, at the
+	// index given by its base instance.
+	// Occlusion culling is done in two phases against a single frustum :
+	// CullPrevious keeps the commands visible at the previous frame, then
+	// CullOccluded keeps the visible commands not drawn by the first phase
+	// according to a Hi-Z buffer of the first phase depth.
+	// The number of visible commands is read back without waiting (see
+	// SampleDistribution), for the statistics only
+	class GPUCuller
+	{
+	public:
+										GPUCuller();
+										~GPUCuller();
+		// Uploads the mesh bounds and the commands to cull. _commandMeshes
+		// gives the mesh of each command
+		void							Set(			const std::vector<BBox>& _bounds,
+														const std::vector<int>& _commandMeshes,
+														std::vector<DrawElementsIndirectCommand>& _commands);
+		int								Count() const;
+		void							Cull(			const Frustum* _volumes,
+														int _nVolumes);
+		void							CullPrevious(	const Frustum& _frustum);
+		void							CullOccluded(	const Frustum& _frustum,
+														const glm::mat4& _viewProj,
+														const Texture2D& _hizTex);
+		// Offset added to the base instance written for each command, 0 by
+		// default. Masks stay at the command index, so draws reading the
+		// masks keep a null offset
+		void							SetBaseInstance(int _base);
+		// Copies the visibility of the last pass (volume masks, or the
+		// occlusion visibility after CullOccluded) for a later Visibles
+		void							ReadVisibles(	);
+		// Visible commands of the newest copy which arrived, -1 if none did
+		int								Visibles(		);
+	private:
+		enum Mode						{ VOLUMES, PREVIOUS, OCCLUSION };	// See meshculling.vs
+		void							Run(			Mode _mode,
+														const Frustum* _volumes,
+														int _nVolumes);
+										GPUCuller(		const GPUCuller&);
+		GPUCuller&						operator=(		const GPUCuller&);
+	public:
+		IndirectElementBuffer			commands;
+		VertexBuffer<unsigned int>::Buffer masks;	// Volume mask of each command
+		VertexBuffer<unsigned int>::Buffer visibility;// Visibility at the last occlusion phase
+	private:
+		int								count;
+		Program							program;
+		GLint							planesVar;
+		GLint							nVolumesVar;
+		GLint							modeVar;
+		GLint							viewProjVar;
+		GLint							hizLevelsVar;
+		GLint							baseInstanceVar;
+		GLint							hizTexUnit;
+		GLint							visibilityImageUnit;
+		GLint							boundTexUnit;
+		GLint							commandMeshTexUnit;
+		GLint							commandImageUnit;
+		GLint							maskImageUnit;
+		VertexBuffer4F					boundBuffer;
+		VertexBuffer<int>::Buffer		commandMeshBuffer;
+		GLuint							boundTexID;
+		GLuint							commandMeshTexID;
+		GLuint							commandTexID;
+		GLuint							maskTexID;
+		GLuint							visibilityTexID;
+		VertexArray						vao;			// Empty, vertices are only indices
+
+		struct Readback
+		{
+			VertexBuffer<unsigned int>::Buffer buffer;
+			GLsync						fence;			// 0 if read or dropped
+		};
+		Mode							lastMode;
+		Readback						readbacks[CULLING_READBACK_FRAMES];
+		int								current;		// Readback of the last copy
+		int								nVisibles;
+	};
+}
+
+#endif
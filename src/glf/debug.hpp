@@ -17,6 +17,19 @@
 //------------------------------------------------------------------------------
 #define ENABLE_CHECK_MODEL_LOADING		0
 #define ENABLE_LOAD_NORMAL_MAP			1
+#define ENABLE_MESH_OPTIMIZATION		1
+#define ENABLE_GEOMETRY_ARENA			1
+#define ENABLE_FRUSTUM_CULLING			1
+#define ENABLE_CASTER_CULLING			1
+#define ENABLE_GPU_CULLING				1
+#define ENABLE_OCCLUSION_CULLING		1
+#define ENABLE_RENDER_QUEUE				1
+#define ENABLE_TERRAIN_CULLING			1
+#define ENABLE_TERRAIN_CAPTURE			1
+#define ENABLE_PAGED_TERRAIN			1
+#define ENABLE_CSM_CACHE				1
+#define ENABLE_SDSM						1
+#define ENABLE_SHADOW_ATLAS				1
 #define ENABLE_ANISOSTROPIC_FILTERING	1
 //------------------------------------------------------------------------------
 #define ENABLE_LIGHTING_ONLY			0
@@ -33,6 +46,14 @@
 #define ENABLE_ASSERT_ON_ERROR			1
 #define ENABLE_EXIT_ON_ERROR			1
 
+// GPU culling replaces the CPU culling of the indirect commands
+#if (ENABLE_GPU_CULLING && !ENABLE_GEOMETRY_ARENA)
+#	error("GPU culling needs the geometry arena")
+#endif
+#if (ENABLE_OCCLUSION_CULLING && !ENABLE_GPU_CULLING)
+#	error("Occlusion culling is done by the GPU culling pass")
+#endif
+
 namespace glf
 {
 	namespace manager
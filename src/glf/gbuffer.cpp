@@ -3,14 +3,76 @@
 //------------------------------------------------------------------------------
 #include <glf/gbuffer.hpp>
 #include <glf/geometry.hpp>
+#include <glf/debug.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
+#include <algorithm>
 
 namespace glf
 {
+	namespace
+	{
+		//----------------------------------------------------------------------
+		// Per draw attributes of the render queue draws without records
+		struct RegularDrawState
+		{
+			const SceneManager*				scene;
+			std::vector<const RegularMesh*>	meshes;	// Of the instanced draws
+		};
+		//----------------------------------------------------------------------
+		// Generic attribute values, read by the draws when the attribute
+		// arrays are disabled
+		void SetGenericMaterial(			const RegularMesh& _mesh)
+		{
+			glVertexAttrib4f(semantic::Material, _mesh.roughness, _mesh.specularity, 0.f, 0.f);
+		}
+		//----------------------------------------------------------------------
+		void SetGenericModel(				const glm::mat4& _model)
+		{
+			for(int c=0;c<4;++c)
+				glVertexAttrib4fv(semantic::Model+c, &_model[c][0]);
+		}
+		//----------------------------------------------------------------------
+		void SetRegularState(				int _mesh,
+											void* _data)
+		{
+			const RegularDrawState& state = *(const RegularDrawState*)_data;
+			SetGenericModel(state.scene->transformations[_mesh]);
+			SetGenericMaterial(state.scene->regularMeshes[_mesh]);
+		}
+		//----------------------------------------------------------------------
+		void SetInstancedState(				int _mesh,
+											void* _data)
+		{
+			const RegularDrawState& state = *(const RegularDrawState*)_data;
+			SetGenericMaterial(*state.meshes[_mesh]);
+		}
+		//----------------------------------------------------------------------
+		// Queued draw of a regular mesh, with its material textures and its
+		// view depth
+		void PushRegular(					RenderQueue& _queue,
+											RenderQueue::Draw _draw,
+											const GBuffer::RegularRenderer& _renderer,
+											const RegularMesh& _mesh,
+											const BBox& _bound,
+											const glm::mat4& _transform)
+		{
+			_draw.textures[0] = _mesh.diffuseTex;
+			_draw.units[0]    = _renderer.diffuseTexUnit;
+			_draw.textures[1] = _mesh.normalTex;
+			_draw.units[1]    = _renderer.normalTexUnit;
+			glm::vec4 center  = _transform * glm::vec4((_bound.pMin+_bound.pMax)*0.5f,1.f);
+			_queue.Push(0,center.w,_draw);
+		}
+	}
 	//--------------------------------------------------------------------------
 	GBuffer::GBuffer(				unsigned int _width, 
-									unsigned int _height)
+									unsigned int _height):
+	regularRenderer("GBuffer::Regular"),
+	instancedRenderer("GBuffer::Instanced"),
+	hizBuffer(NULL),
+	useRecords(DrawRecordRing::Supported() && (ENABLE_GEOMETRY_ARENA || ENABLE_RENDER_QUEUE)),
+	nInstancedArrays(0)
 	{
 		// Initialize G-Buffer textures
 		positionTex.Allocate(GL_RGBA32F,_width,_height);
@@ -51,24 +113,28 @@ namespace glf
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
-		// Program regular mesh
-		ProgramOptions regularOptions = ProgramOptions::CreateVSOptions();
-		regularOptions.AddDefine<int>("GBUFFER",				1);
-		regularOptions.AddDefine<int>("OUT_POSITION",			outPosition);
-		regularOptions.AddDefine<int>("OUT_DIFFUSE_SPECULAR",	outDiffuseSpecular);
-		regularOptions.AddDefine<int>("OUT_NORMAL_ROUGHNESS",	outNormalRoughness);
-		regularRenderer.program.Compile(regularOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.vs")),
+		// Programs regular mesh, without and with instancing
+		RegularRenderer* renderers[2] = {&regularRenderer,&instancedRenderer};
+		for(int r=0;r<2;++r)
+		{
+			RegularRenderer& renderer = *renderers[r];
+			ProgramOptions regularOptions = ProgramOptions::CreateVSOptions();
+			regularOptions.AddDefine<int>("GBUFFER",				1);
+			regularOptions.AddDefine<int>("OUT_POSITION",			outPosition);
+			regularOptions.AddDefine<int>("OUT_DIFFUSE_SPECULAR",	outDiffuseSpecular);
+			regularOptions.AddDefine<int>("OUT_NORMAL_ROUGHNESS",	outNormalRoughness);
+			if(r==1)
+				regularOptions.AddDefine<int>("INSTANCED",			1);
+			regularOptions.Include(LoadFile(directory::ShaderDirectory + "frame.glsl"));
+			renderer.program.Compile(	regularOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.vs")),
 										regularOptions.Append(LoadFile(directory::ShaderDirectory + "meshregular.fs")));
 
-		regularRenderer.transformVar	= regularRenderer.program["Transform"].location;
-		regularRenderer.modelVar		= regularRenderer.program["Model"].location;
-		regularRenderer.diffuseTexUnit	= regularRenderer.program["DiffuseTex"].unit;
-		regularRenderer.normalTexUnit	= regularRenderer.program["NormalTex"].unit;
-		regularRenderer.roughnessVar	= regularRenderer.program["Roughness"].location;
-		regularRenderer.specularityVar	= regularRenderer.program["Specularity"].location;
+			renderer.diffuseTexUnit	= renderer.program["DiffuseTex"].unit;
+			renderer.normalTexUnit	= renderer.program["NormalTex"].unit;
 
-		glProgramUniform1i(regularRenderer.program.id, regularRenderer.program["DiffuseTex"].location, regularRenderer.diffuseTexUnit);
-		glProgramUniform1i(regularRenderer.program.id, regularRenderer.program["NormalTex"].location,  regularRenderer.normalTexUnit);
+			glProgramUniform1i(renderer.program.id, renderer.program["DiffuseTex"].location, renderer.diffuseTexUnit);
+			glProgramUniform1i(renderer.program.id, renderer.program["NormalTex"].location,  renderer.normalTexUnit);
+		}
 
 
 		// Program terrain mesh
@@ -77,15 +143,16 @@ namespace glf
 		terrainOptions.AddDefine<int>("OUT_POSITION",			outPosition);
 		terrainOptions.AddDefine<int>("OUT_DIFFUSE_SPECULAR",	outDiffuseSpecular);
 		terrainOptions.AddDefine<int>("OUT_NORMAL_ROUGHNESS",	outNormalRoughness);
+		terrainOptions.Include(LoadFile(directory::ShaderDirectory + "frame.glsl"));
 		terrainRenderer.program.Compile(terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.vs")),
 										terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.cs")),
 										terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.es")),
 										terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.fs")));
 
-		terrainRenderer.transformVar	= terrainRenderer.program["Transform"].location;
 		terrainRenderer.diffuseTexUnit	= terrainRenderer.program["DiffuseTex"].unit;
 		terrainRenderer.normalTexUnit	= terrainRenderer.program["NormalTex"].unit;
 		terrainRenderer.heightTexUnit	= terrainRenderer.program["HeightTex"].unit;
+		terrainRenderer.occlusionTexUnit= terrainRenderer.program["OcclusionTex"].unit;
 		terrainRenderer.roughnessVar	= terrainRenderer.program["Roughness"].location;
 		terrainRenderer.specularityVar	= terrainRenderer.program["Specularity"].location;
 
@@ -100,72 +167,495 @@ namespace glf
 		glProgramUniform1i(terrainRenderer.program.id, terrainRenderer.program["DiffuseTex"].location, terrainRenderer.diffuseTexUnit);
 		glProgramUniform1i(terrainRenderer.program.id, terrainRenderer.program["NormalTex"].location,  terrainRenderer.normalTexUnit);
 		glProgramUniform1i(terrainRenderer.program.id, terrainRenderer.program["HeightTex"].location,  terrainRenderer.heightTexUnit);
+		glProgramUniform1i(terrainRenderer.program.id, terrainRenderer.program["OcclusionTex"].location, terrainRenderer.occlusionTexUnit);
+
+		// Program of the captured terrain meshes, same fragment stage
+		terrainOptions.AddDefine<int>("CAPTURED",				1);
+		capturedRenderer.program.Compile(	terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.vs")),
+											terrainOptions.Append(LoadFile(directory::ShaderDirectory + "meshterrain.fs")));
+
+		capturedRenderer.diffuseTexUnit	= capturedRenderer.program["DiffuseTex"].unit;
+		capturedRenderer.normalTexUnit	= capturedRenderer.program["NormalTex"].unit;
+		capturedRenderer.occlusionTexUnit= capturedRenderer.program["OcclusionTex"].unit;
+		capturedRenderer.roughnessVar	= capturedRenderer.program["Roughness"].location;
+		capturedRenderer.specularityVar	= capturedRenderer.program["Specularity"].location;
+		capturedRenderer.tileFactorVar	= capturedRenderer.program["TileFactor"].location;
+
+		glProgramUniform1i(capturedRenderer.program.id, capturedRenderer.program["DiffuseTex"].location, capturedRenderer.diffuseTexUnit);
+		glProgramUniform1i(capturedRenderer.program.id, capturedRenderer.program["NormalTex"].location,  capturedRenderer.normalTexUnit);
+		glProgramUniform1i(capturedRenderer.program.id, capturedRenderer.program["OcclusionTex"].location, capturedRenderer.occlusionTexUnit);
+
+		// Program of the paged terrains
+		ProgramOptions pagedOptions = ProgramOptions::CreateVSOptions();
+		pagedOptions.AddDefine<int>("GBUFFER",					1);
+		pagedOptions.AddDefine<int>("OUT_POSITION",				outPosition);
+		pagedOptions.AddDefine<int>("OUT_DIFFUSE_SPECULAR",		outDiffuseSpecular);
+		pagedOptions.AddDefine<int>("OUT_NORMAL_ROUGHNESS",		outNormalRoughness);
+		pagedOptions.Include(LoadFile(directory::ShaderDirectory + "frame.glsl"));
+		pagedRenderer.program.Compile(	pagedOptions.Append(LoadFile(directory::ShaderDirectory + "pagedterrain.vs")),
+										pagedOptions.Append(LoadFile(directory::ShaderDirectory + "pagedterrain.fs")));
+
+		pagedRenderer.heightPagesUnit	= pagedRenderer.program["HeightPages"].unit;
+		pagedRenderer.diffusePagesUnit	= pagedRenderer.program["DiffusePages"].unit;
+		pagedRenderer.roughnessVar		= pagedRenderer.program["Roughness"].location;
+		pagedRenderer.specularityVar	= pagedRenderer.program["Specularity"].location;
+		pagedRenderer.terrainOffsetVar	= pagedRenderer.program["TerrainOffset"].location;
+		pagedRenderer.terrainSizeVar	= pagedRenderer.program["TerrainSize"].location;
+		pagedRenderer.heightFactorVar	= pagedRenderer.program["HeightFactor"].location;
+		pagedRenderer.gridResolutionVar	= pagedRenderer.program["GridResolution"].location;
+		pagedRenderer.pageSizeVar		= pagedRenderer.program["PageSize"].location;
+
+		glProgramUniform1i(pagedRenderer.program.id, pagedRenderer.program["HeightPages"].location,  pagedRenderer.heightPagesUnit);
+		glProgramUniform1i(pagedRenderer.program.id, pagedRenderer.program["DiffusePages"].location, pagedRenderer.diffusePagesUnit);
 
 		glf::CheckError("GBuffer::GBuffer");
 	}
 	//--------------------------------------------------------------------------
 	GBuffer::~GBuffer()
 	{
+		delete hizBuffer;
 		glDeleteFramebuffers(1,&framebuffer);
 	}	
 	//--------------------------------------------------------------------------
-	void GBuffer::Draw(				const glm::mat4& _projection,
-									const glm::mat4& _view,
+	void GBuffer::UpdateGPUCuller(	const SceneManager& _scene)
+	{
+		if(gpuCuller.Count()!=int(_scene.regularCommandMeshes.size()))
+		{
+			std::vector<DrawElementsIndirectCommand> commands;
+			IndirectCommands(_scene.regularMeshes,_scene.regularCommandMeshes,commands);
+			gpuCuller.Set(_scene.oBounds,_scene.regularCommandMeshes,commands);
+		}
+		if(useRecords)
+			gpuCuller.SetBaseInstance(drawRecords.Base());
+	}
+	//--------------------------------------------------------------------------
+	void GBuffer::CountGPUVisibles()
+	{
+		gpuCuller.ReadVisibles();
+		int nVisibles = gpuCuller.Visibles();
+		if(nVisibles>=0)
+		{
+			glf::manager::timings->SetCounter(counter::GbufferVisible,nVisibles);
+			glf::manager::timings->SetCounter(counter::GbufferCulled,gpuCuller.Count()-nVisibles);
+		}
+	}
+	//--------------------------------------------------------------------------
+	void GBuffer::UpdateRecords(	const SceneManager& _scene)
+	{
+		int nMeshes = int(_scene.regularMeshes.size());
+		DrawRecord* records = drawRecords.Map(nMeshes);
+		for(int r=0;r<nMeshes;++r)
+		{
+			#if ENABLE_GEOMETRY_ARENA
+			int m = _scene.regularCommandMeshes[r];
+			#else
+			int m = r;
+			#endif
+			const RegularMesh& mesh = _scene.regularMeshes[m];
+			records[r].model		= _scene.transformations[m];
+			records[r].material		= glm::vec4(mesh.roughness,mesh.specularity,float(m),0.f);
+		}
+		drawRecords.Unmap();
+
+		// Arrays of the records are set once, draws add the base of the frame
+		if(recordPrimitives.empty())
+		{
+			for(int i=0;i<nMeshes;++i)
+				recordPrimitives.push_back(_scene.regularMeshes[i].primitive);
+			std::sort(recordPrimitives.begin(),recordPrimitives.end());
+			recordPrimitives.erase(std::unique(recordPrimitives.begin(),recordPrimitives.end()),recordPrimitives.end());
+			for(unsigned int i=0;i<recordPrimitives.size();++i)
+				drawRecords.Bind(*recordPrimitives[i]);
+		}
+
+		#if ENABLE_GEOMETRY_ARENA && !(ENABLE_FRUSTUM_CULLING || ENABLE_GPU_CULLING)
+		// Scene commands select the records of the first region : they are
+		// copied with the base of the frame
+		visibleCommands.resize(nMeshes);
+		for(int c=0;c<nMeshes;++c)
+		{
+			visibleCommands[c] = IndirectCommand(_scene.regularMeshes[_scene.regularCommandMeshes[c]]);
+			visibleCommands[c].baseInstance = drawRecords.Base() + c;
+		}
+		if(visibleCommandBuffer.count<nMeshes)
+			visibleCommandBuffer.Allocate(nMeshes,GL_STREAM_DRAW);
+		visibleCommandBuffer.Fill(&visibleCommands[0],nMeshes);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	void GBuffer::Cull(				const glm::mat4& _transform,
 									const SceneManager& _scene)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		#if ENABLE_GPU_CULLING
+		// Instance counts of the scene commands are rewritten on the GPU
+		UpdateGPUCuller(_scene);
+		Frustum frustum = ExtractFrustum(_transform);
+		gpuCuller.Cull(&frustum,1);
+		CountGPUVisibles();
+		return;
+		#endif
 
-		glm::mat4 transform = _projection * _view;
+		if(meshBounds.Count()!=int(_scene.oBounds.size()))
+			meshBounds.Set(_scene.oBounds);
 
-		int nMeshes = int(_scene.regularMeshes.size());
-		if(nMeshes>0)
+		visibleMeshes.clear();
+		int nMeshes   = int(_scene.regularMeshes.size());
+		int nVisibles = meshBounds.Cull(ExtractFrustum(_transform),visibleMeshes);
+		glf::manager::timings->SetCounter(counter::GbufferVisible,nVisibles);
+		glf::manager::timings->SetCounter(counter::GbufferCulled,nMeshes-nVisibles);
+
+		#if ENABLE_GEOMETRY_ARENA
+		// Keeps the visible commands of each batch, batches are unchanged
+		// apart from their command range
+		visibleFlags.assign(nMeshes,0);
+		for(unsigned int i=0;i<visibleMeshes.size();++i)
+			visibleFlags[visibleMeshes[i]] = 1;
+
+		visibleBatches.clear();
+		visibleCommands.clear();
+		for(unsigned int b=0;b<_scene.regularBatches.size();++b)
 		{
-			// Render at the same resolution than the original window
-			// Draw all objects
-			glUseProgram(regularRenderer.program.id);
-			glProgramUniformMatrix4fv(regularRenderer.program.id, regularRenderer.transformVar,  1, GL_FALSE, &transform[0][0]);
-			for(int i=0;i<nMeshes;++i)
+			MeshBatch batch     = _scene.regularBatches[b];
+			batch.firstCommand  = int(visibleCommands.size());
+			int lastCommand     = _scene.regularBatches[b].firstCommand + _scene.regularBatches[b].countCommands;
+			for(int c=_scene.regularBatches[b].firstCommand;c<lastCommand;++c)
+			{
+				int mesh = _scene.regularCommandMeshes[c];
+				if(visibleFlags[mesh])
+				{
+					visibleCommands.push_back(IndirectCommand(_scene.regularMeshes[mesh]));
+					if(useRecords)
+						visibleCommands.back().baseInstance = drawRecords.Base() + c;
+				}
+			}
+			batch.countCommands = int(visibleCommands.size()) - batch.firstCommand;
+			if(batch.countCommands>0)
+				visibleBatches.push_back(batch);
+		}
+
+		// Respecified every frame, which orphans the previous storage
+		if(!visibleCommands.empty())
+		{
+			if(visibleCommandBuffer.count<nMeshes)
+				visibleCommandBuffer.Allocate(nMeshes,GL_STREAM_DRAW);
+			visibleCommandBuffer.Fill(&visibleCommands[0],int(visibleCommands.size()));
+		}
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	void GBuffer::DrawRegulars(		const glm::mat4& _transform,
+									const SceneManager& _scene)
+	{
+		// Render at the same resolution than the original window
+		// Draw all objects
+		// The render queue binds the program at its first draw
+		#if !ENABLE_RENDER_QUEUE
+		glUseProgram(regularRenderer.program.id);
+		#endif
+		#if ENABLE_GEOMETRY_ARENA
+		// One multi draw per material and transformation
+		#if ENABLE_GPU_CULLING
+		const std::vector<MeshBatch>& batches = _scene.regularBatches;
+		const IndirectElementBuffer& commands = gpuCuller.commands;
+		#elif ENABLE_FRUSTUM_CULLING
+		const std::vector<MeshBatch>& batches = visibleBatches;
+		const IndirectElementBuffer& commands = visibleCommandBuffer;
+		#else
+		const std::vector<MeshBatch>& batches = _scene.regularBatches;
+		const IndirectElementBuffer& commands = useRecords ? visibleCommandBuffer : *_scene.regularCommands;
+		#endif
+		#if ENABLE_RENDER_QUEUE
+		// Bound of the first mesh of a batch, which share their transformation
+		for(unsigned int b=0;b<batches.size();++b)
+		{
+			const MeshBatch& batch  = batches[b];
+			BBox bound = Transform(_scene.oBounds[batch.mesh],_scene.transformations[batch.mesh]);
+			PushRegular(queue,QueueDraw(batch,commands,regularRenderer.program.id),regularRenderer,_scene.regularMeshes[batch.mesh],bound,_transform);
+		}
+		#else
+		for(unsigned int b=0;b<batches.size();++b)
+		{
+			const MeshBatch& batch  = batches[b];
+			const RegularMesh& mesh = _scene.regularMeshes[batch.mesh];
+			// Meshes of a batch share their transformation and material
+			if(!useRecords)
 			{
-				const RegularMesh& mesh = _scene.regularMeshes[i];
-				glProgramUniformMatrix4fv(regularRenderer.program.id, regularRenderer.modelVar,  1, GL_FALSE, &_scene.transformations[i][0][0]);
-				glProgramUniform1f(regularRenderer.program.id, regularRenderer.roughnessVar,   mesh.roughness);
-				glProgramUniform1f(regularRenderer.program.id, regularRenderer.specularityVar, mesh.specularity);
-
-				mesh.diffuseTex->Bind(regularRenderer.diffuseTexUnit);
-				mesh.normalTex->Bind(regularRenderer.normalTexUnit);
-				mesh.Draw();
+				SetGenericModel(_scene.transformations[batch.mesh]);
+				SetGenericMaterial(mesh);
 			}
-			glf::CheckError("GBuffer::Draw::Regulars");
+
+			mesh.diffuseTex->Bind(regularRenderer.diffuseTexUnit);
+			mesh.normalTex->Bind(regularRenderer.normalTexUnit);
+			batch.primitive->MultiDrawElements(GL_TRIANGLES,batch.indexType,commands,batch.firstCommand,batch.countCommands);
 		}
+		#endif
+		#else
+		#if ENABLE_FRUSTUM_CULLING
+		for(unsigned int v=0;v<visibleMeshes.size();++v)
+		{
+			int i = visibleMeshes[v];
+		#else
+		for(int i=0;i<int(_scene.regularMeshes.size());++i)
+		{
+		#endif
+			const RegularMesh& mesh = _scene.regularMeshes[i];
+			#if ENABLE_RENDER_QUEUE
+			RenderQueue::Draw draw = QueueDraw(mesh,regularRenderer.program.id,i);
+			if(useRecords)
+				draw.baseInstance = drawRecords.Base() + i;
+			PushRegular(queue,draw,regularRenderer,mesh,_scene.oBounds[i],_transform * _scene.transformations[i]);
+			#else
+			SetGenericModel(_scene.transformations[i]);
+			SetGenericMaterial(mesh);
 
-		int nTerrains = int(_scene.terrainMeshes.size());
-		if(nTerrains>0)
+			mesh.diffuseTex->Bind(regularRenderer.diffuseTexUnit);
+			mesh.normalTex->Bind(regularRenderer.normalTexUnit);
+			mesh.Draw();
+			#endif
+		}
+		#endif
+		#if ENABLE_RENDER_QUEUE
+		RegularDrawState state;
+		state.scene    = &_scene;
+		queue.Submit(useRecords ? NULL : SetRegularState,&state);
+		#endif
+		glf::CheckError("GBuffer::Draw::Regulars");
+	}
+	//--------------------------------------------------------------------------
+	void GBuffer::DrawTerrains(		const glm::mat4& _transform,
+									const SceneManager& _scene,
+									const TerrainCapture* _capture)
+	{
+		// Tiles of the view were culled and tessellated by the capture
+		if(_capture!=NULL)
 		{
-			// Render at the same resolution than the original window
-			// Draw all objects
-			glUseProgram(terrainRenderer.program.id);
-			glProgramUniformMatrix4fv(terrainRenderer.program.id, terrainRenderer.transformVar,  1, GL_FALSE, &transform[0][0]);
-			for(int i=0;i<nTerrains;++i)
+			glUseProgram(capturedRenderer.program.id);
+			for(unsigned int i=0;i<_scene.terrainMeshes.size();++i)
 			{
 				const TerrainMesh& mesh = _scene.terrainMeshes[i];
-				glProgramUniform3f(terrainRenderer.program.id, terrainRenderer.tileOffsetVar,	mesh.tileOffset.x, mesh.tileOffset.y, mesh.tileOffset.z);
-				glProgramUniform2i(terrainRenderer.program.id, terrainRenderer.tileCountVar,	mesh.tileCount.x, mesh.tileCount.y);
-				glProgramUniform2f(terrainRenderer.program.id, terrainRenderer.tileSizeVar,		mesh.tileSize.x, mesh.tileSize.y);
-				glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.tessFactorVar,	mesh.tessFactor);
-				glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.heightFactorVar,	mesh.heightFactor);
-				glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.projFactorVar,	mesh.projFactor);
-				glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.roughnessVar,	mesh.roughness);
-				glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.specularityVar,	mesh.specularity);
-				glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.tileFactorVar,	mesh.tileFactor);
-
-				mesh.diffuseTex->Bind(terrainRenderer.diffuseTexUnit);
-				mesh.normalTex->Bind(terrainRenderer.normalTexUnit);
-				mesh.heightTex->Bind(terrainRenderer.heightTexUnit);
-				mesh.Draw();
+				glProgramUniform1f(capturedRenderer.program.id, capturedRenderer.roughnessVar,	mesh.roughness);
+				glProgramUniform1f(capturedRenderer.program.id, capturedRenderer.specularityVar,	mesh.specularity);
+				glProgramUniform1f(capturedRenderer.program.id, capturedRenderer.tileFactorVar,	mesh.tileFactor);
+				mesh.diffuseTex->Bind(capturedRenderer.diffuseTexUnit);
+				mesh.normalTex->Bind(capturedRenderer.normalTexUnit);
+				mesh.occlusionTex->Bind(capturedRenderer.occlusionTexUnit);
+				_capture->Draw(i,false);
+			}
+			glf::CheckError("GBuffer::Draw::CapturedTerrains");
+			return;
+		}
+
+		// Render at the same resolution than the original window
+		// Draw all objects
+		Frustum frustum = ExtractFrustum(_transform);
+		int nTiles = terrainTiles.Cull(_scene.terrainMeshes,&frustum,1);
+		#if ENABLE_TERRAIN_CULLING
+		glf::manager::timings->SetCounter(counter::GbufferTerrainTiles,nTiles);
+		#endif
+		if(nTiles==0)
+			return;
+
+		glUseProgram(terrainRenderer.program.id);
+		for(unsigned int i=0;i<_scene.terrainMeshes.size();++i)
+		{
+			if(terrainTiles.Count(i)==0)
+				continue;
+			const TerrainMesh& mesh = _scene.terrainMeshes[i];
+			glProgramUniform3f(terrainRenderer.program.id, terrainRenderer.tileOffsetVar,	mesh.tileOffset.x, mesh.tileOffset.y, mesh.tileOffset.z);
+			glProgramUniform2i(terrainRenderer.program.id, terrainRenderer.tileCountVar,	mesh.tileCount.x, mesh.tileCount.y);
+			glProgramUniform2f(terrainRenderer.program.id, terrainRenderer.tileSizeVar,		mesh.tileSize.x, mesh.tileSize.y);
+			glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.tessFactorVar,	mesh.tessFactor);
+			glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.heightFactorVar,	mesh.heightFactor);
+			glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.projFactorVar,	mesh.projFactor);
+			glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.roughnessVar,	mesh.roughness);
+			glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.specularityVar,	mesh.specularity);
+			glProgramUniform1f(terrainRenderer.program.id, terrainRenderer.tileFactorVar,	mesh.tileFactor);
+
+			mesh.diffuseTex->Bind(terrainRenderer.diffuseTexUnit);
+			mesh.normalTex->Bind(terrainRenderer.normalTexUnit);
+			mesh.heightTex->Bind(terrainRenderer.heightTexUnit);
+			mesh.occlusionTex->Bind(terrainRenderer.occlusionTexUnit);
+			terrainTiles.Draw(mesh,i);
+		}
+		glf::CheckError("GBuffer::Draw::Terrains");
+	}
+	//--------------------------------------------------------------------------
+	void GBuffer::DrawPagedTerrains(const glm::mat4& _transform,
+									const SceneManager& _scene)
+	{
+		Frustum frustum = ExtractFrustum(_transform);
+		int nNodes = pagedNodes.Cull(_scene.pagedTerrains,&frustum,1);
+		#if ENABLE_PAGED_TERRAIN
+		glf::manager::timings->SetCounter(counter::GbufferPagedNodes,nNodes);
+		#endif
+		if(nNodes==0)
+			return;
+
+		glUseProgram(pagedRenderer.program.id);
+		for(unsigned int i=0;i<_scene.pagedTerrains.size();++i)
+		{
+			if(pagedNodes.Count(i)==0)
+				continue;
+			PagedTerrain& terrain = *_scene.pagedTerrains[i];
+			glProgramUniform3f(pagedRenderer.program.id, pagedRenderer.terrainOffsetVar,	terrain.terrainOffset.x, terrain.terrainOffset.y, terrain.terrainOffset.z);
+			glProgramUniform2f(pagedRenderer.program.id, pagedRenderer.terrainSizeVar,		terrain.terrainSize.x, terrain.terrainSize.y);
+			glProgramUniform1f(pagedRenderer.program.id, pagedRenderer.heightFactorVar,	terrain.heightFactor);
+			glProgramUniform1f(pagedRenderer.program.id, pagedRenderer.gridResolutionVar,	float(terrain.gridResolution));
+			glProgramUniform1f(pagedRenderer.program.id, pagedRenderer.pageSizeVar,		float(terrain.PageSize()));
+			glProgramUniform1f(pagedRenderer.program.id, pagedRenderer.roughnessVar,		terrain.roughness);
+			glProgramUniform1f(pagedRenderer.program.id, pagedRenderer.specularityVar,		terrain.specularity);
+
+			terrain.heightPages.Bind(pagedRenderer.heightPagesUnit);
+			terrain.diffusePages.Bind(pagedRenderer.diffusePagesUnit);
+			pagedNodes.Draw(terrain,i);
+		}
+		glf::CheckError("GBuffer::Draw::PagedTerrains");
+	}
+	//--------------------------------------------------------------------------
+	void GBuffer::DrawInstances(	const glm::mat4& _transform,
+									const SceneManager& _scene)
+	{
+		// Visible instances of all the models are streamed into one buffer
+		int nModels = int(_scene.instancedModels.size());
+		#if ENABLE_FRUSTUM_CULLING
+		Frustum frustum = ExtractFrustum(_transform);
+		#endif
+		instanceTransforms.clear();
+		instanceFirsts.resize(nModels+1);
+		for(int m=0;m<nModels;++m)
+		{
+			const InstancedModel& model = _scene.instancedModels[m];
+			instanceFirsts[m] = int(instanceTransforms.size());
+			for(unsigned int i=0;i<model.transforms.size();++i)
+			{
+				#if ENABLE_FRUSTUM_CULLING
+				if(!Intersect(frustum,model.bounds[i]))
+					continue;
+				#endif
+				instanceTransforms.push_back(model.transforms[i]);
 			}
-			glf::CheckError("GBuffer::Draw::Terrains");
 		}
+		instanceFirsts[nModels] = int(instanceTransforms.size());
+		if(instanceTransforms.empty())
+			return;
+
+		// Respecified every frame, which orphans the previous storage
+		int nInstances = int(instanceTransforms.size());
+		if(instanceBuffer.count<nInstances)
+			instanceBuffer.Allocate(nInstances,GL_STREAM_DRAW);
+		instanceBuffer.Fill(&instanceTransforms[0],nInstances);
+
+		// The arrays of the models read the buffer from its start, set once
+		for(;nInstancedArrays<nModels;++nInstancedArrays)
+			_scene.instancedModels[nInstancedArrays].meshes[0].primitive->AddInstancedMatrix(instanceBuffer,semantic::Model,0);
+
+		// One instanced draw per mesh, its base instance is the first
+		// transformation of its model
+		#if ENABLE_RENDER_QUEUE
+		RegularDrawState state;
+		state.scene    = &_scene;
+		#else
+		glUseProgram(instancedRenderer.program.id);
+		#endif
+		for(int m=0;m<nModels;++m)
+		{
+			int count = instanceFirsts[m+1] - instanceFirsts[m];
+			if(count==0)
+				continue;
+			const InstancedModel& model = _scene.instancedModels[m];
+			for(unsigned int i=0;i<model.meshes.size();++i)
+			{
+				const RegularMesh& mesh = model.meshes[i];
+				#if ENABLE_RENDER_QUEUE
+				// Instances are spread over the scene, they are only sorted
+				// by state
+				RenderQueue::Draw draw = QueueDraw(mesh,instancedRenderer.program.id,int(state.meshes.size()),count);
+				draw.baseInstance = instanceFirsts[m];
+				draw.textures[0] = mesh.diffuseTex;
+				draw.units[0]    = instancedRenderer.diffuseTexUnit;
+				draw.textures[1] = mesh.normalTex;
+				draw.units[1]    = instancedRenderer.normalTexUnit;
+				queue.Push(1,0.f,draw);
+				state.meshes.push_back(&mesh);
+				#else
+				SetGenericMaterial(mesh);
+
+				mesh.diffuseTex->Bind(instancedRenderer.diffuseTexUnit);
+				mesh.normalTex->Bind(instancedRenderer.normalTexUnit);
+				mesh.Draw(count,instanceFirsts[m]);
+				#endif
+			}
+		}
+		#if ENABLE_RENDER_QUEUE
+		queue.Submit(SetInstancedState,&state);
+		#endif
+		glf::CheckError("GBuffer::Draw::Instances");
+	}
+	//--------------------------------------------------------------------------
+	void GBuffer::Draw(				const glm::mat4& _projection,
+									const glm::mat4& _view,
+									const SceneManager& _scene,
+									const TerrainCapture* _capture)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+		glm::mat4 transform = _projection * _view;
+
+		bool hasMeshes   = !_scene.regularMeshes.empty();
+		bool hasTerrains = !_scene.terrainMeshes.empty();
+		bool hasInstances= !_scene.instancedModels.empty();
+		bool hasPaged    = !_scene.pagedTerrains.empty();
+
+		// Records of the frame, read by both occlusion phases
+		if(hasMeshes && useRecords)
+			UpdateRecords(_scene);
+
+		#if ENABLE_OCCLUSION_CULLING
+		// First phase : meshes visible at the previous frame, then instances
+		// and terrains which are the main occluders
+		Frustum frustum = ExtractFrustum(transform);
+		if(hasMeshes)
+		{
+			UpdateGPUCuller(_scene);
+			gpuCuller.CullPrevious(frustum);
+			DrawRegulars(transform,_scene);
+		}
+		if(hasInstances)
+			DrawInstances(transform,_scene);
+		if(hasTerrains)
+			DrawTerrains(transform,_scene,_capture);
+		if(hasPaged)
+			DrawPagedTerrains(transform,_scene);
+
+		// Second phase : meshes uncovered according to the first phase depth
+		if(hasMeshes)
+		{
+			if(hizBuffer==NULL)
+				hizBuffer = new HiZBuffer(depthTex.size.x,depthTex.size.y);
+			hizBuffer->Build(depthTex);
+			gpuCuller.CullOccluded(frustum,transform,hizBuffer->hizTex);
+			CountGPUVisibles();
+			glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+			DrawRegulars(transform,_scene);
+		}
+		#else
+		#if (ENABLE_FRUSTUM_CULLING || ENABLE_GPU_CULLING)
+		if(hasMeshes)
+			Cull(transform,_scene);
+		#endif
+		if(hasMeshes)
+			DrawRegulars(transform,_scene);
+		if(hasInstances)
+			DrawInstances(transform,_scene);
+		if(hasTerrains)
+			DrawTerrains(transform,_scene,_capture);
+		if(hasPaged)
+			DrawPagedTerrains(transform,_scene);
+		#endif
+
+		if(hasMeshes && useRecords)
+			drawRecords.Fence();
 
 		glBindFramebuffer(GL_FRAMEBUFFER,0);
 		glf::CheckError("GBuffer::Draw");
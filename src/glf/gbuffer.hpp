@@ -7,6 +7,9 @@
 #include <glf/utils.hpp>
 #include <glf/wrapper.hpp>
 #include <glf/scene.hpp>
+#include <glf/culling.hpp>
+#include <glf/hiz.hpp>
+#include <glf/constants.hpp>
 
 namespace glf
 {
@@ -20,21 +23,48 @@ namespace glf
 					GBuffer(			unsigned int _width, 
 										unsigned int _height);
 				   ~GBuffer(			);
+		// Draws the terrains captured by _capture for the frame, if any,
+		// instead of tessellating them
 		void 		Draw(				const glm::mat4& _projection,
 										const glm::mat4& _view,
+										const SceneManager& _scene,
+										const TerrainCapture* _capture=NULL);
+		// Builds the visible-index list of the regular meshes and, with the
+		// geometry arena, the batches and commands of the visible ones. With
+		// GPU culling, only runs the culling pass on the scene commands
+		void 		Cull(				const glm::mat4& _transform,
 										const SceneManager& _scene);
+		void		UpdateGPUCuller(	const SceneManager& _scene);
+		// Visible and culled counters from the GPU culling of a previous
+		// frame, read back without waiting
+		void		CountGPUVisibles(	);
+		void		DrawRegulars(		const glm::mat4& _transform,
+										const SceneManager& _scene);
+		void		DrawTerrains(		const glm::mat4& _transform,
+										const SceneManager& _scene,
+										const TerrainCapture* _capture);
+		// Draws the nodes of the paged terrains selected by their last
+		// update, culled with the view frustum
+		void		DrawPagedTerrains(	const glm::mat4& _transform,
+										const SceneManager& _scene);
+		// Draws the instanced models, culled on CPU with frustum culling
+		void		DrawInstances(		const glm::mat4& _transform,
+										const SceneManager& _scene);
+
+		// Fills the draw records of the regular meshes for the frame and
+		// points the vertex arrays at them
+		void		UpdateRecords(		const SceneManager& _scene);
 
-		// Regular mesh renderer
+		// Regular mesh renderer. The view projection comes from the frame
+		// block, the model matrix and the material are attributes : per
+		// instance for instanced models, read from the draw records or set
+		// as generic values per draw for the others
 		struct RegularRenderer
 		{
-										RegularRenderer():program("GBuffer::Regular"){}
+										RegularRenderer(const std::string& _name):program(_name){}
 			Program 					program;
 			GLint 	 					diffuseTexUnit;
 			GLint 	 					normalTexUnit;
-			GLint	 					roughnessVar;
-			GLint	 					specularityVar;
-			GLint	 					transformVar;
-			GLint	 					modelVar;
 		};
 
 		// Terrain mesh renderer
@@ -45,9 +75,9 @@ namespace glf
 			GLint						diffuseTexUnit;
 			GLint						normalTexUnit;
 			GLint						heightTexUnit;
+			GLint						occlusionTexUnit;
 			GLint	 					roughnessVar;
 			GLint	 					specularityVar;
-			GLint 						transformVar;
 
 			GLint 						tileSizeVar;
 			GLint 						tileCountVar;
@@ -58,14 +88,78 @@ namespace glf
 			GLint						tileFactorVar;
 		};
 
+		// Renderer of the terrains tessellated by a TerrainCapture
+		struct CapturedTerrainRenderer
+		{
+										CapturedTerrainRenderer():program("GBuffer::CapturedTerrain"){}
+			Program 					program;
+			GLint						diffuseTexUnit;
+			GLint						normalTexUnit;
+			GLint						occlusionTexUnit;
+			GLint	 					roughnessVar;
+			GLint	 					specularityVar;
+			GLint						tileFactorVar;
+		};
+
+		// Paged terrain renderer, the view projection and the eye come from
+		// the frame block
+		struct PagedTerrainRenderer
+		{
+										PagedTerrainRenderer():program("GBuffer::PagedTerrain"){}
+			Program 					program;
+			GLint						heightPagesUnit;
+			GLint						diffusePagesUnit;
+			GLint	 					roughnessVar;
+			GLint	 					specularityVar;
+			GLint						terrainOffsetVar;
+			GLint						terrainSizeVar;
+			GLint						heightFactorVar;
+			GLint						gridResolutionVar;
+			GLint						pageSizeVar;
+		};
+
 		// Resources
 		RegularRenderer					regularRenderer;
+		RegularRenderer					instancedRenderer;
 		TerrainRenderer					terrainRenderer;
+		CapturedTerrainRenderer			capturedRenderer;
+		PagedTerrainRenderer			pagedRenderer;
 		Texture2D 						positionTex;	// Position buffer (could be reconstruct from depth)
 		Texture2D  						normalTex;		// RGB : World space normal buffer / A : roughness
 		Texture2D 						diffuseTex;		// RGB : albedo / A : specularity
 		Texture2D  						depthTex; 		// Depth/Stencil buffer
 		GLuint	 						framebuffer;
+
+		// Frustum culling of the regular meshes. Bounds are copied from the
+		// scene when their number changes
+		BoundsSoA						meshBounds;
+		std::vector<int>				visibleMeshes;	// Visible-index list
+		std::vector<unsigned char>		visibleFlags;
+		std::vector<MeshBatch>			visibleBatches;
+		std::vector<DrawElementsIndirectCommand> visibleCommands;
+		IndirectElementBuffer			visibleCommandBuffer;
+		GPUCuller						gpuCuller;
+		HiZBuffer*						hizBuffer;		// Created with occlusion culling
+
+		// Visible draws sorted by state, with the render queue
+		RenderQueue						queue;
+
+		// Per draw records of the regular meshes, indexed by scene command
+		// with the geometry arena and by mesh otherwise. Not used without
+		// base instance support, nor without the arena and the render queue
+		bool							useRecords;
+		DrawRecordRing					drawRecords;
+		std::vector<VertexArray*>		recordPrimitives;	// Reading the records
+
+		// Terrain tiles in the view frustum
+		TerrainTiles					terrainTiles;
+		PagedTerrainNodes				pagedNodes;
+
+		// Transformations of the visible instances, streamed every frame
+		std::vector<glm::mat4>			instanceTransforms;
+		std::vector<int>				instanceFirsts;	// First one of each model
+		VertexBuffer<glm::mat4>::Buffer	instanceBuffer;
+		int								nInstancedArrays;	// Models reading the instance buffer
 	};
 	//--------------------------------------------------------------------------
 }
@@ -2,12 +2,30 @@
 // Includes
 //------------------------------------------------------------------------------
 #include <glf/helper.hpp>
+#include <glf/debug.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform2.hpp>
 
 namespace glf
 {
+	namespace
+	{
+		//----------------------------------------------------------------------
+		// Per draw uniforms of the render queue draws
+		struct HelperDrawState
+		{
+			const HelperRenderer*			renderer;
+			const std::vector<Helper::Ptr>*	helpers;
+		};
+		//----------------------------------------------------------------------
+		void SetHelperState(				int _helper,
+											void* _data)
+		{
+			const HelperDrawState& state = *(const HelperDrawState*)_data;
+			glProgramUniformMatrix4fv(state.renderer->program.id, state.renderer->modelVar, 1, GL_FALSE, &(*state.helpers)[_helper]->transform[0][0]);
+		}
+	}
 	//--------------------------------------------------------------------------
 	Helper::Helper():
 	transform(1.f),
@@ -30,10 +48,11 @@ namespace glf
 	HelperRenderer::HelperRenderer():
 	program("HelperRenderer")
 	{
-		program.Compile(ProgramOptions::CreateVSOptions().Append(LoadFile(directory::ShaderDirectory + "helper.vs")),
+		ProgramOptions options = ProgramOptions::CreateVSOptions();
+		options.Include(LoadFile(directory::ShaderDirectory + "frame.glsl"));
+		program.Compile(options.Append(LoadFile(directory::ShaderDirectory + "helper.vs")),
 						LoadFile(directory::ShaderDirectory + "helper.fs"));
 
-		transformVar	= program["Transform"].location;
 		modelVar		= program["Model"].location;
 
 		vbufferVar		= program["Position"].location;
@@ -45,18 +64,34 @@ namespace glf
 									const std::vector<Helper::Ptr>& _helpers)
 	{
 		// Render lighting pass
+		#if !ENABLE_RENDER_QUEUE
 		glUseProgram(program.id);
 		glf::CheckError("Check program");
-		glm::mat4 transform = _projection * _view;
-		glProgramUniformMatrix4fv(program.id, transformVar,  1, GL_FALSE, &transform[0][0]);
+		#endif
 
 		// Render at the same resolution than the original window
 		// Draw all helpers
 		for(unsigned int i=0;i<_helpers.size();++i)
 		{
+			#if ENABLE_RENDER_QUEUE
+			RenderQueue::Draw draw;
+			draw.program       = program.id;
+			draw.primitive     = &_helpers[i]->vao;
+			draw.primitiveType = _helpers[i]->type;
+			draw.count         = _helpers[i]->vbuffer.count;
+			draw.user          = int(i);
+			queue.Push(0,0.f,draw);
+			#else
 			glProgramUniformMatrix4fv(program.id, 	modelVar,  1, 	GL_FALSE, &_helpers[i]->transform[0][0]);
 			_helpers[i]->vao.Draw(_helpers[i]->type,_helpers[i]->vbuffer.count);
+			#endif
 		}
+		#if ENABLE_RENDER_QUEUE
+		HelperDrawState state;
+		state.renderer = this;
+		state.helpers  = &_helpers;
+		queue.Submit(SetHelperState,&state);
+		#endif
 	}
 	//--------------------------------------------------------------------------
 	HelperRenderer::~HelperRenderer()
@@ -318,10 +353,9 @@ namespace glf
 		return ref;
 	}
 	//--------------------------------------------------------------------------
-	Helper::Ptr HelperManager::CreateTangentSpace(	VertexBuffer3F& _pvbo,
-													VertexBuffer3F& _nvbo,
-													VertexBuffer4F& _tvbo,
-													IndexBuffer& _ibo,
+	Helper::Ptr HelperManager::CreateTangentSpace(	const MeshVertex* _vertices,
+													const void* _indices,
+													GLenum _indexType,
 													int _startIndex,
 													int _countIndex,
 													float _vectorSize)
@@ -335,27 +369,28 @@ namespace glf
 		glm::vec3* hvertices = ref->vbuffer.Lock();
 		glm::vec3* hcolors   = ref->cbuffer.Lock();
 
-		glm::vec3* vertices = _pvbo.Lock();
-		glm::vec4* tangents = _tvbo.Lock();
-		glm::vec3* normals  = _nvbo.Lock();
-		unsigned int* indices= _ibo.Lock();
 		int current = 0;
 		for(int i=_startIndex;i<_startIndex+_countIndex;++i)
 		{
-			int index = indices[i];
+			int index = _indexType==GL_UNSIGNED_SHORT ? ((const unsigned short*)_indices)[i] : ((const unsigned int*)_indices)[i];
+
+			glm::vec3 vertex, normal;
+			glm::vec4 tangent;
+			glm::vec2 texCoord;
+			DecodeVertex(_vertices[index],vertex,normal,tangent,texCoord);
 
 			// Tangent
-			hvertices[current+0] = vertices[index];
-			hvertices[current+1] = vertices[index] + glm::vec3(tangents[index]) * _vectorSize;
+			hvertices[current+0] = vertex;
+			hvertices[current+1] = vertex + glm::vec3(tangent) * _vectorSize;
 
 			// Bitangent
-			glm::vec3 bitangent = glm::cross(glm::vec3(tangents[index]),normals[index]) * glm::sign(tangents[index].w);
-			hvertices[current+2] = vertices[index];
-			hvertices[current+3] = vertices[index] + bitangent * _vectorSize;
+			glm::vec3 bitangent = glm::cross(glm::vec3(tangent),normal) * glm::sign(tangent.w);
+			hvertices[current+2] = vertex;
+			hvertices[current+3] = vertex + bitangent * _vectorSize;
 
 			// Normal
-			hvertices[current+4] = vertices[index];
-			hvertices[current+5] = vertices[index] + normals[index] * _vectorSize;
+			hvertices[current+4] = vertex;
+			hvertices[current+5] = vertex + normal * _vectorSize;
 
 			hcolors[current+0] = glm::vec3(1.f,0.f,0.f);
 			hcolors[current+1] = glm::vec3(1.f,0.f,0.f);
@@ -366,10 +401,6 @@ namespace glf
 
 			current += 6;
 		}
-		_ibo.Unlock();
-		_nvbo.Unlock();
-		_tvbo.Unlock();
-		_pvbo.Unlock();
 
 		ref->cbuffer.Unlock();
 		ref->vbuffer.Unlock();
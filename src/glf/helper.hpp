@@ -9,6 +9,7 @@
 #include <glf/memory.hpp>
 #include <glf/buffer.hpp>
 #include <glf/wrapper.hpp>
+#include <glf/scene.hpp>
 #include <vector>
 
 namespace glf
@@ -63,10 +64,9 @@ namespace glf
 											const glm::vec3& c2,
 											const glm::vec3& c3,
 											const glm::mat4& _t=glm::mat4(1.f));
-		Helper::Ptr CreateTangentSpace(		VertexBuffer3F& _pvbo,
-											VertexBuffer3F& _nvbo,
-											VertexBuffer4F& _tvbo,
-											IndexBuffer& _ibo,
+		Helper::Ptr CreateTangentSpace(		const MeshVertex* _vertices,
+											const void* _indices,
+											GLenum _indexType,
 											int _startIndex,
 											int _countIndex,
 											float _vectorSize);
@@ -79,10 +79,10 @@ namespace glf
 	{
 	public:
 		Program 		program;
-		GLint			transformVar;
 		GLint			modelVar;
 		GLint			vbufferVar;
 		GLint			cbufferVar;
+		RenderQueue		queue;
 	public:
 		void 			Draw(	const glm::mat4& _projection,
 								const glm::mat4& _view,
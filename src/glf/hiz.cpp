@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/hiz.hpp>
+#include <glf/geometry.hpp>
+#include <glf/window.hpp>
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	HiZBuffer::HiZBuffer(			int _w,
+									int _h):
+	copyProgram("HiZBuffer::Copy"),
+	reduceProgram("HiZBuffer::Reduce")
+	{
+		hizTex.Allocate(GL_R32F,_w,_h,true);
+		hizTex.SetFiltering(GL_NEAREST_MIPMAP_NEAREST,GL_NEAREST);
+		hizTex.SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
+
+		glGenFramebuffers(1, &framebuffer);
+
+		CreateScreenTriangle(vbo);
+		vao.Add(vbo,semantic::Position,2,GL_FLOAT);
+	}
+	//--------------------------------------------------------------------------
+	HiZBuffer::~HiZBuffer()
+	{
+		glDeleteFramebuffers(1,&framebuffer);
+	}
+	//--------------------------------------------------------------------------
+	void HiZBuffer::Build(			const Texture2D& _depthTex)
+	{
+		// Compiled on first use : only needed with occlusion culling
+		if(!copyProgram.compiled)
+		{
+			ProgramOptions copyOptions = ProgramOptions::CreateVSOptions();
+			copyOptions.AddDefine<int>("HIZ_COPY",1);
+			copyProgram.Compile(	copyOptions.Append(LoadFile(directory::ShaderDirectory + "hiz.vs")),
+									copyOptions.Append(LoadFile(directory::ShaderDirectory + "hiz.fs")));
+			depthTexUnit = copyProgram["DepthTex"].unit;
+			glProgramUniform1i(copyProgram.id, copyProgram["DepthTex"].location, depthTexUnit);
+
+			ProgramOptions reduceOptions = ProgramOptions::CreateVSOptions();
+			reduceOptions.AddDefine<int>("HIZ_REDUCE",1);
+			reduceProgram.Compile(	reduceOptions.Append(LoadFile(directory::ShaderDirectory + "hiz.vs")),
+									reduceOptions.Append(LoadFile(directory::ShaderDirectory + "hiz.fs")));
+			hizTexUnit = reduceProgram["HiZTex"].unit;
+			sizeVar    = reduceProgram["Size"].location;
+			glProgramUniform1i(reduceProgram.id, reduceProgram["HiZTex"].location, hizTexUnit);
+		}
+
+		glDisable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+
+		// Level 0 : copy of the depth buffer
+		glUseProgram(copyProgram.id);
+		glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,hizTex.target,hizTex.id,0);
+		glViewport(0,0,hizTex.size.x,hizTex.size.y);
+		_depthTex.Bind(depthTexUnit);
+		vao.Draw(GL_TRIANGLES,3,0);
+
+		// Other levels : the previous level is the only one readable, so
+		// that the written level is never sampled
+		glUseProgram(reduceProgram.id);
+		hizTex.Bind(hizTexUnit);
+		for(int l=1;l<hizTex.levels;++l)
+		{
+			int w = NextMipmapDimension(hizTex.size.x,l);
+			int h = NextMipmapDimension(hizTex.size.y,l);
+			glTexParameteri(hizTex.target,GL_TEXTURE_BASE_LEVEL,l-1);
+			glTexParameteri(hizTex.target,GL_TEXTURE_MAX_LEVEL, l-1);
+			glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,hizTex.target,hizTex.id,l);
+			glProgramUniform2i(reduceProgram.id, sizeVar, w, h);
+			glViewport(0,0,w,h);
+			vao.Draw(GL_TRIANGLES,3,0);
+		}
+		glTexParameteri(hizTex.target,GL_TEXTURE_BASE_LEVEL,0);
+		glTexParameteri(hizTex.target,GL_TEXTURE_MAX_LEVEL, hizTex.levels-1);
+
+		glBindFramebuffer(GL_FRAMEBUFFER,0);
+		glViewport(0,0,ctx::window.Size.x,ctx::window.Size.y);
+		glEnable(GL_DEPTH_TEST);
+		glf::CheckError("HiZBuffer::Build");
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef GLF_HIZ_HPP
+#define GLF_HIZ_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/wrapper.hpp>
+#include <glf/texture.hpp>
+#include <glf/buffer.hpp>
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	// Hierarchical depth buffer : max-reduction mip chain of a depth buffer,
+	// used for occlusion tests of bounds (see GPUCuller)
+	class HiZBuffer
+	{
+	public:
+					HiZBuffer(			int _w,
+										int _h);
+				   ~HiZBuffer(			);
+		void		Build(				const Texture2D& _depthTex);
+	private:
+					HiZBuffer(			const HiZBuffer&);
+		HiZBuffer&	operator=(			const HiZBuffer&);
+	public:
+		Texture2D						hizTex;		// R32F, all levels
+	private:
+		Program							copyProgram;
+		Program							reduceProgram;
+		GLint							depthTexUnit;
+		GLint							hizTexUnit;
+		GLint							sizeVar;
+		GLuint							framebuffer;
+		VertexBuffer2F					vbo;
+		VertexArray						vao;
+	};
+}
+
+#endif
@@ -0,0 +1,64 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/io/camerapath.hpp>
+#include <cstdio>
+
+namespace glf
+{
+	namespace io
+	{
+		//----------------------------------------------------------------------
+		std::string CameraPathFilename(const std::string& _sceneFilename)
+		{
+			std::size_t dot   = _sceneFilename.find_last_of('.');
+			std::size_t slash = _sceneFilename.find_last_of("/\\");
+			if(dot==std::string::npos || (slash!=std::string::npos && dot<slash))
+				return _sceneFilename + ".path";
+			return _sceneFilename.substr(0,dot) + ".path";
+		}
+		//----------------------------------------------------------------------
+		bool LoadCameraPath(const std::string& _filename,
+							std::vector<CameraKey>& _keys)
+		{
+			FILE* file = fopen(_filename.c_str(),"r");
+			if(!file)
+				return false;
+
+			_keys.clear();
+			float v[19];
+			while(fscanf(file,"%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f",
+						&v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9],
+						&v[10],&v[11],&v[12],&v[13],&v[14],&v[15],&v[16],&v[17],&v[18])==19)
+			{
+				CameraKey key;
+				key.eye = glm::vec3(v[0],v[1],v[2]);
+				for(int c=0;c<4;++c)
+					key.viewProjection[c] = glm::vec4(v[3+4*c],v[4+4*c],v[5+4*c],v[6+4*c]);
+				_keys.push_back(key);
+			}
+			bool complete = feof(file)!=0;
+			fclose(file);
+			return complete && !_keys.empty();
+		}
+		//----------------------------------------------------------------------
+		bool SaveCameraPath(const std::string& _filename,
+							const std::vector<CameraKey>& _keys)
+		{
+			FILE* file = fopen(_filename.c_str(),"w");
+			if(!file)
+				return false;
+
+			for(unsigned int i=0;i<_keys.size();++i)
+			{
+				const CameraKey& key = _keys[i];
+				fprintf(file,"%.9g %.9g %.9g",key.eye.x,key.eye.y,key.eye.z);
+				for(int c=0;c<4;++c)
+				for(int r=0;r<4;++r)
+					fprintf(file," %.9g",key.viewProjection[c][r]);
+				fprintf(file,"\n");
+			}
+			return fclose(file)==0;
+		}
+	}
+}
@@ -0,0 +1,36 @@
+#ifndef GLF_IO_CAMERAPATH_HPP
+#define GLF_IO_CAMERAPATH_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace glf
+{
+	namespace io
+	{
+		//----------------------------------------------------------------------
+		// Camera of a recorded frame. Paths are text files with one key per
+		// line : eye (3 floats) and view projection matrix (16 floats,
+		// column major)
+		struct CameraKey
+		{
+			glm::vec3						eye;
+			glm::mat4						viewProjection;
+		};
+
+		// Path filename associated to a scene file (scene.json -> scene.path)
+		std::string CameraPathFilename(	const std::string& _sceneFilename);
+
+		bool LoadCameraPath(			const std::string& _filename,
+										std::vector<CameraKey>& _keys);
+
+		bool SaveCameraPath(			const std::string& _filename,
+										const std::vector<CameraKey>& _keys);
+	}
+}
+
+#endif
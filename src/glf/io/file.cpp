@@ -0,0 +1,176 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/io/file.hpp>
+#if defined(WIN32)
+	#include <windows.h>
+	#include <sys/types.h>
+	#include <sys/stat.h>
+	#include <direct.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace glf
+{
+	namespace io
+	{
+		//----------------------------------------------------------------------
+		MappedFile::MappedFile():
+		data(0),
+		size(0),
+		#if defined(WIN32)
+		file(INVALID_HANDLE_VALUE),
+		mapping(0)
+		#else
+		file(-1)
+		#endif
+		{
+
+		}
+		//----------------------------------------------------------------------
+		MappedFile::~MappedFile()
+		{
+			Close();
+		}
+		//----------------------------------------------------------------------
+		bool MappedFile::Open(const std::string& _filename)
+		{
+			Close();
+
+			#if defined(WIN32)
+			file = CreateFileA(_filename.c_str(),GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+			if(file==INVALID_HANDLE_VALUE)
+				return false;
+
+			LARGE_INTEGER fileSize;
+			if(!GetFileSizeEx(file,&fileSize))
+			{
+				Close();
+				return false;
+			}
+			size = std::size_t(fileSize.QuadPart);
+
+			// Empty files can not be mapped, but they are valid files
+			if(size==0)
+				return true;
+
+			mapping = CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+			if(mapping==0)
+			{
+				Close();
+				return false;
+			}
+			data = (const char*)MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+			if(data==0)
+			{
+				Close();
+				return false;
+			}
+			#else
+			file = open(_filename.c_str(),O_RDONLY);
+			if(file<0)
+				return false;
+
+			struct stat fileStat;
+			if(fstat(file,&fileStat)!=0)
+			{
+				Close();
+				return false;
+			}
+			size = std::size_t(fileStat.st_size);
+
+			// Empty files can not be mapped, but they are valid files
+			if(size==0)
+				return true;
+
+			void* ptr = mmap(0,size,PROT_READ,MAP_PRIVATE,file,0);
+			if(ptr==MAP_FAILED)
+			{
+				Close();
+				return false;
+			}
+			data = (const char*)ptr;
+
+			// Files are always consumed front to back
+			madvise(ptr,size,MADV_SEQUENTIAL);
+			#endif
+
+			return true;
+		}
+		//----------------------------------------------------------------------
+		void MappedFile::Close()
+		{
+			#if defined(WIN32)
+			if(data)
+				UnmapViewOfFile(data);
+			if(mapping)
+				CloseHandle(mapping);
+			if(file!=INVALID_HANDLE_VALUE)
+				CloseHandle(file);
+			mapping = 0;
+			file    = INVALID_HANDLE_VALUE;
+			#else
+			if(data)
+				munmap((void*)data,size);
+			if(file>=0)
+				close(file);
+			file    = -1;
+			#endif
+			data    = 0;
+			size    = 0;
+		}
+		//----------------------------------------------------------------------
+		bool MappedFile::IsOpen() const
+		{
+			#if defined(WIN32)
+			return file!=INVALID_HANDLE_VALUE;
+			#else
+			return file>=0;
+			#endif
+		}
+		//----------------------------------------------------------------------
+		const char* MappedFile::Data() const
+		{
+			return data;
+		}
+		//----------------------------------------------------------------------
+		std::size_t MappedFile::Size() const
+		{
+			return size;
+		}
+		//----------------------------------------------------------------------
+		bool FileStatus(	const std::string& _filename,
+							long long& _modified,
+							long long& _size)
+		{
+			#if defined(WIN32)
+			struct __stat64 fileStat;
+			if(_stat64(_filename.c_str(),&fileStat)!=0)
+				return false;
+			#else
+			struct stat fileStat;
+			if(stat(_filename.c_str(),&fileStat)!=0)
+				return false;
+			#endif
+			_modified = (long long)fileStat.st_mtime;
+			_size     = (long long)fileStat.st_size;
+			return true;
+		}
+		//----------------------------------------------------------------------
+		bool MakeDirectory(	const std::string& _path)
+		{
+			long long modified, size;
+			if(FileStatus(_path,modified,size))
+				return true;
+			#if defined(WIN32)
+			return _mkdir(_path.c_str())==0;
+			#else
+			return mkdir(_path.c_str(),0755)==0;
+			#endif
+		}
+	}
+}
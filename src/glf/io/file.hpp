@@ -0,0 +1,57 @@
+#ifndef GLF_IO_FILE_HPP
+#define GLF_IO_FILE_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <string>
+#include <cstddef>
+
+namespace glf
+{
+	namespace io
+	{
+		//----------------------------------------------------------------------
+		// Read-only memory mapping of a whole file. The mapping is released
+		// when the object is destroyed or when Close() is called
+		class MappedFile
+		{
+		public:
+							MappedFile();
+							~MappedFile();
+			bool			Open(			const std::string& _filename);
+			void			Close();
+			bool			IsOpen() const;
+			const char*		Data() const;
+			std::size_t		Size() const;
+
+		private:
+							MappedFile(const MappedFile&);
+							MappedFile& operator=(const MappedFile&);
+
+		private:
+			const char*		data;
+			std::size_t		size;
+			#if defined(WIN32)
+			void*			file;
+			void*			mapping;
+			#else
+			int				file;
+			#endif
+		};
+
+		//----------------------------------------------------------------------
+		// Last modification time (seconds since epoch) and size of a file.
+		// Returns false if the file does not exist
+		bool FileStatus(	const std::string& _filename,
+							long long& _modified,
+							long long& _size);
+
+		//----------------------------------------------------------------------
+		// Creates a directory if it does not exist yet (parents have to
+		// exist). Returns false if it can not be created
+		bool MakeDirectory(	const std::string& _path);
+	}
+}
+
+#endif
@@ -184,6 +184,50 @@ namespace glf
 			}
 		}
 		//----------------------------------------------------------------------
+		bool LoadImage(		const std::string& _filename,
+							std::vector<unsigned char>& _pixels,
+							int& _w,
+							int& _h,
+							bool _verbose)
+		{
+			ilInit();
+
+			ILuint imgH;
+			ilGenImages(1, &imgH);
+			ilBindImage(imgH);
+			bool loaded = ilLoadImage((const ILstring)_filename.c_str())
+						&& ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE);
+			if(loaded)
+			{
+				if(_verbose)
+				{
+					Info("Load image : %s",_filename.c_str());
+				}
+
+				// Flip image
+				ILinfo ImageInfo;
+				iluGetImageInfo(&ImageInfo);
+				if( ImageInfo.Origin == IL_ORIGIN_UPPER_LEFT )
+				{
+					iluFlipImage();
+					if(_verbose) Info("Flip image");
+				}
+
+				_w = ilGetInteger(IL_IMAGE_WIDTH);
+				_h = ilGetInteger(IL_IMAGE_HEIGHT);
+				const unsigned char* data = ilGetData();
+				_pixels.assign(data, data + _w*_h*4);
+			}
+			else
+			{
+				Warning("Load image error : unable to decode (%s)",_filename.c_str());
+			}
+
+			ilDeleteImages(1, &imgH);
+			ilShutDown();
+			return loaded;
+		}
+		//----------------------------------------------------------------------
 		void SaveTexture(	const std::string& _filename,
 							Texture2D& _texture,
 							bool _verbose)
@@ -6,6 +6,7 @@
 //------------------------------------------------------------------------------
 #include <glf/texture.hpp>
 #include <string>
+#include <vector>
 
 namespace glf
 {
@@ -18,6 +19,14 @@ namespace glf
 							bool _allocateMipmap,
 							bool _verbose=true);
 		//----------------------------------------------------------------------
+		// Decodes an image into 8 bits RGBA pixels, bottom row first, without
+		// creating any texture
+		bool LoadImage(		const std::string& _filename,
+							std::vector<unsigned char>& _pixels,
+							int& _w,
+							int& _h,
+							bool _verbose=true);
+		//----------------------------------------------------------------------
 		void SaveTexture(	const std::string& _filename,
 							Texture2D& _texture,
 							bool _verbose=true);
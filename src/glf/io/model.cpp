@@ -3,10 +3,14 @@
 //------------------------------------------------------------------------------
 #include <glf/io/model.hpp>
 #include <glf/io/image.hpp>
+#include <glf/io/file.hpp>
+#include <glf/io/optimizer.hpp>
 #include <glf/utils.hpp>
 #include <glf/debug.hpp>
+#include <GLFW/glfw3.h>
 //------------------------------------------------------------------------------
 #include <cstring>
+#include <cstddef>
 #include <cstdio>
 #include <cmath>
 #include <cstdlib>
@@ -19,15 +23,146 @@
 #include <map>
 #include <fstream>
 #include <cassert>
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
 
 //------------------------------------------------------------------------------
 // Macros
 //------------------------------------------------------------------------------
 #define MAX_ANISOSTROPY					16.f
+#define MIN_CHUNK_SIZE					(256*1024)	// Bytes of OBJ parsed by a thread
 
 // OBJ loader
 namespace
 {
+	//--------------------------------------------------------------------------
+	// Open addressing hash table (linear probing) used to weld the vertices
+	// of an OBJ file. It maps the (v, vt, vn) indices of a face corner to the
+	// index of its vertex. Entries are stored inline, no allocation happens
+	// per entry, and the table is sized once from the number of faces.
+	//--------------------------------------------------------------------------
+	class VertexTable
+	{
+	public:
+		VertexTable();
+
+		void clear();
+		void reserve(int numberOfKeys);
+		int insert(int v, int vt, int vn, int index);
+		int size() const;
+
+	private:
+		struct Entry
+		{
+			int v;
+			int vt;
+			int vn;
+			int index;      // -1 for an empty entry
+		};
+
+		static unsigned int hash(int v, int vt, int vn);
+		void rehash(std::size_t capacity);
+
+		std::vector<Entry> m_entries;
+		unsigned int m_mask;
+		int m_size;
+	};
+	//--------------------------------------------------------------------------
+	VertexTable::VertexTable()
+	{
+		m_mask = 0;
+		m_size = 0;
+	}
+	//--------------------------------------------------------------------------
+	void VertexTable::clear()
+	{
+		std::vector<Entry>().swap(m_entries);
+		m_mask = 0;
+		m_size = 0;
+	}
+	//--------------------------------------------------------------------------
+	inline int VertexTable::size() const
+	{
+		return m_size;
+	}
+	//--------------------------------------------------------------------------
+	inline unsigned int VertexTable::hash(int v, int vt, int vn)
+	{
+		// Murmur3 finalizer over the combined indices. Consecutive indices
+		// are the common case, they have to be spread over the whole table.
+		unsigned int h = static_cast<unsigned int>(v) * 0x9E3779B1u;
+		h ^= static_cast<unsigned int>(vt) * 0x85EBCA77u;
+		h ^= static_cast<unsigned int>(vn) * 0xC2B2AE3Du;
+		h ^= h >> 16;
+		h *= 0x85EBCA6Bu;
+		h ^= h >> 13;
+		h *= 0xC2B2AE35u;
+		h ^= h >> 16;
+		return h;
+	}
+	//--------------------------------------------------------------------------
+	void VertexTable::reserve(int numberOfKeys)
+	{
+		// Keep the load factor under 0.7.
+		std::size_t capacity = 16;
+		while (capacity * 7 < static_cast<std::size_t>(numberOfKeys) * 10)
+		    capacity <<= 1;
+
+		if (capacity > m_entries.size())
+		    rehash(capacity);
+	}
+	//--------------------------------------------------------------------------
+	void VertexTable::rehash(std::size_t capacity)
+	{
+		Entry empty = {0, 0, 0, -1};
+		std::vector<Entry> entries(capacity, empty);
+		unsigned int mask = static_cast<unsigned int>(capacity - 1);
+
+		for (std::size_t i = 0; i < m_entries.size(); ++i)
+		{
+		    const Entry &entry = m_entries[i];
+		    if (entry.index < 0)
+		        continue;
+
+		    unsigned int slot = hash(entry.v, entry.vt, entry.vn) & mask;
+		    while (entries[slot].index >= 0)
+		        slot = (slot + 1) & mask;
+		    entries[slot] = entry;
+		}
+
+		m_entries.swap(entries);
+		m_mask = mask;
+	}
+	//--------------------------------------------------------------------------
+	inline int VertexTable::insert(int v, int vt, int vn, int index)
+	{
+		// Returns the index already associated to the key or inserts index.
+		if ((m_size + 1) * 10 > static_cast<int>(m_entries.size()) * 7)
+		    rehash(std::max<std::size_t>(16, m_entries.size() * 2));
+
+		unsigned int slot = hash(v, vt, vn) & m_mask;
+
+		for (;;)
+		{
+		    Entry &entry = m_entries[slot];
+
+		    if (entry.index < 0)
+		    {
+		        entry.v = v;
+		        entry.vt = vt;
+		        entry.vn = vn;
+		        entry.index = index;
+		        ++m_size;
+		        return index;
+		    }
+
+		    if (entry.v == v && entry.vt == vt && entry.vn == vn)
+		        return entry.index;
+
+		    slot = (slot + 1) & m_mask;
+		}
+	}
 	//--------------------------------------------------------------------------
 	// Copyright (c) 2007 dhpoware. All Rights Reserved.
 	//
@@ -53,8 +188,9 @@ namespace
 	// The methods normalize() and scale() are based on source code from
 	// http://www.mvps.org/directx/articles/scalemesh9.htm.
 	//
-	// The addVertex() method is based on source code from the Direct3D MeshFromOBJ
-	// sample found in the DirectX SDK.
+	// The addVertex() method was based on source code from the Direct3D
+	// MeshFromOBJ sample found in the DirectX SDK. It now welds vertices through
+	// the VertexTable open addressing hash table.
 	//
 	// The generateTangents() method is based on public source code from
 	// http://www.terathon.com/code/tangent.php.
@@ -101,7 +237,9 @@ namespace
 		~ModelOBJ();
 
 		void destroy();
+		void setNumberOfThreads(int numberOfThreads);
 		bool import(const char *pszFilename, bool rebuildNormals = false, bool rebuildTangents = false);
+		bool importStream(const char *pszFilename, bool rebuildNormals = false, bool rebuildTangents = false);
 		void normalize(float scaleTo = 1.0f, bool center = true);
 		void reverseWinding();
 
@@ -124,6 +262,7 @@ namespace
 		int getNumberOfVertices() const;
 
 		const std::string &getPath() const;
+		const std::vector<std::string> &getMaterialLibraries() const;
 
 		const Vertex &getVertex(int i) const;
 		const Vertex *getVertexBuffer() const;
@@ -135,24 +274,65 @@ namespace
 		bool hasTextureCoords() const;
 
 	private:
-		void addTrianglePos(int index, int material,
+		// Faces and material statements of a chunk are recorded as they are
+		// in the file and are resolved once all chunks have been parsed.
+		struct Face
+		{
+			int firstCorner;
+			int numberOfCorners;
+			bool hasTexCoord;
+			bool hasNormal;
+			int numberOfVertexCoords;   // Attributes preceding the face in its
+			int numberOfTextureCoords;  // chunk, used to resolve negative
+			int numberOfNormals;        // indices.
+		};
+
+		struct Statement
+		{
+			int face;                   // Number of faces preceding it in its chunk
+			bool library;               // mtllib or usemtl
+			std::string name;
+		};
+
+		struct Chunk
+		{
+			const char *pBegin;
+			const char *pEnd;
+			int vertexOffset;
+			int textureOffset;
+			int normalOffset;
+			std::vector<float> vertexCoords;
+			std::vector<float> textureCoords;
+			std::vector<float> normals;
+			std::vector<int> corners;   // (v, vt, vn) as read in the file
+			std::vector<Face> faces;
+			std::vector<Statement> statements;
+		};
+
+		void addTrianglePos(int material,
 			int v0, int v1, int v2);
-		void addTrianglePosNormal(int index, int material,
+		void addTrianglePosNormal(int material,
 			int v0, int v1, int v2,
 			int vn0, int vn1, int vn2);
-		void addTrianglePosTexCoord(int index, int material,
+		void addTrianglePosTexCoord(int material,
 			int v0, int v1, int v2,
 			int vt0, int vt1, int vt2);
-		void addTrianglePosTexCoordNormal(int index, int material,
+		void addTrianglePosTexCoordNormal(int material,
 			int v0, int v1, int v2,
 			int vt0, int vt1, int vt2,
 			int vn0, int vn1, int vn2);
-		int addVertex(int hash, const Vertex *pVertex);
+		int addVertex(int v, int vt, int vn, const Vertex *pVertex);
 		void bounds(float center[3], float &width, float &height,
 			float &length, float &radius) const;
 		void buildMeshes();
 		void generateNormals();
 		void generateTangents();
+		void addDefaultMaterial();
+		void extractDirectoryPath(const char *pszFilename);
+		void finalizeImport(bool rebuildNormals, bool rebuildTangents);
+		void importGeometry(const char *pBegin, const char *pEnd);
+		static void importChunk(Chunk &chunk);
+		static const char *importFace(const char *p, const char *pEnd, Chunk &chunk);
 		void importGeometryFirstPass(FILE *pFile);
 		void importGeometrySecondPass(FILE *pFile);
 		bool importMaterials(const char *pszFilename);
@@ -169,6 +349,7 @@ namespace
 		int m_numberOfTriangles;
 		int m_numberOfMaterials;
 		int m_numberOfMeshes;
+		int m_numberOfThreads;
 
 		float m_center[3];
 		float m_width;
@@ -177,6 +358,7 @@ namespace
 		float m_radius;
 
 		std::string m_directoryPath;
+		std::vector<std::string> m_materialLibraries;
 
 		std::vector<Mesh> m_meshes;
 		std::vector<Material> m_materials;
@@ -188,7 +370,7 @@ namespace
 		std::vector<float> m_normals;
 
 		std::map<std::string, int> m_materialCache;
-		std::map<int, std::vector<int> > m_vertexCache;
+		VertexTable m_vertexCache;
 	};
 	//--------------------------------------------------------------------------
 	bool MeshCompFunc(const ModelOBJ::Mesh &lhs, const ModelOBJ::Mesh &rhs)
@@ -196,6 +378,196 @@ namespace
 		return lhs.pMaterial->alpha > rhs.pMaterial->alpha;
 	}
 	//--------------------------------------------------------------------------
+	// Tokenizer used by the single pass importer. All functions work on a
+	// [p, pEnd) range since a mapped file is not null terminated.
+	//--------------------------------------------------------------------------
+	inline bool isBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+	}
+	//--------------------------------------------------------------------------
+	inline bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+	//--------------------------------------------------------------------------
+	inline const char *skipBlanks(const char *p, const char *pEnd)
+	{
+		while (p < pEnd && isBlank(*p))
+		    ++p;
+		return p;
+	}
+	//--------------------------------------------------------------------------
+	inline const char *skipToken(const char *p, const char *pEnd)
+	{
+		while (p < pEnd && *p != '\n' && !isBlank(*p))
+		    ++p;
+		return p;
+	}
+	//--------------------------------------------------------------------------
+	inline const char *skipLine(const char *p, const char *pEnd)
+	{
+		const char *pEol = static_cast<const char *>(memchr(p, '\n', pEnd - p));
+		return pEol ? pEol + 1 : pEnd;
+	}
+	//--------------------------------------------------------------------------
+	// Returns p unchanged if no integer could be read.
+	inline const char *parseInt(const char *p, const char *pEnd, int &value)
+	{
+		const char *pStart = p;
+		bool negative = false;
+
+		if (p < pEnd && (*p == '-' || *p == '+'))
+		{
+		    negative = (*p == '-');
+		    ++p;
+		}
+
+		if (p == pEnd || !isDigit(*p))
+		    return pStart;
+
+		int result = 0;
+		while (p < pEnd && isDigit(*p))
+		    result = result * 10 + (*p++ - '0');
+
+		value = negative ? -result : result;
+		return p;
+	}
+	//--------------------------------------------------------------------------
+	// Copies the token into a null terminated buffer and lets the C library
+	// convert it. Used for everything the fast path can not round exactly.
+	const char *parseFloatSlow(const char *p, const char *pEnd, float &value)
+	{
+		char buffer[128];
+		int length = 0;
+
+		while (p + length < pEnd && length < 127 && p[length] != '\n' && !isBlank(p[length]))
+		{
+		    buffer[length] = p[length];
+		    ++length;
+		}
+		buffer[length] = '\0';
+
+		char *pLast = buffer;
+		float result = strtof(buffer, &pLast);
+
+		if (pLast != buffer)
+		    value = result;
+		return p + (pLast - buffer);
+	}
+	//--------------------------------------------------------------------------
+	// Decimal to float conversion giving the same (correctly rounded) result
+	// as scanf. A mantissa below 2^53 multiplied or divided by an exact power
+	// of ten is correctly rounded in double precision; the only remaining
+	// error comes from the double to float rounding when the double lands
+	// exactly on the midpoint between two floats, which is detected and sent
+	// to the slow path.
+	// Returns p unchanged (after blanks) if no number could be read.
+	const char *parseFloat(const char *p, const char *pEnd, float &value)
+	{
+		static const double powersOf10[] =
+		{
+		    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+		    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		p = skipBlanks(p, pEnd);
+
+		const char *pStart = p;
+		bool negative = false;
+
+		if (p < pEnd && (*p == '-' || *p == '+'))
+		{
+		    negative = (*p == '-');
+		    ++p;
+		}
+
+		unsigned long long mantissa = 0;
+		int numDigits = 0;
+		int numSignificant = 0;
+		int exponent = 0;
+
+		while (p < pEnd && isDigit(*p))
+		{
+		    mantissa = mantissa * 10 + (*p++ - '0');
+		    numSignificant += (mantissa != 0);
+		    ++numDigits;
+		}
+
+		if (p < pEnd && *p == '.')
+		{
+		    ++p;
+		    while (p < pEnd && isDigit(*p))
+		    {
+		        mantissa = mantissa * 10 + (*p++ - '0');
+		        numSignificant += (mantissa != 0);
+		        ++numDigits;
+		        --exponent;
+		    }
+		}
+
+		// inf, nan, hexadecimal floats or too many digits for 64 bits
+		if (numDigits == 0 || numSignificant > 18 || (p < pEnd && (*p == 'x' || *p == 'X')))
+		    return parseFloatSlow(pStart, pEnd, value);
+
+		if (p < pEnd && (*p == 'e' || *p == 'E'))
+		{
+		    const char *pExponent = p + 1;
+		    bool negativeExponent = false;
+
+		    if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+'))
+		    {
+		        negativeExponent = (*pExponent == '-');
+		        ++pExponent;
+		    }
+
+		    if (pExponent < pEnd && isDigit(*pExponent))
+		    {
+		        int e = 0;
+		        while (pExponent < pEnd && isDigit(*pExponent))
+		        {
+		            if (e < 100000)
+		                e = e * 10 + (*pExponent - '0');
+		            ++pExponent;
+		        }
+		        exponent += negativeExponent ? -e : e;
+		        p = pExponent;
+		    }
+		}
+
+		if (mantissa > 9007199254740992ULL || exponent < -22 || exponent > 22)
+		    return parseFloatSlow(pStart, pEnd, value);
+
+		double result = static_cast<double>(mantissa);
+		if (exponent < 0)
+		    result /= powersOf10[-exponent];
+		else
+		    result *= powersOf10[exponent];
+
+		if (mantissa != 0)
+		{
+		    // Float denormals and overflows round differently.
+		    if (result < FLT_MIN || result > FLT_MAX)
+		        return parseFloatSlow(pStart, pEnd, value);
+
+		    unsigned long long bits = 0;
+		    memcpy(&bits, &result, sizeof(bits));
+		    if ((bits & 0x1FFFFFFFULL) == 0x10000000ULL)
+		        return parseFloatSlow(pStart, pEnd, value);
+		}
+
+		value = static_cast<float>(negative ? -result : result);
+		return p;
+	}
+	//--------------------------------------------------------------------------
+	inline int resolveIndex(int index, int count)
+	{
+		// OBJ indices are one based, negative ones are relative to the end of
+		// the attributes read so far (-1 is the last one).
+		return (index < 0) ? index + count : index - 1;
+	}
+	//--------------------------------------------------------------------------
 	inline void ModelOBJ::getCenter(float &x, float &y, float &z) const
 	{ x = m_center[0]; y = m_center[1]; z = m_center[2]; }
 	//--------------------------------------------------------------------------
@@ -241,6 +613,9 @@ namespace
 	inline const std::string &ModelOBJ::getPath() const
 	{ return m_directoryPath; }
 	//--------------------------------------------------------------------------
+	inline const std::vector<std::string> &ModelOBJ::getMaterialLibraries() const
+	{ return m_materialLibraries; }
+	//--------------------------------------------------------------------------
 	inline const ModelOBJ::Vertex &ModelOBJ::getVertex(int i) const
 	{ return m_vertexBuffer[i]; }
 	//--------------------------------------------------------------------------
@@ -275,6 +650,7 @@ namespace
 		m_numberOfTriangles = 0;
 		m_numberOfMaterials = 0;
 		m_numberOfMeshes = 0;
+		m_numberOfThreads = 0;
 
 		m_center[0] = m_center[1] = m_center[2] = 0.0f;
 		m_width = m_height = m_length = m_radius = 0.0f;
@@ -356,6 +732,7 @@ namespace
 		m_width = m_height = m_length = m_radius = 0.0f;
 
 		m_directoryPath.clear();
+		m_materialLibraries.clear();
 
 		m_meshes.clear();
 		m_materials.clear();
@@ -371,13 +748,53 @@ namespace
 		m_vertexCache.clear();
 	}
 	//--------------------------------------------------------------------------
+	void ModelOBJ::setNumberOfThreads(int numberOfThreads)
+	{
+		// 0 uses all the available threads.
+		m_numberOfThreads = numberOfThreads;
+	}
+	//--------------------------------------------------------------------------
 	bool ModelOBJ::import(const char *pszFilename, bool rebuildNormals, bool rebuildTangents)
+	{
+		glf::io::MappedFile file;
+
+		if (!file.Open(pszFilename))
+		    return false;
+
+		extractDirectoryPath(pszFilename);
+
+		// Import the OBJ file in a single pass over the mapped bytes, split
+		// into chunks parsed in parallel.
+
+		importGeometry(file.Data(), file.Data() + file.Size());
+		file.Close();
+
+		finalizeImport(rebuildNormals, rebuildTangents);
+		return true;
+	}
+	//--------------------------------------------------------------------------
+	bool ModelOBJ::importStream(const char *pszFilename, bool rebuildNormals, bool rebuildTangents)
 	{
 		FILE *pFile = fopen(pszFilename, "r");
 
 		if (!pFile)
 		    return false;
 
+		extractDirectoryPath(pszFilename);
+
+		// Import the OBJ file.
+
+		importGeometryFirstPass(pFile);
+		rewind(pFile);
+		importGeometrySecondPass(pFile);
+		fclose(pFile);
+
+		finalizeImport(rebuildNormals, rebuildTangents);
+		return true;
+	}
+	//--------------------------------------------------------------------------
+	void ModelOBJ::extractDirectoryPath(const char *pszFilename)
+	{
 		// Extract the directory the OBJ file is in from the file name.
 		// This directory path will be used to load the OBJ's associated MTL file.
 
@@ -397,14 +814,10 @@ namespace
 		    if (offset != std::string::npos)
 		        m_directoryPath = filename.substr(0, ++offset);
 		}
-
-		// Import the OBJ file.
-
-		importGeometryFirstPass(pFile);
-		rewind(pFile);
-		importGeometrySecondPass(pFile);
-		fclose(pFile);
-
+	}
+	//--------------------------------------------------------------------------
+	void ModelOBJ::finalizeImport(bool rebuildNormals, bool rebuildTangents)
+	{
 		// Perform post import tasks.
 
 		buildMeshes();
@@ -438,8 +851,6 @@ namespace
 				}
 			}
 		}
-
-		return true;
 	}
 	//--------------------------------------------------------------------------
 	void ModelOBJ::normalize(float scaleTo, bool center)
@@ -520,7 +931,7 @@ namespace
 		}
 	}
 	//--------------------------------------------------------------------------
-	void ModelOBJ::addTrianglePos(int index, int material, int v0, int v1, int v2)
+	void ModelOBJ::addTrianglePos(int material, int v0, int v1, int v2)
 	{
 		Vertex vertex =
 		{
@@ -529,26 +940,26 @@ namespace
 		    {0.0f, 0.0f, 0.0f}
 		};
 
-		m_attributeBuffer[index] = material;
+		m_attributeBuffer.push_back(material);
 
 		vertex.position[0] = m_vertexCoords[v0 * 3];
 		vertex.position[1] = m_vertexCoords[v0 * 3 + 1];
 		vertex.position[2] = m_vertexCoords[v0 * 3 + 2];
-		m_indexBuffer[index * 3] = addVertex(v0, &vertex);
+		m_indexBuffer.push_back(addVertex(v0, -1, -1, &vertex));
 
 		vertex.position[0] = m_vertexCoords[v1 * 3];
 		vertex.position[1] = m_vertexCoords[v1 * 3 + 1];
 		vertex.position[2] = m_vertexCoords[v1 * 3 + 2];
-		m_indexBuffer[index * 3 + 1] = addVertex(v1, &vertex);
+		m_indexBuffer.push_back(addVertex(v1, -1, -1, &vertex));
 
 		vertex.position[0] = m_vertexCoords[v2 * 3];
 		vertex.position[1] = m_vertexCoords[v2 * 3 + 1];
 		vertex.position[2] = m_vertexCoords[v2 * 3 + 2];
-		m_indexBuffer[index * 3 + 2] = addVertex(v2, &vertex);
+		m_indexBuffer.push_back(addVertex(v2, -1, -1, &vertex));
 	}
 	//--------------------------------------------------------------------------
-	void ModelOBJ::addTrianglePosNormal(int index, int material, int v0, int v1,
-		                                int v2, int vn0, int vn1, int vn2)
+	void ModelOBJ::addTrianglePosNormal(int material, int v0, int v1, int v2,
+		                                int vn0, int vn1, int vn2)
 	{
 		Vertex vertex =
 		{
@@ -558,7 +969,7 @@ namespace
 		    {0.0f, 0.0f, 0.0f}
 		};
 
-		m_attributeBuffer[index] = material;
+		m_attributeBuffer.push_back(material);
 
 		vertex.position[0] = m_vertexCoords[v0 * 3];
 		vertex.position[1] = m_vertexCoords[v0 * 3 + 1];
@@ -566,7 +977,7 @@ namespace
 		vertex.normal[0] = m_normals[vn0 * 3];
 		vertex.normal[1] = m_normals[vn0 * 3 + 1];
 		vertex.normal[2] = m_normals[vn0 * 3 + 2];
-		m_indexBuffer[index * 3] = addVertex(v0, &vertex);
+		m_indexBuffer.push_back(addVertex(v0, -1, vn0, &vertex));
 
 		vertex.position[0] = m_vertexCoords[v1 * 3];
 		vertex.position[1] = m_vertexCoords[v1 * 3 + 1];
@@ -574,7 +985,7 @@ namespace
 		vertex.normal[0] = m_normals[vn1 * 3];
 		vertex.normal[1] = m_normals[vn1 * 3 + 1];
 		vertex.normal[2] = m_normals[vn1 * 3 + 2];
-		m_indexBuffer[index * 3 + 1] = addVertex(v1, &vertex);
+		m_indexBuffer.push_back(addVertex(v1, -1, vn1, &vertex));
 
 		vertex.position[0] = m_vertexCoords[v2 * 3];
 		vertex.position[1] = m_vertexCoords[v2 * 3 + 1];
@@ -582,11 +993,11 @@ namespace
 		vertex.normal[0] = m_normals[vn2 * 3];
 		vertex.normal[1] = m_normals[vn2 * 3 + 1];
 		vertex.normal[2] = m_normals[vn2 * 3 + 2];
-		m_indexBuffer[index * 3 + 2] = addVertex(v2, &vertex);
+		m_indexBuffer.push_back(addVertex(v2, -1, vn2, &vertex));
 	}
 	//--------------------------------------------------------------------------
-	void ModelOBJ::addTrianglePosTexCoord(int index, int material, int v0, int v1,
-		                                  int v2, int vt0, int vt1, int vt2)
+	void ModelOBJ::addTrianglePosTexCoord(int material, int v0, int v1, int v2,
+		                                  int vt0, int vt1, int vt2)
 	{
 		Vertex vertex =
 		{
@@ -596,33 +1007,33 @@ namespace
 		    {0.0f, 0.0f, 0.0f}
 		};
 
-		m_attributeBuffer[index] = material;
+		m_attributeBuffer.push_back(material);
 
 		vertex.position[0] = m_vertexCoords[v0 * 3];
 		vertex.position[1] = m_vertexCoords[v0 * 3 + 1];
 		vertex.position[2] = m_vertexCoords[v0 * 3 + 2];
 		vertex.texCoord[0] = m_textureCoords[vt0 * 2];
 		vertex.texCoord[1] = m_textureCoords[vt0 * 2 + 1];
-		m_indexBuffer[index * 3] = addVertex(v0, &vertex);
+		m_indexBuffer.push_back(addVertex(v0, vt0, -1, &vertex));
 
 		vertex.position[0] = m_vertexCoords[v1 * 3];
 		vertex.position[1] = m_vertexCoords[v1 * 3 + 1];
 		vertex.position[2] = m_vertexCoords[v1 * 3 + 2];
 		vertex.texCoord[0] = m_textureCoords[vt1 * 2];
 		vertex.texCoord[1] = m_textureCoords[vt1 * 2 + 1];
-		m_indexBuffer[index * 3 + 1] = addVertex(v1, &vertex);
+		m_indexBuffer.push_back(addVertex(v1, vt1, -1, &vertex));
 
 		vertex.position[0] = m_vertexCoords[v2 * 3];
 		vertex.position[1] = m_vertexCoords[v2 * 3 + 1];
 		vertex.position[2] = m_vertexCoords[v2 * 3 + 2];
 		vertex.texCoord[0] = m_textureCoords[vt2 * 2];
 		vertex.texCoord[1] = m_textureCoords[vt2 * 2 + 1];
-		m_indexBuffer[index * 3 + 2] = addVertex(v2, &vertex);
+		m_indexBuffer.push_back(addVertex(v2, vt2, -1, &vertex));
 	}
 	//--------------------------------------------------------------------------
-	void ModelOBJ::addTrianglePosTexCoordNormal(int index, int material, int v0,
-		                                        int v1, int v2, int vt0, int vt1,
-		                                        int vt2, int vn0, int vn1, int vn2)
+	void ModelOBJ::addTrianglePosTexCoordNormal(int material, int v0, int v1,
+		                                        int v2, int vt0, int vt1, int vt2,
+		                                        int vn0, int vn1, int vn2)
 	{
 		Vertex vertex =
 		{
@@ -632,7 +1043,7 @@ namespace
 		    {0.0f, 0.0f, 0.0f}
 		};
 
-		m_attributeBuffer[index] = material;
+		m_attributeBuffer.push_back(material);
 
 		vertex.position[0] = m_vertexCoords[v0 * 3];
 		vertex.position[1] = m_vertexCoords[v0 * 3 + 1];
@@ -642,7 +1053,7 @@ namespace
 		vertex.normal[0] = m_normals[vn0 * 3];
 		vertex.normal[1] = m_normals[vn0 * 3 + 1];
 		vertex.normal[2] = m_normals[vn0 * 3 + 2];
-		m_indexBuffer[index * 3] = addVertex(v0, &vertex);
+		m_indexBuffer.push_back(addVertex(v0, vt0, vn0, &vertex));
 
 		vertex.position[0] = m_vertexCoords[v1 * 3];
 		vertex.position[1] = m_vertexCoords[v1 * 3 + 1];
@@ -652,7 +1063,7 @@ namespace
 		vertex.normal[0] = m_normals[vn1 * 3];
 		vertex.normal[1] = m_normals[vn1 * 3 + 1];
 		vertex.normal[2] = m_normals[vn1 * 3 + 2];
-		m_indexBuffer[index * 3 + 1] = addVertex(v1, &vertex);
+		m_indexBuffer.push_back(addVertex(v1, vt1, vn1, &vertex));
 
 		vertex.position[0] = m_vertexCoords[v2 * 3];
 		vertex.position[1] = m_vertexCoords[v2 * 3 + 1];
@@ -662,51 +1073,19 @@ namespace
 		vertex.normal[0] = m_normals[vn2 * 3];
 		vertex.normal[1] = m_normals[vn2 * 3 + 1];
 		vertex.normal[2] = m_normals[vn2 * 3 + 2];
-		m_indexBuffer[index * 3 + 2] = addVertex(v2, &vertex);
+		m_indexBuffer.push_back(addVertex(v2, vt2, vn2, &vertex));
 	}
 	//--------------------------------------------------------------------------
-	int ModelOBJ::addVertex(int hash, const Vertex *pVertex)
+	int ModelOBJ::addVertex(int v, int vt, int vn, const Vertex *pVertex)
 	{
-		int index = -1;
-		std::map<int, std::vector<int> >::const_iterator iter = m_vertexCache.find(hash);
+		// Corners sharing the same (v, vt, vn) triplet share the same vertex.
+		int index = static_cast<int>(m_vertexBuffer.size());
+		int cachedIndex = m_vertexCache.insert(v, vt, vn, index);
 
-		if (iter == m_vertexCache.end())
-		{
-		    // Vertex hash doesn't exist in the cache.
-
-		    index = static_cast<int>(m_vertexBuffer.size());
+		if (cachedIndex == index)
 		    m_vertexBuffer.push_back(*pVertex);
-		    m_vertexCache.insert(std::make_pair(hash, std::vector<int>(1, index)));
-		}
-		else
-		{
-		    // One or more vertices have been hashed to this entry in the cache.
-
-		    const std::vector<int> &vertices = iter->second;
-		    const Vertex *pCachedVertex = 0;
-		    bool found = false;
-
-		    for (std::vector<int>::const_iterator i = vertices.begin(); i != vertices.end(); ++i)
-		    {
-		        index = *i;
-		        pCachedVertex = &m_vertexBuffer[index];
 
-		        if (memcmp(pCachedVertex, pVertex, sizeof(Vertex)) == 0)
-		        {
-		            found = true;
-		            break;
-		        }
-		    }
-
-		    if (!found)
-		    {
-		        index = static_cast<int>(m_vertexBuffer.size());
-		        m_vertexBuffer.push_back(*pVertex);
-		        m_vertexCache[hash].push_back(index);
-		    }
-		}
-
-		return index;
+		return cachedIndex;
 	}
 	//--------------------------------------------------------------------------
 	void ModelOBJ::buildMeshes()
@@ -1110,6 +1489,330 @@ namespace
 		m_hasTangents = true;
 	}
 	//--------------------------------------------------------------------------
+	void ModelOBJ::importGeometry(const char *pBegin, const char *pEnd)
+	{
+		m_hasTextureCoords = false;
+		m_hasNormals = false;
+
+		m_numberOfVertexCoords = 0;
+		m_numberOfTextureCoords = 0;
+		m_numberOfNormals = 0;
+		m_numberOfTriangles = 0;
+
+		m_vertexCoords.clear();
+		m_textureCoords.clear();
+		m_normals.clear();
+		m_indexBuffer.clear();
+		m_attributeBuffer.clear();
+
+		// Split the file into line aligned chunks. There are more chunks than
+		// threads since vertex and face lines do not cost the same to parse.
+		int numThreads = m_numberOfThreads;
+		#ifdef _OPENMP
+		if (numThreads <= 0)
+		    numThreads = omp_get_max_threads();
+		#else
+		numThreads = 1;
+		#endif
+
+		std::size_t size = pEnd - pBegin;
+		std::size_t numChunks = (numThreads > 1) ? std::size_t(numThreads) * 4 : 1;
+		numChunks = std::max<std::size_t>(1, std::min(numChunks, size / MIN_CHUNK_SIZE));
+
+		std::vector<Chunk> chunks(numChunks);
+		const char *p = pBegin;
+
+		for (std::size_t i = 0; i < numChunks; ++i)
+		{
+		    const char *pSplit = pBegin + (size * (i + 1)) / numChunks;
+		    chunks[i].pBegin = p;
+		    chunks[i].pEnd = (i + 1 == numChunks) ? pEnd : skipLine(std::max(p, pSplit - 1), pEnd);
+		    p = chunks[i].pEnd;
+		}
+
+		// Parse all chunks independently.
+		int numParallelChunks = static_cast<int>(numChunks);
+		#pragma omp parallel for schedule(dynamic, 1) num_threads(numThreads) if(numThreads > 1)
+		for (int i = 0; i < numParallelChunks; ++i)
+		    importChunk(chunks[i]);
+
+		// Concatenate the attributes. The number of attributes preceding each
+		// chunk is the offset of its (relative) negative indices.
+		std::size_t numVertexCoords = 0;
+		std::size_t numTextureCoords = 0;
+		std::size_t numNormals = 0;
+
+		for (std::size_t i = 0; i < numChunks; ++i)
+		{
+		    numVertexCoords += chunks[i].vertexCoords.size();
+		    numTextureCoords += chunks[i].textureCoords.size();
+		    numNormals += chunks[i].normals.size();
+		}
+
+		m_vertexCoords.reserve(numVertexCoords);
+		m_textureCoords.reserve(numTextureCoords);
+		m_normals.reserve(numNormals);
+
+		// Size the welding table and the output buffers from the number of
+		// triangles, a closed mesh has about half as many vertices.
+		std::size_t numTriangles = 0;
+
+		for (std::size_t i = 0; i < numChunks; ++i)
+		{
+		    for (std::size_t f = 0; f < chunks[i].faces.size(); ++f)
+		        numTriangles += chunks[i].faces[f].numberOfCorners - 2;
+		}
+
+		m_vertexCache.reserve(static_cast<int>(numTriangles));
+		m_indexBuffer.reserve(numTriangles * 3);
+		m_attributeBuffer.reserve(numTriangles);
+
+		for (std::size_t i = 0; i < numChunks; ++i)
+		{
+		    Chunk &chunk = chunks[i];
+		    chunk.vertexOffset = static_cast<int>(m_vertexCoords.size() / 3);
+		    chunk.textureOffset = static_cast<int>(m_textureCoords.size() / 2);
+		    chunk.normalOffset = static_cast<int>(m_normals.size() / 3);
+
+		    m_vertexCoords.insert(m_vertexCoords.end(), chunk.vertexCoords.begin(), chunk.vertexCoords.end());
+		    m_textureCoords.insert(m_textureCoords.end(), chunk.textureCoords.begin(), chunk.textureCoords.end());
+		    m_normals.insert(m_normals.end(), chunk.normals.begin(), chunk.normals.end());
+
+		    std::vector<float>().swap(chunk.vertexCoords);
+		    std::vector<float>().swap(chunk.textureCoords);
+		    std::vector<float>().swap(chunk.normals);
+		}
+
+		// Stitch the faces in file order so that the vertex welding, and
+		// thus the output, does not depend on the number of chunks.
+		int activeMaterial = 0;
+		std::map<std::string, int>::const_iterator iter;
+
+		for (std::size_t i = 0; i < numChunks; ++i)
+		{
+		    const Chunk &chunk = chunks[i];
+		    std::size_t statement = 0;
+
+		    for (std::size_t f = 0; f <= chunk.faces.size(); ++f)
+		    {
+		        // Apply the mtllib and usemtl statements preceding this face.
+		        for (; statement < chunk.statements.size() && chunk.statements[statement].face == static_cast<int>(f); ++statement)
+		        {
+		            const Statement &s = chunk.statements[statement];
+
+		            if (s.library)
+		            {
+		                importMaterials((m_directoryPath + s.name).c_str());
+		            }
+		            else
+		            {
+		                iter = m_materialCache.find(s.name);
+		                activeMaterial = (iter == m_materialCache.end()) ? 0 : iter->second;
+		            }
+		        }
+
+		        if (f == chunk.faces.size())
+		            break;
+
+		        // Resolve the face indices and triangulate it as a fan.
+		        const Face &face = chunk.faces[f];
+		        const int *pCorner = &chunk.corners[face.firstCorner * 3];
+		        int numFaceVertices = chunk.vertexOffset + face.numberOfVertexCoords;
+		        int numFaceTexCoords = chunk.textureOffset + face.numberOfTextureCoords;
+		        int numFaceNormals = chunk.normalOffset + face.numberOfNormals;
+		        int v[3] = {0};
+		        int vt[3] = {0};
+		        int vn[3] = {0};
+
+		        for (int corner = 0; corner < face.numberOfCorners; ++corner, pCorner += 3)
+		        {
+		            int slot = (corner < 2) ? corner : 2;
+
+		            v[slot] = resolveIndex(pCorner[0], numFaceVertices);
+		            vt[slot] = resolveIndex(pCorner[1], numFaceTexCoords);
+		            vn[slot] = resolveIndex(pCorner[2], numFaceNormals);
+
+		            if (corner < 2)
+		                continue;
+
+		            if (face.hasTexCoord && face.hasNormal)
+		                addTrianglePosTexCoordNormal(activeMaterial, v[0], v[1], v[2], vt[0], vt[1], vt[2], vn[0], vn[1], vn[2]);
+		            else if (face.hasNormal)
+		                addTrianglePosNormal(activeMaterial, v[0], v[1], v[2], vn[0], vn[1], vn[2]);
+		            else if (face.hasTexCoord)
+		                addTrianglePosTexCoord(activeMaterial, v[0], v[1], v[2], vt[0], vt[1], vt[2]);
+		            else
+		                addTrianglePos(activeMaterial, v[0], v[1], v[2]);
+
+		            v[1] = v[2];
+		            vt[1] = vt[2];
+		            vn[1] = vn[2];
+		        }
+		    }
+		}
+
+		m_numberOfVertexCoords = static_cast<int>(m_vertexCoords.size() / 3);
+		m_numberOfTextureCoords = static_cast<int>(m_textureCoords.size() / 2);
+		m_numberOfNormals = static_cast<int>(m_normals.size() / 3);
+		m_numberOfTriangles = static_cast<int>(m_attributeBuffer.size());
+
+		m_hasPositions = m_numberOfVertexCoords > 0;
+		m_hasNormals = m_numberOfNormals > 0;
+		m_hasTextureCoords = m_numberOfTextureCoords > 0;
+
+		// Define a default material if no materials were loaded.
+		addDefaultMaterial();
+	}
+	//--------------------------------------------------------------------------
+	void ModelOBJ::importChunk(Chunk &chunk)
+	{
+		// Only touches the chunk, this is called concurrently.
+		float x = 0.0f;
+		float y = 0.0f;
+		float z = 0.0f;
+		const char *p = chunk.pBegin;
+		const char *pEnd = chunk.pEnd;
+
+		// Attributes are not pre-counted, all arrays grow geometrically.
+		while (p < pEnd)
+		{
+		    p = skipBlanks(p, pEnd);
+
+		    const char *pToken = p;
+		    p = skipToken(p, pEnd);
+		    std::size_t length = p - pToken;
+
+		    if (length == 0)
+		    {
+		        p = skipLine(p, pEnd);
+		        continue;
+		    }
+
+		    switch (pToken[0])
+		    {
+		    case 'f': // v, v//vn, v/vt, or v/vt/vn.
+		        if (length == 1)
+		            p = importFace(p, pEnd, chunk);
+		        break;
+
+		    case 'm': // mtllib
+		    case 'u': // usemtl
+		        if (length == 6 && (strncmp(pToken, "mtllib", 6) == 0 || strncmp(pToken, "usemtl", 6) == 0))
+		        {
+		            Statement statement;
+		            statement.face = static_cast<int>(chunk.faces.size());
+		            statement.library = (pToken[0] == 'm');
+
+		            pToken = skipBlanks(p, pEnd);
+		            p = skipToken(pToken, pEnd);
+		            statement.name.assign(pToken, p);
+		            chunk.statements.push_back(statement);
+		        }
+		        break;
+
+		    case 'v': // v, vn, or vt.
+		        x = y = z = 0.0f;
+
+		        if (length == 1) // v
+		        {
+		            p = parseFloat(parseFloat(parseFloat(p, pEnd, x), pEnd, y), pEnd, z);
+		            chunk.vertexCoords.push_back(x);
+		            chunk.vertexCoords.push_back(y);
+		            chunk.vertexCoords.push_back(z);
+		        }
+		        else if (pToken[1] == 'n') // vn
+		        {
+		            p = parseFloat(parseFloat(parseFloat(p, pEnd, x), pEnd, y), pEnd, z);
+		            chunk.normals.push_back(x);
+		            chunk.normals.push_back(y);
+		            chunk.normals.push_back(z);
+		        }
+		        else if (pToken[1] == 't') // vt
+		        {
+		            p = parseFloat(parseFloat(p, pEnd, x), pEnd, y);
+		            chunk.textureCoords.push_back(x);
+		            chunk.textureCoords.push_back(y);
+		        }
+		        break;
+
+		    default:
+		        break;
+		    }
+
+		    p = skipLine(p, pEnd);
+		}
+	}
+	//--------------------------------------------------------------------------
+	const char *ModelOBJ::importFace(const char *p, const char *pEnd, Chunk &chunk)
+	{
+		Face face;
+		face.firstCorner = static_cast<int>(chunk.corners.size() / 3);
+		face.numberOfCorners = 0;
+		face.hasTexCoord = false;
+		face.hasNormal = false;
+		face.numberOfVertexCoords = static_cast<int>(chunk.vertexCoords.size() / 3);
+		face.numberOfTextureCoords = static_cast<int>(chunk.textureCoords.size() / 2);
+		face.numberOfNormals = static_cast<int>(chunk.normals.size() / 3);
+
+		const char *pNext = 0;
+
+		// The format of the first vertex (v, v//vn, v/vt, or v/vt/vn) is used
+		// for the whole face. Indices are kept as they are in the file since
+		// negative ones can only be resolved once all chunks are parsed.
+		for (;;)
+		{
+		    int v = 0;
+		    int vt = 0;
+		    int vn = 0;
+		    bool texCoord = false;
+		    bool normal = false;
+
+		    p = skipBlanks(p, pEnd);
+		    pNext = parseInt(p, pEnd, v);
+		    if (pNext == p)
+		        break;
+		    p = pNext;
+
+		    if (p < pEnd && *p == '/')
+		    {
+		        ++p;
+		        pNext = parseInt(p, pEnd, vt);
+		        texCoord = (pNext != p);
+		        p = pNext;
+
+		        if (p < pEnd && *p == '/')
+		        {
+		            ++p;
+		            pNext = parseInt(p, pEnd, vn);
+		            normal = (pNext != p);
+		            p = pNext;
+		        }
+		    }
+
+		    if (face.numberOfCorners == 0)
+		    {
+		        face.hasTexCoord = texCoord;
+		        face.hasNormal = normal;
+		    }
+		    else if (texCoord != face.hasTexCoord || normal != face.hasNormal)
+		    {
+		        break;
+		    }
+
+		    chunk.corners.push_back(v);
+		    chunk.corners.push_back(vt);
+		    chunk.corners.push_back(vn);
+		    ++face.numberOfCorners;
+		}
+
+		if (face.numberOfCorners >= 3)
+		    chunk.faces.push_back(face);
+		else
+		    chunk.corners.resize(face.firstCorner * 3);
+
+		return p;
+	}
+	//--------------------------------------------------------------------------
 	void ModelOBJ::importGeometryFirstPass(FILE *pFile)
 	{
 		m_hasTextureCoords = false;
@@ -1216,10 +1919,16 @@ namespace
 		m_vertexCoords.resize(m_numberOfVertexCoords * 3);
 		m_textureCoords.resize(m_numberOfTextureCoords * 2);
 		m_normals.resize(m_numberOfNormals * 3);
-		m_indexBuffer.resize(m_numberOfTriangles * 3);
-		m_attributeBuffer.resize(m_numberOfTriangles);
+		m_indexBuffer.reserve(m_numberOfTriangles * 3);
+		m_attributeBuffer.reserve(m_numberOfTriangles);
+		m_vertexCache.reserve(m_numberOfTriangles);
 
 		// Define a default material if no materials were loaded.
+		addDefaultMaterial();
+	}
+	//--------------------------------------------------------------------------
+	void ModelOBJ::addDefaultMaterial()
+	{
 		if (m_numberOfMaterials == 0)
 		{
 		    Material defaultMaterial =
@@ -1247,7 +1956,6 @@ namespace
 		int numVertices = 0;
 		int numTexCoords = 0;
 		int numNormals = 0;
-		int numTriangles = 0;
 		int activeMaterial = 0;
 		char buffer[256] = {0};
 		std::map<std::string, int>::const_iterator iter;
@@ -1269,15 +1977,15 @@ namespace
 		            fscanf(pFile, "%256d//%256d", &v[1], &vn[1]);
 		            fscanf(pFile, "%256d//%256d", &v[2], &vn[2]);
 
-		            v[0] = (v[0] < 0) ? v[0] + numVertices - 1 : v[0] - 1;
-		            v[1] = (v[1] < 0) ? v[1] + numVertices - 1 : v[1] - 1;
-		            v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+		            v[0] = (v[0] < 0) ? v[0] + numVertices : v[0] - 1;
+		            v[1] = (v[1] < 0) ? v[1] + numVertices : v[1] - 1;
+		            v[2] = (v[2] < 0) ? v[2] + numVertices : v[2] - 1;
 
-		            vn[0] = (vn[0] < 0) ? vn[0] + numNormals - 1 : vn[0] - 1;
-		            vn[1] = (vn[1] < 0) ? vn[1] + numNormals - 1 : vn[1] - 1;
-		            vn[2] = (vn[2] < 0) ? vn[2] + numNormals - 1 : vn[2] - 1;
+		            vn[0] = (vn[0] < 0) ? vn[0] + numNormals : vn[0] - 1;
+		            vn[1] = (vn[1] < 0) ? vn[1] + numNormals : vn[1] - 1;
+		            vn[2] = (vn[2] < 0) ? vn[2] + numNormals : vn[2] - 1;
 
-		            addTrianglePosNormal(numTriangles++, activeMaterial,
+		            addTrianglePosNormal(activeMaterial,
 		                v[0], v[1], v[2], vn[0], vn[1], vn[2]);
 
 		            v[1] = v[2];
@@ -1285,10 +1993,10 @@ namespace
 
 		            while (fscanf(pFile, "%256d//%256d", &v[2], &vn[2]) > 0)
 		            {
-		                v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
-		                vn[2] = (vn[2] < 0) ? vn[2] + numNormals - 1 : vn[2] - 1;
+		                v[2] = (v[2] < 0) ? v[2] + numVertices : v[2] - 1;
+		                vn[2] = (vn[2] < 0) ? vn[2] + numNormals : vn[2] - 1;
 
-		                addTrianglePosNormal(numTriangles++, activeMaterial,
+		                addTrianglePosNormal(activeMaterial,
 		                    v[0], v[1], v[2], vn[0], vn[1], vn[2]);
 
 		                v[1] = v[2];
@@ -1300,19 +2008,19 @@ namespace
 		            fscanf(pFile, "%256d/%256d/%256d", &v[1], &vt[1], &vn[1]);
 		            fscanf(pFile, "%256d/%256d/%256d", &v[2], &vt[2], &vn[2]);
 
-		            v[0] = (v[0] < 0) ? v[0] + numVertices - 1 : v[0] - 1;
-		            v[1] = (v[1] < 0) ? v[1] + numVertices - 1 : v[1] - 1;
-		            v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+		            v[0] = (v[0] < 0) ? v[0] + numVertices : v[0] - 1;
+		            v[1] = (v[1] < 0) ? v[1] + numVertices : v[1] - 1;
+		            v[2] = (v[2] < 0) ? v[2] + numVertices : v[2] - 1;
 
-		            vt[0] = (vt[0] < 0) ? vt[0] + numTexCoords - 1 : vt[0] - 1;
-		            vt[1] = (vt[1] < 0) ? vt[1] + numTexCoords - 1 : vt[1] - 1;
-		            vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords - 1 : vt[2] - 1;
+		            vt[0] = (vt[0] < 0) ? vt[0] + numTexCoords : vt[0] - 1;
+		            vt[1] = (vt[1] < 0) ? vt[1] + numTexCoords : vt[1] - 1;
+		            vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords : vt[2] - 1;
 
-		            vn[0] = (vn[0] < 0) ? vn[0] + numNormals - 1 : vn[0] - 1;
-		            vn[1] = (vn[1] < 0) ? vn[1] + numNormals - 1 : vn[1] - 1;
-		            vn[2] = (vn[2] < 0) ? vn[2] + numNormals - 1 : vn[2] - 1;
+		            vn[0] = (vn[0] < 0) ? vn[0] + numNormals : vn[0] - 1;
+		            vn[1] = (vn[1] < 0) ? vn[1] + numNormals : vn[1] - 1;
+		            vn[2] = (vn[2] < 0) ? vn[2] + numNormals : vn[2] - 1;
 
-		            addTrianglePosTexCoordNormal(numTriangles++, activeMaterial,
+		            addTrianglePosTexCoordNormal(activeMaterial,
 		                v[0], v[1], v[2], vt[0], vt[1], vt[2], vn[0], vn[1], vn[2]);
 
 		            v[1] = v[2];
@@ -1321,11 +2029,11 @@ namespace
 
 		            while (fscanf(pFile, "%256d/%256d/%256d", &v[2], &vt[2], &vn[2]) > 0)
 		            {
-		                v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
-		                vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords - 1 : vt[2] - 1;
-		                vn[2] = (vn[2] < 0) ? vn[2] + numNormals - 1 : vn[2] - 1;
+		                v[2] = (v[2] < 0) ? v[2] + numVertices : v[2] - 1;
+		                vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords : vt[2] - 1;
+		                vn[2] = (vn[2] < 0) ? vn[2] + numNormals : vn[2] - 1;
 
-		                addTrianglePosTexCoordNormal(numTriangles++, activeMaterial,
+		                addTrianglePosTexCoordNormal(activeMaterial,
 		                    v[0], v[1], v[2], vt[0], vt[1], vt[2], vn[0], vn[1], vn[2]);
 
 		                v[1] = v[2];
@@ -1338,15 +2046,15 @@ namespace
 		            fscanf(pFile, "%256d/%256d", &v[1], &vt[1]);
 		            fscanf(pFile, "%256d/%256d", &v[2], &vt[2]);
 
-		            v[0] = (v[0] < 0) ? v[0] + numVertices - 1 : v[0] - 1;
-		            v[1] = (v[1] < 0) ? v[1] + numVertices - 1 : v[1] - 1;
-		            v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+		            v[0] = (v[0] < 0) ? v[0] + numVertices : v[0] - 1;
+		            v[1] = (v[1] < 0) ? v[1] + numVertices : v[1] - 1;
+		            v[2] = (v[2] < 0) ? v[2] + numVertices : v[2] - 1;
 
-		            vt[0] = (vt[0] < 0) ? vt[0] + numTexCoords - 1 : vt[0] - 1;
-		            vt[1] = (vt[1] < 0) ? vt[1] + numTexCoords - 1 : vt[1] - 1;
-		            vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords - 1 : vt[2] - 1;
+		            vt[0] = (vt[0] < 0) ? vt[0] + numTexCoords : vt[0] - 1;
+		            vt[1] = (vt[1] < 0) ? vt[1] + numTexCoords : vt[1] - 1;
+		            vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords : vt[2] - 1;
 
-		            addTrianglePosTexCoord(numTriangles++, activeMaterial,
+		            addTrianglePosTexCoord(activeMaterial,
 		                v[0], v[1], v[2], vt[0], vt[1], vt[2]);
 
 		            v[1] = v[2];
@@ -1354,10 +2062,10 @@ namespace
 
 		            while (fscanf(pFile, "%256d/%256d", &v[2], &vt[2]) > 0)
 		            {
-		                v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
-		                vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords - 1 : vt[2] - 1;
+		                v[2] = (v[2] < 0) ? v[2] + numVertices : v[2] - 1;
+		                vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords : vt[2] - 1;
 
-		                addTrianglePosTexCoord(numTriangles++, activeMaterial,
+		                addTrianglePosTexCoord(activeMaterial,
 		                    v[0], v[1], v[2], vt[0], vt[1], vt[2]);
 
 		                v[1] = v[2];
@@ -1370,19 +2078,19 @@ namespace
 		            fscanf(pFile, "%256d", &v[1]);
 		            fscanf(pFile, "%256d", &v[2]);
 
-		            v[0] = (v[0] < 0) ? v[0] + numVertices - 1 : v[0] - 1;
-		            v[1] = (v[1] < 0) ? v[1] + numVertices - 1 : v[1] - 1;
-		            v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+		            v[0] = (v[0] < 0) ? v[0] + numVertices : v[0] - 1;
+		            v[1] = (v[1] < 0) ? v[1] + numVertices : v[1] - 1;
+		            v[2] = (v[2] < 0) ? v[2] + numVertices : v[2] - 1;
 
-		            addTrianglePos(numTriangles++, activeMaterial, v[0], v[1], v[2]);
+		            addTrianglePos(activeMaterial, v[0], v[1], v[2]);
 
 		            v[1] = v[2];
 
 		            while (fscanf(pFile, "%256d", &v[2]) > 0)
 		            {
-		                v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+		                v[2] = (v[2] < 0) ? v[2] + numVertices : v[2] - 1;
 
-		                addTrianglePos(numTriangles++, activeMaterial, v[0], v[1], v[2]);
+		                addTrianglePos(activeMaterial, v[0], v[1], v[2]);
 
 		                v[1] = v[2];
 		            }
@@ -1441,6 +2149,8 @@ namespace
 		if (!pFile)
 		    return false;
 
+		m_materialLibraries.push_back(pszFilename);
+
 		Material *pMaterial = 0;
 		int illum = 0;
 		int numMaterials = 0;
@@ -1740,12 +2450,53 @@ namespace glf
 				_textureDB["defaultnormal"]   = normalTex;
 			}
 		}
+		namespace
+		{
+			//------------------------------------------------------------------
+			// Reorders triangles of each cluster for the post-transform cache
+			// and the clusters of each mesh for overdraw, then vertices in
+			// fetch order
+			void OptimizeModel(	std::vector<glm::vec3>& _positions,
+								ModelData& _model,
+								bool _verbose)
+			{
+				int nVertices = int(_model.vertices.size());
+				int nIndices  = int(_model.indices.size());
+				CacheStatistics before;
+				if(_verbose)
+					before = SimulateVertexCache(&_model.indices[0],nIndices,nVertices);
+
+				int nClusters = int(_model.clusters.size());
+				for(int first=0,last=0;first<nClusters;first=last)
+				{
+					while(last<nClusters && _model.clusters[last].mesh==_model.clusters[first].mesh)
+						++last;
+					OptimizeClusters(	&_positions[0],
+										&_model.indices[0],
+										&_model.clusters[first],
+										last-first);
+				}
+
+				std::vector<unsigned int> remap;
+				OptimizeVertexFetch(&_model.indices[0],nIndices,nVertices,remap);
+				RemapVertices(_model.vertices,remap);
+				RemapVertices(_positions,remap);
+
+				if(_verbose)
+				{
+					CacheStatistics after = SimulateVertexCache(&_model.indices[0],nIndices,nVertices);
+					glf::Info("----------------------------------------------");
+					glf::Info("Vertex cache : %d entries (FIFO)",VERTEX_CACHE_SIZE);
+					glf::Info("ACMR         : %.3f -> %.3f",before.ACMR(),after.ACMR());
+					glf::Info("ATVR         : %.3f -> %.3f",before.ATVR(),after.ATVR());
+				}
+			}
+		}
 		//----------------------------------------------------------------------
-		void LoadModel(		const std::string& _folder,
+		bool BuildModel(	const std::string& _folder,
 							const std::string& _filename,
 							const glm::mat4& _transform,
-							ResourceManager& _resourceManager,
-							SceneManager& _scene,
+							ModelData& _model,
 							bool _verbose)
 		{
 			// Load objects
@@ -1753,8 +2504,8 @@ namespace glf
 			bool loadOK = loader.import((_folder+_filename).c_str(), true, true);
 			if(!loadOK)
 			{
-				glf::Error("Load model error (Folder: %s, Filename: %s)",_folder.c_str(),_filename.c_str());
-				exit(-1);
+				glf::Warning("Load model error (Folder: %s, Filename: %s)",_folder.c_str(),_filename.c_str());
+				return false;
 			}
 
 			int nObjects = loader.getNumberOfMeshes();
@@ -1776,41 +2527,33 @@ namespace glf
 			assert(loader.hasNormals());
 			assert(loader.hasTangents());
 
-			// Create VBO
-			glf::VertexBuffer3F* vb = _resourceManager.CreateVBO3F();
-			glf::VertexBuffer3F* nb = _resourceManager.CreateVBO3F();
-			glf::VertexBuffer4F* tb = _resourceManager.CreateVBO4F();
-			glf::VertexBuffer2F* ub = _resourceManager.CreateVBO2F();
-
+			// Transform and quantize vertices
 			int nVertices = loader.getNumberOfVertices();
-			vb->Allocate(nVertices,GL_STATIC_DRAW);
-			nb->Allocate(nVertices,GL_STATIC_DRAW);
-			tb->Allocate(nVertices,GL_STATIC_DRAW);
-			ub->Allocate(nVertices,GL_STATIC_DRAW);
+			_model.vertices.resize(nVertices);
 
 			glm::mat3 rotTransform = glm::mat3(_transform);
 			const ModelOBJ::Vertex* vSource = loader.getVertexBuffer();
-			glm::vec3* vptr = vb->Lock();
-			glm::vec3* nptr = nb->Lock();
-			glm::vec4* tptr = tb->Lock();
-			glm::vec2* uptr = ub->Lock();
+			std::vector<glm::vec3> positions(nVertices);
 			for(int i=0;i<nVertices;++i)
 			{
-				vptr[i].x = vSource[i].position[0];
-				vptr[i].y = vSource[i].position[1];
-				vptr[i].z = vSource[i].position[2];
-				vptr[i]   = glm::vec3(_transform * glm::vec4(vptr[i],1.f));
-
-				nptr[i].x = vSource[i].normal[0];
-				nptr[i].y = vSource[i].normal[1];
-				nptr[i].z = vSource[i].normal[2];
-				nptr[i]   = glm::normalize(rotTransform * nptr[i]);
-
-				tptr[i].x = vSource[i].tangent[0];
-				tptr[i].y = vSource[i].tangent[1];
-				tptr[i].z = vSource[i].tangent[2];
-				tptr[i].w = 0; 						// For removing translation
-				tptr[i]   = glm::normalize(_transform * tptr[i]);
+				glm::vec3 position;
+				position.x = vSource[i].position[0];
+				position.y = vSource[i].position[1];
+				position.z = vSource[i].position[2];
+				position   = glm::vec3(_transform * glm::vec4(position,1.f));
+
+				glm::vec3 normal;
+				normal.x   = vSource[i].normal[0];
+				normal.y   = vSource[i].normal[1];
+				normal.z   = vSource[i].normal[2];
+				normal     = glm::normalize(rotTransform * normal);
+
+				glm::vec4 tangent;
+				tangent.x  = vSource[i].tangent[0];
+				tangent.y  = vSource[i].tangent[1];
+				tangent.z  = vSource[i].tangent[2];
+				tangent.w  = 0; 						// For removing translation
+				tangent    = glm::normalize(_transform * tangent);
 
 				glm::vec3 bitangent;
 				bitangent.x = vSource[i].bitangent[0];
@@ -1818,87 +2561,53 @@ namespace glf
 				bitangent.z = vSource[i].bitangent[2];
 				bitangent   = glm::normalize(rotTransform * bitangent);
 
-				uptr[i].x = vSource[i].texCoord[0];
-				uptr[i].y = vSource[i].texCoord[1];
+				glm::vec2 texCoord;
+				texCoord.x = vSource[i].texCoord[0];
+				texCoord.y = vSource[i].texCoord[1];
 
 				// Compute the referential's handedness and store its sign 
 				// into w component of the tangent vector
-				tptr[i].w = glm::dot(bitangent,glm::normalize(glm::cross(nptr[i],glm::vec3(tptr[i]))));
-				//glf::Info("Sign : %f",tptr[i].w);
+				tangent.w  = glm::dot(bitangent,glm::normalize(glm::cross(normal,glm::vec3(tangent))));
+
+				positions[i]       = position;
+				_model.vertices[i] = EncodeVertex(position,normal,tangent,texCoord);
 			}
-			ub->Unlock();
-			tb->Unlock();
-			nb->Unlock();
-			vb->Unlock();
 
-			// Create IBO
-			glf::IndexBuffer* ib = _resourceManager.CreateIBO();
+			// Copy indices
 			int nIndices = loader.getNumberOfIndices();
-			ib->Allocate(nIndices);
 			const int* iSource = loader.getIndexBuffer();
-			unsigned int* iptr = ib->Lock();
-			for(int i=0;i<nIndices;++i)
-				iptr[i] = iSource[i];
-			ib->Unlock();
-
-			// Create VAOs
-			glf::VertexArray* regularVAO = _resourceManager.CreateVAO();
-			regularVAO->Add(*vb,semantic::Position, 3,GL_FLOAT,false,0);
-			regularVAO->Add(*nb,semantic::Normal,   3,GL_FLOAT,false,0);
-			regularVAO->Add(*tb,semantic::Tangent,  4,GL_FLOAT,false,0);
-			regularVAO->Add(*ub,semantic::TexCoord, 2,GL_FLOAT,false,0);
-
-			glf::VertexArray* shadowVAO  = _resourceManager.CreateVAO();
-			shadowVAO->Add(*vb,semantic::Position,  3,GL_FLOAT,false,0);
-
-			// Create objets and load textures
-			TextureDB textureDB;
-			InitializeDB(textureDB,_resourceManager);
+			_model.indices.assign(iSource,iSource+nIndices);
+
+			// Create objets (textures are referenced by their filename, an
+			// empty filename stands for the default texture)
+			_model.meshes.resize(nObjects);
 			for(int i=0;i<nObjects;++i)
 			{
 				const ModelOBJ::Mesh& mesh	= loader.getMesh(i);
+				MeshData& mdata				= _model.meshes[i];
 
-				// Load textures
-				glf::Texture2D* diffuseTex  = GetDiffuseTex(_folder,mesh.pMaterial->colorMapFilename,textureDB,_resourceManager);
-				//glf::Texture2D* specularTex = GetSpecularTex(_folder,mesh.pMaterial->specularMapFilename,textureDB,_resourceManager);
+				mdata.diffuseTex   = ValidFilename(_folder,mesh.pMaterial->colorMapFilename,"");
 				#if ENABLE_LOAD_NORMAL_MAP
-				glf::Texture2D* normalTex   = GetNormalTex(_folder,mesh.pMaterial->bumpMapFilename,textureDB,_resourceManager);
+				mdata.normalTex    = ValidFilename(_folder,mesh.pMaterial->bumpMapFilename,"");
 				#else
-				glf::Texture2D* normalTex   = GetNormalTex(_folder,"",textureDB,_resourceManager);
-				#endif
-
-				// Create and add regular mesh
-				RegularMesh rmesh;
-				rmesh.diffuseTex   = diffuseTex;
-				//rmesh.specularTex  = specularTex;
-				rmesh.normalTex    = normalTex;
-				rmesh.roughness    = 1.f / mesh.pMaterial->shininess; // (Has to be specified as roughness into MTL file)
-				rmesh.specularity  = 0.3333f * (mesh.pMaterial->specular[0]+mesh.pMaterial->specular[1]+mesh.pMaterial->specular[2]);
-				rmesh.indices      = ib;
-				rmesh.startIndices = mesh.startIndex;
-				rmesh.countIndices = mesh.triangleCount*3;
-				rmesh.primitiveType= GL_TRIANGLES;
-				rmesh.primitive    = regularVAO;
-				_scene.regularMeshes.push_back(rmesh);
-
-				// Create and add shadow mesh
-				ShadowMesh smesh;
-				smesh.indices      = ib;
-				smesh.startIndices = mesh.startIndex;
-				smesh.countIndices = mesh.triangleCount*3;
-				smesh.primitiveType= GL_TRIANGLES;
-				smesh.primitive    = shadowVAO;
-				_scene.shadowMeshes.push_back(smesh);
-
-				glm::mat4 identity(1);
-				_scene.transformations.push_back(identity);
-
-				BBox obound = ObjectBound(*vb,*ib,rmesh.startIndices,rmesh.countIndices);
-				_scene.oBounds.push_back(obound);
-
-				#if ENABLE_OBJECT_TBN_HELPERS
-					glf::manager::helpers->CreateTangentSpace(*vb,*nb,*tb,*ib,rmesh.startIndices,rmesh.countIndices,0.1f);
+				mdata.normalTex    = "";
 				#endif
+				mdata.roughness    = 1.f / mesh.pMaterial->shininess; // (Has to be specified as roughness into MTL file)
+				mdata.specularity  = 0.3333f * (mesh.pMaterial->specular[0]+mesh.pMaterial->specular[1]+mesh.pMaterial->specular[2]);
+				mdata.startIndices = mesh.startIndex;
+				mdata.countIndices = mesh.triangleCount*3;
+
+				// Bound is computed on CPU, no need to read back the VBO
+				mdata.bound        = BBox();
+				for(int j=mdata.startIndices;j<mdata.startIndices+mdata.countIndices;++j)
+					mdata.bound.Add(positions[iSource[j]]);
+
+				BuildClusters(	&positions[0],
+								&_model.indices[0],
+								mdata.startIndices,
+								mdata.countIndices,
+								i,
+								_model.clusters);
 
 				if(_verbose)
 				{
@@ -1933,16 +2642,474 @@ namespace glf
 					glf::Info("Bump      : %s",mesh.pMaterial->bumpMapFilename.c_str());
 
 					glf::Info("Bound     : (%f,%f,%f) (%f,%f,%f)",
-											obound.pMin.x,
-											obound.pMin.y,
-											obound.pMin.z,
-											obound.pMax.x,
-											obound.pMax.y,
-											obound.pMax.z);
+											mdata.bound.pMin.x,
+											mdata.bound.pMin.y,
+											mdata.bound.pMin.z,
+											mdata.bound.pMax.x,
+											mdata.bound.pMax.y,
+											mdata.bound.pMax.z);
 				}
 			}
 
+			#if ENABLE_MESH_OPTIMIZATION
+			OptimizeModel(positions,_model,_verbose);
+			#endif
+			if(_verbose)
+			{
+				glf::Info("----------------------------------------------");
+				glf::Info("Clusters     : %d (%.1f triangles on average)",
+							int(_model.clusters.size()),
+							_model.clusters.empty() ? 0.f : float(nIndices/3)/float(_model.clusters.size()));
+			}
+
+			// Files the model has been built from
+			_model.sources.push_back(_folder+_filename);
+			const std::vector<std::string>& libraries = loader.getMaterialLibraries();
+			_model.sources.insert(_model.sources.end(),libraries.begin(),libraries.end());
+
 			loader.destroy();
+			return true;
+		}
+		//----------------------------------------------------------------------
+		GLenum ModelIndexType(int _nVertices)
+		{
+			return _nVertices<65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		}
+		namespace
+		{
+			//------------------------------------------------------------------
+			// Vertex and index buffers of a model on their own, with its
+			// regular and shadow vertex arrays
+			void CreateModelArrays(	const MeshVertex* _vertices,
+									int _nVertices,
+									const void* _indices,
+									int _nIndices,
+									GLenum _indexType,
+									ResourceManager& _resourceManager,
+									glf::VertexArray*& _regularVAO,
+									glf::VertexArray*& _shadowVAO)
+			{
+				// Create VBO
+				glf::MeshVertexBuffer* vb = _resourceManager.CreateMeshVBO();
+				vb->Allocate(_nVertices,GL_STATIC_DRAW);
+				vb->Fill(const_cast<MeshVertex*>(_vertices),_nVertices);
+
+				// Create VAOs
+				_regularVAO = _resourceManager.CreateVAO();
+				_regularVAO->Add(*vb,semantic::Position, 3,GL_FLOAT,		false,offsetof(MeshVertex,position));
+				_regularVAO->Add(*vb,semantic::Normal,   2,GL_SHORT,		true, offsetof(MeshVertex,normal));
+				_regularVAO->Add(*vb,semantic::Tangent,  2,GL_SHORT,		true, offsetof(MeshVertex,tangent));
+				_regularVAO->Add(*vb,semantic::TexCoord, 2,GL_HALF_FLOAT,	false,offsetof(MeshVertex,texCoord));
+
+				_shadowVAO  = _resourceManager.CreateVAO();
+				_shadowVAO->Add(*vb,semantic::Position,  3,GL_FLOAT,		false,offsetof(MeshVertex,position));
+
+				// Create IBO, attached to both VAOs
+				if(_indexType==GL_UNSIGNED_SHORT)
+				{
+					glf::IndexBuffer16* ib = _resourceManager.CreateIBO16();
+					ib->Allocate(_nIndices,GL_STATIC_DRAW);
+					ib->Fill((unsigned short*)_indices,_nIndices);
+					_regularVAO->SetIndices(*ib);
+					_shadowVAO->SetIndices(*ib);
+				}
+				else
+				{
+					glf::IndexBuffer* ib = _resourceManager.CreateIBO();
+					ib->Allocate(_nIndices,GL_STATIC_DRAW);
+					ib->Fill((unsigned int*)_indices,_nIndices);
+					_regularVAO->SetIndices(*ib);
+					_shadowVAO->SetIndices(*ib);
+				}
+			}
+			//------------------------------------------------------------------
+			void AddGeometryMemory(	int _nVertices,
+									int _nIndices,
+									GLenum _indexType,
+									SceneManager& _scene)
+			{
+				GeometryMemory& memory = _scene.geometryMemory;
+				memory.nVertices   += _nVertices;
+				memory.nIndices    += _nIndices;
+				memory.vertexBytes += _nVertices*sizeof(MeshVertex);
+				memory.indexBytes  += _nIndices*(_indexType==GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
+			}
+			//------------------------------------------------------------------
+			// Builds a model and loads its textures. Indices are narrowed
+			// into _indices16 when possible, returns the indices to upload
+			const void* PrepareModel(	const std::string& _folder,
+										const std::string& _filename,
+										const glm::mat4& _transform,
+										ResourceManager& _resourceManager,
+										ModelData& _model,
+										std::vector<RegularMesh>& _meshes,
+										std::vector<BBox>& _bounds,
+										std::vector<unsigned short>& _indices16,
+										bool _verbose)
+			{
+				if(!BuildModel(_folder,_filename,_transform,_model,_verbose))
+				{
+					glf::Error("Load model error (Folder: %s, Filename: %s)",_folder.c_str(),_filename.c_str());
+					exit(-1);
+				}
+
+				// Load textures
+				TextureDB textureDB;
+				InitializeDB(textureDB,_resourceManager);
+				int nObjects = int(_model.meshes.size());
+				_meshes.resize(nObjects);
+				_bounds.resize(nObjects);
+				for(int i=0;i<nObjects;++i)
+				{
+					const MeshData& mdata = _model.meshes[i];
+					_meshes[i].diffuseTex   = GetDiffuseTex("",mdata.diffuseTex,textureDB,_resourceManager);
+					_meshes[i].normalTex    = GetNormalTex("",mdata.normalTex,textureDB,_resourceManager);
+					_meshes[i].roughness    = mdata.roughness;
+					_meshes[i].specularity  = mdata.specularity;
+					_meshes[i].startIndices = mdata.startIndices;
+					_meshes[i].countIndices = mdata.countIndices;
+					_bounds[i]              = mdata.bound;
+				}
+
+				// Narrow indices when possible
+				if(ModelIndexType(int(_model.vertices.size()))==GL_UNSIGNED_SHORT)
+				{
+					_indices16.assign(_model.indices.begin(),_model.indices.end());
+					return &_indices16[0];
+				}
+				return &_model.indices[0];
+			}
+		}
+		//----------------------------------------------------------------------
+		void CreateModel(	const MeshVertex* _vertices,
+							int _nVertices,
+							const void* _indices,
+							int _nIndices,
+							const std::vector<RegularMesh>& _meshes,
+							const std::vector<BBox>& _bounds,
+							const std::vector<MeshCluster>& _clusters,
+							ResourceManager& _resourceManager,
+							SceneManager& _scene)
+		{
+			assert(_meshes.size()==_bounds.size());
+
+			GLenum indexType = ModelIndexType(_nVertices);
+			#if ENABLE_GEOMETRY_ARENA
+			// Sub-allocate the model into the shared buffers
+			GeometryArena& arena = _resourceManager.Arena();
+			int baseVertex, firstIndex;
+			arena.Add(_vertices,_nVertices,_indices,_nIndices,indexType,baseVertex,firstIndex);
+			glf::VertexArray* regularVAO = arena.RegularVAO(indexType);
+			glf::VertexArray* shadowVAO  = arena.ShadowVAO(indexType);
+			#else
+			int baseVertex = 0, firstIndex = 0;
+			glf::VertexArray* regularVAO;
+			glf::VertexArray* shadowVAO;
+			CreateModelArrays(_vertices,_nVertices,_indices,_nIndices,indexType,_resourceManager,regularVAO,shadowVAO);
+			#endif
+			AddGeometryMemory(_nVertices,_nIndices,indexType,_scene);
+
+			// Clusters refer to the meshes of the model
+			int firstMesh = int(_scene.regularMeshes.size());
+			for(unsigned int i=0;i<_clusters.size();++i)
+			{
+				MeshCluster cluster = _clusters[i];
+				cluster.mesh       += firstMesh;
+				cluster.startIndices += firstIndex;
+				_scene.regularClusters.push_back(cluster);
+			}
+
+			// Create objets
+			for(unsigned int i=0;i<_meshes.size();++i)
+			{
+				// Create and add regular mesh
+				RegularMesh rmesh  = _meshes[i];
+				rmesh.indexType    = indexType;
+				rmesh.startIndices+= firstIndex;
+				rmesh.baseVertex   = baseVertex;
+				rmesh.primitiveType= GL_TRIANGLES;
+				rmesh.primitive    = regularVAO;
+				_scene.regularMeshes.push_back(rmesh);
+
+				// Create and add shadow mesh
+				ShadowMesh smesh;
+				smesh.indexType    = indexType;
+				smesh.startIndices = rmesh.startIndices;
+				smesh.countIndices = rmesh.countIndices;
+				smesh.baseVertex   = baseVertex;
+				smesh.primitiveType= GL_TRIANGLES;
+				smesh.primitive    = shadowVAO;
+				_scene.shadowMeshes.push_back(smesh);
+
+				glm::mat4 identity(1);
+				_scene.transformations.push_back(identity);
+				_scene.oBounds.push_back(_bounds[i]);
+
+				#if ENABLE_OBJECT_TBN_HELPERS
+					glf::manager::helpers->CreateTangentSpace(_vertices,_indices,indexType,_meshes[i].startIndices,_meshes[i].countIndices,0.1f);
+				#endif
+			}
+		}
+		//----------------------------------------------------------------------
+		void LoadModel(		const std::string& _folder,
+							const std::string& _filename,
+							const glm::mat4& _transform,
+							ResourceManager& _resourceManager,
+							SceneManager& _scene,
+							bool _verbose)
+		{
+			ModelData model;
+			std::vector<RegularMesh> meshes;
+			std::vector<BBox> bounds;
+			std::vector<unsigned short> indices16;
+			const void* indices = PrepareModel(_folder,_filename,_transform,_resourceManager,model,meshes,bounds,indices16,_verbose);
+
+			CreateModel(&model.vertices[0],
+						int(model.vertices.size()),
+						indices,
+						int(model.indices.size()),
+						meshes,
+						bounds,
+						model.clusters,
+						_resourceManager,
+						_scene);
+		}
+		//----------------------------------------------------------------------
+		void LoadInstancedModel(const std::string& _folder,
+							const std::string& _filename,
+							const glm::mat4& _transform,
+							const std::vector<glm::mat4>& _instances,
+							ResourceManager& _resourceManager,
+							SceneManager& _scene,
+							bool _verbose)
+		{
+			ModelData model;
+			std::vector<RegularMesh> meshes;
+			std::vector<BBox> bounds;
+			std::vector<unsigned short> indices16;
+			const void* indices = PrepareModel(_folder,_filename,_transform,_resourceManager,model,meshes,bounds,indices16,_verbose);
+
+			// Own buffers : the instance attributes are set on its arrays
+			int nVertices    = int(model.vertices.size());
+			int nIndices     = int(model.indices.size());
+			GLenum indexType = ModelIndexType(nVertices);
+			glf::VertexArray* regularVAO;
+			glf::VertexArray* shadowVAO;
+			CreateModelArrays(&model.vertices[0],nVertices,indices,nIndices,indexType,_resourceManager,regularVAO,shadowVAO);
+			AddGeometryMemory(nVertices,nIndices,indexType,_scene);
+
+			_scene.instancedModels.push_back(InstancedModel());
+			InstancedModel& instanced = _scene.instancedModels.back();
+			for(unsigned int i=0;i<meshes.size();++i)
+			{
+				RegularMesh rmesh  = meshes[i];
+				rmesh.indexType    = indexType;
+				rmesh.baseVertex   = 0;
+				rmesh.primitiveType= GL_TRIANGLES;
+				rmesh.primitive    = regularVAO;
+				instanced.meshes.push_back(rmesh);
+
+				ShadowMesh smesh;
+				smesh.indexType    = indexType;
+				smesh.startIndices = rmesh.startIndices;
+				smesh.countIndices = rmesh.countIndices;
+				smesh.baseVertex   = 0;
+				smesh.primitiveType= GL_TRIANGLES;
+				smesh.primitive    = shadowVAO;
+				instanced.shadowMeshes.push_back(smesh);
+
+				instanced.bound.Add(bounds[i]);
+			}
+
+			instanced.transforms = _instances;
+			instanced.bounds.resize(_instances.size());
+			for(unsigned int i=0;i<_instances.size();++i)
+				instanced.bounds[i] = Transform(instanced.bound,_instances[i]);
+
+			if(_verbose)
+				glf::Info("Instances       : %d",int(_instances.size()));
+		}
+		namespace
+		{
+			//------------------------------------------------------------------
+			bool SameModel(	const ModelOBJ& _a,
+							const ModelOBJ& _b)
+			{
+				bool identical =	_a.getNumberOfVertices()  == _b.getNumberOfVertices() &&
+									_a.getNumberOfIndices()   == _b.getNumberOfIndices()  &&
+									_a.getNumberOfMeshes()    == _b.getNumberOfMeshes();
+				if(identical && _a.getNumberOfVertices()>0)
+					identical = memcmp(	_a.getVertexBuffer(),
+										_b.getVertexBuffer(),
+										_a.getNumberOfVertices()*_a.getVertexSize()) == 0;
+				if(identical && _a.getNumberOfIndices()>0)
+					identical = memcmp(	_a.getIndexBuffer(),
+										_b.getIndexBuffer(),
+										_a.getNumberOfIndices()*_a.getIndexSize()) == 0;
+				for(int i=0;identical && i<_a.getNumberOfMeshes();++i)
+				{
+					const ModelOBJ::Mesh& aMesh = _a.getMesh(i);
+					const ModelOBJ::Mesh& bMesh = _b.getMesh(i);
+					identical =	aMesh.startIndex       == bMesh.startIndex &&
+								aMesh.triangleCount    == bMesh.triangleCount &&
+								aMesh.pMaterial->name  == bMesh.pMaterial->name;
+				}
+				return identical;
+			}
+		}
+		//----------------------------------------------------------------------
+		bool BenchmarkModel(	const std::string& _filename,
+								int _nIterations)
+		{
+			MappedFile file;
+			if(!file.Open(_filename))
+			{
+				glf::Warning("Benchmark model error (Filename: %s)",_filename.c_str());
+				return false;
+			}
+			double sizeMB = double(file.Size()) / (1024.0*1024.0);
+			file.Close();
+
+			// Warm up the file cache before timing anything
+			{
+				ModelOBJ warmup;
+				warmup.import(_filename.c_str(), true, true);
+			}
+
+			double streamTime = 0;
+			double serialTime = 0;
+			double parallelTime = 0;
+			ModelOBJ streamLoader;
+			ModelOBJ serialLoader;
+			ModelOBJ parallelLoader;
+			serialLoader.setNumberOfThreads(1);
+			for(int i=0;i<_nIterations;++i)
+			{
+				streamLoader.destroy();
+				double start  = glfwGetTime();
+				streamLoader.importStream(_filename.c_str(), true, true);
+				streamTime   += glfwGetTime() - start;
+
+				serialLoader.destroy();
+				start         = glfwGetTime();
+				serialLoader.import(_filename.c_str(), true, true);
+				serialTime   += glfwGetTime() - start;
+
+				parallelLoader.destroy();
+				start         = glfwGetTime();
+				parallelLoader.import(_filename.c_str(), true, true);
+				parallelTime += glfwGetTime() - start;
+			}
+			streamTime   /= _nIterations;
+			serialTime   /= _nIterations;
+			parallelTime /= _nIterations;
+
+			// All importers have to produce exactly the same model
+			bool identical = SameModel(streamLoader,serialLoader) && SameModel(streamLoader,parallelLoader);
+
+			#ifdef _OPENMP
+			int nThreads = omp_get_max_threads();
+			#else
+			int nThreads = 1;
+			#endif
+
+			glf::Info("%s",_filename.c_str());
+			glf::Info("Size            : %.2f MB",sizeMB);
+			glf::Info("Stream importer : %8.2f ms (%8.2f MB/s)",streamTime*1000.0,sizeMB/streamTime);
+			glf::Info("Mapped importer : %8.2f ms (%8.2f MB/s) 1 thread",serialTime*1000.0,sizeMB/serialTime);
+			glf::Info("Mapped importer : %8.2f ms (%8.2f MB/s) %d threads",parallelTime*1000.0,sizeMB/parallelTime,nThreads);
+			glf::Info("Speedup         : %.2fx",streamTime/parallelTime);
+			glf::Info("Identical output: %s",identical?"yes":"no");
+
+			return identical;
+		}
+		//----------------------------------------------------------------------
+		bool BenchmarkVertexWelding(int _nTriangles)
+		{
+			// Regular grid where each corner uses the same v, vt and vn index,
+			// like most exporters write them
+			int side       = std::max(1,int(sqrtf(0.5f*float(_nTriangles))));
+			int nTriangles = 2*side*side;
+			int nCorners   = 3*nTriangles;
+			std::vector<int> corners;
+			corners.reserve(nCorners);
+			for(int y=0;y<side;++y)
+			for(int x=0;x<side;++x)
+			{
+				int a = y*(side+1) + x;
+				int b = a + 1;
+				int c = a + side + 1;
+				int d = c + 1;
+				corners.push_back(a); corners.push_back(b); corners.push_back(d);
+				corners.push_back(a); corners.push_back(d); corners.push_back(c);
+			}
+
+			ModelOBJ::Vertex vertex;
+			memset(&vertex,0,sizeof(vertex));
+			float invSide = 1.f / float(side);
+
+			// Former welding : tree keyed on the position index, then memcmp
+			// over all the vertices sharing this position
+			std::vector<ModelOBJ::Vertex> mapVertices;
+			std::vector<int> mapIndices(nCorners);
+			std::map<int, std::vector<int> > mapCache;
+			double start = glfwGetTime();
+			for(int i=0;i<nCorners;++i)
+			{
+				int id = corners[i];
+				vertex.position[0] = vertex.texCoord[0] = float(id % (side+1)) * invSide;
+				vertex.position[2] = vertex.texCoord[1] = float(id / (side+1)) * invSide;
+				vertex.normal[1]   = 1.f;
+
+				std::map<int, std::vector<int> >::iterator it = mapCache.find(id);
+				int index = -1;
+				if(it != mapCache.end())
+				{
+					for(unsigned int j=0;j<it->second.size() && index<0;++j)
+						if(memcmp(&mapVertices[it->second[j]],&vertex,sizeof(vertex))==0)
+							index = it->second[j];
+				}
+				if(index<0)
+				{
+					index = int(mapVertices.size());
+					mapVertices.push_back(vertex);
+					mapCache[id].push_back(index);
+				}
+				mapIndices[i] = index;
+			}
+			double mapTime = glfwGetTime() - start;
+			std::map<int, std::vector<int> >().swap(mapCache);
+
+			// Open addressing table keyed on the (v,vt,vn) triplet
+			std::vector<ModelOBJ::Vertex> tableVertices;
+			std::vector<int> tableIndices(nCorners);
+			start = glfwGetTime();
+			VertexTable table;
+			table.reserve(nTriangles);
+			for(int i=0;i<nCorners;++i)
+			{
+				int id = corners[i];
+				vertex.position[0] = vertex.texCoord[0] = float(id % (side+1)) * invSide;
+				vertex.position[2] = vertex.texCoord[1] = float(id / (side+1)) * invSide;
+				vertex.normal[1]   = 1.f;
+
+				int index  = int(tableVertices.size());
+				int welded = table.insert(id,id,id,index);
+				if(welded == index)
+					tableVertices.push_back(vertex);
+				tableIndices[i] = welded;
+			}
+			double tableTime = glfwGetTime() - start;
+
+			bool identical = mapVertices.size()==tableVertices.size() && mapIndices==tableIndices;
+
+			glf::Info("Vertex welding  : %d triangles, %d vertices",nTriangles,int(tableVertices.size()));
+			glf::Info("Map welding     : %8.2f ms (%6.2f Mcorners/s)",mapTime*1000.0,nCorners*1e-6/mapTime);
+			glf::Info("Table welding   : %8.2f ms (%6.2f Mcorners/s)",tableTime*1000.0,nCorners*1e-6/tableTime);
+			glf::Info("Speedup         : %.2fx",mapTime/tableTime);
+			glf::Info("Identical output: %s",identical?"yes":"no");
+
+			return identical;
 		}
 		//----------------------------------------------------------------------
 		void LoadTerrain(	const std::string& _folder,
@@ -1957,10 +3124,26 @@ namespace glf
 							float _tessFactor,
 							float _projFactor,
 							float _tileFactor,
+							int _budgetMB,
+							int _nThreads,
 							ResourceManager& _resourceManager,
 							SceneManager& _scene,
 							bool _verbose)
 		{
+			#if ENABLE_PAGED_TERRAIN
+			long long modified, size;
+			std::string pyramidFolder = _folder + _heightTex;
+			if(FileStatus(pyramidFolder + "/pyramid.json",modified,size))
+			{
+				PagedTerrain* terrain = _resourceManager.CreatePagedTerrain();
+				if(terrain->Load(pyramidFolder,_terrainSize,_terrainOffset,_heightFactor,_roughness,_specularity,_budgetMB,_nThreads,_verbose))
+					_scene.pagedTerrains.push_back(terrain);
+				else
+					glf::Warning("Can not load the paged terrain %s",pyramidFolder.c_str());
+				return;
+			}
+			#endif
+
 			TextureDB textureDB;
 			InitializeDB(textureDB,_resourceManager);
 
@@ -1982,10 +3165,15 @@ namespace glf
 			normalTex->Allocate(GL_RGBA8, heightTex->size.x, heightTex->size.y,true);
 			normalTex->SetFiltering(GL_LINEAR_MIPMAP_LINEAR,GL_LINEAR);
 			normalTex->SetAnisotropy(MAX_ANISOSTROPY);
+			glf::Texture2D* occlusionTex = _resourceManager.CreateTexture2D();
+			occlusionTex->Allocate(GL_RGBA8, heightTex->size.x, heightTex->size.y);
+			occlusionTex->SetFiltering(GL_LINEAR,GL_LINEAR);
 
 			TerrainMesh mesh(_terrainSize,_terrainOffset,diffuseTex,normalTex,heightTex,_tileFactor,_roughness,_specularity,_tileResolution);
 			mesh.primitive  = terrainVAO;
+			mesh.occlusionTex = occlusionTex;
 			mesh.Tesselation(_tileResolution,_heightFactor,_tessFactor,_projFactor);
+			mesh.UpdateHeights();
 			_scene.terrainMeshes.push_back(mesh);
 			_scene.tBounds.push_back(mesh.Bound());
 		}
@@ -5,6 +5,7 @@
 // Includes
 //------------------------------------------------------------------------------
 #include <string>
+#include <vector>
 #include <glf/scene.hpp>
 #include <glf/helper.hpp>
 
@@ -12,6 +13,55 @@ namespace glf
 {
 	namespace io
 	{
+		//----------------------------------------------------------------------
+		// CPU side of a model, with vertices already transformed into world
+		// space. Textures are full filenames, empty for the default ones
+		struct MeshData
+		{
+			std::string						diffuseTex;
+			std::string						normalTex;
+			float							roughness;
+			float							specularity;
+			int								startIndices;
+			int								countIndices;
+			BBox							bound;
+		};
+
+		struct ModelData
+		{
+			std::vector<MeshVertex>			vertices;
+			std::vector<unsigned int>		indices;
+			std::vector<MeshData>			meshes;
+			std::vector<MeshCluster>		clusters;	// Sorted by mesh
+			std::vector<std::string>		sources;	// OBJ and MTL files read
+		};
+
+		//----------------------------------------------------------------------
+		// Imports an OBJ file and builds its final vertex streams and bounds
+		bool BuildModel(	const std::string& _folder,
+							const std::string& _filename,
+							const glm::mat4& _transform,
+							ModelData& _model,
+							bool _verbose=false);
+
+		// Index type of a model : 16 bits indices when they are enough
+		GLenum ModelIndexType(int _nVertices);
+
+		// Uploads vertices and indices (of ModelIndexType) into new buffers
+		// and adds the meshes and their clusters to the scene. Meshes have to
+		// provide their textures, materials and ranges. Clusters refer to
+		// _meshes
+		void CreateModel(	const MeshVertex* _vertices,
+							int _nVertices,
+							const void* _indices,
+							int _nIndices,
+							const std::vector<RegularMesh>& _meshes,
+							const std::vector<BBox>& _bounds,
+							const std::vector<MeshCluster>& _clusters,
+							ResourceManager& _resourceManager,
+							SceneManager& _scene);
+
+		//----------------------------------------------------------------------
 		void LoadModel(		const std::string& _folder,
 							const std::string& _filename,
 							const glm::mat4& _transform,
@@ -19,6 +69,20 @@ namespace glf
 							SceneManager& _scene,
 							bool _verbose=false);
 
+		// Loads a model once and places it with each instance transformation
+		// (applied after _transform)
+		void LoadInstancedModel(const std::string& _folder,
+							const std::string& _filename,
+							const glm::mat4& _transform,
+							const std::vector<glm::mat4>& _instances,
+							ResourceManager& _resourceManager,
+							SceneManager& _scene,
+							bool _verbose=false);
+
+		// If _heightTex is a folder holding a tiled pyramid (see
+		// TerrainPyramid), the terrain is paged in by _nThreads I/O threads
+		// within _budgetMB of texture memory, and _diffuseTex, the
+		// tessellation factors and _tileFactor are not used
 		void LoadTerrain(	const std::string& _folder,
 							const std::string& _diffuseTex,
 							const std::string& _heightTex,
@@ -31,9 +95,21 @@ namespace glf
 							float _tessFactor,
 							float _projFactor,
 							float _tileFactor,
+							int _budgetMB,
+							int _nThreads,
 							ResourceManager& _resourceManager,
 							SceneManager& _scene,
 							bool _verbose=false);
+
+		// Imports an OBJ file with the mapped single pass importer and with
+		// the former two passes stream importer, reports their throughput and
+		// returns true if both produce exactly the same vertices and meshes
+		bool BenchmarkModel(const std::string& _filename,
+							int _nIterations=5);
+
+		// Welds the corners of a synthetic grid mesh with the former map
+		// based cache and with the open addressing table used by the importer
+		bool BenchmarkVertexWelding(int _nTriangles=5000000);
 	}
 }
 
@@ -0,0 +1,591 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/io/optimizer.hpp>
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cfloat>
+#include <cassert>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+// A cluster ends as soon as its cold cache ACMR is below this threshold, so
+// that clusters can be drawn in any order without loosing much cache
+// efficiency (lambda in Sander et al.)
+#define OVERDRAW_CLUSTER_ACMR			0.75f
+
+namespace glf
+{
+	namespace io
+	{
+		namespace
+		{
+			//------------------------------------------------------------------
+			struct Cluster
+			{
+				int						first;		// Triangle
+				int						count;
+				float					order;		// Outward facing first
+			};
+			//------------------------------------------------------------------
+			bool ClusterCompFunc(const Cluster& _lhs, const Cluster& _rhs)
+			{
+				return _lhs.order > _rhs.order;
+			}
+			//------------------------------------------------------------------
+			struct PositionCompFunc
+			{
+				const glm::vec3* positions;
+				bool operator()(unsigned int _lhs, unsigned int _rhs) const
+				{
+					const glm::vec3& a = positions[_lhs];
+					const glm::vec3& b = positions[_rhs];
+					if(a.x!=b.x) return a.x<b.x;
+					if(a.y!=b.y) return a.y<b.y;
+					return a.z<b.z;
+				}
+			};
+			//------------------------------------------------------------------
+			void ClusterBounds(	const glm::vec3* _positions,
+								const unsigned int* _indices,
+								MeshCluster& _cluster)
+			{
+				const unsigned int* indices = _indices + _cluster.startIndices;
+				int nIndices = _cluster.countIndices;
+
+				BBox bound;
+				for(int i=0;i<nIndices;++i)
+					bound.Add(_positions[indices[i]]);
+				glm::vec3 center = 0.5f*(bound.pMin+bound.pMax);
+				float radius2 = 0;
+				for(int i=0;i<nIndices;++i)
+				{
+					glm::vec3 d = _positions[indices[i]] - center;
+					radius2 = std::max(radius2,glm::dot(d,d));
+				}
+
+				// Cone around the average normal, degenerated triangles are
+				// never rasterized and are ignored
+				std::vector<glm::vec3> normals;
+				normals.reserve(nIndices/3);
+				glm::vec3 axis(0);
+				for(int i=0;i<nIndices;i+=3)
+				{
+					const glm::vec3& p0 = _positions[indices[i+0]];
+					const glm::vec3& p1 = _positions[indices[i+1]];
+					const glm::vec3& p2 = _positions[indices[i+2]];
+					glm::vec3 n = glm::cross(p1-p0,p2-p0);
+					float l     = glm::length(n);
+					if(l<=0)
+						continue;
+					normals.push_back(n/l);
+					axis += n/l;
+				}
+				float l = glm::length(axis);
+				float minDot = -1;
+				if(l>0)
+				{
+					axis  /= l;
+					minDot = 1;
+					for(unsigned int i=0;i<normals.size();++i)
+						minDot = std::min(minDot,glm::dot(normals[i],axis));
+				}
+				else
+					axis = glm::vec3(0,0,1);
+
+				_cluster.bound      = bound;
+				_cluster.center     = center;
+				_cluster.radius     = sqrtf(radius2);
+				_cluster.coneAxis   = axis;
+				_cluster.coneCutoff = minDot>0 ? sqrtf(std::max(0.f,1.f-minDot*minDot)) : 2.f;
+			}
+			//------------------------------------------------------------------
+			// Tipsify : greedy fan of triangles around a vertex, the next one
+			// is chosen among the vertices of the fan which are still in cache
+			// and will stay in cache while their remaining triangles are
+			// emitted. Returns the emitted triangles and the start of each
+			// cluster, i.e. each restart with a cold cache
+			void Tipsify(	const std::vector<unsigned int>& _indices,
+							int _nVertices,
+							int _cacheSize,
+							std::vector<unsigned int>& _output,
+							std::vector<int>& _boundaries)
+			{
+				int nIndices   = int(_indices.size());
+				int nTriangles = nIndices / 3;
+
+				// Vertex -> triangles adjacency
+				std::vector<int> live(_nVertices,0);
+				std::vector<int> offsets(_nVertices+1,0);
+				std::vector<int> adjacency(nIndices);
+				for(int i=0;i<nIndices;++i)
+					++live[_indices[i]];
+				for(int v=0;v<_nVertices;++v)
+					offsets[v+1] = offsets[v] + live[v];
+				std::vector<int> fill(offsets.begin(),offsets.end()-1);
+				for(int i=0;i<nIndices;++i)
+					adjacency[fill[_indices[i]]++] = i/3;
+
+				std::vector<int>  cacheTime(_nVertices,0);
+				std::vector<char> emitted(nTriangles,0);
+				std::vector<int>  deadEnd;
+				std::vector<int>  candidates;
+				deadEnd.reserve(nIndices);
+				_output.clear();
+				_output.reserve(nIndices);
+				_boundaries.clear();
+				_boundaries.push_back(0);
+
+				int fanning = 0;
+				int time    = _cacheSize + 1;
+				int cursor  = 1;
+				while(fanning>=0)
+				{
+					// Emit all the remaining triangles around the fanning vertex
+					candidates.clear();
+					for(int k=offsets[fanning];k<offsets[fanning+1];++k)
+					{
+						int t = adjacency[k];
+						if(emitted[t])
+							continue;
+						for(int c=0;c<3;++c)
+						{
+							int v = _indices[3*t+c];
+							_output.push_back(v);
+							deadEnd.push_back(v);
+							candidates.push_back(v);
+							--live[v];
+							if(time - cacheTime[v] > _cacheSize)
+							{
+								cacheTime[v] = time;
+								++time;
+							}
+						}
+						emitted[t] = 1;
+					}
+
+					// Next fanning vertex : the oldest candidate which stays in
+					// cache once all its triangles are emitted
+					int next     = -1;
+					int priority = -1;
+					for(unsigned int i=0;i<candidates.size();++i)
+					{
+						int v = candidates[i];
+						if(live[v]<=0)
+							continue;
+						int p = 0;
+						if(time - cacheTime[v] + 2*live[v] <= _cacheSize)
+							p = time - cacheTime[v];
+						if(p>priority)
+						{
+							priority = p;
+							next     = v;
+						}
+					}
+
+					// Dead end : most recent vertex with remaining triangles,
+					// otherwise the next one in input order (cold cache)
+					while(next<0 && !deadEnd.empty())
+					{
+						int v = deadEnd.back();
+						deadEnd.pop_back();
+						if(live[v]>0)
+							next = v;
+					}
+					if(next<0)
+					{
+						while(cursor<_nVertices && live[cursor]==0)
+							++cursor;
+						if(cursor<_nVertices)
+						{
+							next = cursor;
+							_boundaries.push_back(int(_output.size())/3);
+						}
+					}
+					fanning = next;
+				}
+				assert(int(_output.size())==nIndices);
+			}
+			//------------------------------------------------------------------
+			// Splits clusters as soon as their cold cache ACMR is good enough
+			void SplitClusters(	const std::vector<unsigned int>& _indices,
+								int _nVertices,
+								int _cacheSize,
+								const std::vector<int>& _boundaries,
+								std::vector<Cluster>& _clusters)
+			{
+				int nTriangles = int(_indices.size()) / 3;
+				std::vector<int> cacheTime(_nVertices,INT_MIN/2);
+				int misses = 0;
+
+				_clusters.clear();
+				for(unsigned int b=0;b<_boundaries.size();++b)
+				{
+					int end   = b+1<_boundaries.size() ? _boundaries[b+1] : nTriangles;
+					int first = _boundaries[b];
+
+					// Flush the simulated cache
+					misses += _cacheSize + 1;
+					int start = misses;
+					for(int t=first;t<end;++t)
+					{
+						for(int c=0;c<3;++c)
+						{
+							int v = _indices[3*t+c];
+							if(misses - cacheTime[v] > _cacheSize)
+								cacheTime[v] = misses++;
+						}
+
+						int count = t - first + 1;
+						if(t+1==end || float(misses-start) < OVERDRAW_CLUSTER_ACMR*count)
+						{
+							Cluster cluster;
+							cluster.first = first;
+							cluster.count = count;
+							cluster.order = 0;
+							_clusters.push_back(cluster);
+
+							first   = t + 1;
+							misses += _cacheSize + 1;
+							start   = misses;
+						}
+					}
+				}
+			}
+		}
+		//----------------------------------------------------------------------
+		float CacheStatistics::ACMR() const
+		{
+			return nTriangles>0 ? float(nTransformed)/float(nTriangles) : 0.f;
+		}
+		//----------------------------------------------------------------------
+		float CacheStatistics::ATVR() const
+		{
+			return nVertices>0 ? float(nTransformed)/float(nVertices) : 0.f;
+		}
+		//----------------------------------------------------------------------
+		CacheStatistics SimulateVertexCache(	const unsigned int* _indices,
+												int _nIndices,
+												int _nVertices,
+												int _cacheSize)
+		{
+			CacheStatistics stats;
+			stats.nTriangles   = _nIndices / 3;
+			stats.nVertices    = 0;
+			stats.nTransformed = 0;
+
+			std::vector<int> cacheTime(_nVertices,INT_MIN/2);
+			std::vector<char> used(_nVertices,0);
+			for(int i=0;i<_nIndices;++i)
+			{
+				unsigned int v = _indices[i];
+				if(!used[v])
+				{
+					used[v] = 1;
+					++stats.nVertices;
+				}
+				if(stats.nTransformed - cacheTime[v] > _cacheSize)
+					cacheTime[v] = stats.nTransformed++;
+			}
+			return stats;
+		}
+		//----------------------------------------------------------------------
+		void OptimizeTriangles(	const glm::vec3* _positions,
+								unsigned int* _indices,
+								int _nIndices,
+								int _cacheSize)
+		{
+			int nTriangles = _nIndices / 3;
+			if(nTriangles<2)
+				return;
+
+			// Work on compact local vertex ids
+			std::vector<unsigned int> vertices(_indices,_indices+_nIndices);
+			std::sort(vertices.begin(),vertices.end());
+			vertices.erase(std::unique(vertices.begin(),vertices.end()),vertices.end());
+			int nVertices = int(vertices.size());
+			std::vector<unsigned int> local(_nIndices);
+			for(int i=0;i<_nIndices;++i)
+				local[i] = (unsigned int)(std::lower_bound(vertices.begin(),vertices.end(),_indices[i]) - vertices.begin());
+
+			// Vertex cache optimization
+			std::vector<unsigned int> optimized;
+			std::vector<int> boundaries;
+			Tipsify(local,nVertices,_cacheSize,optimized,boundaries);
+
+			// Overdraw : clusters are sorted by the distance of their
+			// centroid to the mesh centroid, along their average normal
+			std::vector<Cluster> clusters;
+			SplitClusters(optimized,nVertices,_cacheSize,boundaries,clusters);
+			if(clusters.size()>1)
+			{
+				std::vector<glm::vec3> centroids(clusters.size());
+				std::vector<glm::vec3> normals(clusters.size());
+				glm::vec3 meshCentroid(0);
+				float meshArea = 0;
+				for(unsigned int c=0;c<clusters.size();++c)
+				{
+					glm::vec3 centroid(0), normal(0);
+					float area = 0;
+					for(int t=clusters[c].first;t<clusters[c].first+clusters[c].count;++t)
+					{
+						const glm::vec3& p0 = _positions[vertices[optimized[3*t+0]]];
+						const glm::vec3& p1 = _positions[vertices[optimized[3*t+1]]];
+						const glm::vec3& p2 = _positions[vertices[optimized[3*t+2]]];
+						glm::vec3 n = glm::cross(p1-p0,p2-p0);
+						float a     = glm::length(n);
+						centroid   += a * (p0+p1+p2) / 3.f;
+						normal     += n;
+						area       += a;
+					}
+					meshCentroid += centroid;
+					meshArea     += area;
+					centroids[c]  = area>0 ? centroid / area : _positions[vertices[optimized[3*clusters[c].first]]];
+					normals[c]    = normal;
+				}
+				if(meshArea>0)
+					meshCentroid /= meshArea;
+
+				for(unsigned int c=0;c<clusters.size();++c)
+				{
+					float l = glm::length(normals[c]);
+					clusters[c].order = l>0 ? glm::dot(centroids[c]-meshCentroid,normals[c]/l) : 0.f;
+				}
+				std::stable_sort(clusters.begin(),clusters.end(),ClusterCompFunc);
+			}
+
+			// Write back global indices
+			int current = 0;
+			for(unsigned int c=0;c<clusters.size();++c)
+			for(int i=3*clusters[c].first;i<3*(clusters[c].first+clusters[c].count);++i)
+				_indices[current++] = vertices[optimized[i]];
+			assert(current==_nIndices);
+		}
+		//----------------------------------------------------------------------
+		void BuildClusters(	const glm::vec3* _positions,
+							unsigned int* _indices,
+							int _startIndices,
+							int _countIndices,
+							int _mesh,
+							std::vector<MeshCluster>& _clusters)
+		{
+			unsigned int* indices = _indices + _startIndices;
+			int nTriangles = _countIndices / 3;
+			if(nTriangles==0)
+				return;
+
+			// Triangles are connected through positions rather than vertices,
+			// so that hard edges and uv seams do not split the clusters
+			std::vector<unsigned int> vertices(indices,indices+_countIndices);
+			std::sort(vertices.begin(),vertices.end());
+			vertices.erase(std::unique(vertices.begin(),vertices.end()),vertices.end());
+			int nVertices = int(vertices.size());
+
+			PositionCompFunc positionComp;
+			positionComp.positions = _positions;
+			std::vector<unsigned int> byPosition(vertices);
+			std::sort(byPosition.begin(),byPosition.end(),positionComp);
+			std::vector<int> welded(nVertices);
+			int nWelded = 0;
+			for(int i=0;i<nVertices;++i)
+			{
+				if(i>0 && positionComp(byPosition[i-1],byPosition[i]))
+					++nWelded;
+				int v = int(std::lower_bound(vertices.begin(),vertices.end(),byPosition[i]) - vertices.begin());
+				welded[v] = nWelded;
+			}
+			++nWelded;
+
+			std::vector<int> corners(_countIndices);
+			for(int i=0;i<_countIndices;++i)
+				corners[i] = welded[std::lower_bound(vertices.begin(),vertices.end(),indices[i]) - vertices.begin()];
+
+			// Position -> triangles adjacency
+			std::vector<int> offsets(nWelded+1,0);
+			std::vector<int> adjacency(_countIndices);
+			for(int i=0;i<_countIndices;++i)
+				++offsets[corners[i]+1];
+			for(int v=0;v<nWelded;++v)
+				offsets[v+1] += offsets[v];
+			std::vector<int> fill(offsets.begin(),offsets.end()-1);
+			for(int i=0;i<_countIndices;++i)
+				adjacency[fill[corners[i]]++] = i/3;
+
+			std::vector<glm::vec3> centroids(nTriangles);
+			std::vector<glm::vec3> normals(nTriangles);
+			for(int t=0;t<nTriangles;++t)
+			{
+				const glm::vec3& p0 = _positions[indices[3*t+0]];
+				const glm::vec3& p1 = _positions[indices[3*t+1]];
+				const glm::vec3& p2 = _positions[indices[3*t+2]];
+				glm::vec3 n  = glm::cross(p1-p0,p2-p0);
+				float l      = glm::length(n);
+				centroids[t] = (p0+p1+p2) / 3.f;
+				normals[t]   = l>0 ? n/l : glm::vec3(0);
+			}
+
+			// Greedy growth : the next triangle is the adjacent one which is
+			// the closest to the cluster's centroid and the best aligned with
+			// its average normal
+			std::size_t firstCluster = _clusters.size();
+			std::vector<int>  order;
+			std::vector<int>  candidates;
+			std::vector<int>  stamp(nTriangles,-1);
+			std::vector<char> emitted(nTriangles,0);
+			order.reserve(nTriangles);
+			int cursor = 0;
+			int first  = 0;
+			for(int c=0;first<nTriangles;++c)
+			{
+				glm::vec3 sumCentroid(0), sumNormal(0);
+				candidates.clear();
+				int next  = -1;
+				int count = 0;
+				while(count<CLUSTER_MAX_TRIANGLES)
+				{
+					if(next<0)
+					{
+						// Disconnected : continue with the next triangle in
+						// input order, modelling tools keep them close
+						if(count>=CLUSTER_MIN_TRIANGLES)
+							break;
+						while(cursor<nTriangles && emitted[cursor])
+							++cursor;
+						if(cursor==nTriangles)
+							break;
+						next = cursor;
+					}
+
+					// Add triangle
+					emitted[next] = 1;
+					order.push_back(next);
+					sumCentroid += centroids[next];
+					sumNormal   += normals[next];
+					++count;
+					for(int k=0;k<3;++k)
+					{
+						int v = corners[3*next+k];
+						for(int a=offsets[v];a<offsets[v+1];++a)
+						{
+							int t = adjacency[a];
+							if(!emitted[t] && stamp[t]!=c)
+							{
+								stamp[t] = c;
+								candidates.push_back(t);
+							}
+						}
+					}
+
+					// Select the next one
+					glm::vec3 centroid = sumCentroid / float(count);
+					float l = glm::length(sumNormal);
+					glm::vec3 normal   = l>0 ? sumNormal/l : glm::vec3(0);
+					float bestScore    = FLT_MAX;
+					next = -1;
+					for(unsigned int i=0;i<candidates.size();)
+					{
+						int t = candidates[i];
+						if(emitted[t])
+						{
+							candidates[i] = candidates.back();
+							candidates.pop_back();
+							continue;
+						}
+						float score = glm::length(centroids[t]-centroid) * (2.f - glm::dot(normals[t],normal));
+						if(score<bestScore)
+						{
+							bestScore = score;
+							next      = t;
+						}
+						++i;
+					}
+				}
+
+				MeshCluster cluster;
+				cluster.mesh         = _mesh;
+				cluster.startIndices = _startIndices + 3*first;
+				cluster.countIndices = 3*count;
+				_clusters.push_back(cluster);
+				first += count;
+			}
+			assert(int(order.size())==nTriangles);
+
+			std::vector<unsigned int> reordered(_countIndices);
+			for(int t=0;t<nTriangles;++t)
+				for(int k=0;k<3;++k)
+					reordered[3*t+k] = indices[3*order[t]+k];
+			std::copy(reordered.begin(),reordered.end(),indices);
+
+			for(unsigned int i=firstCluster;i<_clusters.size();++i)
+				ClusterBounds(_positions,_indices,_clusters[i]);
+		}
+		//----------------------------------------------------------------------
+		void OptimizeClusters(	const glm::vec3* _positions,
+								unsigned int* _indices,
+								MeshCluster* _clusters,
+								int _nClusters,
+								int _cacheSize)
+		{
+			if(_nClusters==0)
+				return;
+
+			// Clusters are contiguous and cover the whole mesh
+			unsigned int first = _clusters[0].startIndices;
+			unsigned int count = 0;
+			glm::vec3 meshCentroid(0);
+			for(int c=0;c<_nClusters;++c)
+			{
+				OptimizeTriangles(_positions,_indices+_clusters[c].startIndices,_clusters[c].countIndices,_cacheSize);
+				meshCentroid += float(_clusters[c].countIndices) * _clusters[c].center;
+				count        += _clusters[c].countIndices;
+			}
+			meshCentroid /= float(count);
+
+			// Same criterion than the clusters of OptimizeTriangles
+			std::vector<Cluster> sorted(_nClusters);
+			for(int c=0;c<_nClusters;++c)
+			{
+				sorted[c].first = c;
+				sorted[c].count = 1;
+				sorted[c].order = glm::dot(_clusters[c].center-meshCentroid,_clusters[c].coneAxis);
+			}
+			std::stable_sort(sorted.begin(),sorted.end(),ClusterCompFunc);
+
+			std::vector<unsigned int> indices(_indices+first,_indices+first+count);
+			std::vector<MeshCluster> clusters(_clusters,_clusters+_nClusters);
+			unsigned int current = first;
+			for(int c=0;c<_nClusters;++c)
+			{
+				MeshCluster& cluster = clusters[sorted[c].first];
+				std::copy(	indices.begin()+(cluster.startIndices-first),
+							indices.begin()+(cluster.startIndices-first+cluster.countIndices),
+							_indices+current);
+				cluster.startIndices = current;
+				current += cluster.countIndices;
+				_clusters[c] = cluster;
+			}
+			assert(current==first+count);
+		}
+		//----------------------------------------------------------------------
+		void OptimizeVertexFetch(	unsigned int* _indices,
+									int _nIndices,
+									int _nVertices,
+									std::vector<unsigned int>& _remap)
+		{
+			_remap.assign(_nVertices,UINT_MAX);
+			unsigned int next = 0;
+			for(int i=0;i<_nIndices;++i)
+			{
+				unsigned int& remapped = _remap[_indices[i]];
+				if(remapped==UINT_MAX)
+					remapped = next++;
+				_indices[i] = remapped;
+			}
+			for(int v=0;v<_nVertices;++v)
+				if(_remap[v]==UINT_MAX)
+					_remap[v] = next++;
+		}
+	}
+}
@@ -0,0 +1,89 @@
+#ifndef GLF_IO_OPTIMIZER_HPP
+#define GLF_IO_OPTIMIZER_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <vector>
+#include <glm/glm.hpp>
+#include <glf/scene.hpp>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+// Post-transform cache size used for optimizing and for statistics (FIFO)
+#define VERTEX_CACHE_SIZE				16
+// Triangles per cluster. Clusters only end below the maximum when they reach
+// the border of their connected part of the mesh
+#define CLUSTER_MIN_TRIANGLES			64
+#define CLUSTER_MAX_TRIANGLES			128
+
+namespace glf
+{
+	namespace io
+	{
+		//----------------------------------------------------------------------
+		// Simulated FIFO post-transform cache
+		struct CacheStatistics
+		{
+			int							nTriangles;
+			int							nVertices;		// Referenced vertices
+			int							nTransformed;	// Cache misses
+			float						ACMR() const;	// Transformed per triangle
+			float						ATVR() const;	// Transformed per vertex
+		};
+		CacheStatistics SimulateVertexCache(	const unsigned int* _indices,
+												int _nIndices,
+												int _nVertices,
+												int _cacheSize=VERTEX_CACHE_SIZE);
+
+		//----------------------------------------------------------------------
+		// Reorders the triangles of an index range in place : Tipsify vertex
+		// cache optimization (Sander et al. 2007), then the resulting clusters
+		// are sorted so that the ones facing outward are drawn first, which
+		// reduces overdraw whatever the view
+		void OptimizeTriangles(					const glm::vec3* _positions,
+												unsigned int* _indices,
+												int _nIndices,
+												int _cacheSize=VERTEX_CACHE_SIZE);
+
+		// Regroups the triangles of an index range into spatially compact
+		// clusters of triangles facing similar directions. Indices are
+		// reordered so that each cluster is contiguous, and the clusters are
+		// appended with their bounds and normal cone
+		void BuildClusters(						const glm::vec3* _positions,
+												unsigned int* _indices,
+												int _startIndices,
+												int _countIndices,
+												int _mesh,
+												std::vector<MeshCluster>& _clusters);
+
+		// OptimizeTriangles for each cluster of a mesh, then the clusters
+		// themselves are reordered for overdraw (ranges are updated)
+		void OptimizeClusters(					const glm::vec3* _positions,
+												unsigned int* _indices,
+												MeshCluster* _clusters,
+												int _nClusters,
+												int _cacheSize=VERTEX_CACHE_SIZE);
+
+		// Renumbers vertices in their first use order. Indices are updated and
+		// _remap gives the new position of each vertex (unused ones go last)
+		void OptimizeVertexFetch(				unsigned int* _indices,
+												int _nIndices,
+												int _nVertices,
+												std::vector<unsigned int>& _remap);
+
+		// Moves vertices according to a remap table of OptimizeVertexFetch
+		template<typename T>
+		void RemapVertices(						std::vector<T>& _vertices,
+												const std::vector<unsigned int>& _remap)
+		{
+			std::vector<T> vertices(_vertices.size());
+			for(unsigned int i=0;i<_vertices.size();++i)
+				vertices[_remap[i]] = _vertices[i];
+			_vertices.swap(vertices);
+		}
+	}
+}
+
+#endif
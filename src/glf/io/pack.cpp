@@ -0,0 +1,626 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/io/pack.hpp>
+#include <glf/io/scene.hpp>
+#include <glf/io/model.hpp>
+#include <glf/io/image.hpp>
+#include <glf/io/file.hpp>
+#include <glf/utils.hpp>
+#include <GLFW/glfw3.h>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <set>
+#include <cassert>
+
+//------------------------------------------------------------------------------
+// Packs are written in the native byte order. Bump PACK_VERSION each time the
+// layout or the content of the streams changes
+//------------------------------------------------------------------------------
+#define PACK_VERSION					4
+#define PACK_ALIGNMENT					16
+#define MAX_ANISOSTROPY					16.f
+
+namespace glf
+{
+	namespace io
+	{
+		namespace
+		{
+			//------------------------------------------------------------------
+			// Pack layout : header, data (streams and mipmap chains), then the
+			// record tables. All offsets are relative to the pack's beginning
+			//------------------------------------------------------------------
+			struct PackHeader
+			{
+				char						magic[4];
+				int							version;
+				int							nSources;
+				int							nTextures;
+				int							nModels;
+				int							nMeshes;
+				int							nClusters;
+				unsigned long long			sources;
+				unsigned long long			textures;
+				unsigned long long			models;
+				unsigned long long			meshes;
+				unsigned long long			clusters;
+				unsigned long long			strings;
+				unsigned long long			size;		// Whole pack
+			};
+			struct PackSource
+			{
+				unsigned int				name;		// Into the string table
+				unsigned int				length;
+				long long					modified;
+				long long					size;
+				unsigned long long			hash;
+			};
+			struct PackTexture
+			{
+				int							width;
+				int							height;
+				int							levels;
+				int							srgb;
+				unsigned long long			offset;		// RGBA8 levels, finest first
+				unsigned long long			size;
+			};
+			struct PackModel
+			{
+				unsigned long long			vertices;	// MeshVertex
+				unsigned long long			indices;	// Of ModelIndexType(nVertices)
+				int							nVertices;
+				int							nIndices;
+				int							firstMesh;
+				int							nMeshes;
+				int							firstCluster;
+				int							nClusters;
+			};
+			struct PackMesh
+			{
+				int							diffuseTex;
+				int							normalTex;
+				float						roughness;
+				float						specularity;
+				int							startIndices;
+				int							countIndices;
+				float						pMin[3];
+				float						pMax[3];
+			};
+			struct PackCluster
+			{
+				int							mesh;		// Into the model's meshes
+				int							startIndices;
+				int							countIndices;
+				float						radius;
+				float						center[3];
+				float						coneCutoff;
+				float						coneAxis[3];
+				float						pMin[3];
+				float						pMax[3];
+			};
+			const char PackMagic[4] = {'P','B','C','K'};
+			//------------------------------------------------------------------
+			bool HashFile(	const std::string& _filename,
+							unsigned long long& _hash)
+			{
+				MappedFile file;
+				if(!file.Open(_filename))
+					return false;
+
+				// 64 bits FNV-1a
+				unsigned long long hash = 14695981039346656037ULL;
+				const unsigned char* p  = (const unsigned char*)file.Data();
+				const unsigned char* e  = p + file.Size();
+				for(;p<e;++p)
+				{
+					hash ^= *p;
+					hash *= 1099511628211ULL;
+				}
+				_hash = hash;
+				return true;
+			}
+			//------------------------------------------------------------------
+			inline float SRGBToLinear(float _c)
+			{
+				return _c<=0.04045f ? _c/12.92f : powf((_c+0.055f)/1.055f,2.4f);
+			}
+			//------------------------------------------------------------------
+			inline unsigned char LinearToSRGB(float _c)
+			{
+				float c = _c<=0.0031308f ? _c*12.92f : 1.055f*powf(_c,1.f/2.4f)-0.055f;
+				return (unsigned char)(std::min(std::max(c,0.f),1.f)*255.f + 0.5f);
+			}
+			//------------------------------------------------------------------
+			// Appends the whole mipmap chain to the finest level held by
+			// _pixels. Colors of sRGB textures are averaged in linear space
+			void BuildMipmaps(	int _w,
+								int _h,
+								bool _srgb,
+								std::vector<unsigned char>& _pixels,
+								int& _levels)
+			{
+				_levels = MipmapLevels(std::max(_w,_h));
+
+				float toLinear[256];
+				for(int i=0;i<256;++i)
+					toLinear[i] = _srgb ? SRGBToLinear(i/255.f) : i/255.f;
+
+				std::size_t srcOffset = 0;
+				for(int l=1;l<_levels;++l)
+				{
+					int sw = NextMipmapDimension(_w,l-1);
+					int sh = NextMipmapDimension(_h,l-1);
+					int dw = NextMipmapDimension(_w,l);
+					int dh = NextMipmapDimension(_h,l);
+
+					std::size_t dstOffset = _pixels.size();
+					_pixels.resize(dstOffset + std::size_t(dw)*dh*4);
+					const unsigned char* src = &_pixels[srcOffset];
+					unsigned char* dst       = &_pixels[dstOffset];
+
+					#pragma omp parallel for if(dw*dh>=65536)
+					for(int y=0;y<dh;++y)
+					for(int x=0;x<dw;++x)
+					{
+						int x0 = std::min(2*x,sw-1), x1 = std::min(2*x+1,sw-1);
+						int y0 = std::min(2*y,sh-1), y1 = std::min(2*y+1,sh-1);
+						const unsigned char* p00 = src + (y0*sw + x0)*4;
+						const unsigned char* p01 = src + (y0*sw + x1)*4;
+						const unsigned char* p10 = src + (y1*sw + x0)*4;
+						const unsigned char* p11 = src + (y1*sw + x1)*4;
+						unsigned char* q         = dst + (y*dw + x)*4;
+						for(int c=0;c<3;++c)
+						{
+							if(_srgb)
+								q[c] = LinearToSRGB(0.25f*(toLinear[p00[c]]+toLinear[p01[c]]+toLinear[p10[c]]+toLinear[p11[c]]));
+							else
+								q[c] = (unsigned char)((p00[c]+p01[c]+p10[c]+p11[c]+2)/4);
+						}
+						q[3] = (unsigned char)((p00[3]+p01[3]+p10[3]+p11[3]+2)/4);
+					}
+					srcOffset = dstOffset;
+				}
+			}
+			//------------------------------------------------------------------
+			class PackBuilder
+			{
+			public:
+				unsigned long long		Append(		const void* _data,
+													std::size_t _size);
+				bool					AddSource(	const std::string& _filename);
+				int						AddTexture(	const std::string& _filename,
+													bool _srgb,
+													const unsigned char _default[4],
+													bool _verbose);
+				void					AddModel(	const ModelData& _model,
+													bool _verbose);
+				bool					Write(		const std::string& _filename);
+
+				std::vector<char>			data;
+				std::vector<PackSource>		sources;
+				std::vector<PackTexture>	textures;
+				std::vector<PackModel>		models;
+				std::vector<PackMesh>		meshes;
+				std::vector<PackCluster>	clusters;
+				std::string					strings;
+				std::set<std::string>		sourceNames;
+				std::map<std::string,int>	textureIds;
+			};
+			//------------------------------------------------------------------
+			unsigned long long PackBuilder::Append(	const void* _data,
+													std::size_t _size)
+			{
+				std::size_t offset = (data.size() + PACK_ALIGNMENT-1) & ~std::size_t(PACK_ALIGNMENT-1);
+				data.resize(offset + _size);
+				if(_size>0)
+					memcpy(&data[offset],_data,_size);
+				return offset;
+			}
+			//------------------------------------------------------------------
+			bool PackBuilder::AddSource(const std::string& _filename)
+			{
+				if(!sourceNames.insert(_filename).second)
+					return true;
+
+				PackSource source;
+				source.name   = (unsigned int)strings.size();
+				source.length = (unsigned int)_filename.size();
+				if(!FileStatus(_filename,source.modified,source.size) || !HashFile(_filename,source.hash))
+				{
+					glf::Warning("Cook error : unable to read source (%s)",_filename.c_str());
+					return false;
+				}
+				strings += _filename;
+				sources.push_back(source);
+				return true;
+			}
+			//------------------------------------------------------------------
+			int PackBuilder::AddTexture(const std::string& _filename,
+										bool _srgb,
+										const unsigned char _default[4],
+										bool _verbose)
+			{
+				std::string key = (_srgb?"srgb:":"linear:") + _filename;
+				std::map<std::string,int>::iterator it = textureIds.find(key);
+				if(it != textureIds.end())
+					return it->second;
+
+				std::vector<unsigned char> pixels;
+				int w = 1, h = 1;
+				if(_filename.empty() || !LoadImage(_filename,pixels,w,h,_verbose))
+				{
+					// Missing textures fall back to the default one, like the
+					// text path does
+					if(!_filename.empty())
+						return textureIds[key] = AddTexture("",_srgb,_default,_verbose);
+					pixels.assign(_default,_default+4);
+				}
+				else
+					AddSource(_filename);
+
+				PackTexture texture;
+				texture.width  = w;
+				texture.height = h;
+				texture.srgb   = _srgb?1:0;
+				BuildMipmaps(w,h,_srgb,pixels,texture.levels);
+				texture.size   = pixels.size();
+				texture.offset = Append(&pixels[0],pixels.size());
+
+				int id = int(textures.size());
+				textures.push_back(texture);
+				textureIds[key] = id;
+				return id;
+			}
+			//------------------------------------------------------------------
+			void PackBuilder::AddModel(	const ModelData& _model,
+										bool _verbose)
+			{
+				static const unsigned char defaultDiffuse[4] = {255,255,255,255};
+				static const unsigned char defaultNormal[4]  = {128,128,255,255};
+
+				for(unsigned int i=0;i<_model.sources.size();++i)
+					AddSource(_model.sources[i]);
+
+				PackModel model;
+				model.nVertices = int(_model.vertices.size());
+				model.nIndices  = int(_model.indices.size());
+				model.firstMesh = int(meshes.size());
+				model.nMeshes   = int(_model.meshes.size());
+				model.firstCluster = int(clusters.size());
+				model.nClusters = int(_model.clusters.size());
+				model.vertices  = Append(&_model.vertices[0],_model.vertices.size()*sizeof(MeshVertex));
+				if(ModelIndexType(model.nVertices)==GL_UNSIGNED_SHORT)
+				{
+					std::vector<unsigned short> indices16(_model.indices.begin(),_model.indices.end());
+					model.indices = Append(&indices16[0],indices16.size()*sizeof(unsigned short));
+				}
+				else
+					model.indices = Append(&_model.indices[0],_model.indices.size()*sizeof(unsigned int));
+				models.push_back(model);
+
+				for(int i=0;i<model.nMeshes;++i)
+				{
+					const MeshData& mdata = _model.meshes[i];
+					PackMesh mesh;
+					mesh.diffuseTex   = AddTexture(mdata.diffuseTex,true,defaultDiffuse,_verbose);
+					mesh.normalTex    = AddTexture(mdata.normalTex,false,defaultNormal,_verbose);
+					mesh.roughness    = mdata.roughness;
+					mesh.specularity  = mdata.specularity;
+					mesh.startIndices = mdata.startIndices;
+					mesh.countIndices = mdata.countIndices;
+					for(int c=0;c<3;++c)
+					{
+						mesh.pMin[c] = mdata.bound.pMin[c];
+						mesh.pMax[c] = mdata.bound.pMax[c];
+					}
+					meshes.push_back(mesh);
+				}
+
+				for(int i=0;i<model.nClusters;++i)
+				{
+					const MeshCluster& mcluster = _model.clusters[i];
+					PackCluster cluster;
+					cluster.mesh         = mcluster.mesh;
+					cluster.startIndices = mcluster.startIndices;
+					cluster.countIndices = mcluster.countIndices;
+					cluster.radius       = mcluster.radius;
+					cluster.coneCutoff   = mcluster.coneCutoff;
+					for(int c=0;c<3;++c)
+					{
+						cluster.center[c]   = mcluster.center[c];
+						cluster.coneAxis[c] = mcluster.coneAxis[c];
+						cluster.pMin[c]     = mcluster.bound.pMin[c];
+						cluster.pMax[c]     = mcluster.bound.pMax[c];
+					}
+					clusters.push_back(cluster);
+				}
+			}
+			//------------------------------------------------------------------
+			bool PackBuilder::Write(const std::string& _filename)
+			{
+				PackHeader header;
+				memcpy(header.magic,PackMagic,4);
+				header.version   = PACK_VERSION;
+				header.nSources  = int(sources.size());
+				header.nTextures = int(textures.size());
+				header.nModels   = int(models.size());
+				header.nMeshes   = int(meshes.size());
+				header.nClusters = int(clusters.size());
+				header.sources   = Append(sources.empty() ?NULL:&sources[0], sources.size()*sizeof(PackSource));
+				header.textures  = Append(textures.empty()?NULL:&textures[0],textures.size()*sizeof(PackTexture));
+				header.models    = Append(models.empty()  ?NULL:&models[0],  models.size()*sizeof(PackModel));
+				header.meshes    = Append(meshes.empty()  ?NULL:&meshes[0],  meshes.size()*sizeof(PackMesh));
+				header.clusters  = Append(clusters.empty()?NULL:&clusters[0],clusters.size()*sizeof(PackCluster));
+				header.strings   = Append(strings.data(),strings.size());
+				header.size      = data.size();
+				memcpy(&data[0],&header,sizeof(header));
+
+				// Write next to the destination, then swap, so that an
+				// interrupted cook never leaves a truncated pack behind
+				std::string tmpFilename = _filename + ".tmp";
+				FILE* file = fopen(tmpFilename.c_str(),"wb");
+				if(!file)
+					return false;
+				bool written = fwrite(&data[0],1,data.size(),file)==data.size();
+				written = (fclose(file)==0) && written;
+				remove(_filename.c_str());
+				if(!written || rename(tmpFilename.c_str(),_filename.c_str())!=0)
+				{
+					remove(tmpFilename.c_str());
+					return false;
+				}
+				return true;
+			}
+			//------------------------------------------------------------------
+			inline bool InPack(	const PackHeader& _header,
+								unsigned long long _offset,
+								unsigned long long _size)
+			{
+				return _offset<=_header.size && _size<=_header.size-_offset;
+			}
+			//------------------------------------------------------------------
+			unsigned long long MipChainSize(int _w,
+											int _h,
+											int _levels)
+			{
+				unsigned long long size = 0;
+				for(int l=0;l<_levels;++l)
+					size += (unsigned long long)NextMipmapDimension(_w,l)*NextMipmapDimension(_h,l)*4;
+				return size;
+			}
+			//------------------------------------------------------------------
+			// A source is up to date if its size and its timestamp are the
+			// same. If only its timestamp changed (checkout, copy), its content
+			// is hashed and compared
+			bool UpToDate(	const std::string& _filename,
+							const PackSource& _source)
+			{
+				long long modified, size;
+				if(!FileStatus(_filename,modified,size) || size!=_source.size)
+					return false;
+				if(modified==_source.modified)
+					return true;
+				unsigned long long hash;
+				return HashFile(_filename,hash) && hash==_source.hash;
+			}
+		}
+		//----------------------------------------------------------------------
+		std::string PackFilename(const std::string& _sceneFilename)
+		{
+			std::size_t dot   = _sceneFilename.find_last_of('.');
+			std::size_t slash = _sceneFilename.find_last_of("/\\");
+			if(dot==std::string::npos || (slash!=std::string::npos && dot<slash))
+				return _sceneFilename + ".pack";
+			return _sceneFilename.substr(0,dot) + ".pack";
+		}
+		//----------------------------------------------------------------------
+		bool CookScene(	const std::string& _sceneFilename,
+						const std::string& _packFilename,
+						bool _verbose)
+		{
+			double startTime = glfwGetTime();
+
+			std::vector<SceneGeometry> geometries;
+			LoadSceneGeometries(_sceneFilename,geometries);
+
+			PackBuilder builder;
+			PackHeader header;
+			memset(&header,0,sizeof(header));
+			builder.Append(&header,sizeof(header));
+			if(!builder.AddSource(_sceneFilename))
+				return false;
+
+			for(unsigned int i=0;i<geometries.size();++i)
+			{
+				// Instanced models are loaded from their files
+				if(!geometries[i].instances.empty())
+					continue;
+				ModelData model;
+				if(!BuildModel(	geometries[i].folder,
+								geometries[i].filename,
+								geometries[i].transform,
+								model,
+								_verbose))
+					return false;
+				builder.AddModel(model,_verbose);
+			}
+
+			if(!builder.Write(_packFilename))
+			{
+				glf::Warning("Cook error : unable to write pack (%s)",_packFilename.c_str());
+				return false;
+			}
+
+			glf::Info("Cooked %s -> %s",_sceneFilename.c_str(),_packFilename.c_str());
+			glf::Info("Models   : %d (%d meshes)",int(builder.models.size()),int(builder.meshes.size()));
+			glf::Info("Textures : %d",int(builder.textures.size()));
+			glf::Info("Sources  : %d",int(builder.sources.size()));
+			glf::Info("Size     : %.2f MB",builder.data.size()/(1024.0*1024.0));
+			glf::Info("Time     : %.2f s",glfwGetTime()-startTime);
+			return true;
+		}
+		//----------------------------------------------------------------------
+		bool LoadPack(	const std::string& _packFilename,
+						ResourceManager& _resourceManager,
+						SceneManager& _scene,
+						bool _verbose)
+		{
+			double startTime = glfwGetTime();
+
+			MappedFile file;
+			if(!file.Open(_packFilename))
+			{
+				if(_verbose) glf::Info("No cooked pack (%s)",_packFilename.c_str());
+				return false;
+			}
+
+			// Check the layout before touching any record
+			const char* base = file.Data();
+			if(file.Size()<sizeof(PackHeader))
+			{
+				glf::Warning("Invalid pack, ignored (%s)",_packFilename.c_str());
+				return false;
+			}
+			PackHeader header;
+			memcpy(&header,base,sizeof(header));
+			bool valid =	memcmp(header.magic,PackMagic,4)==0 &&
+							header.version==PACK_VERSION &&
+							header.size==file.Size() &&
+							InPack(header,header.sources, header.nSources*sizeof(PackSource)) &&
+							InPack(header,header.textures,header.nTextures*sizeof(PackTexture)) &&
+							InPack(header,header.models,  header.nModels*sizeof(PackModel)) &&
+							InPack(header,header.meshes,  header.nMeshes*sizeof(PackMesh)) &&
+							InPack(header,header.clusters,header.nClusters*sizeof(PackCluster));
+			const PackSource*  sources  = (const PackSource*)(base+header.sources);
+			const PackTexture* textures = (const PackTexture*)(base+header.textures);
+			const PackModel*   models   = (const PackModel*)(base+header.models);
+			const PackMesh*    meshes   = (const PackMesh*)(base+header.meshes);
+			const PackCluster* clusters = (const PackCluster*)(base+header.clusters);
+			const char*        strings  = base+header.strings;
+			for(int i=0;valid && i<header.nSources;++i)
+				valid = InPack(header,header.strings+sources[i].name,sources[i].length);
+			for(int i=0;valid && i<header.nTextures;++i)
+				valid = textures[i].width>0 && textures[i].height>0 &&
+						textures[i].levels==MipmapLevels(std::max(textures[i].width,textures[i].height)) &&
+						textures[i].size==MipChainSize(textures[i].width,textures[i].height,textures[i].levels) &&
+						InPack(header,textures[i].offset,textures[i].size);
+			for(int i=0;valid && i<header.nModels;++i)
+				valid = models[i].firstMesh>=0 && models[i].firstMesh+models[i].nMeshes<=header.nMeshes &&
+						models[i].firstCluster>=0 && models[i].firstCluster+models[i].nClusters<=header.nClusters &&
+						InPack(header,models[i].vertices,models[i].nVertices*sizeof(MeshVertex)) &&
+						InPack(header,models[i].indices, models[i].nIndices*(ModelIndexType(models[i].nVertices)==GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int)));
+			for(int i=0;valid && i<header.nModels;++i)
+				for(int j=0;valid && j<models[i].nClusters;++j)
+				{
+					const PackCluster& cluster = clusters[models[i].firstCluster+j];
+					valid = cluster.mesh>=0 && cluster.mesh<models[i].nMeshes &&
+							cluster.startIndices>=0 && cluster.countIndices>=0 &&
+							cluster.startIndices+cluster.countIndices<=models[i].nIndices;
+				}
+			for(int i=0;valid && i<header.nMeshes;++i)
+				valid = meshes[i].diffuseTex>=0 && meshes[i].diffuseTex<header.nTextures &&
+						meshes[i].normalTex>=0  && meshes[i].normalTex<header.nTextures;
+			if(!valid)
+			{
+				glf::Warning("Invalid pack, ignored (%s)",_packFilename.c_str());
+				return false;
+			}
+
+			// Check sources
+			for(int i=0;i<header.nSources;++i)
+			{
+				std::string filename(strings+sources[i].name,sources[i].length);
+				if(!UpToDate(filename,sources[i]))
+				{
+					glf::Warning("Stale pack, %s has changed (%s)",filename.c_str(),_packFilename.c_str());
+					return false;
+				}
+			}
+
+			// Upload textures
+			std::vector<Texture2D*> packTextures(header.nTextures);
+			for(int i=0;i<header.nTextures;++i)
+			{
+				const PackTexture& ptex = textures[i];
+				Texture2D* texture = _resourceManager.CreateTexture2D();
+				texture->Allocate(ptex.srgb?GL_SRGB8_ALPHA8:GL_RGBA8,ptex.width,ptex.height,ptex.levels>1);
+				assert(texture->levels==ptex.levels);
+
+				const unsigned char* pixels = (const unsigned char*)(base+ptex.offset);
+				for(int l=0;l<ptex.levels;++l)
+				{
+					texture->Fill(GL_RGBA,GL_UNSIGNED_BYTE,const_cast<unsigned char*>(pixels),l);
+					pixels += NextMipmapDimension(ptex.width,l)*NextMipmapDimension(ptex.height,l)*4;
+				}
+
+				if(ptex.levels>1)
+				{
+					texture->SetFiltering(GL_LINEAR_MIPMAP_LINEAR,GL_LINEAR);
+					texture->SetAnisotropy(MAX_ANISOSTROPY);
+				}
+				else
+					texture->SetFiltering(GL_LINEAR,GL_LINEAR);
+				packTextures[i] = texture;
+			}
+
+			// Upload models straight from the mapped streams
+			for(int i=0;i<header.nModels;++i)
+			{
+				const PackModel& pmodel = models[i];
+				std::vector<RegularMesh> rmeshes(pmodel.nMeshes);
+				std::vector<BBox> bounds(pmodel.nMeshes);
+				for(int j=0;j<pmodel.nMeshes;++j)
+				{
+					const PackMesh& pmesh    = meshes[pmodel.firstMesh+j];
+					rmeshes[j].diffuseTex    = packTextures[pmesh.diffuseTex];
+					rmeshes[j].normalTex     = packTextures[pmesh.normalTex];
+					rmeshes[j].roughness     = pmesh.roughness;
+					rmeshes[j].specularity   = pmesh.specularity;
+					rmeshes[j].startIndices  = pmesh.startIndices;
+					rmeshes[j].countIndices  = pmesh.countIndices;
+					bounds[j].pMin           = glm::vec3(pmesh.pMin[0],pmesh.pMin[1],pmesh.pMin[2]);
+					bounds[j].pMax           = glm::vec3(pmesh.pMax[0],pmesh.pMax[1],pmesh.pMax[2]);
+				}
+				std::vector<MeshCluster> mclusters(pmodel.nClusters);
+				for(int j=0;j<pmodel.nClusters;++j)
+				{
+					const PackCluster& pcluster = clusters[pmodel.firstCluster+j];
+					mclusters[j].mesh         = pcluster.mesh;
+					mclusters[j].startIndices = pcluster.startIndices;
+					mclusters[j].countIndices = pcluster.countIndices;
+					mclusters[j].center       = glm::vec3(pcluster.center[0],pcluster.center[1],pcluster.center[2]);
+					mclusters[j].radius       = pcluster.radius;
+					mclusters[j].bound.pMin   = glm::vec3(pcluster.pMin[0],pcluster.pMin[1],pcluster.pMin[2]);
+					mclusters[j].bound.pMax   = glm::vec3(pcluster.pMax[0],pcluster.pMax[1],pcluster.pMax[2]);
+					mclusters[j].coneAxis     = glm::vec3(pcluster.coneAxis[0],pcluster.coneAxis[1],pcluster.coneAxis[2]);
+					mclusters[j].coneCutoff   = pcluster.coneCutoff;
+				}
+
+				CreateModel((const MeshVertex*)(base+pmodel.vertices),
+							pmodel.nVertices,
+							base+pmodel.indices,
+							pmodel.nIndices,
+							rmeshes,
+							bounds,
+							mclusters,
+							_resourceManager,
+							_scene);
+			}
+
+			if(_verbose)
+			{
+				glf::Info("Load pack       : %s",_packFilename.c_str());
+				glf::Info("Models          : %d (%d meshes, %d clusters)",header.nModels,header.nMeshes,header.nClusters);
+				glf::Info("Textures        : %d",header.nTextures);
+				glf::Info("Size            : %.2f MB",file.Size()/(1024.0*1024.0));
+				glf::Info("Time            : %.3f s",glfwGetTime()-startTime);
+			}
+			return true;
+		}
+	}
+}
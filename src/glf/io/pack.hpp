@@ -0,0 +1,37 @@
+#ifndef GLF_IO_PACK_HPP
+#define GLF_IO_PACK_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <string>
+#include <glf/scene.hpp>
+
+namespace glf
+{
+	namespace io
+	{
+		//----------------------------------------------------------------------
+		// A pack is the cooked version of the models of a scene : final
+		// vertex and index streams, materials, bounds and full mipmap chains of
+		// the textures. It also records the timestamp, the size and the hash
+		// of every file it has been built from, in order to detect stale packs
+		//----------------------------------------------------------------------
+		// Pack filename associated to a scene file (scene.json -> scene.pack)
+		std::string PackFilename(	const std::string& _sceneFilename);
+
+		// Builds the pack of a scene file. Terrains are not cooked
+		bool CookScene(				const std::string& _sceneFilename,
+									const std::string& _packFilename,
+									bool _verbose=false);
+
+		// Maps a pack and uploads its content. Returns false without creating
+		// anything if the pack does not exist, is invalid or is stale
+		bool LoadPack(				const std::string& _packFilename,
+									ResourceManager& _resourceManager,
+									SceneManager& _scene,
+									bool _verbose=false);
+	}
+}
+
+#endif
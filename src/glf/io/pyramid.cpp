@@ -0,0 +1,298 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/io/pyramid.hpp>
+#include <glf/io/config.hpp>
+#include <glf/io/file.hpp>
+#include <glf/io/image.hpp>
+#include <glf/utils.hpp>
+#include <algorithm>
+#include <cstdio>
+
+namespace glf
+{
+	namespace io
+	{
+		namespace
+		{
+			//------------------------------------------------------------------
+			std::string LevelPath(	const std::string& _folder,
+									int _level)
+			{
+				char buffer[32];
+				sprintf(buffer,"%d",_level);
+				return _folder + "/" + buffer;
+			}
+			//------------------------------------------------------------------
+			std::string PagePath(	const std::string& _folder,
+									int _level,
+									int _x,
+									int _y,
+									const char* _extension)
+			{
+				char buffer[64];
+				sprintf(buffer,"/%d_%d.%s",_x,_y,_extension);
+				return LevelPath(_folder,_level) + buffer;
+			}
+			//------------------------------------------------------------------
+			bool ReadFile(			const std::string& _filename,
+									void* _data,
+									std::size_t _size)
+			{
+				FILE* file = fopen(_filename.c_str(),"rb");
+				if(file==NULL)
+					return false;
+				bool read = fread(_data,1,_size,file)==_size;
+				fclose(file);
+				return read;
+			}
+			//------------------------------------------------------------------
+			bool WriteFile(			const std::string& _filename,
+									const void* _data,
+									std::size_t _size)
+			{
+				FILE* file = fopen(_filename.c_str(),"wb");
+				if(file==NULL)
+					return false;
+				bool written = fwrite(_data,1,_size,file)==_size;
+				fclose(file);
+				return written;
+			}
+			//------------------------------------------------------------------
+			// Samples and pages of each level, down to a single page
+			void BuildLevels(		TerrainPyramid& _pyramid,
+									const glm::ivec2& _samples)
+			{
+				_pyramid.samples.clear();
+				_pyramid.pages.clear();
+				_pyramid.firstPages.clear();
+				glm::ivec2 samples = _samples;
+				int nPages = 0;
+				for(int l=0;l<_pyramid.levels;++l)
+				{
+					glm::ivec2 pages(	std::max(1,(samples.x-1+_pyramid.pageSize-1)/_pyramid.pageSize),
+										std::max(1,(samples.y-1+_pyramid.pageSize-1)/_pyramid.pageSize));
+					_pyramid.samples.push_back(samples);
+					_pyramid.pages.push_back(pages);
+					_pyramid.firstPages.push_back(nPages);
+					nPages += pages.x*pages.y;
+					samples = glm::ivec2((samples.x-1+1)/2+1,(samples.y-1+1)/2+1);
+				}
+				_pyramid.firstPages.push_back(nPages);
+			}
+			//------------------------------------------------------------------
+			inline int Clamp(int _i, int _n)
+			{
+				return std::min(std::max(_i,0),_n-1);
+			}
+		}
+		//----------------------------------------------------------------------
+		int TerrainPyramid::PageIndex(int _level, int _x, int _y) const
+		{
+			return firstPages[_level] + _y*pages[_level].x + _x;
+		}
+		//----------------------------------------------------------------------
+		int TerrainPyramid::PageCount() const
+		{
+			return firstPages.back();
+		}
+		//----------------------------------------------------------------------
+		int TerrainPyramid::PageSamples() const
+		{
+			return pageSize + 1;
+		}
+		//----------------------------------------------------------------------
+		bool LoadPyramid(	const std::string& _folder,
+							TerrainPyramid& _pyramid,
+							bool _verbose)
+		{
+			std::string description = _folder + "/pyramid.json";
+			long long modified, size;
+			if(!FileStatus(description,modified,size))
+				return false;
+
+			ConfigLoader loader;
+			ConfigNode* root	= loader.Load(description);
+			_pyramid.folder		= _folder;
+			_pyramid.pageSize	= loader.GetInt(root,"pageSize");
+			_pyramid.levels		= loader.GetInt(root,"levels");
+			glm::ivec2 samples	= loader.GetIVec2(root,"samples");
+			if(_pyramid.pageSize<=0 || _pyramid.levels<=0 || samples.x<2 || samples.y<2)
+			{
+				Warning("Invalid terrain pyramid (%s)",description.c_str());
+				return false;
+			}
+			BuildLevels(_pyramid,samples);
+
+			_pyramid.bounds.resize(2*_pyramid.PageCount());
+			for(int l=0;l<_pyramid.levels;++l)
+			{
+				int nPages = _pyramid.pages[l].x*_pyramid.pages[l].y;
+				std::string filename = LevelPath(_folder,l) + "/bounds.r16";
+				if(!ReadFile(filename,&_pyramid.bounds[2*_pyramid.firstPages[l]],2*nPages*sizeof(unsigned short)))
+				{
+					Warning("Terrain pyramid error : can not read %s",filename.c_str());
+					return false;
+				}
+			}
+
+			if(_verbose)
+			{
+				Info("Pyramid : %s",_folder.c_str());
+				Info("  Samples : %dx%d, %d levels of %d cells pages (%d pages)",samples.x,samples.y,_pyramid.levels,_pyramid.pageSize,_pyramid.PageCount());
+			}
+			return true;
+		}
+		//----------------------------------------------------------------------
+		bool ReadPage(		const TerrainPyramid& _pyramid,
+							int _level,
+							int _x,
+							int _y,
+							unsigned short* _heights,
+							unsigned char* _colors)
+		{
+			std::size_t nSamples = _pyramid.PageSamples()*_pyramid.PageSamples();
+			return	ReadFile(PagePath(_pyramid.folder,_level,_x,_y,"r16"), _heights,nSamples*sizeof(unsigned short)) &&
+					ReadFile(PagePath(_pyramid.folder,_level,_x,_y,"rgba"),_colors, nSamples*4);
+		}
+		//----------------------------------------------------------------------
+		bool CookPyramid(	const std::string& _heightFile,
+							const std::string& _diffuseFile,
+							const std::string& _folder,
+							int _pageSize,
+							bool _verbose)
+		{
+			if(_pageSize<2 || (_pageSize & (_pageSize-1))!=0)
+			{
+				Warning("Cook pyramid error : page size %d is not a power of two",_pageSize);
+				return false;
+			}
+
+			// Level 0 : heights from the red channel, colors bilinearly
+			// resampled on the height samples
+			std::vector<unsigned char> pixels;
+			int w, h;
+			if(!LoadImage(_heightFile,pixels,w,h,_verbose) || w<2 || h<2)
+				return false;
+			std::vector<unsigned short> heights(w*h);
+			for(int i=0;i<w*h;++i)
+				heights[i] = (unsigned short)(pixels[4*i]*257);
+
+			std::vector<unsigned char> colors(4*w*h,255);
+			int dw, dh;
+			if(!_diffuseFile.empty() && LoadImage(_diffuseFile,pixels,dw,dh,_verbose))
+			{
+				for(int y=0;y<h;++y)
+				for(int x=0;x<w;++x)
+				{
+					float u = x*(dw-1)/float(w-1);
+					float v = y*(dh-1)/float(h-1);
+					int x0 = int(u), y0 = int(v);
+					int x1 = std::min(x0+1,dw-1), y1 = std::min(y0+1,dh-1);
+					float fu = u-x0, fv = v-y0;
+					for(int c=0;c<4;++c)
+					{
+						float c0 = pixels[4*(y0*dw+x0)+c]*(1.f-fu) + pixels[4*(y0*dw+x1)+c]*fu;
+						float c1 = pixels[4*(y1*dw+x0)+c]*(1.f-fu) + pixels[4*(y1*dw+x1)+c]*fu;
+						colors[4*(y*w+x)+c] = (unsigned char)(c0*(1.f-fv) + c1*fv + 0.5f);
+					}
+				}
+			}
+			std::vector<unsigned char>().swap(pixels);
+
+			// Levels down to a single page
+			TerrainPyramid pyramid;
+			pyramid.folder   = _folder;
+			pyramid.pageSize = _pageSize;
+			pyramid.levels   = 1;
+			for(int s=std::max(w,h)-1;s>_pageSize;s=(s+1)/2)
+				++pyramid.levels;
+			BuildLevels(pyramid,glm::ivec2(w,h));
+			if(!MakeDirectory(_folder))
+			{
+				Warning("Cook pyramid error : can not create %s",_folder.c_str());
+				return false;
+			}
+
+			int nPageSamples = pyramid.PageSamples();
+			std::vector<unsigned short> pageHeights(nPageSamples*nPageSamples);
+			std::vector<unsigned char> pageColors(4*nPageSamples*nPageSamples);
+			for(int l=0;l<pyramid.levels;++l)
+			{
+				glm::ivec2 samples = pyramid.samples[l];
+				glm::ivec2 pages   = pyramid.pages[l];
+				std::string levelPath = LevelPath(_folder,l);
+				if(!MakeDirectory(levelPath))
+				{
+					Warning("Cook pyramid error : can not create %s",levelPath.c_str());
+					return false;
+				}
+
+				// Pages beyond the last samples are clamped to them
+				std::vector<unsigned short> bounds(2*pages.x*pages.y);
+				for(int py=0;py<pages.y;++py)
+				for(int px=0;px<pages.x;++px)
+				{
+					unsigned short minHeight = 65535, maxHeight = 0;
+					for(int y=0;y<nPageSamples;++y)
+					for(int x=0;x<nPageSamples;++x)
+					{
+						int src = Clamp(py*_pageSize+y,samples.y)*samples.x + Clamp(px*_pageSize+x,samples.x);
+						int dst = y*nPageSamples + x;
+						pageHeights[dst] = heights[src];
+						for(int c=0;c<4;++c)
+							pageColors[4*dst+c] = colors[4*src+c];
+						minHeight = std::min(minHeight,heights[src]);
+						maxHeight = std::max(maxHeight,heights[src]);
+					}
+					bounds[2*(py*pages.x+px)+0] = minHeight;
+					bounds[2*(py*pages.x+px)+1] = maxHeight;
+					if(	!WriteFile(PagePath(_folder,l,px,py,"r16"), &pageHeights[0],pageHeights.size()*sizeof(unsigned short)) ||
+						!WriteFile(PagePath(_folder,l,px,py,"rgba"),&pageColors[0], pageColors.size()))
+					{
+						Warning("Cook pyramid error : can not write the pages of %s",levelPath.c_str());
+						return false;
+					}
+				}
+				WriteFile(levelPath + "/bounds.r16",&bounds[0],bounds.size()*sizeof(unsigned short));
+				if(_verbose)
+					Info("Level %d : %dx%d samples, %dx%d pages",l,samples.x,samples.y,pages.x,pages.y);
+
+				// Next level keeps every other height and averages the colors
+				if(l+1<pyramid.levels)
+				{
+					glm::ivec2 next = pyramid.samples[l+1];
+					std::vector<unsigned short> nextHeights(next.x*next.y);
+					std::vector<unsigned char> nextColors(4*next.x*next.y);
+					for(int y=0;y<next.y;++y)
+					for(int x=0;x<next.x;++x)
+					{
+						int x0 = Clamp(2*x,samples.x), x1 = Clamp(2*x+1,samples.x);
+						int y0 = Clamp(2*y,samples.y), y1 = Clamp(2*y+1,samples.y);
+						int dst = y*next.x + x;
+						nextHeights[dst] = heights[y0*samples.x+x0];
+						for(int c=0;c<4;++c)
+							nextColors[4*dst+c] = (unsigned char)((	colors[4*(y0*samples.x+x0)+c] + colors[4*(y0*samples.x+x1)+c] +
+																	colors[4*(y1*samples.x+x0)+c] + colors[4*(y1*samples.x+x1)+c] + 2) / 4);
+					}
+					heights.swap(nextHeights);
+					colors.swap(nextColors);
+				}
+			}
+
+			std::string description = _folder + "/pyramid.json";
+			FILE* file = fopen(description.c_str(),"w");
+			if(file==NULL)
+			{
+				Warning("Cook pyramid error : can not write %s",description.c_str());
+				return false;
+			}
+			fprintf(file,"{\n\t\"pageSize\"\t: %d,\n\t\"levels\"\t: %d,\n\t\"samples\"\t: [%d,%d]\n}\n",_pageSize,pyramid.levels,w,h);
+			fclose(file);
+
+			if(_verbose)
+				Info("Pyramid cooked : %s (%d pages)",_folder.c_str(),pyramid.PageCount());
+			return true;
+		}
+	}
+}
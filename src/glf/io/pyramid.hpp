@@ -0,0 +1,70 @@
+#ifndef GLF_IO_PYRAMID_HPP
+#define GLF_IO_PYRAMID_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+namespace glf
+{
+	namespace io
+	{
+		//----------------------------------------------------------------------
+		// Tiled on disk pyramid of a heightfield and of its diffuse map, paged
+		// in by the paged terrains. The folder holds :
+		//	pyramid.json		: {"pageSize" : 256, "levels" : 7, "samples" : [16385,16385]}
+		//	<l>/bounds.r16		: min/max height of each page of level l, row major
+		//	<l>/<x>_<y>.r16		: (pageSize+1)^2 heights, 16 bits unorm
+		//	<l>/<x>_<y>.rgba	: (pageSize+1)^2 sRGB diffuse colors, RGBA8
+		// Page (x,y) of a level covers its samples [x,x+1]*pageSize (clamped
+		// to the last one), so neighbour pages share their border samples.
+		// Level l+1 keeps every other sample of level l : the vertices of a
+		// coarse grid match the even vertices of the finer one. Rows are
+		// stored bottom first, like textures, in the host byte order
+		struct TerrainPyramid
+		{
+			int							PageIndex(		int _level,
+														int _x,
+														int _y) const;
+			int							PageCount() const;
+			int							PageSamples() const;	// Per page side
+
+			std::string					folder;
+			int							pageSize;		// Cells per page side
+			int							levels;
+			std::vector<glm::ivec2>		samples;		// Of each level
+			std::vector<glm::ivec2>		pages;			// Of each level
+			std::vector<int>			firstPages;		// Index of the first page of each level
+			std::vector<unsigned short>	bounds;			// Min/max height of each page
+		};
+
+		//----------------------------------------------------------------------
+		// Reads the description and the page bounds of a pyramid. Returns
+		// false if _folder is not a pyramid
+		bool LoadPyramid(	const std::string& _folder,
+							TerrainPyramid& _pyramid,
+							bool _verbose=false);
+
+		// Reads the heights and the colors of a page. Only uses the C file
+		// API, so it can be called from any thread
+		bool ReadPage(		const TerrainPyramid& _pyramid,
+							int _level,
+							int _x,
+							int _y,
+							unsigned short* _heights,
+							unsigned char* _colors);
+
+		// Builds the pyramid of a height map (red channel) and of its diffuse
+		// map, resampled on the height samples. _pageSize is a power of two
+		bool CookPyramid(	const std::string& _heightFile,
+							const std::string& _diffuseFile,
+							const std::string& _folder,
+							int _pageSize,
+							bool _verbose=false);
+	}
+}
+
+#endif
@@ -3,48 +3,156 @@
 //------------------------------------------------------------------------------
 #include <glf/io/scene.hpp>
 #include <glf/io/model.hpp>
+#include <glf/io/pack.hpp>
 #include <glf/io/config.hpp>
+#include <glf/io/camerapath.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
 
 namespace glf
 {
 	namespace io
 	{
+		namespace
+		{
+			//------------------------------------------------------------------
+			glm::mat4 ParseTransform(	glf::io::ConfigLoader& _loader,
+										glf::io::ConfigNode* _node)
+			{
+				glm::vec3 translate			= _loader.GetVec3(_node,"translate");
+				glm::vec3 rotate			= _loader.GetVec3(_node,"rotate");
+				float scale					= _loader.GetFloat(_node,"scale",1.f);
+				return	glm::translate(translate.x,translate.y,translate.z) *
+						glm::rotate(rotate.z,0.f,0.f,1.f) *
+						glm::rotate(rotate.y,0.f,1.f,0.f) *
+						glm::rotate(rotate.x,1.f,0.f,0.f) *
+						glm::scale(scale,scale,scale);
+			}
+			//------------------------------------------------------------------
+			void ParseGeometries(	glf::io::ConfigLoader& _loader,
+									glf::io::ConfigNode* _root,
+									std::vector<SceneGeometry>& _geometries)
+			{
+				glf::io::ConfigNode* geometriesNode = _loader.GetNode(_root,"geometries");
+				if(geometriesNode == NULL)
+					return;
+
+				int nGeometries = _loader.GetCount(geometriesNode);
+				for(int i=0;i<nGeometries;++i)
+				{
+					glf::io::ConfigNode* geometryNode = _loader.GetNode(geometriesNode,i);
+
+					SceneGeometry geometry;
+					geometry.name				= _loader.GetString(geometryNode,"name");
+					geometry.folder				= glf::directory::ModelDirectory + _loader.GetString(geometryNode,"folder") + "/";
+					geometry.filename			= _loader.GetString(geometryNode,"file");
+					geometry.transform			= ParseTransform(_loader,geometryNode);
+
+					// Instances are placed relatively to the model transform
+					glf::io::ConfigNode* instancesNode = _loader.GetNode(geometryNode,"instances");
+					int nInstances = instancesNode!=NULL ? _loader.GetCount(instancesNode) : 0;
+					for(int j=0;j<nInstances;++j)
+						geometry.instances.push_back(ParseTransform(_loader,_loader.GetNode(instancesNode,j)));
+					_geometries.push_back(geometry);
+				}
+			}
+			//------------------------------------------------------------------
+			// Spot and point lights. Entries without radius (the sun) are
+			// skipped. A light with a "grid" (count along x and y) is
+			// repeated with the "spacing" offsets
+			void ParseLights(		glf::io::ConfigLoader& _loader,
+									glf::io::ConfigNode* _root,
+									std::vector<LocalLight>& _lights)
+			{
+				glf::io::ConfigNode* lightsNode = _loader.GetNode(_root,"lights");
+				if(lightsNode == NULL)
+					return;
+
+				int nLights = _loader.GetCount(lightsNode);
+				for(int i=0;i<nLights;++i)
+				{
+					glf::io::ConfigNode* lightNode = _loader.GetNode(lightsNode,i);
+
+					std::string type			= _loader.GetString(lightNode,"type","point");
+					LocalLight light;
+					light.type					= type=="spot" ? LocalLight::SPOT : LocalLight::POINT;
+					light.position				= _loader.GetVec3(lightNode,"position");
+					light.direction				= _loader.GetVec3(lightNode,"direction",glm::vec3(0,0,-1));
+					light.intensity				= _loader.GetVec3(lightNode,"intensity");
+					light.radius				= _loader.GetFloat(lightNode,"radius");
+					light.innerAngle			= _loader.GetFloat(lightNode,"innerAngle",30.f);
+					light.outerAngle			= _loader.GetFloat(lightNode,"outerAngle",45.f);
+					light.castShadows			= _loader.GetBool(lightNode,"castShadows",true);
+					if(type!="spot" && type!="point")
+					{
+						glf::Warning("Unknown light type (%s : %s)",_loader.GetString(lightNode,"name").c_str(),type.c_str());
+						continue;
+					}
+					if(light.radius<=0.f || glm::length(light.direction)==0.f)
+						continue;
+					light.direction				= glm::normalize(light.direction);
+					light.outerAngle			= std::min(light.outerAngle,89.f);
+					light.innerAngle			= std::min(light.innerAngle,light.outerAngle);
+
+					glm::ivec2 grid				= _loader.GetIVec2(lightNode,"grid",glm::ivec2(1));
+					glm::vec2 spacing			= _loader.GetVec2(lightNode,"spacing");
+					glm::vec3 origin			= light.position;
+					for(int y=0;y<grid.y;++y)
+					for(int x=0;x<grid.x;++x)
+					{
+						light.position			= origin + glm::vec3(x*spacing.x,y*spacing.y,0.f);
+						_lights.push_back(light);
+					}
+				}
+			}
+		}
+		//----------------------------------------------------------------------
+		void LoadSceneGeometries(	const std::string& _filename,
+									std::vector<SceneGeometry>& _geometries)
+		{
+			glf::io::ConfigLoader loader;
+			glf::io::ConfigNode* root	= loader.Load(_filename);
+			ParseGeometries(loader,root,_geometries);
+		}
 		//----------------------------------------------------------------------
 		void LoadScene(		const std::string& _filename,
 							ResourceManager& _resourceManager,
 							SceneManager& _scene,
 							bool _verbose)
 		{
+			double startTime = glfwGetTime();
+
 			// Load configuration file
 			glf::io::ConfigLoader loader;
 			glf::io::ConfigNode* root	= loader.Load(_filename);
 
-			// Load models
-			glf::io::ConfigNode* geometriesNode = loader.GetNode(root,"geometries");
-			if(geometriesNode != NULL)
+			// Load models, from the cooked pack when it is up to date.
+			// Instanced models are not cooked
+			std::vector<SceneGeometry> geometries;
+			ParseGeometries(loader,root,geometries);
+			bool packed = LoadPack(PackFilename(_filename),_resourceManager,_scene,_verbose);
+			for(unsigned int i=0;i<geometries.size();++i)
 			{
-				int nGeometries = loader.GetCount(geometriesNode);
-				for(int i=0;i<nGeometries;++i)
+				if(!geometries[i].instances.empty())
+				{
+					LoadInstancedModel(	geometries[i].folder,
+										geometries[i].filename,
+										geometries[i].transform,
+										geometries[i].instances,
+										_resourceManager,
+										_scene,
+										_verbose);
+				}
+				else if(!packed)
 				{
-					glf::io::ConfigNode* geometryNode = loader.GetNode(geometriesNode,i);
-
-					std::string name			= loader.GetString(geometryNode,"name");
-					std::string folder			= loader.GetString(geometryNode,"folder");
-					std::string filename		= loader.GetString(geometryNode,"file");
-					glm::vec3 translate			= loader.GetVec3(geometryNode,"translate");
-					glm::vec3 rotate			= loader.GetVec3(geometryNode,"rotate");
-					float scale					= loader.GetFloat(geometryNode,"scale");
-					glm::mat4 transform			=	glm::translate(translate.x,translate.y,translate.z) *
-													glm::rotate(rotate.z,0.f,0.f,1.f) *
-													glm::rotate(rotate.y,0.f,1.f,0.f) *
-													glm::rotate(rotate.x,1.f,0.f,0.f) *
-													glm::scale(scale,scale,scale);
-
-					LoadModel(	glf::directory::ModelDirectory + folder + "/",
-								filename,
-								transform,
+					LoadModel(	geometries[i].folder,
+								geometries[i].filename,
+								geometries[i].transform,
 								_resourceManager,
 								_scene,
 								_verbose);
@@ -74,6 +182,8 @@ namespace glf
 					float tileFactor			= loader.GetFloat(terrainNode,"tileFactor");
 					float tessFactor			= 15.f; //loader.GetFloat(terrainNode,"tessFactor");
 					float projFactor			= 10.f; //loader.GetFloat(terrainNode,"projFactor");
+					int residencyBudget			= loader.GetInt(terrainNode,"residencyBudget",256);	// MB, paged terrains
+					int ioThreads				= loader.GetInt(terrainNode,"ioThreads",2);
 
 					LoadTerrain(glf::directory::TextureDirectory,
 								diffuse,
@@ -87,14 +197,22 @@ namespace glf
 								tessFactor,
 								projFactor,
 								tileFactor,
+								residencyBudget,
+								ioThreads,
 								_resourceManager,
 								_scene,
 								_verbose);
 				}
 			}
 
+			// Multi draw batches of the regular meshes
+			_scene.BuildBatches(_resourceManager);
+
 			// Compute bounds
 			_scene.wBound = WorldBound(_scene);
+			double bvhTime = glfwGetTime();
+			_scene.bvh.Build(_scene);
+			bvhTime = glfwGetTime() - bvhTime;
 			if(_verbose)
 			{
 				glf::Info("----------------------------------------------");
@@ -105,14 +223,170 @@ namespace glf
 											_scene.wBound.pMax.x,
 											_scene.wBound.pMax.y,
 											_scene.wBound.pMax.z);
+
+				// Regular meshes' geometry, compared to separated float
+				// streams (position, normal, tangent, uv) with 32 bits indices
+				const GeometryMemory& memory = _scene.geometryMemory;
+				std::size_t floatBytes = memory.nVertices*(2*sizeof(glm::vec3)+sizeof(glm::vec4)+sizeof(glm::vec2)) + memory.nIndices*sizeof(unsigned int);
+				std::size_t packedBytes= memory.vertexBytes + memory.indexBytes;
+				glf::Info("Vertices      : %d (%.2f MB)",memory.nVertices,memory.vertexBytes/(1024.0*1024.0));
+				glf::Info("Indices       : %d (%.2f MB)",memory.nIndices,memory.indexBytes/(1024.0*1024.0));
+				glf::Info("Geometry      : %.2f MB, %.2f MB with float streams (%.1f%%)",
+											packedBytes/(1024.0*1024.0),
+											floatBytes/(1024.0*1024.0),
+											floatBytes>0 ? 100.0*packedBytes/floatBytes : 0.0);
+				glf::Info("Batches       : %d regular, %d shadow (%d meshes)",
+											int(_scene.regularBatches.size()),
+											int(_scene.shadowBatches.size()),
+											int(_scene.regularMeshes.size()));
+				int nInstances = 0;
+				for(unsigned int i=0;i<_scene.instancedModels.size();++i)
+					nInstances += int(_scene.instancedModels[i].transforms.size());
+				glf::Info("Instanced     : %d models, %d instances",
+											int(_scene.instancedModels.size()),
+											nInstances);
+				glf::Info("BVH           : %d nodes over %d items (%.2f ms)",
+											_scene.bvh.NodeCount(),
+											_scene.bvh.Count(),
+											bvhTime*1000.0);
+				glf::Info("Scene loaded in %.3f s (%s)",glfwGetTime()-startTime,_filename.c_str());
 			}
 
 			// Load lights
-			//TODO
+			ParseLights(loader,root,_scene.lights);
+			if(_verbose && !_scene.lights.empty())
+			{
+				int nShadowed = 0;
+				for(unsigned int i=0;i<_scene.lights.size();++i)
+					nShadowed += _scene.lights[i].castShadows ? 1 : 0;
+				glf::Info("Lights        : %d (%d shadowed)",int(_scene.lights.size()),nShadowed);
+			}
 
 			// Load camera
 			//TODO
 		}
 		//----------------------------------------------------------------------
+		bool BenchmarkClusters(	const std::string& _sceneFilename,
+								const std::string& _pathFilename)
+		{
+			std::vector<SceneGeometry> geometries;
+			LoadSceneGeometries(_sceneFilename,geometries);
+			if(geometries.empty())
+			{
+				glf::Warning("Benchmark clusters error, no geometry (Filename: %s)",_sceneFilename.c_str());
+				return false;
+			}
+
+			// Build all models, clusters refer to the meshes of the scene
+			std::vector<BBox> meshBounds;
+			std::vector<int> meshTriangles;
+			std::vector<MeshCluster> clusters;
+			double buildTime = glfwGetTime();
+			for(unsigned int i=0;i<geometries.size();++i)
+			{
+				ModelData model;
+				if(!BuildModel(geometries[i].folder,geometries[i].filename,geometries[i].transform,model))
+					return false;
+				int firstMesh = int(meshBounds.size());
+				for(unsigned int j=0;j<model.meshes.size();++j)
+				{
+					meshBounds.push_back(model.meshes[j].bound);
+					meshTriangles.push_back(model.meshes[j].countIndices/3);
+				}
+				for(unsigned int j=0;j<model.clusters.size();++j)
+				{
+					clusters.push_back(model.clusters[j]);
+					clusters.back().mesh += firstMesh;
+				}
+			}
+			buildTime = glfwGetTime() - buildTime;
+
+			int nClusters    = int(clusters.size());
+			int nMeshes      = int(meshBounds.size());
+			long long nTriangles = 0;
+			int minTriangles = nClusters>0 ? INT_MAX : 0;
+			int maxTriangles = 0;
+			int nCones       = 0;
+			BBox wBound;
+			for(int i=0;i<nMeshes;++i)
+			{
+				nTriangles += meshTriangles[i];
+				wBound.Add(meshBounds[i]);
+			}
+			for(int i=0;i<nClusters;++i)
+			{
+				int count    = clusters[i].countIndices/3;
+				minTriangles = std::min(minTriangles,count);
+				maxTriangles = std::max(maxTriangles,count);
+				nCones      += clusters[i].coneCutoff<=1.f ? 1 : 0;
+			}
+
+			// Recorded path, or an orbit around the scene
+			std::vector<CameraKey> keys;
+			bool recorded = LoadCameraPath(_pathFilename,keys);
+			if(!recorded)
+			{
+				glm::vec3 center = 0.5f*(wBound.pMin+wBound.pMax);
+				float radius     = glm::length(wBound.pMax-wBound.pMin);
+				glm::mat4 proj   = glm::perspective(45.f,2.f,0.1f,2.f*radius);
+				for(int i=0;i<64;++i)
+				{
+					float angle  = 2.f*float(M_PI)*i/64.f;
+					CameraKey key;
+					key.eye      = center + 0.6f*radius*glm::vec3(cosf(angle),sinf(angle),0.25f);
+					key.viewProjection = proj * glm::lookAt(key.eye,center,glm::vec3(0,0,1));
+					keys.push_back(key);
+				}
+			}
+
+			// Triangles remaining after each culling stage
+			long long meshVisible = 0, frustumVisible = 0, coneVisible = 0;
+			long long frustumCulled = 0, coneCulled = 0;
+			double cullTime = glfwGetTime();
+			for(unsigned int k=0;k<keys.size();++k)
+			{
+				Frustum frustum = ExtractFrustum(keys[k].viewProjection);
+				for(int i=0;i<nMeshes;++i)
+					if(Intersect(frustum,meshBounds[i]))
+						meshVisible += meshTriangles[i];
+
+				for(int i=0;i<nClusters;++i)
+				{
+					const MeshCluster& cluster = clusters[i];
+					int count = cluster.countIndices/3;
+					if(!Intersect(frustum,cluster.center,cluster.radius) || !Intersect(frustum,cluster.bound))
+					{
+						++frustumCulled;
+						continue;
+					}
+					frustumVisible += count;
+					if(BackfacingCluster(cluster,keys[k].eye))
+					{
+						++coneCulled;
+						continue;
+					}
+					coneVisible += count;
+				}
+			}
+			cullTime = glfwGetTime() - cullTime;
+
+			double total = double(nTriangles)*keys.size();
+			glf::Info("%s",_sceneFilename.c_str());
+			glf::Info("Triangles         : %lld (%d meshes)",nTriangles,nMeshes);
+			glf::Info("Clusters          : %d (%d/%.1f/%d triangles min/avg/max)",
+						nClusters,minTriangles,nClusters>0 ? double(nTriangles)/nClusters : 0.0,maxTriangles);
+			glf::Info("Normal cones      : %.1f%% of the clusters",nClusters>0 ? 100.0*nCones/nClusters : 0.0);
+			glf::Info("Build time        : %.3f s",buildTime);
+			glf::Info("Camera path       : %s (%d keys)",recorded ? _pathFilename.c_str() : "orbit",int(keys.size()));
+			glf::Info("Culled per mesh   : %5.1f%% of the triangles",100.0*(1.0-meshVisible/total));
+			glf::Info("Culled per cluster: %5.1f%% of the triangles (frustum)",100.0*(1.0-frustumVisible/total));
+			glf::Info("                    %5.1f%% of the triangles (frustum and cones)",100.0*(1.0-coneVisible/total));
+			glf::Info("                    %5.1f%% of the clusters (%.1f%% frustum, %.1f%% cones)",
+						100.0*(frustumCulled+coneCulled)/(double(nClusters)*keys.size()),
+						100.0*frustumCulled/(double(nClusters)*keys.size()),
+						100.0*coneCulled/(double(nClusters)*keys.size()));
+			glf::Info("Cull time         : %.3f ms per key",1000.0*cullTime/keys.size());
+			return true;
+		}
 	}
 }
@@ -1,10 +1,11 @@
-#ifndef GLF_IO_MODEL_HPP
+#ifndef GLF_IO_SCENE_HPP
 #define GLF_IO_SCENE_HPP
 
 //------------------------------------------------------------------------------
 // Includes
 //------------------------------------------------------------------------------
 #include <string>
+#include <vector>
 #include <glf/scene.hpp>
 #include <glf/helper.hpp>
 
@@ -12,10 +13,35 @@ namespace glf
 {
 	namespace io
 	{
+		//----------------------------------------------------------------------
+		// Model entry of a scene file
+		struct SceneGeometry
+		{
+			std::string						name;
+			std::string						folder;		// With trailing '/'
+			std::string						filename;
+			glm::mat4						transform;
+			std::vector<glm::mat4>			instances;	// Empty for a single copy
+		};
+
+		//----------------------------------------------------------------------
+		// Loads the cooked pack of the scene if it is up to date, otherwise
+		// loads the scene from its text files
 		void LoadScene(		const std::string& _filename,
 							ResourceManager& _resourceManager,
 							SceneManager& _scene,
 							bool _verbose=false);
+
+		// Reads the model entries of a scene file
+		void LoadSceneGeometries(	const std::string& _filename,
+									std::vector<SceneGeometry>& _geometries);
+
+		// Builds the clusters of the models of a scene (on CPU only) and
+		// reports their counts and the fraction of triangles culled along a
+		// camera path, per mesh and per cluster (frustum and normal cones).
+		// An orbit around the scene is used when the path does not exist
+		bool BenchmarkClusters(		const std::string& _sceneFilename,
+									const std::string& _pathFilename);
 	}
 }
 
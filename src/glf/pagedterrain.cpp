@@ -0,0 +1,577 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/pagedterrain.hpp>
+#include <glf/debug.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace glf
+{
+	namespace
+	{
+		//----------------------------------------------------------------------
+		float DistanceSq(const glm::vec3& _p, const BBox& _bound)
+		{
+			glm::vec3 d = glm::max(glm::max(_bound.pMin - _p, _p - _bound.pMax), glm::vec3(0.f));
+			return glm::dot(d,d);
+		}
+		//----------------------------------------------------------------------
+		float MaxDistanceSq(const glm::vec3& _p, const BBox& _bound)
+		{
+			glm::vec3 d = glm::max(glm::abs(_bound.pMin - _p), glm::abs(_p - _bound.pMax));
+			return glm::dot(d,d);
+		}
+		//----------------------------------------------------------------------
+		// Some vertices of the quadrant are within its morph distances
+		bool Morphing(const glm::vec3& _p, const PagedTerrain::Node& _node, const BBox& _bound)
+		{
+			return	DistanceSq(_p,_bound)    < _node.morph.y*_node.morph.y &&
+					MaxDistanceSq(_p,_bound) > _node.morph.x*_node.morph.x;
+		}
+		//----------------------------------------------------------------------
+		// Byte order of the nodes, for matching the quadrants of two updates
+		struct NodeLess
+		{
+			const std::vector<PagedTerrain::Node>* nodes;
+			NodeLess(const std::vector<PagedTerrain::Node>& _nodes):nodes(&_nodes) {}
+			bool operator()(int _a, int _b) const
+			{
+				return memcmp(&(*nodes)[_a],&(*nodes)[_b],sizeof(PagedTerrain::Node))<0;
+			}
+		};
+	}
+	//--------------------------------------------------------------------------
+	bool PagedTerrain::Request::operator<(const Request& _r) const
+	{
+		// Coarse pages first, then the nearest ones
+		return level<_r.level || (level==_r.level && distance>_r.distance);
+	}
+	//--------------------------------------------------------------------------
+	PagedTerrain::PagedTerrain():
+	heightFactor(1.f),
+	roughness(0.f),
+	specularity(0.f),
+	lodFactor(2.f),
+	gridResolution(0),
+	nResident(0),
+	frame(0),
+	previousEye(0),
+	gridChanged(false),
+	gridCount(0),
+	quit(false)
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	PagedTerrain::~PagedTerrain()
+	{
+		mutex.Lock();
+		quit = true;
+		mutex.Unlock();
+		condition.Broadcast();
+		for(unsigned int i=0;i<threads.size();++i)
+			delete threads[i];
+		for(unsigned int i=0;i<loaded.size();++i)
+			delete loaded[i];
+		for(unsigned int i=0;i<freePages.size();++i)
+			delete freePages[i];
+	}
+	//--------------------------------------------------------------------------
+	bool PagedTerrain::Load(		const std::string& _folder,
+									const glm::vec2& _terrainSize,
+									const glm::vec3& _terrainOffset,
+									float _heightFactor,
+									float _roughness,
+									float _specularity,
+									int _budgetMB,
+									int _nThreads,
+									bool _verbose)
+	{
+		assert(threads.empty());
+		if(!io::LoadPyramid(_folder,pyramid,_verbose))
+			return false;
+
+		terrainSize		= _terrainSize;
+		terrainOffset	= _terrainOffset;
+		heightFactor	= _heightFactor;
+		roughness		= _roughness;
+		specularity		= _specularity;
+		cellSize		= _terrainSize / glm::vec2(pyramid.samples[0] - glm::ivec2(1));
+		pageSlots.assign(pyramid.PageCount(),-1);
+
+		// Layers within the budget, at least the coarsest level and a few
+		// pages to refine it
+		int top          = pyramid.levels-1;
+		int nTopPages    = pyramid.pages[top].x*pyramid.pages[top].y;
+		int nSamples     = pyramid.PageSamples();
+		std::size_t pageBytes = nSamples*nSamples*(sizeof(unsigned short)+4);
+		GLint maxLayers;
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS,&maxLayers);
+		int nLayers      = int(std::size_t(_budgetMB)*1024*1024 / pageBytes);
+		nLayers          = std::min(std::max(nLayers,nTopPages+16),pyramid.PageCount());
+		if(nLayers>maxLayers)
+		{
+			Warning("Paged terrain : %d layers clamped to %d (%s)",nLayers,maxLayers,_folder.c_str());
+			nLayers = maxLayers;
+		}
+		if(nLayers<nTopPages)
+		{
+			Warning("Paged terrain error : the coarsest level does not fit into %d layers (%s)",nLayers,_folder.c_str());
+			return false;
+		}
+
+		heightPages.Allocate(GL_R16,nSamples,nSamples,nLayers);
+		heightPages.SetFiltering(GL_LINEAR,GL_LINEAR);
+		heightPages.SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
+		diffusePages.Allocate(GL_SRGB8_ALPHA8,nSamples,nSamples,nLayers);
+		diffusePages.SetFiltering(GL_LINEAR,GL_LINEAR);
+		diffusePages.SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
+		Slot freeSlot;
+		freeSlot.page = -1;
+		freeSlot.used = -1;
+		slots.assign(nLayers,freeSlot);
+
+		// Coarsest level, read at once and never evicted
+		LoadedPage page;
+		page.heights.resize(nSamples*nSamples);
+		page.colors.resize(4*nSamples*nSamples);
+		for(int y=0;y<pyramid.pages[top].y;++y)
+		for(int x=0;x<pyramid.pages[top].x;++x)
+		{
+			page.page  = pyramid.PageIndex(top,x,y);
+			page.valid = io::ReadPage(pyramid,top,x,y,&page.heights[0],&page.colors[0]);
+			if(!page.valid)
+			{
+				Warning("Paged terrain error : can not read page (%d,%d) of level %d (%s)",x,y,top,_folder.c_str());
+				return false;
+			}
+			Upload(page,nResident);
+			slots[pageSlots[page.page]].used = INT_MAX;
+		}
+
+		if(gridResolution==0)
+			SetGridResolution(32);
+
+		// I/O threads, waiting for the requests of the first update
+		quit = false;
+		for(int i=0;i<std::max(_nThreads,1);++i)
+		{
+			Thread* thread = new Thread();
+			if(!thread->Start(LoadPages,this))
+			{
+				Warning("Paged terrain : can not start I/O thread %d",i);
+				delete thread;
+				break;
+			}
+			threads.push_back(thread);
+		}
+
+		if(_verbose)
+			Info("Paged terrain : %d layers (%.1f MB), %d I/O threads",nLayers,nLayers*pageBytes/(1024.0*1024.0),int(threads.size()));
+		glf::CheckError("PagedTerrain::Load");
+		return !threads.empty();
+	}
+	//--------------------------------------------------------------------------
+	void PagedTerrain::LoadPages(	void* _terrain)
+	{
+		PagedTerrain* terrain = (PagedTerrain*)_terrain;
+		int nSamples = terrain->pyramid.PageSamples();
+
+		terrain->mutex.Lock();
+		for(;;)
+		{
+			while(!terrain->quit && terrain->requests.empty())
+				terrain->condition.Wait(terrain->mutex);
+			if(terrain->quit)
+				break;
+
+			Request request = terrain->requests.back();
+			terrain->requests.pop_back();
+			terrain->loading.push_back(request.page);
+			LoadedPage* page;
+			if(terrain->freePages.empty())
+				page = new LoadedPage();
+			else
+			{
+				page = terrain->freePages.back();
+				terrain->freePages.pop_back();
+			}
+			terrain->mutex.Unlock();
+
+			// The pyramid is not modified once loaded
+			page->heights.resize(nSamples*nSamples);
+			page->colors.resize(4*nSamples*nSamples);
+			page->page  = request.page;
+			page->valid = io::ReadPage(terrain->pyramid,request.level,request.x,request.y,&page->heights[0],&page->colors[0]);
+
+			terrain->mutex.Lock();
+			terrain->loaded.push_back(page);
+		}
+		terrain->mutex.Unlock();
+	}
+	//--------------------------------------------------------------------------
+	void PagedTerrain::Upload(		const LoadedPage& _loaded,
+									int _slot)
+	{
+		// Rows of the pages are not 4 bytes aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+		heightPages.Fill(_slot,GL_RED,GL_UNSIGNED_SHORT,(unsigned char*)&_loaded.heights[0]);
+		diffusePages.Fill(_slot,GL_RGBA,GL_UNSIGNED_BYTE,(unsigned char*)&_loaded.colors[0]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+
+		Slot& slot = slots[_slot];
+		if(slot.page>=0)
+			pageSlots[slot.page] = -1;
+		else
+			++nResident;
+		slot.page = _loaded.page;
+		slot.used = frame;
+		pageSlots[_loaded.page] = _slot;
+	}
+	//--------------------------------------------------------------------------
+	int PagedTerrain::FreeSlot()
+	{
+		// Least recently used page, not drawn by this frame
+		int lru = -1;
+		for(unsigned int s=0;s<slots.size();++s)
+		{
+			if(slots[s].page<0)
+				return s;
+			if(slots[s].used<frame && (lru<0 || slots[s].used<slots[lru].used))
+				lru = s;
+		}
+		return lru;
+	}
+	//--------------------------------------------------------------------------
+	BBox PagedTerrain::Update(		const glm::vec3& _eye)
+	{
+		++frame;
+		previousNodes.swap(nodes);
+		previousBounds.swap(nodeBounds);
+		nodes.clear();
+		nodeBounds.clear();
+		wanted.clear();
+		int top = pyramid.levels-1;
+		for(int y=0;y<pyramid.pages[top].y;++y)
+		for(int x=0;x<pyramid.pages[top].x;++x)
+			Select(top,x,y,_eye);
+
+		// Requests of the previous frame which are not read yet are replaced
+		std::sort(wanted.begin(),wanted.end());
+		std::vector<LoadedPage*> ready;
+		mutex.Lock();
+		requests.clear();
+		for(unsigned int i=0;i<wanted.size();++i)
+			if(std::find(loading.begin(),loading.end(),wanted[i].page)==loading.end())
+				requests.push_back(wanted[i]);
+		int nReady = std::min(int(loaded.size()),PAGED_TERRAIN_UPLOADS);
+		ready.assign(loaded.begin(),loaded.begin()+nReady);
+		loaded.erase(loaded.begin(),loaded.begin()+nReady);
+		mutex.Unlock();
+		if(!requests.empty())
+			condition.Broadcast();
+
+		// Pages drawn from the next frame on. Without any evictable layer,
+		// the page is dropped and requested again later
+		for(unsigned int i=0;i<ready.size();++i)
+		{
+			const LoadedPage& page = *ready[i];
+			if(!page.valid)
+			{
+				Warning("Paged terrain : can not read page %d (%s)",page.page,pyramid.folder.c_str());
+				pageSlots[page.page] = -2;
+			}
+			else if(pageSlots[page.page]==-1)
+			{
+				int slot = FreeSlot();
+				if(slot>=0)
+					Upload(page,slot);
+			}
+		}
+		mutex.Lock();
+		for(unsigned int i=0;i<ready.size();++i)
+		{
+			loading.erase(std::find(loading.begin(),loading.end(),ready[i]->page));
+			freePages.push_back(ready[i]);
+		}
+		mutex.Unlock();
+		glf::CheckError("PagedTerrain::Update");
+
+		BBox changes = Changes(_eye);
+		previousEye  = _eye;
+		gridChanged  = false;
+		return changes;
+	}
+	//--------------------------------------------------------------------------
+	BBox PagedTerrain::Changes(		const glm::vec3& _eye) const
+	{
+		BBox changes;
+		if(gridChanged)
+		{
+			for(unsigned int i=0;i<nodeBounds.size();++i)
+				changes.Add(nodeBounds[i]);
+			for(unsigned int i=0;i<previousBounds.size();++i)
+				changes.Add(previousBounds[i]);
+			return changes;
+		}
+
+		// Quadrants of one update only. Uploaded pages only change the
+		// geometry through the quadrants they split
+		std::vector<int> current(nodes.size());
+		std::vector<int> previous(previousNodes.size());
+		for(unsigned int i=0;i<current.size();++i)	current[i]  = i;
+		for(unsigned int i=0;i<previous.size();++i)	previous[i] = i;
+		std::sort(current.begin(),current.end(),NodeLess(nodes));
+		std::sort(previous.begin(),previous.end(),NodeLess(previousNodes));
+		unsigned int c = 0, p = 0;
+		while(c<current.size() || p<previous.size())
+		{
+			int order = c==current.size() ?  1 :
+						p==previous.size()? -1 :
+						memcmp(&nodes[current[c]],&previousNodes[previous[p]],sizeof(Node));
+			if(order<0)			changes.Add(nodeBounds[current[c++]]);
+			else if(order>0)	changes.Add(previousBounds[previous[p++]]);
+			else				{ ++c; ++p; }
+		}
+
+		// Vertices slide with the eye distance
+		if(_eye!=previousEye)
+		{
+			for(unsigned int i=0;i<nodes.size();++i)
+				if(Morphing(_eye,nodes[i],nodeBounds[i]) || Morphing(previousEye,nodes[i],nodeBounds[i]))
+					changes.Add(nodeBounds[i]);
+		}
+		return changes;
+	}
+	//--------------------------------------------------------------------------
+	float PagedTerrain::Range(		int _level) const
+	{
+		return lodFactor * pyramid.pageSize * std::max(cellSize.x,cellSize.y) * float(1<<_level);
+	}
+	//--------------------------------------------------------------------------
+	BBox PagedTerrain::PageBound(	int _level,
+									int _x,
+									int _y) const
+	{
+		glm::vec2 pageWorld = cellSize * float(pyramid.pageSize << _level);
+		glm::vec2 pMin      = glm::vec2(terrainOffset) + glm::vec2(_x,_y)*pageWorld;
+		glm::vec2 pMax      = glm::min(pMin + pageWorld, glm::vec2(terrainOffset) + terrainSize);
+		int page            = pyramid.PageIndex(_level,_x,_y);
+		float h0            = terrainOffset.z + heightFactor * pyramid.bounds[2*page+0] / 65535.f;
+		float h1            = terrainOffset.z + heightFactor * pyramid.bounds[2*page+1] / 65535.f;
+
+		BBox bound;
+		bound.pMin = glm::vec3(pMin,std::min(h0,h1));
+		bound.pMax = glm::vec3(pMax,std::max(h0,h1));
+		return bound;
+	}
+	//--------------------------------------------------------------------------
+	void PagedTerrain::Select(		int _level,
+									int _x,
+									int _y,
+									const glm::vec3& _eye)
+	{
+		int page = pyramid.PageIndex(_level,_x,_y);
+		Slot& slot = slots[pageSlots[page]];
+		slot.used  = std::max(slot.used,frame);
+
+		// Split if the finer level is in range and all its pages are
+		// resident. Missing ones are requested
+		bool split = false;
+		float range = 0.f;
+		if(_level>0)
+		{
+			range = Range(_level-1);
+			float distance = DistanceSq(_eye,PageBound(_level,_x,_y));
+			split = distance < range*range;
+			for(int j=0;j<2 && split;++j)
+			for(int i=0;i<2;++i)
+			{
+				int cx = 2*_x+i, cy = 2*_y+j;
+				if(cx>=pyramid.pages[_level-1].x || cy>=pyramid.pages[_level-1].y)
+					continue;
+				int child = pyramid.PageIndex(_level-1,cx,cy);
+				if(pageSlots[child]>=0)
+					continue;
+				split = false;
+				if(pageSlots[child]==-1)
+				{
+					Request request;
+					request.page     = child;
+					request.level    = _level-1;
+					request.x        = cx;
+					request.y        = cy;
+					request.distance = sqrtf(distance);
+					wanted.push_back(request);
+				}
+			}
+		}
+
+		// Quadrants out of range of the finer level are drawn at this one.
+		// Quadrants beyond the heightfield have no child
+		for(int j=0;j<2;++j)
+		for(int i=0;i<2;++i)
+		{
+			if(_level>0)
+			{
+				int cx = 2*_x+i, cy = 2*_y+j;
+				if(cx>=pyramid.pages[_level-1].x || cy>=pyramid.pages[_level-1].y)
+					continue;
+				if(split && DistanceSq(_eye,PageBound(_level-1,cx,cy)) < range*range)
+				{
+					Select(_level-1,cx,cy,_eye);
+					continue;
+				}
+			}
+			AddQuadrant(_level,_x,_y,i,j);
+		}
+	}
+	//--------------------------------------------------------------------------
+	void PagedTerrain::AddQuadrant(	int _level,
+									int _x,
+									int _y,
+									int _i,
+									int _j)
+	{
+		glm::vec2 pageWorld = cellSize * float(pyramid.pageSize << _level);
+		glm::vec2 texelSize = cellSize * float(1<<_level);
+		glm::vec2 origin    = glm::vec2(terrainOffset) + (glm::vec2(_x,_y) + 0.5f*glm::vec2(_i,_j))*pageWorld;
+		int page            = pyramid.PageIndex(_level,_x,_y);
+
+		// Vertices reach the grid of the parent level at the end of the
+		// range of their level. The coarsest level never morphs
+		float end   = _level<pyramid.levels-1 ? Range(_level) : 1e30f;
+		float begin = _level<pyramid.levels-1 ? end - 0.3f*(end - (_level>0 ? Range(_level-1) : 0.f)) : 0.5e30f;
+
+		Node node;
+		node.node  = glm::vec4(origin,0.5f*pageWorld);
+		node.page  = glm::vec4(0.5f*_i,0.5f*_j,0.5f,float(pageSlots[page]));
+		node.morph = glm::vec4(begin,end,texelSize);
+		nodes.push_back(node);
+
+		BBox bound = PageBound(_level,_x,_y);
+		bound.pMin = glm::vec3(glm::vec2(origin),bound.pMin.z);
+		bound.pMax = glm::vec3(glm::min(origin + 0.5f*pageWorld,glm::vec2(terrainOffset) + terrainSize),bound.pMax.z);
+		nodeBounds.push_back(bound);
+	}
+	//--------------------------------------------------------------------------
+	void PagedTerrain::SetGridResolution(int _gridResolution)
+	{
+		// Power of two, the odd vertices morph onto the even ones
+		int resolution = 2;
+		while(resolution<_gridResolution && resolution<PAGED_TERRAIN_MAX_GRID)
+			resolution *= 2;
+		if(resolution==gridResolution)
+			return;
+		gridResolution = resolution;
+		gridChanged    = true;
+
+		int nVertices = (resolution+1)*(resolution+1);
+		gridVertices.Allocate(nVertices,GL_STATIC_DRAW);
+		glm::vec2* vertices = gridVertices.Lock();
+		for(int y=0;y<=resolution;++y)
+		for(int x=0;x<=resolution;++x)
+			vertices[y*(resolution+1)+x] = glm::vec2(x,y) / float(resolution);
+		gridVertices.Unlock();
+
+		gridCount = 6*resolution*resolution;
+		gridIndices.Allocate(gridCount,GL_STATIC_DRAW);
+		unsigned short* indices = gridIndices.Lock();
+		for(int y=0;y<resolution;++y)
+		for(int x=0;x<resolution;++x)
+		{
+			unsigned short i0 = (unsigned short)(y*(resolution+1)+x);
+			unsigned short i1 = i0+1;
+			unsigned short i2 = (unsigned short)(i0+resolution+1);
+			unsigned short i3 = i2+1;
+			unsigned short* quad = indices + 6*(y*resolution+x);
+			quad[0] = i0; quad[1] = i1; quad[2] = i3;
+			quad[3] = i0; quad[4] = i3; quad[5] = i2;
+		}
+		gridIndices.Unlock();
+
+		grid.Add(gridVertices,semantic::Position,2,GL_FLOAT);
+		grid.SetIndices(gridIndices);
+		grid.AddInstancedVectors(nodeBuffer,semantic::TerrainNode,3,0,0);
+		glf::CheckError("PagedTerrain::SetGridResolution");
+	}
+	//--------------------------------------------------------------------------
+	void PagedTerrain::Draw(		const Node* _nodes,
+									int _count)
+	{
+		// Respecified by each draw, which orphans the storage read by the
+		// draws of the previous pass
+		nodeBuffer.Allocate(std::max(nodeBuffer.count,_count),GL_STREAM_DRAW);
+		nodeBuffer.Update(_nodes,_count,0);
+		grid.DrawElementsInstanced(GL_TRIANGLES,GL_UNSIGNED_SHORT,gridCount,0,0,_count);
+
+		assert(glf::CheckError("PagedTerrain::Draw"));
+	}
+	//--------------------------------------------------------------------------
+	BBox PagedTerrain::Bound() const
+	{
+		BBox bound;
+		int top = pyramid.levels-1;
+		for(int y=0;y<pyramid.pages[top].y;++y)
+		for(int x=0;x<pyramid.pages[top].x;++x)
+			bound.Add(PageBound(top,x,y));
+		return bound;
+	}
+	//--------------------------------------------------------------------------
+	int PagedTerrain::PageSize() const
+	{
+		return pyramid.pageSize;
+	}
+	//--------------------------------------------------------------------------
+	int PagedTerrain::ResidentPages() const
+	{
+		return nResident;
+	}
+	//--------------------------------------------------------------------------
+	int PagedTerrain::LayerCount() const
+	{
+		return int(slots.size());
+	}
+	//--------------------------------------------------------------------------
+	int PagedTerrainNodes::Cull(	const std::vector<PagedTerrain*>& _terrains,
+									const Frustum* _volumes,
+									int _nVolumes)
+	{
+		int nTerrains = int(_terrains.size());
+		nodes.clear();
+		firsts.resize(nTerrains+1);
+		for(int i=0;i<nTerrains;++i)
+		{
+			firsts[i] = int(nodes.size());
+			const PagedTerrain& terrain = *_terrains[i];
+			for(unsigned int n=0;n<terrain.nodes.size();++n)
+			{
+				for(int v=0;v<_nVolumes;++v)
+				{
+					if(Intersect(_volumes[v],terrain.nodeBounds[n]))
+					{
+						nodes.push_back(terrain.nodes[n]);
+						break;
+					}
+				}
+			}
+		}
+		firsts[nTerrains] = int(nodes.size());
+		return int(nodes.size());
+	}
+	//--------------------------------------------------------------------------
+	int PagedTerrainNodes::Count(	int _terrain) const
+	{
+		return firsts[_terrain+1] - firsts[_terrain];
+	}
+	//--------------------------------------------------------------------------
+	void PagedTerrainNodes::Draw(	PagedTerrain& _paged,
+									int _terrain) const
+	{
+		int count = Count(_terrain);
+		if(count>0)
+			_paged.Draw(&nodes[firsts[_terrain]],count);
+	}
+}
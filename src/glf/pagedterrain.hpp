@@ -0,0 +1,184 @@
+#ifndef GLF_PAGEDTERRAIN_HPP
+#define GLF_PAGEDTERRAIN_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/buffer.hpp>
+#include <glf/bound.hpp>
+#include <glf/texture.hpp>
+#include <glf/thread.hpp>
+#include <glf/io/pyramid.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define PAGED_TERRAIN_UPLOADS			8		// Pages uploaded per frame at most
+#define PAGED_TERRAIN_MAX_GRID			128		// Cells per node side (16 bits indices)
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	// Terrain paged from a tiled pyramid (see io::TerrainPyramid) and drawn
+	// with continuous distance-dependent LOD (CDLOD). Pages are loaded by
+	// background I/O threads into a fixed number of layers of two texture
+	// arrays (heights and colors), within a memory budget. The least
+	// recently used pages are evicted, except the coarsest level which is
+	// loaded at once and always kept.
+	// The quadtree follows the pyramid : a node is a page. Nodes at level l
+	// are drawn up to lodFactor * 2^l page sizes of level 0 from the eye,
+	// and a node is only split when its four children are resident, so the
+	// terrain is drawn coarser while its pages are loading. Nodes are drawn
+	// by quadrants with a single grid, whose odd vertices slide onto the
+	// grid of the parent level as the distance reaches the end of the range
+	// of their level (no cracks between levels)
+	class PagedTerrain
+	{
+	public:
+		// Per instance attributes of a drawn quadrant (semantic::TerrainNode)
+		struct Node
+		{
+			glm::vec4						node;		// xy : world origin, zw : world size
+			glm::vec4						page;		// xy : origin into the page, z : scale, w : layer
+			glm::vec4						morph;		// xy : morph distances, zw : world size of a page texel
+		};
+
+											PagedTerrain();
+											~PagedTerrain();	// Stops the I/O threads
+		// Loads the pyramid description and its coarsest level, allocates
+		// the page layers within _budgetMB and starts _nThreads I/O threads
+		bool	Load(						const std::string& _folder,
+											const glm::vec2& _terrainSize,
+											const glm::vec3& _terrainOffset,
+											float _heightFactor,
+											float _roughness,
+											float _specularity,
+											int _budgetMB,
+											int _nThreads,
+											bool _verbose=false);
+		// Uploads the pages loaded since the last frame, selects the nodes
+		// of the frame around _eye and queues the missing pages. Returns
+		// the bound of the geometry which changed since the last update
+		// (empty if none) : quadrants added or removed, and the ones
+		// morphing with the eye when it moved
+		BBox	Update(						const glm::vec3& _eye);
+		void	SetGridResolution(			int _gridResolution);
+		// Streams _count quadrants into the node buffer and draws them
+		void	Draw(						const Node* _nodes,
+											int _count);
+		BBox	Bound() const;
+		int		PageSize() const;
+		int		ResidentPages() const;
+		int		LayerCount() const;
+
+		// Quadrants selected by the last update, and their bounds
+		std::vector<Node>					nodes;
+		std::vector<BBox>					nodeBounds;
+
+		glm::vec2							terrainSize;
+		glm::vec3							terrainOffset;
+		float								heightFactor;
+		float								roughness;
+		float								specularity;
+		float								lodFactor;		// Range of level 0 in page sizes
+		int									gridResolution;	// Cells per quadrant side
+		TextureArray2D						heightPages;	// R16
+		TextureArray2D						diffusePages;	// sRGB RGBA8
+
+	private:
+											PagedTerrain(	const PagedTerrain&);
+		PagedTerrain&						operator=(		const PagedTerrain&);
+
+		struct Request
+		{
+			int								page;
+			int								level;
+			int								x;
+			int								y;
+			float							distance;
+			bool							operator<(const Request& _r) const;
+		};
+		struct LoadedPage
+		{
+			int								page;
+			bool							valid;
+			std::vector<unsigned short>		heights;
+			std::vector<unsigned char>		colors;
+		};
+		struct Slot
+		{
+			int								page;			// -1 if free
+			int								used;			// Last frame the page was drawn
+		};
+
+		static void	LoadPages(				void* _terrain);
+		void	Upload(						const LoadedPage& _loaded,
+											int _slot);
+		int		FreeSlot();
+		void	Select(						int _level,
+											int _x,
+											int _y,
+											const glm::vec3& _eye);
+		void	AddQuadrant(				int _level,
+											int _x,
+											int _y,
+											int _i,
+											int _j);
+		BBox	PageBound(					int _level,
+											int _x,
+											int _y) const;
+		float	Range(						int _level) const;
+		BBox	Changes(					const glm::vec3& _eye) const;
+
+		io::TerrainPyramid					pyramid;
+		glm::vec2							cellSize;		// World size of the level 0 cells
+		std::vector<int>					pageSlots;		// Slot of each page, -1 absent, -2 unreadable
+		std::vector<Slot>					slots;			// Of the texture layers
+		int									nResident;
+		int									frame;
+		std::vector<Request>				wanted;			// Missing pages of the frame
+		std::vector<Node>					previousNodes;	// Of the last update
+		std::vector<BBox>					previousBounds;
+		glm::vec3							previousEye;
+		bool								gridChanged;	// Since the last update
+
+		// Grid of a quadrant
+		VertexBuffer2F						gridVertices;
+		IndexBuffer16						gridIndices;
+		VertexArray							grid;
+		int									gridCount;		// Indices
+		VertexBuffer<Node>::Buffer			nodeBuffer;		// Refilled by each draw, read by the grid
+
+		// Shared with the I/O threads
+		Mutex								mutex;
+		Condition							condition;
+		std::vector<Request>				requests;		// Most urgent last
+		std::vector<int>					loading;		// Pages being read
+		std::vector<LoadedPage*>			loaded;
+		std::vector<LoadedPage*>			freePages;
+		bool								quit;
+		std::vector<Thread*>				threads;
+	};
+	//--------------------------------------------------------------------------
+	// Quadrants of the paged terrains drawn by a pass, streamed into the
+	// node buffer of their terrain when drawn
+	class PagedTerrainNodes
+	{
+	public:
+		// Returns the number of quadrants overlapping at least one of the
+		// volumes, over all the terrains
+		int		Cull(						const std::vector<PagedTerrain*>& _terrains,
+											const Frustum* _volumes,
+											int _nVolumes);
+		int		Count(						int _terrain) const;
+		void	Draw(						PagedTerrain& _paged,
+											int _terrain) const;
+	private:
+		std::vector<PagedTerrain::Node>		nodes;
+		std::vector<int>					firsts;			// First node of each terrain
+	};
+}
+
+#endif
@@ -0,0 +1,319 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/renderqueue.hpp>
+#include <glf/debug.hpp>
+#include <glf/rng.hpp>
+#include <glf/utils.hpp>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cmath>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define RENDER_QUEUE_MAX_UNITS		32
+#define RENDER_QUEUE_UNKNOWN		GLuint(~0u)	// Never a GL name
+#define RENDER_QUEUE_RADIX_ITEMS	64			// Insertion sort below
+
+namespace glf
+{
+	namespace
+	{
+		//----------------------------------------------------------------------
+		// Depth buckets are logarithmic : 4096 per doubling of the distance
+		GLuint64 DepthBucket(float _depth)
+		{
+			float bucket = log2f(1.f + std::max(_depth,0.f)) * 4096.f;
+			return GLuint64(std::min(bucket,65535.f));
+		}
+		//----------------------------------------------------------------------
+		bool LessKey(const RenderQueue::Item& _a, const RenderQueue::Item& _b)
+		{
+			return _a.key < _b.key || (_a.key==_b.key && _a.draw<_b.draw);
+		}
+	}
+	//--------------------------------------------------------------------------
+	RenderQueue::Draw::Draw():
+	program(0),
+	primitive(NULL),
+	primitiveType(GL_TRIANGLES),
+	indexType(0),
+	first(0),
+	count(0),
+	baseVertex(0),
+	primCount(1),
+	baseInstance(0),
+	commands(NULL),
+	user(0)
+	{
+		for(int t=0;t<MAX_TEXTURES;++t)
+		{
+			textures[t] = NULL;
+			units[t]    = 0;
+		}
+	}
+	//--------------------------------------------------------------------------
+	RenderQueue::RenderQueue()
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	void RenderQueue::Clear()
+	{
+		draws.clear();
+		items.clear();
+	}
+	//--------------------------------------------------------------------------
+	int RenderQueue::Count() const
+	{
+		return int(draws.size());
+	}
+	//--------------------------------------------------------------------------
+	GLuint64 RenderQueue::Key(				int _pass,
+											float _depth,
+											const Draw& _draw)
+	{
+		GLuint textures[MAX_TEXTURES];
+		for(int t=0;t<MAX_TEXTURES;++t)
+			textures[t] = _draw.textures[t]!=NULL ? _draw.textures[t]->id : 0;
+		return Key(_pass,_depth,_draw.program,_draw.primitive!=NULL ? _draw.primitive->id : 0,textures);
+	}
+	//--------------------------------------------------------------------------
+	GLuint64 RenderQueue::Key(				int _pass,
+											float _depth,
+											GLuint _program,
+											GLuint _primitive,
+											const GLuint* _textures)
+	{
+		assert(_pass>=0 && _pass<16);
+		GLuint64 key = GLuint64(_pass);
+		key = (key<<8)  | GLuint64(_program & 0xFF);
+		key = (key<<12) | GLuint64(_primitive & 0xFFF);
+		for(int t=0;t<MAX_TEXTURES;++t)
+			key = (key<<12) | GLuint64(_textures[t] & 0xFFF);
+		key = (key<<16) | DepthBucket(_depth);
+		return key;
+	}
+	//--------------------------------------------------------------------------
+	void RenderQueue::Push(					int _pass,
+											float _depth,
+											const Draw& _draw)
+	{
+		assert(_draw.program!=0 && _draw.primitive!=NULL);
+		Item item;
+		item.key  = Key(_pass,_depth,_draw);
+		item.draw = int(draws.size());
+		items.push_back(item);
+		draws.push_back(_draw);
+	}
+	//--------------------------------------------------------------------------
+	void RenderQueue::Sort(					std::vector<Item>& _items,
+											std::vector<Item>& _tmp)
+	{
+		// Small queues are not worth the histograms
+		int nItems = int(_items.size());
+		if(nItems<RENDER_QUEUE_RADIX_ITEMS)
+		{
+			for(int i=1;i<nItems;++i)
+			{
+				Item item = _items[i];
+				int j = i;
+				for(;j>0 && item.key<_items[j-1].key;--j)
+					_items[j] = _items[j-1];
+				_items[j] = item;
+			}
+			return;
+		}
+		_tmp.resize(nItems);
+
+		// All the histograms in one pass over the keys
+		int histograms[8][256] = {{0}};
+		for(int i=0;i<nItems;++i)
+		{
+			GLuint64 key = _items[i].key;
+			for(int b=0;b<8;++b)
+				++histograms[b][(key>>(8*b)) & 0xFF];
+		}
+
+		std::vector<Item>* src = &_items;
+		std::vector<Item>* dst = &_tmp;
+		for(int b=0;b<8;++b)
+		{
+			int* histogram = histograms[b];
+			if(histogram[((*src)[0].key>>(8*b)) & 0xFF]==nItems)
+				continue;
+
+			int offset = 0;
+			for(int d=0;d<256;++d)
+			{
+				int count    = histogram[d];
+				histogram[d] = offset;
+				offset      += count;
+			}
+			for(int i=0;i<nItems;++i)
+			{
+				const Item& item = (*src)[i];
+				(*dst)[histogram[(item.key>>(8*b)) & 0xFF]++] = item;
+			}
+			std::swap(src,dst);
+		}
+		if(src!=&_items)
+			_items.swap(_tmp);
+	}
+	//--------------------------------------------------------------------------
+	int RenderQueue::Submit(				DrawCallback _callback,
+											void* _data)
+	{
+		if(draws.empty())
+			return 0;
+		Sort(items,tmpItems);
+
+		// State of the previous draw, unknown at the first one
+		GLuint program = RENDER_QUEUE_UNKNOWN;
+		const VertexArray* primitive = NULL;
+		const IndirectElementBuffer* commands = NULL;
+		GLuint boundTextures[RENDER_QUEUE_MAX_UNITS];
+		for(int u=0;u<RENDER_QUEUE_MAX_UNITS;++u)
+			boundTextures[u] = RENDER_QUEUE_UNKNOWN;
+
+		// Binds of a submission in draw order, which binds everything for
+		// every draw, against the issued ones
+		int nBinds  = 0;
+		int nIssued = 0;
+		for(unsigned int i=0;i<items.size();++i)
+		{
+			const Draw& draw = draws[items[i].draw];
+			nBinds += 2;
+			if(draw.program!=program)
+			{
+				glUseProgram(draw.program);
+				program = draw.program;
+				++nIssued;
+			}
+			if(draw.primitive!=primitive)
+			{
+				glBindVertexArray(draw.primitive->id);
+				primitive = draw.primitive;
+				++nIssued;
+			}
+			for(int t=0;t<MAX_TEXTURES;++t)
+			{
+				if(draw.textures[t]==NULL)
+					continue;
+				assert(draw.units[t]>=0 && draw.units[t]<RENDER_QUEUE_MAX_UNITS);
+				++nBinds;
+				if(boundTextures[draw.units[t]]!=draw.textures[t]->id)
+				{
+					draw.textures[t]->Bind(draw.units[t]);
+					boundTextures[draw.units[t]] = draw.textures[t]->id;
+					++nIssued;
+				}
+			}
+			if(draw.commands!=NULL)
+			{
+				++nBinds;
+				if(draw.commands!=commands)
+				{
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER,draw.commands->id);
+					commands = draw.commands;
+					++nIssued;
+				}
+			}
+
+			if(_callback!=NULL)
+				_callback(draw.user,_data);
+
+			if(draw.commands!=NULL)
+			{
+				MultiDrawElementsIndirect(draw.primitiveType,draw.indexType,draw.first,draw.count);
+			}
+			else if(draw.indexType!=0)
+			{
+				int indexSize = draw.indexType==GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+				if(draw.baseInstance!=0)
+					glDrawElementsInstancedBaseVertexBaseInstance(	draw.primitiveType,
+																	draw.count,
+																	draw.indexType,
+																	GLF_BUFFER_OFFSET(draw.first*indexSize),
+																	draw.primCount,
+																	draw.baseVertex,
+																	draw.baseInstance);
+				else
+					glDrawElementsInstancedBaseVertex(	draw.primitiveType,
+														draw.count,
+														draw.indexType,
+														GLF_BUFFER_OFFSET(draw.first*indexSize),
+														draw.primCount,
+														draw.baseVertex);
+			}
+			else if(draw.baseInstance!=0)
+			{
+				glDrawArraysInstancedBaseInstance(draw.primitiveType,draw.first,draw.count,draw.primCount,draw.baseInstance);
+			}
+			else
+			{
+				glDrawArraysInstanced(draw.primitiveType,draw.first,draw.count,draw.primCount);
+			}
+		}
+		if(commands!=NULL)
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+		glBindVertexArray(0);
+		Clear();
+
+		int nElided = nBinds - nIssued;
+		glf::manager::timings->SetCounter(counter::ElidedBinds,glf::manager::timings->Counter(counter::ElidedBinds)+nElided);
+		glf::CheckError("RenderQueue::Submit");
+		return nElided;
+	}
+	//--------------------------------------------------------------------------
+	bool BenchmarkRenderQueue(				int _nDraws)
+	{
+		// Keys of a typical pass : two passes, few programs, a few hundred
+		// vertex arrays and textures, random depths. The names are synthetic,
+		// no GL object is created
+		RNG rng(17);
+		std::vector<RenderQueue::Item> items(_nDraws);
+		for(int i=0;i<_nDraws;++i)
+		{
+			GLuint textures[RenderQueue::MAX_TEXTURES];
+			for(int t=0;t<RenderQueue::MAX_TEXTURES;++t)
+				textures[t] = 1 + rng.RandomUInt() % 512;
+			items[i].key  = RenderQueue::Key(	int(rng.RandomUInt() % 2),
+												1000.f*rng.RandomFloat(),
+												1 + rng.RandomUInt() % 4,
+												1 + rng.RandomUInt() % 256,
+												textures);
+			items[i].draw = i;
+		}
+
+		int nRuns = 20;
+		std::vector<RenderQueue::Item> radixItems, sortItems, tmp;
+		double start = glfwGetTime();
+		for(int r=0;r<nRuns;++r)
+		{
+			radixItems = items;
+			RenderQueue::Sort(radixItems,tmp);
+		}
+		double radixTime = (glfwGetTime() - start) / nRuns;
+		start = glfwGetTime();
+		for(int r=0;r<nRuns;++r)
+		{
+			sortItems = items;
+			std::sort(sortItems.begin(),sortItems.end(),LessKey);
+		}
+		double sortTime = (glfwGetTime() - start) / nRuns;
+
+		// The radix sort is stable, so the draws of equal keys stay in
+		// push order like with LessKey
+		bool identical = true;
+		for(int i=0;i<_nDraws && identical;++i)
+			identical = radixItems[i].key==sortItems[i].key && radixItems[i].draw==sortItems[i].draw;
+
+		glf::Info("Render queue    : %d draws",_nDraws);
+		glf::Info("Radix sort      : %8.3f ms (%6.2f Mkeys/s)",radixTime*1000.0,_nDraws*1e-6/radixTime);
+		glf::Info("std::sort       : %8.3f ms (%6.2f Mkeys/s)",sortTime*1000.0,_nDraws*1e-6/sortTime);
+		glf::Info("Identical output: %s",identical?"yes":"no");
+		return identical;
+	}
+}
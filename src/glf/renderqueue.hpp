@@ -0,0 +1,94 @@
+#ifndef GLF_RENDERQUEUE_HPP
+#define GLF_RENDERQUEUE_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/buffer.hpp>
+#include <glf/texture.hpp>
+#include <vector>
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	// Queue of the visible draws of a pass, sorted by a 64 bit key to limit
+	// the state changes. From the most significant bits :
+	//	pass (4) | program (8) | vertex array (12) | texture 0 (12) |
+	//	texture 1 (12) | depth bucket (16)
+	// GL names are truncated in the key, which only affects the order :
+	// Submit compares the actual state and only binds what changed. The
+	// per draw state outside of the key (uniforms, generic attributes) is
+	// set by the callback given to Submit.
+	// Vertex arrays are kept bound between draws, so the per instance
+	// attributes of the queued vertex arrays have to be set before Submit
+	class RenderQueue
+	{
+	public:
+		enum { MAX_TEXTURES = 2 };
+
+		// Sets the per draw state of the draw pushed with _user
+		typedef void (*DrawCallback)(int _user, void* _data);
+
+		struct Draw
+		{
+										Draw();
+			GLuint						program;
+			const VertexArray*			primitive;
+			const Texture2D*			textures[MAX_TEXTURES];	// NULL if unused
+			GLint						units[MAX_TEXTURES];
+			GLenum						primitiveType;
+			GLenum						indexType;	// 0 for non indexed draws
+			int							first;		// Index, vertex or command
+			int							count;
+			int							baseVertex;
+			int							primCount;
+			int							baseInstance;	// GL 4.2 or ARB_base_instance if not 0
+			const IndirectElementBuffer* commands;	// Multi draw of count commands
+			int							user;		// Given back to the callback
+		};
+
+										RenderQueue();
+		void							Clear();
+		// _depth is the view distance of the draw, opaque draws of the same
+		// state are submitted front to back
+		void							Push(			int _pass,
+														float _depth,
+														const Draw& _draw);
+		int								Count() const;
+		// Sorts and submits the draws, then clears the queue. Returns the
+		// number of elided binds, also added to the ElidedBinds counter
+		int								Submit(			DrawCallback _callback,
+														void* _data);
+
+		static GLuint64					Key(			int _pass,
+														float _depth,
+														const Draw& _draw);
+		// Same key from the object names of a draw (0 if unused)
+		static GLuint64					Key(			int _pass,
+														float _depth,
+														GLuint _program,
+														GLuint _primitive,
+														const GLuint* _textures);
+		struct Item
+		{
+			GLuint64					key;
+			int							draw;
+		};
+		// Stable LSD radix sort on the keys, 8 bits per pass. Passes on a
+		// byte shared by all the keys are skipped, small queues use an
+		// insertion sort
+		static void						Sort(			std::vector<Item>& _items,
+														std::vector<Item>& _tmp);
+	private:
+		std::vector<Draw>				draws;
+		std::vector<Item>				items;
+		std::vector<Item>				tmpItems;
+	};
+
+	//--------------------------------------------------------------------------
+	// Radix sort throughput on _nDraws random keys, against std::sort.
+	// Returns false if the orders differ
+	bool BenchmarkRenderQueue(			int _nDraws);
+}
+
+#endif
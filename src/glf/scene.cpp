@@ -2,11 +2,18 @@
 // Includes
 //-----------------------------------------------------------------------------
 #include <glf/scene.hpp>
+#include <glf/constants.hpp>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
 
 //-----------------------------------------------------------------------------
 // Constants
 //-----------------------------------------------------------------------------
 #define DEFAULT_POOL_SIZE				1024
+#define PAGED_TERRAIN_POOL_SIZE			16
+#define ARENA_MIN_ELEMENTS				(1024*1024)	// Initial capacity of the arena's buffers
 
 namespace glf
 {
@@ -16,8 +23,13 @@ namespace glf
 	vbo2F(DEFAULT_POOL_SIZE),
 	vbo3F(DEFAULT_POOL_SIZE),
 	vbo4F(DEFAULT_POOL_SIZE),
+	vboMesh(DEFAULT_POOL_SIZE),
 	ibo(DEFAULT_POOL_SIZE),
-	vao(DEFAULT_POOL_SIZE)
+	ibo16(DEFAULT_POOL_SIZE),
+	indirect(DEFAULT_POOL_SIZE),
+	vao(DEFAULT_POOL_SIZE),
+	pagedTerrain(PAGED_TERRAIN_POOL_SIZE),
+	arena(NULL)
 	{
 
 	}
@@ -47,24 +59,160 @@ namespace glf
 		return vbo4F.Allocate();
 	}
 	//--------------------------------------------------------------------------
+	MeshVertexBuffer* ResourceManager::CreateMeshVBO()
+	{
+		return vboMesh.Allocate();
+	}
+	//--------------------------------------------------------------------------
 	IndexBuffer* ResourceManager::CreateIBO()
 	{
 		return ibo.Allocate();
 	}
 	//--------------------------------------------------------------------------
+	IndexBuffer16* ResourceManager::CreateIBO16()
+	{
+		return ibo16.Allocate();
+	}
+	//--------------------------------------------------------------------------
+	IndirectElementBuffer* ResourceManager::CreateIndirectBuffer()
+	{
+		return indirect.Allocate();
+	}
+	//--------------------------------------------------------------------------
 	VertexArray* ResourceManager::CreateVAO()
 	{
 		return vao.Allocate();
 	}
 	//--------------------------------------------------------------------------
+	PagedTerrain* ResourceManager::CreatePagedTerrain()
+	{
+		return pagedTerrain.Allocate();
+	}
+	//--------------------------------------------------------------------------
+	GeometryArena& ResourceManager::Arena()
+	{
+		if(arena==NULL)
+			arena = new GeometryArena();
+		return *arena;
+	}
+	//--------------------------------------------------------------------------
 	void ResourceManager::Clear()
 	{
 		tex2D.DesallocateAll();
 		vbo2F.DesallocateAll();
 		vbo3F.DesallocateAll();
 		vbo4F.DesallocateAll();
+		vboMesh.DesallocateAll();
 		ibo.DesallocateAll();
+		ibo16.DesallocateAll();
+		indirect.DesallocateAll();
 		vao.DesallocateAll();
+		pagedTerrain.DesallocateAll();
+		delete arena;
+		arena = NULL;
+	}
+	//--------------------------------------------------------------------------
+	namespace
+	{
+		//----------------------------------------------------------------------
+		// Makes room for _needed elements into a buffer, the _used first ones
+		// are copied on the GPU. Returns true if the buffer has changed
+		template<typename T>
+		bool Reserve(T& _buffer, int _used, int _needed)
+		{
+			if(_needed<=_buffer.count)
+				return false;
+
+			typedef typename T::DataType DataType;
+			int capacity = std::max(_needed,std::max(2*_buffer.count,ARENA_MIN_ELEMENTS));
+			GLuint id;
+			glGenBuffers(1,&id);
+			glBindBuffer(GL_COPY_WRITE_BUFFER,id);
+			glBufferData(GL_COPY_WRITE_BUFFER,capacity*sizeof(DataType),NULL,GL_STATIC_DRAW);
+			if(_used>0)
+			{
+				glBindBuffer(GL_COPY_READ_BUFFER,_buffer.id);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,0,_used*sizeof(DataType));
+				glBindBuffer(GL_COPY_READ_BUFFER,0);
+			}
+			glBindBuffer(GL_COPY_WRITE_BUFFER,0);
+			glDeleteBuffers(1,&_buffer.id);
+
+			_buffer.id     = id;
+			_buffer.count  = capacity;
+			_buffer.update = GL_STATIC_DRAW;
+			glf::CheckError("GeometryArena::Reserve");
+			return true;
+		}
+	}
+	//--------------------------------------------------------------------------
+	GeometryArena::GeometryArena():
+	nVertices(0),
+	nIndices16(0),
+	nIndices32(0)
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	void GeometryArena::Add(	const MeshVertex* _vertices,
+								int _nVertices,
+								const void* _indices,
+								int _nIndices,
+								GLenum _indexType,
+								int& _baseVertex,
+								int& _firstIndex)
+	{
+		bool grown = Reserve(vertices,nVertices,nVertices+_nVertices);
+		vertices.Update(_vertices,_nVertices,nVertices);
+		_baseVertex = nVertices;
+		nVertices  += _nVertices;
+
+		if(_indexType==GL_UNSIGNED_SHORT)
+		{
+			grown |= Reserve(indices16,nIndices16,nIndices16+_nIndices);
+			indices16.Update((const unsigned short*)_indices,_nIndices,nIndices16);
+			_firstIndex = nIndices16;
+			nIndices16 += _nIndices;
+		}
+		else
+		{
+			grown |= Reserve(indices32,nIndices32,nIndices32+_nIndices);
+			indices32.Update((const unsigned int*)_indices,_nIndices,nIndices32);
+			_firstIndex = nIndices32;
+			nIndices32 += _nIndices;
+		}
+
+		// Vertex arrays refer to the buffers' ids, which change on growth
+		if(grown)
+			AttachBuffers();
+	}
+	//--------------------------------------------------------------------------
+	void GeometryArena::AttachBuffers()
+	{
+		VertexArray* regularVAOs[2] = {&regularVAO16,&regularVAO32};
+		VertexArray* shadowVAOs[2]  = {&shadowVAO16,&shadowVAO32};
+		for(int i=0;i<2;++i)
+		{
+			regularVAOs[i]->Add(vertices,semantic::Position, 3,GL_FLOAT,		false,offsetof(MeshVertex,position));
+			regularVAOs[i]->Add(vertices,semantic::Normal,   2,GL_SHORT,		true, offsetof(MeshVertex,normal));
+			regularVAOs[i]->Add(vertices,semantic::Tangent,  2,GL_SHORT,		true, offsetof(MeshVertex,tangent));
+			regularVAOs[i]->Add(vertices,semantic::TexCoord, 2,GL_HALF_FLOAT,	false,offsetof(MeshVertex,texCoord));
+			shadowVAOs[i]->Add(vertices, semantic::Position, 3,GL_FLOAT,		false,offsetof(MeshVertex,position));
+		}
+		regularVAO16.SetIndices(indices16);
+		shadowVAO16.SetIndices(indices16);
+		regularVAO32.SetIndices(indices32);
+		shadowVAO32.SetIndices(indices32);
+	}
+	//--------------------------------------------------------------------------
+	VertexArray* GeometryArena::RegularVAO(GLenum _indexType)
+	{
+		return _indexType==GL_UNSIGNED_SHORT ? &regularVAO16 : &regularVAO32;
+	}
+	//--------------------------------------------------------------------------
+	VertexArray* GeometryArena::ShadowVAO(GLenum _indexType)
+	{
+		return _indexType==GL_UNSIGNED_SHORT ? &shadowVAO16 : &shadowVAO32;
 	}
 	//--------------------------------------------------------------------------
 	RegularMesh::RegularMesh():
@@ -72,9 +220,10 @@ namespace glf
 	normalTex(NULL),
 	roughness(1),
 	specularity(0),
-	indices(NULL),
+	indexType(GL_UNSIGNED_INT),
 	startIndices(0),
 	countIndices(0),
+	baseVertex(0),
 	primitiveType(GL_TRIANGLES),
 	primitive(NULL)
 	{
@@ -82,13 +231,286 @@ namespace glf
 	}
 	//--------------------------------------------------------------------------
 	ShadowMesh::ShadowMesh():
-	indices(NULL),
+	indexType(GL_UNSIGNED_INT),
 	startIndices(0),
 	countIndices(0),
+	baseVertex(0),
 	primitiveType(GL_TRIANGLES),
 	primitive(NULL)
 	{
 
+	}
+	//--------------------------------------------------------------------------
+	LocalLight::LocalLight():
+	type(POINT),
+	position(0,0,0),
+	direction(0,0,-1),
+	intensity(1,1,1),
+	radius(1),
+	innerAngle(30),
+	outerAngle(45),
+	castShadows(true)
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	GeometryMemory::GeometryMemory():
+	nVertices(0),
+	nIndices(0),
+	vertexBytes(0),
+	indexBytes(0)
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	namespace
+	{
+		//----------------------------------------------------------------------
+		typedef int (*MeshCompFunc)(const SceneManager&, int, int);
+		//----------------------------------------------------------------------
+		template<typename T>
+		int CompareGeometry(const T& _a, const T& _b)
+		{
+			if(_a.primitive!=_b.primitive)	return _a.primitive<_b.primitive ? -1 : 1;
+			if(_a.indexType!=_b.indexType)	return _a.indexType<_b.indexType ? -1 : 1;
+			return 0;
+		}
+		//----------------------------------------------------------------------
+		int CompareTransform(const SceneManager& _scene, int _a, int _b)
+		{
+			return memcmp(&_scene.transformations[_a][0][0],&_scene.transformations[_b][0][0],sizeof(glm::mat4));
+		}
+		//----------------------------------------------------------------------
+		int CompareRegular(const SceneManager& _scene, int _a, int _b)
+		{
+			const RegularMesh& a = _scene.regularMeshes[_a];
+			const RegularMesh& b = _scene.regularMeshes[_b];
+			int geometry = CompareGeometry(a,b);
+			if(geometry!=0)						return geometry;
+			if(a.diffuseTex!=b.diffuseTex)		return a.diffuseTex<b.diffuseTex ? -1 : 1;
+			if(a.normalTex!=b.normalTex)		return a.normalTex<b.normalTex ? -1 : 1;
+			if(a.roughness!=b.roughness)		return a.roughness<b.roughness ? -1 : 1;
+			if(a.specularity!=b.specularity)	return a.specularity<b.specularity ? -1 : 1;
+			return CompareTransform(_scene,_a,_b);
+		}
+		//----------------------------------------------------------------------
+		int CompareShadow(const SceneManager& _scene, int _a, int _b)
+		{
+			int geometry = CompareGeometry(_scene.shadowMeshes[_a],_scene.shadowMeshes[_b]);
+			if(geometry!=0)
+				return geometry;
+			return CompareTransform(_scene,_a,_b);
+		}
+		//----------------------------------------------------------------------
+		struct BatchCompFunc
+		{
+			const SceneManager*	scene;
+			MeshCompFunc		compare;
+			bool operator()(int _a, int _b) const
+			{
+				return compare(*scene,_a,_b)<0;
+			}
+		};
+		//----------------------------------------------------------------------
+		template<typename T>
+		void BuildMeshBatches(	const SceneManager& _scene,
+								const std::vector<T>& _meshes,
+								MeshCompFunc _compare,
+								std::vector<MeshBatch>& _batches,
+								std::vector<int>& _commandMeshes,
+								std::vector<DrawElementsIndirectCommand>& _commands)
+		{
+			// Meshes of a batch keep their loading order
+			int nMeshes = int(_meshes.size());
+			std::vector<int> order(nMeshes);
+			for(int i=0;i<nMeshes;++i)
+				order[i] = i;
+			BatchCompFunc compFunc;
+			compFunc.scene   = &_scene;
+			compFunc.compare = _compare;
+			std::stable_sort(order.begin(),order.end(),compFunc);
+
+			_batches.clear();
+			_commands.resize(nMeshes);
+			_commandMeshes = order;
+			for(int i=0;i<nMeshes;++i)
+			{
+				const T& mesh = _meshes[order[i]];
+				_commands[i]  = IndirectCommand(mesh);
+
+				if(i==0 || _compare(_scene,order[i-1],order[i])!=0)
+				{
+					MeshBatch batch;
+					batch.primitive     = mesh.primitive;
+					batch.indexType     = mesh.indexType;
+					batch.mesh          = order[i];
+					batch.firstCommand  = i;
+					batch.countCommands = 0;
+					_batches.push_back(batch);
+				}
+				++_batches.back().countCommands;
+			}
+		}
+		//----------------------------------------------------------------------
+		void UploadCommands(	ResourceManager& _resourceManager,
+								std::vector<DrawElementsIndirectCommand>& _commands,
+								IndirectElementBuffer*& _buffer)
+		{
+			if(_commands.empty())
+				return;
+			if(_buffer==NULL)
+				_buffer = _resourceManager.CreateIndirectBuffer();
+			_buffer->Allocate(int(_commands.size()),GL_STATIC_DRAW);
+			_buffer->Fill(&_commands[0],int(_commands.size()));
+		}
+	}
+	//--------------------------------------------------------------------------
+	SceneManager::SceneManager():
+	regularCommands(NULL),
+	shadowCommands(NULL)
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	void SceneManager::BuildBatches(ResourceManager& _resourceManager)
+	{
+		std::vector<DrawElementsIndirectCommand> commands;
+		BuildMeshBatches(*this,regularMeshes,CompareRegular,regularBatches,regularCommandMeshes,commands);
+		// The base instance of a regular command selects its draw record
+		if(DrawRecordRing::Supported())
+			for(unsigned int i=0;i<commands.size();++i)
+				commands[i].baseInstance = i;
+		UploadCommands(_resourceManager,commands,regularCommands);
+		BuildMeshBatches(*this,shadowMeshes,CompareShadow,shadowBatches,shadowCommandMeshes,commands);
+		UploadCommands(_resourceManager,commands,shadowCommands);
+		glf::CheckError("SceneManager::BuildBatches");
+	}
+	//--------------------------------------------------------------------------
+	namespace
+	{
+		//----------------------------------------------------------------------
+		inline float SignNotZero(float _v)
+		{
+			return _v>=0.f ? 1.f : -1.f;
+		}
+		//----------------------------------------------------------------------
+		inline short ToSnorm16(float _v)
+		{
+			return short(floorf(std::min(std::max(_v,-1.f),1.f)*32767.f + 0.5f));
+		}
+		//----------------------------------------------------------------------
+		// Octahedral projection of a unit vector onto [-1,1]^2
+		void OctEncode(const glm::vec3& _v, short _e[2])
+		{
+			float l1 = fabsf(_v.x) + fabsf(_v.y) + fabsf(_v.z);
+			if(l1==0.f)
+			{
+				_e[0] = _e[1] = 0;
+				return;
+			}
+			glm::vec3 v = _v / l1;
+			glm::vec2 e(v.x,v.y);
+			if(v.z<0.f)
+				e = glm::vec2(	(1.f-fabsf(v.y)) * SignNotZero(v.x),
+								(1.f-fabsf(v.x)) * SignNotZero(v.y));
+			_e[0] = ToSnorm16(e.x);
+			_e[1] = ToSnorm16(e.y);
+		}
+		//----------------------------------------------------------------------
+		glm::vec3 OctDecode(const short _e[2])
+		{
+			glm::vec2 e(std::max(_e[0]/32767.f,-1.f),std::max(_e[1]/32767.f,-1.f));
+			glm::vec3 v(e.x,e.y,1.f-fabsf(e.x)-fabsf(e.y));
+			if(v.z<0.f)
+			{
+				float x = v.x;
+				v.x = (1.f-fabsf(v.y)) * SignNotZero(x);
+				v.y = (1.f-fabsf(x))   * SignNotZero(v.y);
+			}
+			return glm::normalize(v);
+		}
+		//----------------------------------------------------------------------
+		// IEEE half float, rounded to nearest even
+		unsigned short ToHalf(float _v)
+		{
+			unsigned int x;
+			memcpy(&x,&_v,sizeof(x));
+			unsigned int sign = (x>>16) & 0x8000;
+			unsigned int mant = x & 0x7FFFFF;
+			int exp           = int((x>>23) & 0xFF) - 127 + 15;
+
+			if(((x>>23) & 0xFF)==0xFF)						// Inf, NaN
+				return (unsigned short)(sign | 0x7C00 | (mant?0x200:0));
+			if(exp>=31)										// Overflow
+				return (unsigned short)(sign | 0x7C00);
+			if(exp<=0)										// Denormals
+			{
+				if(exp<-10)
+					return (unsigned short)sign;
+				mant |= 0x800000;
+				unsigned int shift = 14 - exp;
+				unsigned int h     = mant >> shift;
+				unsigned int rem   = mant & ((1u<<shift)-1);
+				unsigned int half  = 1u << (shift-1);
+				if(rem>half || (rem==half && (h&1)))
+					++h;
+				return (unsigned short)(sign | h);
+			}
+			unsigned int h   = (unsigned int)(exp<<10) | (mant>>13);
+			unsigned int rem = mant & 0x1FFF;
+			if(rem>0x1000 || (rem==0x1000 && (h&1)))
+				++h;										// Can carry into the exponent
+			return (unsigned short)(sign | h);
+		}
+		//----------------------------------------------------------------------
+		float FromHalf(unsigned short _h)
+		{
+			unsigned int sign = (_h & 0x8000) << 16;
+			unsigned int exp  = (_h>>10) & 0x1F;
+			unsigned int mant = _h & 0x3FF;
+			if(exp==0)
+			{
+				float v = ldexpf(float(mant),-24);
+				return sign ? -v : v;
+			}
+			unsigned int x = sign | (exp==31 ? 0x7F800000 : (exp+112)<<23) | (mant<<13);
+			float v;
+			memcpy(&v,&x,sizeof(v));
+			return v;
+		}
+	}
+	//--------------------------------------------------------------------------
+	MeshVertex EncodeVertex(	const glm::vec3& _position,
+								const glm::vec3& _normal,
+								const glm::vec4& _tangent,
+								const glm::vec2& _texCoord)
+	{
+		MeshVertex vertex;
+		vertex.position = _position;
+		OctEncode(_normal,vertex.normal);
+		OctEncode(glm::vec3(_tangent),vertex.tangent);
+
+		// Move the lowest bit toward zero so that -32768 is never produced,
+		// since it decodes like -32767
+		int handedness = _tangent.w<0.f ? 1 : 0;
+		if((vertex.tangent[1] & 1)!=handedness)
+			vertex.tangent[1] += vertex.tangent[1]>0 ? -1 : 1;
+
+		vertex.texCoord[0] = ToHalf(_texCoord.x);
+		vertex.texCoord[1] = ToHalf(_texCoord.y);
+		return vertex;
+	}
+	//--------------------------------------------------------------------------
+	void DecodeVertex(	const MeshVertex& _vertex,
+						glm::vec3& _position,
+						glm::vec3& _normal,
+						glm::vec4& _tangent,
+						glm::vec2& _texCoord)
+	{
+		_position = _vertex.position;
+		_normal   = OctDecode(_vertex.normal);
+		_tangent  = glm::vec4(OctDecode(_vertex.tangent), (_vertex.tangent[1] & 1) ? -1.f : 1.f);
+		_texCoord = glm::vec2(FromHalf(_vertex.texCoord[0]),FromHalf(_vertex.texCoord[1]));
 	}
 	//--------------------------------------------------------------------------
 	BBox ObjectBound(	VertexBuffer3F& _vbo,
@@ -113,6 +535,16 @@ namespace glf
 		return bbox;
 	}
 	//--------------------------------------------------------------------------
+	bool BackfacingCluster(	const MeshCluster& _cluster,
+							const glm::vec3& _eye)
+	{
+		// Every direction from _eye to the sphere has to be within 90 degrees
+		// minus the cone's half angle of the cone axis
+		glm::vec3 view = _cluster.center - _eye;
+		float distance = glm::length(view);
+		return glm::dot(view,_cluster.coneAxis) > _cluster.coneCutoff*distance + _cluster.radius*(1.f+_cluster.coneCutoff);
+	}
+	//--------------------------------------------------------------------------
 	BBox WorldBound(const SceneManager& _scene)
 	{
 		BBox bbox;
@@ -122,6 +554,14 @@ namespace glf
 			bbox.Add(_scene.oBounds[i]);
 		for(int i=0;i<nTBounds;++i)
 			bbox.Add(_scene.tBounds[i]);
+		for(unsigned int i=0;i<_scene.pagedTerrains.size();++i)
+			bbox.Add(_scene.pagedTerrains[i]->Bound());
+		for(unsigned int m=0;m<_scene.instancedModels.size();++m)
+		{
+			const InstancedModel& model = _scene.instancedModels[m];
+			for(unsigned int i=0;i<model.bounds.size();++i)
+				bbox.Add(model.bounds[i]);
+		}
 		return bbox;
 	}
 }
@@ -10,6 +10,9 @@
 #include <glf/memory.hpp>
 #include <glf/bound.hpp>
 #include <glf/terrain.hpp>
+#include <glf/pagedterrain.hpp>
+#include <glf/bvh.hpp>
+#include <glf/renderqueue.hpp>
 #include <vector>
 
 namespace glf
@@ -24,18 +27,36 @@ namespace glf
 		extern GLint Bitangent;
 	}
 	//--------------------------------------------------------------------------
+	// Interleaved and quantized vertex of regular meshes (24 bytes) :
+	// - Normal and tangent are octahedral encoded into 2 snorm16
+	// - Handedness of the tangent space is the lowest bit of tangent[1]
+	// - Texture coordinates are half floats, for keeping tiling coordinates
+	struct MeshVertex
+	{
+		glm::vec3						position;
+		short							normal[2];
+		short							tangent[2];
+		unsigned short					texCoord[2];
+	};
+	typedef VertexBuffer<MeshVertex>::Buffer	MeshVertexBuffer;
+	//--------------------------------------------------------------------------
 	struct ShadowMesh
 	{
 	public:
 										ShadowMesh();
-		IndexBuffer*					indices;
+		GLenum							indexType;	// Indices are attached to the VAO
 		unsigned int 					startIndices;
 		unsigned int 					countIndices;
+		int								baseVertex;
 		GLenum							primitiveType;
 		VertexArray*					primitive;
 		void							Draw() const
 		{
-			primitive->Draw(primitiveType,*indices,countIndices,startIndices);
+			primitive->DrawElements(primitiveType,indexType,countIndices,startIndices,baseVertex);
+		}
+		void							Draw(int _primCount, int _baseInstance=0) const
+		{
+			primitive->DrawElementsInstanced(primitiveType,indexType,countIndices,startIndices,baseVertex,_primCount,_baseInstance);
 		}
 	};
 	//--------------------------------------------------------------------------
@@ -47,17 +68,108 @@ namespace glf
 		Texture2D*						normalTex;
 		float 							roughness;
 		float 							specularity;
-		IndexBuffer*					indices;
+		GLenum							indexType;	// Indices are attached to the VAO
 		unsigned int 					startIndices;
 		unsigned int 					countIndices;
+		int								baseVertex;
 		GLenum							primitiveType;
 		VertexArray*					primitive;
 		void							Draw() const
 		{
-			primitive->Draw(primitiveType,*indices,countIndices,startIndices);
+			primitive->DrawElements(primitiveType,indexType,countIndices,startIndices,baseVertex);
+		}
+		void							Draw(int _primCount, int _baseInstance=0) const
+		{
+			primitive->DrawElementsInstanced(primitiveType,indexType,countIndices,startIndices,baseVertex,_primCount,_baseInstance);
 		}
 	};
 	//--------------------------------------------------------------------------
+	// Model placed several times in the scene. Its meshes share one geometry
+	// and texture set and are drawn with one instanced draw each, the
+	// transformation of an instance being a per instance attribute
+	// (semantic::Model) set up once by the renderers, the draws selecting
+	// their first instance with the base instance
+	struct InstancedModel
+	{
+		std::vector<RegularMesh>		meshes;		// All using the same vertex array
+		std::vector<ShadowMesh>			shadowMeshes;
+		BBox							bound;		// Model space
+		std::vector<glm::mat4>			transforms;	// Of each instance
+		std::vector<BBox>				bounds;		// World space bound of each instance
+	};
+	//--------------------------------------------------------------------------
+	// Spot or point light of a scene, lighting up to its radius. The sun is
+	// not one of them (see CSMLight). A point light shadows all directions,
+	// a spot light its cone (see ShadowAtlas)
+	struct LocalLight
+	{
+		enum Type { POINT, SPOT };
+										LocalLight();
+		int								type;
+		glm::vec3						position;
+		glm::vec3						direction;	// Axis of the spot cone
+		glm::vec3						intensity;
+		float							radius;
+		float							innerAngle;	// Half angles of the spot cone, in degrees
+		float							outerAngle;
+		bool							castShadows;
+	};
+	//--------------------------------------------------------------------------
+	// Contiguous range of 64 to 128 triangles of a regular mesh, with bounds
+	// for culling it on its own. All the triangles' normals are within the
+	// cone : dot(normal,coneAxis) >= cos(asin(coneCutoff)). The cone is
+	// empty (coneCutoff > 1) when they do not face a common hemisphere
+	struct MeshCluster
+	{
+										MeshCluster():mesh(0),startIndices(0),countIndices(0),center(0),radius(0),coneAxis(0),coneCutoff(0){}
+		int								mesh;		// Into regularMeshes
+		unsigned int 					startIndices;
+		unsigned int 					countIndices;
+		glm::vec3						center;		// Bounding sphere
+		float							radius;
+		BBox							bound;
+		glm::vec3						coneAxis;
+		float							coneCutoff;	// Sine of the half angle
+	};
+	//--------------------------------------------------------------------------
+	// Shared vertex and index buffers of the regular meshes. Models are
+	// sub-allocated and drawn with a base vertex, so that all the meshes
+	// share one vertex array per vertex format and index type. Buffers grow
+	// by doubling their capacity
+	class GeometryArena
+	{
+	public:
+										GeometryArena();
+		// Copies a model into the arena. Returns its base vertex and the
+		// first index of its range into the index buffer of _indexType
+		void							Add(		const MeshVertex* _vertices,
+													int _nVertices,
+													const void* _indices,
+													int _nIndices,
+													GLenum _indexType,
+													int& _baseVertex,
+													int& _firstIndex);
+		VertexArray*					RegularVAO(	GLenum _indexType);
+		VertexArray*					ShadowVAO(	GLenum _indexType);
+
+	private:
+		GeometryArena(const GeometryArena&);
+		GeometryArena& operator=(const GeometryArena&);
+		void							AttachBuffers();
+
+	private:
+		MeshVertexBuffer				vertices;
+		IndexBuffer16					indices16;
+		IndexBuffer						indices32;
+		int								nVertices;
+		int								nIndices16;
+		int								nIndices32;
+		VertexArray						regularVAO16;
+		VertexArray						regularVAO32;
+		VertexArray						shadowVAO16;
+		VertexArray						shadowVAO32;
+	};
+	//--------------------------------------------------------------------------
 	class ResourceManager
 	{
 	public:
@@ -67,8 +179,13 @@ namespace glf
 		VertexBuffer2F*					CreateVBO2F();
 		VertexBuffer3F*					CreateVBO3F();
 		VertexBuffer4F*					CreateVBO4F();
+		MeshVertexBuffer*				CreateMeshVBO();
 		IndexBuffer*					CreateIBO();
+		IndexBuffer16*					CreateIBO16();
+		IndirectElementBuffer*			CreateIndirectBuffer();
 		VertexArray*					CreateVAO();
+		PagedTerrain*					CreatePagedTerrain();
+		GeometryArena&					Arena();	// Created on first use
 		void							Clear();
 
 	private:
@@ -80,20 +197,119 @@ namespace glf
 		MemoryPool<VertexBuffer2F>		vbo2F;
 		MemoryPool<VertexBuffer3F>		vbo3F;
 		MemoryPool<VertexBuffer4F>		vbo4F;
+		MemoryPool<MeshVertexBuffer>	vboMesh;
 		MemoryPool<IndexBuffer>			ibo;
+		MemoryPool<IndexBuffer16>		ibo16;
+		MemoryPool<IndirectElementBuffer> indirect;
 		MemoryPool<VertexArray>			vao;
+		MemoryPool<PagedTerrain>		pagedTerrain;
+		GeometryArena*					arena;
+	};
+	//--------------------------------------------------------------------------
+	// Vertices and indices uploaded for the regular meshes
+	struct GeometryMemory
+	{
+										GeometryMemory();
+		int								nVertices;
+		int								nIndices;
+		std::size_t						vertexBytes;
+		std::size_t						indexBytes;
+	};
+	//--------------------------------------------------------------------------
+	// Consecutive indirect commands of meshes sharing their vertex array,
+	// index type, transformation and, for regular meshes, their material
+	struct MeshBatch
+	{
+		VertexArray*					primitive;
+		GLenum							indexType;
+		int								mesh;		// First mesh of the batch
+		int								firstCommand;
+		int								countCommands;
 	};
 	//--------------------------------------------------------------------------
+	// Indirect command drawing a whole regular or shadow mesh
+	template<typename T>
+	inline DrawElementsIndirectCommand IndirectCommand(const T& _mesh)
+	{
+		DrawElementsIndirectCommand command;
+		command.count              = _mesh.countIndices;
+		command.primCount          = 1;
+		command.firstIndex         = _mesh.startIndices;
+		command.baseVertex         = _mesh.baseVertex;
+		command.baseInstance       = 0;
+		return command;
+	}
+	//--------------------------------------------------------------------------
+	// Render queue draw of a whole regular or shadow mesh, without textures
+	template<typename T>
+	inline RenderQueue::Draw QueueDraw(const T& _mesh, GLuint _program, int _user, int _primCount=1)
+	{
+		RenderQueue::Draw draw;
+		draw.program              = _program;
+		draw.primitive            = _mesh.primitive;
+		draw.primitiveType        = _mesh.primitiveType;
+		draw.indexType            = _mesh.indexType;
+		draw.first                = _mesh.startIndices;
+		draw.count                = _mesh.countIndices;
+		draw.baseVertex           = _mesh.baseVertex;
+		draw.primCount            = _primCount;
+		draw.user                 = _user;
+		return draw;
+	}
+	//--------------------------------------------------------------------------
+	// Render queue multi draw of a batch of indirect commands
+	inline RenderQueue::Draw QueueDraw(const MeshBatch& _batch, const IndirectElementBuffer& _commands, GLuint _program)
+	{
+		RenderQueue::Draw draw;
+		draw.program              = _program;
+		draw.primitive            = _batch.primitive;
+		draw.primitiveType        = GL_TRIANGLES;
+		draw.indexType            = _batch.indexType;
+		draw.first                = _batch.firstCommand;
+		draw.count                = _batch.countCommands;
+		draw.commands             = &_commands;
+		draw.user                 = _batch.mesh;
+		return draw;
+	}
+	//--------------------------------------------------------------------------
+	template<typename T>
+	inline void IndirectCommands(	const std::vector<T>& _meshes,
+									const std::vector<int>& _commandMeshes,
+									std::vector<DrawElementsIndirectCommand>& _commands)
+	{
+		_commands.resize(_commandMeshes.size());
+		for(unsigned int i=0;i<_commandMeshes.size();++i)
+			_commands[i] = IndirectCommand(_meshes[_commandMeshes[i]]);
+	}
+	//--------------------------------------------------------------------------
 	class SceneManager
 	{
 	public:
+										SceneManager();
+		// Groups the regular and shadow meshes into batches and uploads
+		// their indirect commands. Has to be called once all the meshes
+		// have been added
+		void							BuildBatches(ResourceManager& _resourceManager);
+
 		std::vector<TerrainMesh> 		terrainMeshes;
+		std::vector<PagedTerrain*>		pagedTerrains;	// Updated by the application every frame
 		std::vector<RegularMesh> 		regularMeshes;
+		std::vector<MeshCluster>		regularClusters;// Sorted by mesh
 		std::vector<ShadowMesh> 		shadowMeshes;
+		std::vector<InstancedModel>		instancedModels;
 		std::vector<glm::mat4>			transformations;
+		std::vector<LocalLight>			lights;		// Spot and point lights
 		std::vector<BBox>				oBounds;	// Objects
 		std::vector<BBox>				tBounds;	// Terrains
 		BBox							wBound;		// Global
+		SceneBVH						bvh;		// Objects then terrains
+		GeometryMemory					geometryMemory;
+		std::vector<MeshBatch>			regularBatches;
+		std::vector<MeshBatch>			shadowBatches;
+		std::vector<int>				regularCommandMeshes;	// Mesh of each command
+		std::vector<int>				shadowCommandMeshes;
+		IndirectElementBuffer*			regularCommands;
+		IndirectElementBuffer*			shadowCommands;
 	};
 
 	//--------------------------------------------------------------------------
@@ -105,6 +321,23 @@ namespace glf
 										int _first,
 										int _count);
 
+	// Quantize/unquantize a vertex of a regular mesh. Tangent's w is the
+	// handedness of the tangent space
+	MeshVertex EncodeVertex(			const glm::vec3& _position,
+										const glm::vec3& _normal,
+										const glm::vec4& _tangent,
+										const glm::vec2& _texCoord);
+	void DecodeVertex(					const MeshVertex& _vertex,
+										glm::vec3& _position,
+										glm::vec3& _normal,
+										glm::vec4& _tangent,
+										glm::vec2& _texCoord);
+
+	// Returns true if all the triangles of the cluster are back facing from
+	// _eye. Conservative test of the normal cone against the bounding sphere
+	bool BackfacingCluster(				const MeshCluster& _cluster,
+										const glm::vec3& _eye);
+
 	// Compute the bounding box of a scene (only CPU)
 	// Need all objects' bbox have been set
 	BBox WorldBound(					const SceneManager& _scene);
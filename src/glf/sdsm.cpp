@@ -0,0 +1,201 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/sdsm.hpp>
+#include <glf/csm.hpp>
+#include <glf/geometry.hpp>
+#include <glf/window.hpp>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define SDSM_TILE				8		// Texels reduced by a fragment, per axis
+#define SDSM_LAYERS				(1+SDSM_MAX_CASCADES)	// See sdsm.fs
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	SampleDistribution::SampleDistribution(	int _w,
+											int _h):
+	valid(false),
+	minDepth(1.f),
+	maxDepth(0.f),
+	nCascades(0),
+	current(0),
+	firstProgram("SampleDistribution::First"),
+	reduceProgram("SampleDistribution::Reduce")
+	{
+		for(int c=0;c<SDSM_MAX_CASCADES;++c)
+		{
+			bounds[c]    = glm::vec4(1,1,0,0);
+			splitFars[c] = 0.f;
+		}
+
+		// Each level is SDSM_TILE times smaller than the previous one
+		GLenum drawBuffers[SDSM_LAYERS];
+		for(int l=0;l<SDSM_LAYERS;++l)
+			drawBuffers[l] = GL_COLOR_ATTACHMENT0 + l;
+		int w = _w;
+		int h = _h;
+		do
+		{
+			w = (w + SDSM_TILE - 1) / SDSM_TILE;
+			h = (h + SDSM_TILE - 1) / SDSM_TILE;
+			TextureArray2D* level = new TextureArray2D();
+			level->Allocate(GL_RGBA32F,w,h,SDSM_LAYERS);
+			level->SetFiltering(GL_NEAREST,GL_NEAREST);
+			level->SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
+			levels.push_back(level);
+
+			GLuint framebuffer;
+			glGenFramebuffers(1, &framebuffer);
+			glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+			for(int l=0;l<SDSM_LAYERS;++l)
+				glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+l, level->id, 0, l);
+			glDrawBuffers(SDSM_LAYERS,drawBuffers);
+			glBindFramebuffer(GL_FRAMEBUFFER,0);
+			glf::CheckFramebuffer(framebuffer);
+			framebuffers.push_back(framebuffer);
+		}
+		while(w>1 || h>1);
+
+		for(int r=0;r<SDSM_READBACK_FRAMES;++r)
+		{
+			readbacks[r].buffer.Allocate(SDSM_LAYERS,GL_STREAM_READ);
+			readbacks[r].fence     = 0;
+			readbacks[r].nCascades = 0;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+
+		CreateScreenTriangle(vbo);
+		vao.Add(vbo,semantic::Position,2,GL_FLOAT);
+		glf::CheckError("SampleDistribution::SampleDistribution");
+	}
+	//--------------------------------------------------------------------------
+	SampleDistribution::~SampleDistribution()
+	{
+		for(int r=0;r<SDSM_READBACK_FRAMES;++r)
+			if(readbacks[r].fence!=0)
+				glDeleteSync(readbacks[r].fence);
+		glDeleteFramebuffers(GLsizei(framebuffers.size()),&framebuffers[0]);
+		for(unsigned int l=0;l<levels.size();++l)
+			delete levels[l];
+	}
+	//--------------------------------------------------------------------------
+	void SampleDistribution::Reduce(		const Texture2D& _positionTex,
+											const glm::mat4& _view,
+											const CSMLight& _light)
+	{
+		assert(_light.nCascades<=SDSM_MAX_CASCADES);
+
+		// Compiled on first use : only needed with SDSM enabled
+		if(!firstProgram.compiled)
+		{
+			ProgramOptions firstOptions = ProgramOptions::CreateVSOptions();
+			firstOptions.AddDefine<int>("SDSM_FIRST",1);
+			firstOptions.AddDefine<int>("SDSM_TILE",SDSM_TILE);
+			firstProgram.Compile(	firstOptions.Append(LoadFile(directory::ShaderDirectory + "sdsm.vs")),
+									firstOptions.Append(LoadFile(directory::ShaderDirectory + "sdsm.fs")));
+			positionTexUnit	= firstProgram["PositionTex"].unit;
+			viewVar			= firstProgram["View"].location;
+			lightViewVar	= firstProgram["LightView"].location;
+			splitFarsVar	= firstProgram["SplitFars[0]"].location;
+			nCascadesVar	= firstProgram["nCascades"].location;
+			glProgramUniform1i(firstProgram.id, firstProgram["PositionTex"].location, positionTexUnit);
+
+			ProgramOptions reduceOptions = ProgramOptions::CreateVSOptions();
+			reduceOptions.AddDefine<int>("SDSM_REDUCE",1);
+			reduceOptions.AddDefine<int>("SDSM_TILE",SDSM_TILE);
+			reduceProgram.Compile(	reduceOptions.Append(LoadFile(directory::ShaderDirectory + "sdsm.vs")),
+									reduceOptions.Append(LoadFile(directory::ShaderDirectory + "sdsm.fs")));
+			reduceTexUnit	= reduceProgram["ReduceTex"].unit;
+			glProgramUniform1i(reduceProgram.id, reduceProgram["ReduceTex"].location, reduceTexUnit);
+		}
+
+		// A reduction still in flight after SDSM_READBACK_FRAMES frames is
+		// dropped
+		current = (current + 1) % SDSM_READBACK_FRAMES;
+		Readback& readback = readbacks[current];
+		if(readback.fence!=0)
+			glDeleteSync(readback.fence);
+		readback.lightView = _light.view;
+		readback.nCascades = _light.nCascades;
+		for(int c=0;c<_light.nCascades;++c)
+			readback.splitFars[c] = _light.farPlanes[c];
+
+		// First level from the positions, with the cascades of the frame
+		glUseProgram(firstProgram.id);
+		glProgramUniformMatrix4fv(firstProgram.id,	viewVar,		1,					GL_FALSE, &_view[0][0]);
+		glProgramUniformMatrix4fv(firstProgram.id,	lightViewVar,	1,					GL_FALSE, &_light.view[0][0]);
+		glProgramUniform1fv(firstProgram.id,		splitFarsVar,	_light.nCascades,	_light.farPlanes);
+		glProgramUniform1i(firstProgram.id,			nCascadesVar,	_light.nCascades);
+		_positionTex.Bind(positionTexUnit);
+		glBindFramebuffer(GL_FRAMEBUFFER,framebuffers[0]);
+		glViewport(0,0,levels[0]->size.x,levels[0]->size.y);
+		vao.Draw(GL_TRIANGLES,3,0);
+
+		// Other levels
+		glUseProgram(reduceProgram.id);
+		for(unsigned int l=1;l<levels.size();++l)
+		{
+			levels[l-1]->Bind(reduceTexUnit);
+			glBindFramebuffer(GL_FRAMEBUFFER,framebuffers[l]);
+			glViewport(0,0,levels[l]->size.x,levels[l]->size.y);
+			vao.Draw(GL_TRIANGLES,3,0);
+		}
+
+		// Read back of the last level, fetched by a later frame
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,readback.buffer.id);
+		for(int l=0;l<SDSM_LAYERS;++l)
+		{
+			glReadBuffer(GL_COLOR_ATTACHMENT0+l);
+			glReadPixels(0,0,1,1,GL_RGBA,GL_FLOAT,GLF_BUFFER_OFFSET(l*sizeof(glm::vec4)));
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+		readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER,0);
+		glViewport(0,0,ctx::window.Size.x,ctx::window.Size.y);
+		glf::CheckError("SampleDistribution::Reduce");
+	}
+	//--------------------------------------------------------------------------
+	bool SampleDistribution::Fetch()
+	{
+		// Newest first, the older reductions are dropped once a newer one
+		// is read
+		for(int i=0;i<SDSM_READBACK_FRAMES;++i)
+		{
+			Readback& readback = readbacks[(current - i + SDSM_READBACK_FRAMES) % SDSM_READBACK_FRAMES];
+			if(readback.fence==0)
+				continue;
+			GLenum status = glClientWaitSync(readback.fence,0,0);
+			if(status!=GL_ALREADY_SIGNALED && status!=GL_CONDITION_SATISFIED)
+				continue;
+
+			const glm::vec4* data = readback.buffer.Lock(GL_READ_ONLY);
+			minDepth	=  data[0].x;
+			maxDepth	= -data[0].y;
+			for(int c=0;c<SDSM_MAX_CASCADES;++c)
+				bounds[c] = glm::vec4(data[1+c].x,data[1+c].y,-data[1+c].z,-data[1+c].w);
+			readback.buffer.Unlock();
+			glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+
+			lightView	= readback.lightView;
+			nCascades	= readback.nCascades;
+			for(int c=0;c<nCascades;++c)
+				splitFars[c] = readback.splitFars[c];
+			valid		= true;
+
+			for(int j=i;j<SDSM_READBACK_FRAMES;++j)
+			{
+				Readback& older = readbacks[(current - j + SDSM_READBACK_FRAMES) % SDSM_READBACK_FRAMES];
+				if(older.fence!=0)
+					glDeleteSync(older.fence);
+				older.fence = 0;
+			}
+			glf::CheckError("SampleDistribution::Fetch");
+			return true;
+		}
+		return false;
+	}
+}
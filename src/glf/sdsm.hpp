@@ -0,0 +1,79 @@
+#ifndef GLF_SDSM_HPP
+#define GLF_SDSM_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/wrapper.hpp>
+#include <glf/texture.hpp>
+#include <glf/buffer.hpp>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define SDSM_MAX_CASCADES		4
+#define SDSM_READBACK_FRAMES	3		// Reductions in flight
+
+namespace glf
+{
+	class CSMLight;
+
+	//--------------------------------------------------------------------------
+	// Sample distribution of the view (SDSM) : view depth range of the
+	// G-buffer samples and light space x/y bounds of the samples of each
+	// cascade, reduced on the GPU. The result is read back without waiting
+	// (pixel buffers and fences), so it drives the cascades of the next
+	// frame (see CSMBuilder::Draw)
+	class SampleDistribution
+	{
+	public:
+					SampleDistribution(	int _w,
+										int _h);
+				   ~SampleDistribution(	);
+		// After the G-buffer, with the camera view and the cascades of the
+		// frame. Starts the read back
+		void		Reduce(				const Texture2D& _positionTex,
+										const glm::mat4& _view,
+										const CSMLight& _light);
+		// Reads the newest reduction the GPU is done with, if any. Returns
+		// true when the values changed
+		bool		Fetch(				);
+	private:
+					SampleDistribution(	const SampleDistribution&);
+		SampleDistribution& operator=(	const SampleDistribution&);
+	public:
+		bool							valid;		// A reduction has been read back
+		float							minDepth;	// View depths of the nearest and farthest
+		float							maxDepth;	// samples, minDepth > maxDepth without sample
+		glm::vec4						bounds[SDSM_MAX_CASCADES];	// Light space (min.xy, max.xy), min > max without sample
+		float							splitFars[SDSM_MAX_CASCADES];// Cascades of the reduction, the last one
+		int								nCascades;	// also holds the farther samples
+		glm::mat4						lightView;	// Of the bounds
+	private:
+		struct Readback
+		{
+			PixelPackBuffer<glm::vec4>::Buffer buffer;
+			GLsync						fence;		// 0 if read or dropped
+			glm::mat4					lightView;
+			float						splitFars[SDSM_MAX_CASCADES];
+			int							nCascades;
+		};
+		std::vector<TextureArray2D*>	levels;		// Down to 1x1
+		std::vector<GLuint>				framebuffers;
+		Readback						readbacks[SDSM_READBACK_FRAMES];
+		int								current;	// Readback of the last reduction
+		Program							firstProgram;
+		Program							reduceProgram;
+		GLint							positionTexUnit;
+		GLint							reduceTexUnit;
+		GLint							viewVar;
+		GLint							lightViewVar;
+		GLint							splitFarsVar;
+		GLint							nCascadesVar;
+		VertexBuffer2F					vbo;
+		VertexArray						vao;
+	};
+}
+
+#endif
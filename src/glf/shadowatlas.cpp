@@ -0,0 +1,585 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/shadowatlas.hpp>
+#include <glf/window.hpp>
+#include <glf/debug.hpp>
+#include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define SHADOW_ATLAS_NEAR			0.01f	// Near plane of the faces, relative to the light radius
+#define SHADOW_ATLAS_SLOPE_BIAS		2.f		// Polygon offset of the casters
+#define SHADOW_ATLAS_CONSTANT_BIAS	4.f
+
+namespace glf
+{
+	namespace
+	{
+		//----------------------------------------------------------------------
+		// Power of two tile covering _coverage of the screen height, divided
+		// by 2^_bias
+		int TileSize(						float _coverage,
+											int _pixels,
+											int _bias,
+											int _minTile,
+											int _maxTile)
+		{
+			int size = _minTile;
+			while(size<_maxTile && size<_coverage*_pixels)
+				size *= 2;
+			return std::max(size>>_bias,_minTile);
+		}
+		//----------------------------------------------------------------------
+		bool Moved(							const LocalLight& _a,
+											const LocalLight& _b)
+		{
+			return	_a.type!=_b.type || _a.position!=_b.position || _a.direction!=_b.direction ||
+					_a.radius!=_b.radius || _a.outerAngle!=_b.outerAngle;
+		}
+		//----------------------------------------------------------------------
+		// Visible lights, the most covering first
+		struct MoreCovering
+		{
+			const std::vector<ShadowAtlas::Light>* lights;
+			bool operator()(int _a, int _b) const
+			{
+				return (*lights)[_a].coverage > (*lights)[_b].coverage;
+			}
+		};
+		//----------------------------------------------------------------------
+		// Lights to render, the ones without map first
+		struct MoreUrgent
+		{
+			const std::vector<ShadowAtlas::Light>* lights;
+			float Priority(int _light) const
+			{
+				const ShadowAtlas::Light& light = (*lights)[_light];
+				return (light.valid ? 0.f : 2.f) + light.coverage;
+			}
+			bool operator()(int _a, int _b) const
+			{
+				return Priority(_a) > Priority(_b);
+			}
+		};
+		//----------------------------------------------------------------------
+		// Scissor rectangle of the screen projection of a sphere, false if it
+		// is empty. The whole screen when the sphere crosses the eye plane
+		bool ScreenRect(					const glm::mat4& _viewProj,
+											const glm::vec3& _center,
+											float _radius,
+											const glm::ivec2& _size,
+											glm::ivec4& _rect)
+		{
+			glm::vec2 pMin( 1.f, 1.f);
+			glm::vec2 pMax(-1.f,-1.f);
+			for(int c=0;c<8;++c)
+			{
+				glm::vec3 corner = _center + _radius*glm::vec3((c&1)?1.f:-1.f,(c&2)?1.f:-1.f,(c&4)?1.f:-1.f);
+				glm::vec4 p = _viewProj * glm::vec4(corner,1.f);
+				if(p.w<=0.f)
+				{
+					_rect = glm::ivec4(0,0,_size.x,_size.y);
+					return true;
+				}
+				glm::vec2 ndc(p.x/p.w,p.y/p.w);
+				pMin = glm::min(pMin,ndc);
+				pMax = glm::max(pMax,ndc);
+			}
+			pMin = glm::max(pMin,glm::vec2(-1.f));
+			pMax = glm::min(pMax,glm::vec2( 1.f));
+			if(pMin.x>=pMax.x || pMin.y>=pMax.y)
+				return false;
+
+			int x0 = int(floorf((pMin.x*0.5f+0.5f)*_size.x));
+			int y0 = int(floorf((pMin.y*0.5f+0.5f)*_size.y));
+			int x1 = int(ceilf( (pMax.x*0.5f+0.5f)*_size.x));
+			int y1 = int(ceilf( (pMax.y*0.5f+0.5f)*_size.y));
+			_rect = glm::ivec4(x0,y0,x1-x0,y1-y0);
+			return true;
+		}
+	}
+	//--------------------------------------------------------------------------
+	AtlasAllocator::AtlasAllocator(		int _size,
+										int _minSize):
+	size(_size),
+	minSize(_minSize),
+	usedTexels(0)
+	{
+		assert(_minSize>0 && _minSize<=_size);
+		freeTiles.resize(Level(_minSize)+1);
+		freeTiles[0].push_back(glm::ivec2(0,0));
+	}
+	//--------------------------------------------------------------------------
+	int AtlasAllocator::Level(			int _size) const
+	{
+		int level = 0;
+		while((size>>level)>_size)
+			++level;
+		return level;
+	}
+	//--------------------------------------------------------------------------
+	bool AtlasAllocator::Allocate(		int _size,
+										Tile& _tile)
+	{
+		assert(_size>=minSize && _size<=size);
+		assert(_tile.size==0);
+
+		// Smallest free tile which is large enough
+		int level = Level(_size);
+		int l = level;
+		while(l>=0 && freeTiles[l].empty())
+			--l;
+		if(l<0)
+			return false;
+		glm::ivec2 origin = freeTiles[l].back();
+		freeTiles[l].pop_back();
+
+		// Split down to the size, the three other quadrants are free
+		for(;l<level;++l)
+		{
+			int half = (size>>l)/2;
+			freeTiles[l+1].push_back(origin + glm::ivec2(half,0));
+			freeTiles[l+1].push_back(origin + glm::ivec2(0,half));
+			freeTiles[l+1].push_back(origin + glm::ivec2(half,half));
+		}
+
+		_tile.x		= origin.x;
+		_tile.y		= origin.y;
+		_tile.size	= _size;
+		usedTexels += _size*_size;
+		return true;
+	}
+	//--------------------------------------------------------------------------
+	void AtlasAllocator::Release(		Tile& _tile)
+	{
+		if(_tile.size==0)
+			return;
+		usedTexels -= _tile.size*_tile.size;
+
+		// Merged with its siblings while they are all free
+		int level = Level(_tile.size);
+		glm::ivec2 origin(_tile.x,_tile.y);
+		for(;level>0;--level)
+		{
+			int parentSize = 2*(size>>level);
+			glm::ivec2 parent(origin.x - origin.x%parentSize, origin.y - origin.y%parentSize);
+			std::vector<glm::ivec2>& tiles = freeTiles[level];
+			int siblings[3];
+			int nSiblings = 0;
+			for(int i=0;i<int(tiles.size()) && nSiblings<3;++i)
+			{
+				const glm::ivec2& t = tiles[i];
+				if(t!=origin && t.x>=parent.x && t.x<parent.x+parentSize && t.y>=parent.y && t.y<parent.y+parentSize)
+					siblings[nSiblings++] = i;
+			}
+			if(nSiblings<3)
+				break;
+
+			// Swapped with the last ones, highest indices first
+			for(int s=2;s>=0;--s)
+			{
+				tiles[siblings[s]] = tiles.back();
+				tiles.pop_back();
+			}
+			origin = parent;
+		}
+		freeTiles[level].push_back(origin);
+		_tile = Tile();
+	}
+	//--------------------------------------------------------------------------
+	int AtlasAllocator::UsedTexels() const
+	{
+		return usedTexels;
+	}
+	//--------------------------------------------------------------------------
+	ShadowAtlas::Light::Light():
+	nFaces(0),
+	texelAngle(0),
+	valid(false),
+	visible(false),
+	coverage(0),
+	lastVisible(-1),
+	lastUpdate(-1)
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	ShadowAtlas::ShadowAtlas(			int _size,
+										int _minTile,
+										int _maxTile):
+	allocator(_size,std::min(_minTile,_size)),
+	minTile(std::min(_minTile,_size)),
+	maxTile(std::max(std::min(_maxTile,_size),std::min(_minTile,_size))),
+	frame(0),
+	nRenderedFaces(0),
+	nShadowedLights(0),
+	program("ShadowAtlas")
+	{
+		glf::Info("ShadowAtlas::ShadowAtlas");
+
+		depthTex.Allocate(GL_DEPTH_COMPONENT32F,_size,_size);
+		depthTex.SetFiltering(GL_LINEAR,GL_LINEAR);
+		depthTex.SetWrapping(GL_CLAMP_TO_EDGE,GL_CLAMP_TO_EDGE);
+		depthTex.SetCompare(GL_COMPARE_REF_TO_TEXTURE,GL_LEQUAL);
+
+		glGenFramebuffers(1, &framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+		glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTex.id, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER,0);
+		glf::CheckFramebuffer(framebuffer);
+
+		glf::CheckError("ShadowAtlas::ShadowAtlas");
+	}
+	//--------------------------------------------------------------------------
+	ShadowAtlas::~ShadowAtlas()
+	{
+		glDeleteFramebuffers(1,&framebuffer);
+	}
+	//--------------------------------------------------------------------------
+	void ShadowAtlas::Invalidate()
+	{
+		for(unsigned int i=0;i<lights.size();++i)
+			lights[i].valid = false;
+	}
+	//--------------------------------------------------------------------------
+	size_t ShadowAtlas::MemoryBytes() const
+	{
+		return size_t(depthTex.size.x) * depthTex.size.y * sizeof(float);
+	}
+	//--------------------------------------------------------------------------
+	void ShadowAtlas::ReleaseTiles(		int _light)
+	{
+		Light& light = lights[_light];
+		for(int f=0;f<SHADOW_ATLAS_MAX_FACES;++f)
+			allocator.Release(light.tiles[f]);
+		light.valid = false;
+	}
+	//--------------------------------------------------------------------------
+	bool ShadowAtlas::AllocateTiles(	int _light,
+										int _size)
+	{
+		Light& light = lights[_light];
+		for(int f=0;f<light.nFaces;++f)
+		{
+			// Evicts the lights out of the view, least recently seen first
+			while(!allocator.Allocate(_size,light.tiles[f]))
+			{
+				int victim = -1;
+				for(unsigned int i=0;i<lights.size();++i)
+				{
+					const Light& other = lights[i];
+					if(other.visible || other.tiles[0].size==0)
+						continue;
+					if(victim<0 || other.lastVisible<lights[victim].lastVisible)
+						victim = int(i);
+				}
+				if(victim<0)
+				{
+					ReleaseTiles(_light);
+					return false;
+				}
+				ReleaseTiles(victim);
+			}
+		}
+		light.valid = false;
+		return true;
+	}
+	//--------------------------------------------------------------------------
+	void ShadowAtlas::RenderFaces(		int _light,
+										const LocalLight& _source,
+										const SceneManager& _scene)
+	{
+		Light& light = lights[_light];
+		float fov = _source.type==LocalLight::POINT ? 90.f : 2.f*_source.outerAngle;
+		glm::mat4 proj = glm::perspective(fov,1.f,SHADOW_ATLAS_NEAR*_source.radius,_source.radius);
+		float atlasSize = float(depthTex.size.x);
+		int nObjects = int(_scene.oBounds.size());
+
+		for(int f=0;f<light.nFaces;++f)
+		{
+			// Faces of a point light are +x,-x,+y,-y,+z,-z (see locallight.fs)
+			glm::vec3 dir, up;
+			if(_source.type==LocalLight::POINT)
+			{
+				int axis = f/2;
+				dir		 = glm::vec3(0);
+				dir[axis]= (f&1)!=0 ? -1.f : 1.f;
+				up		 = axis==2 ? glm::vec3(0,1,0) : glm::vec3(0,0,1);
+			}
+			else
+			{
+				dir		 = _source.direction;
+				up		 = fabsf(dir.z)<0.99f ? glm::vec3(0,0,1) : glm::vec3(0,1,0);
+			}
+			light.viewProjs[f] = proj * glm::lookAt(_source.position,_source.position+dir,up);
+
+			const AtlasAllocator::Tile& tile = light.tiles[f];
+			light.rects[f] = glm::vec4(float(tile.x),float(tile.y),float(tile.size),float(tile.size)) / atlasSize;
+			glViewport(tile.x,tile.y,tile.size,tile.size);
+			glScissor(tile.x,tile.y,tile.size,tile.size);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glProgramUniformMatrix4fv(program.id, viewProjVar, 1, GL_FALSE, &light.viewProjs[f][0][0]);
+
+			// Regular meshes (items of the hierarchy after them are terrains)
+			Frustum frustum = ExtractFrustum(light.viewProjs[f]);
+			items.clear();
+			_scene.bvh.Cull(frustum,items);
+			for(unsigned int i=0;i<items.size();++i)
+			{
+				int o = items[i];
+				if(o>=nObjects)
+					continue;
+				glProgramUniformMatrix4fv(program.id, modelVar, 1, GL_FALSE, &_scene.transformations[o][0][0]);
+				_scene.shadowMeshes[o].Draw();
+			}
+
+			// Instanced models, one draw per visible instance
+			for(unsigned int m=0;m<_scene.instancedModels.size();++m)
+			{
+				const InstancedModel& model = _scene.instancedModels[m];
+				for(unsigned int k=0;k<model.transforms.size();++k)
+				{
+					if(!Intersect(frustum,model.bounds[k]))
+						continue;
+					glProgramUniformMatrix4fv(program.id, modelVar, 1, GL_FALSE, &model.transforms[k][0][0]);
+					for(unsigned int s=0;s<model.shadowMeshes.size();++s)
+						model.shadowMeshes[s].Draw();
+				}
+			}
+		}
+
+		light.texelAngle	= 2.f*tanf(0.5f*fov*float(M_PI)/180.f) / light.tiles[0].size;
+		light.rendered		= _source;
+		light.valid			= true;
+		light.lastUpdate	= frame;
+	}
+	//--------------------------------------------------------------------------
+	void ShadowAtlas::Update(			const SceneManager&	_scene,
+										const Camera&		_camera,
+										int					_budget)
+	{
+		++frame;
+		nRenderedFaces	= 0;
+		nShadowedLights	= 0;
+		if(lights.size()!=_scene.lights.size())
+		{
+			for(unsigned int i=0;i<lights.size();++i)
+				ReleaseTiles(i);
+			lights.assign(_scene.lights.size(),Light());
+		}
+		if(lights.empty())
+			return;
+
+		// Fraction of the screen height covered by the bounding sphere of
+		// the visible lights
+		glm::mat4 viewProj	= _camera.Projection() * _camera.View();
+		Frustum frustum		= ExtractFrustum(viewProj);
+		glm::vec3 eye		= _camera.Eye();
+		float focal			= _camera.Projection()[1][1];
+		int pixels			= _camera.Resolution().y;
+		order.clear();
+		for(unsigned int i=0;i<lights.size();++i)
+		{
+			const LocalLight& source = _scene.lights[i];
+			Light& light	= lights[i];
+			light.nFaces	= !source.castShadows ? 0 : (source.type==LocalLight::POINT ? 6 : 1);
+			if(light.nFaces==0 && light.tiles[0].size>0)
+				ReleaseTiles(i);
+			light.visible	= light.nFaces>0 && Intersect(frustum,source.position,source.radius);
+			light.coverage	= 0.f;
+			if(!light.visible)
+				continue;
+
+			float d			= glm::length(source.position-eye);
+			float r			= source.radius;
+			light.coverage	= d<=r ? 1.f : std::min(1.f, r*focal/sqrtf(d*d-r*r));
+			light.lastVisible= frame;
+			order.push_back(i);
+		}
+
+		// All the sizes are halved while the visible lights do not fit
+		int bias = 0;
+		long long atlasTexels = (long long)(depthTex.size.x) * depthTex.size.y;
+		for(;(maxTile>>bias)>minTile;++bias)
+		{
+			long long texels = 0;
+			for(unsigned int o=0;o<order.size();++o)
+			{
+				const Light& light = lights[order[o]];
+				int size = TileSize(light.coverage,pixels,bias,minTile,maxTile);
+				texels += (long long)(light.nFaces) * size * size;
+			}
+			if(texels<=atlasTexels)
+				break;
+		}
+
+		// Tiles of the visible lights, the most covering first. A tile is
+		// reallocated when it is too small or more than twice too large,
+		// smaller if the atlas is full
+		MoreCovering moreCovering;
+		moreCovering.lights = &lights;
+		std::sort(order.begin(),order.end(),moreCovering);
+		for(unsigned int o=0;o<order.size();++o)
+		{
+			Light& light = lights[order[o]];
+			int size	= TileSize(light.coverage,pixels,bias,minTile,maxTile);
+			int current	= light.tiles[0].size;
+			if(current>=size && current<4*size)
+				continue;
+			ReleaseTiles(order[o]);
+			for(;size>=minTile && !AllocateTiles(order[o],size);size/=2);
+		}
+
+		// Maps rendered within the budget, at least one light per update.
+		// Lights without map are lit without shadow until they are rendered
+		order.clear();
+		for(unsigned int i=0;i<lights.size();++i)
+		{
+			const Light& light = lights[i];
+			if(light.visible && light.tiles[0].size>0 && (!light.valid || Moved(light.rendered,_scene.lights[i])))
+				order.push_back(i);
+		}
+		MoreUrgent moreUrgent;
+		moreUrgent.lights = &lights;
+		std::sort(order.begin(),order.end(),moreUrgent);
+
+		if(!order.empty())
+		{
+			// Compiled on first use : only needed by scenes with local lights
+			if(!program.compiled)
+			{
+				ProgramOptions options = ProgramOptions::CreateVSOptions();
+				options.AddDefine<int>("SHADOW_ATLAS", 1);
+				program.Compile(options.Append(LoadFile(directory::ShaderDirectory + "meshregular.vs")),
+								options.Append(LoadFile(directory::ShaderDirectory + "meshregular.fs")));
+				viewProjVar	= program["LightViewProj"].location;
+				modelVar	= program["Model"].location;
+			}
+
+			glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+			glUseProgram(program.id);
+			glEnable(GL_SCISSOR_TEST);
+			glEnable(GL_POLYGON_OFFSET_FILL);
+			glPolygonOffset(SHADOW_ATLAS_SLOPE_BIAS,SHADOW_ATLAS_CONSTANT_BIAS);
+			for(unsigned int o=0;o<order.size();++o)
+			{
+				const Light& light = lights[order[o]];
+				if(nRenderedFaces>0 && nRenderedFaces+light.nFaces>_budget)
+					break;
+				RenderFaces(order[o],_scene.lights[order[o]],_scene);
+				nRenderedFaces += light.nFaces;
+			}
+			glDisable(GL_POLYGON_OFFSET_FILL);
+			glDisable(GL_SCISSOR_TEST);
+			glBindFramebuffer(GL_FRAMEBUFFER,0);
+			glViewport(0,0,ctx::window.Size.x,ctx::window.Size.y);
+		}
+
+		for(unsigned int i=0;i<lights.size();++i)
+			nShadowedLights += lights[i].visible && lights[i].valid ? 1 : 0;
+		glf::manager::timings->SetCounter(counter::ShadowAtlasFaces,nRenderedFaces);
+		glf::manager::timings->SetCounter(counter::ShadowAtlasLights,nShadowedLights);
+		glf::CheckError("ShadowAtlas::Update");
+	}
+	//--------------------------------------------------------------------------
+	LocalLightRenderer::LocalLightRenderer():
+	program("LocalLightRenderer")
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	int LocalLightRenderer::Draw(		const SceneManager&	_scene,
+										const ShadowAtlas*	_atlas,
+										const GBuffer&		_gbuffer,
+										const glm::mat4&	_viewProj,
+										float				_bias,
+										RenderTarget&		_target)
+	{
+		if(_scene.lights.empty())
+			return 0;
+
+		// Compiled on first use : only needed by scenes with local lights
+		if(!program.compiled)
+		{
+			ProgramOptions options = ProgramOptions::CreateVSOptions();
+			options.AddDefine<int>("LOCAL_LIGHT",1);
+			options.Include(LoadFile(directory::ShaderDirectory + "brdf.fs"));
+			options.Include(LoadFile(directory::ShaderDirectory + "frame.glsl"));
+			program.Compile(options.Append(LoadFile(directory::ShaderDirectory + "locallight.vs")),
+							options.Append(LoadFile(directory::ShaderDirectory + "locallight.fs")));
+
+			typeVar				= program["LocalType"].location;
+			positionVar			= program["LocalPosition"].location;
+			directionVar		= program["LocalDirection"].location;
+			intensityVar		= program["LocalIntensity"].location;
+			radiusVar			= program["LocalRadius"].location;
+			spotCosinesVar		= program["SpotCosines"].location;
+			nFacesVar			= program["nFaces"].location;
+			faceViewProjsVar	= program["FaceViewProjs[0]"].location;
+			faceRectsVar		= program["FaceRects[0]"].location;
+			normalOffsetVar		= program["NormalOffset"].location;
+
+			positionTexUnit		= program["PositionTex"].unit;
+			diffuseTexUnit		= program["DiffuseTex"].unit;
+			normalTexUnit		= program["NormalTex"].unit;
+			shadowTexUnit		= program["ShadowTex"].unit;
+
+			glProgramUniform1i(program.id, program["PositionTex"].location,	positionTexUnit);
+			glProgramUniform1i(program.id, program["DiffuseTex"].location,	diffuseTexUnit);
+			glProgramUniform1i(program.id, program["NormalTex"].location,	normalTexUnit);
+			glProgramUniform1i(program.id, program["ShadowTex"].location,	shadowTexUnit);
+		}
+
+		glUseProgram(program.id);
+		_gbuffer.positionTex.Bind(positionTexUnit);
+		_gbuffer.diffuseTex.Bind(diffuseTexUnit);
+		_gbuffer.normalTex.Bind(normalTexUnit);
+		if(_atlas!=NULL)
+			_atlas->depthTex.Bind(shadowTexUnit);
+
+		Frustum frustum = ExtractFrustum(_viewProj);
+		glm::ivec2 size(_gbuffer.positionTex.size.x,_gbuffer.positionTex.size.y);
+		glEnable(GL_SCISSOR_TEST);
+		int nDrawn = 0;
+		for(unsigned int i=0;i<_scene.lights.size();++i)
+		{
+			const LocalLight& light = _scene.lights[i];
+			glm::ivec4 rect;
+			if(!Intersect(frustum,light.position,light.radius) || !ScreenRect(_viewProj,light.position,light.radius,size,rect))
+				continue;
+			glScissor(rect.x,rect.y,rect.z,rect.w);
+
+			float toRadians = float(M_PI)/180.f;
+			glProgramUniform1i(program.id,	typeVar,		light.type);
+			glProgramUniform3f(program.id,	positionVar,	light.position.x,light.position.y,light.position.z);
+			glProgramUniform3f(program.id,	directionVar,	light.direction.x,light.direction.y,light.direction.z);
+			glProgramUniform3f(program.id,	intensityVar,	light.intensity.x,light.intensity.y,light.intensity.z);
+			glProgramUniform1f(program.id,	radiusVar,		light.radius);
+			glProgramUniform2f(program.id,	spotCosinesVar,	cosf(light.innerAngle*toRadians),cosf(light.outerAngle*toRadians));
+
+			int nFaces = 0;
+			if(_atlas!=NULL && i<_atlas->lights.size() && _atlas->lights[i].valid)
+			{
+				const ShadowAtlas::Light& shadow = _atlas->lights[i];
+				nFaces = shadow.nFaces;
+				glProgramUniformMatrix4fv(program.id,	faceViewProjsVar,	nFaces,	GL_FALSE,	&shadow.viewProjs[0][0][0]);
+				glProgramUniform4fv(program.id,			faceRectsVar,		nFaces,				&shadow.rects[0][0]);
+				glProgramUniform1f(program.id,			normalOffsetVar,	_bias*shadow.texelAngle);
+			}
+			glProgramUniform1i(program.id,	nFacesVar,		nFaces);
+			_target.Draw();
+			++nDrawn;
+		}
+		glDisable(GL_SCISSOR_TEST);
+
+		glf::manager::timings->SetCounter(counter::LocalLights,nDrawn);
+		glf::CheckError("LocalLightRenderer::Draw");
+		return nDrawn;
+	}
+}
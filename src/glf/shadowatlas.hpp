@@ -0,0 +1,156 @@
+#ifndef GLF_SHADOWATLAS_HPP
+#define GLF_SHADOWATLAS_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/camera.hpp>
+#include <glf/texture.hpp>
+#include <glf/scene.hpp>
+#include <glf/pass.hpp>
+#include <glf/gbuffer.hpp>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define SHADOW_ATLAS_MAX_FACES		6		// Of a point light
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	// Square power of two tiles of a square texture, split and merged like a
+	// quadtree (buddy allocation) : a released tile is merged back with its
+	// three siblings when they are free, so the free space does not end up
+	// in slivers. Tiles never move
+	class AtlasAllocator
+	{
+	public:
+		struct Tile
+		{
+									Tile():x(0),y(0),size(0){}
+			int						x;
+			int						y;
+			int						size;		// 0 if not allocated
+		};
+									AtlasAllocator(	int _size,
+													int _minSize);
+		// _size is a power of two between the min size and the atlas size
+		bool						Allocate(		int _size,
+													Tile& _tile);
+		void						Release(		Tile& _tile);
+		int							UsedTexels() const;
+	private:
+		int							Level(			int _size) const;
+		int							size;
+		int							minSize;
+		int							usedTexels;
+		std::vector< std::vector<glm::ivec2> > freeTiles;	// Per level, 0 is the whole texture
+	};
+	//--------------------------------------------------------------------------
+	// Shadow maps of the local lights of a scene, packed into one depth
+	// texture. Each light gets one tile per face (6 for a point light, 1 for
+	// a spot light) whose size follows the screen coverage of the light :
+	// tiles are reallocated when the coverage changes by more than a power of
+	// two, and all the sizes are halved while the visible lights do not fit.
+	// Lights out of the view keep their tiles until the space is needed,
+	// least recently seen first. At most _budget faces are rendered per
+	// frame : lights without map first, then the ones which moved, the
+	// lights covering more of the screen first. Casters are the regular
+	// meshes and the instanced models (terrains are not)
+	class ShadowAtlas
+	{
+	public:
+					ShadowAtlas(	int _size,
+									int _minTile,
+									int _maxTile);
+				   ~ShadowAtlas(	);
+		void		Update(			const SceneManager&	_scene,
+									const Camera&		_camera,
+									int					_budget);
+		// Drops all the maps, rendered again by the next updates. Needed
+		// when the shadow casters change
+		void		Invalidate(		);
+		size_t		MemoryBytes(	) const;
+	private:
+					ShadowAtlas(	const ShadowAtlas&);
+		ShadowAtlas& operator=(		const ShadowAtlas&);
+		bool		AllocateTiles(	int _light,
+									int _size);
+		void		ReleaseTiles(	int _light);
+		void		RenderFaces(	int _light,
+									const LocalLight& _source,
+									const SceneManager& _scene);
+	public:
+		// Shadow state of a scene light, same order as SceneManager::lights
+		struct Light
+		{
+									Light();
+			int						nFaces;		// 6 (point), 1 (spot), 0 without shadow
+			AtlasAllocator::Tile	tiles[SHADOW_ATLAS_MAX_FACES];
+			glm::mat4				viewProjs[SHADOW_ATLAS_MAX_FACES];	// Of the rendered maps
+			glm::vec4				rects[SHADOW_ATLAS_MAX_FACES];		// Atlas coordinates (offset, scale)
+			float					texelAngle;	// Tile texel size per unit of distance
+			bool					valid;		// The tiles hold a map
+			bool					visible;	// Of the current frame
+			float					coverage;	// Fraction of the screen height
+			int						lastVisible;// Frames
+			int						lastUpdate;
+			LocalLight				rendered;	// State of the rendered maps
+		};
+		std::vector<Light>			lights;
+		Texture2D					depthTex;
+		AtlasAllocator				allocator;
+		int							minTile;
+		int							maxTile;
+		int							frame;
+		int							nRenderedFaces;	// By the last update
+		int							nShadowedLights;// Visible with a valid map
+
+	private:
+		GLuint						framebuffer;
+		Program						program;
+		GLint						viewProjVar;
+		GLint						modelVar;
+		std::vector<int>			order;
+		std::vector<int>			items;
+	};
+	//--------------------------------------------------------------------------
+	// Additive lighting of the local lights, one scissored pass per visible
+	// light over the G-buffer. The view position comes from the frame block
+	// (see FrameConstants). Without _atlas the lights are not shadowed
+	class LocalLightRenderer
+	{
+	public:
+					LocalLightRenderer(	);
+		// Returns the number of lights drawn
+		int			Draw(			const SceneManager&	_scene,
+									const ShadowAtlas*	_atlas,
+									const GBuffer&		_gbuffer,
+									const glm::mat4&	_viewProj,
+									float				_bias,
+									RenderTarget&		_target);
+	private:
+					LocalLightRenderer(	const LocalLightRenderer&);
+		LocalLightRenderer& operator=(	const LocalLightRenderer&);
+	public:
+		Program						program;
+		GLint						positionTexUnit;
+		GLint						diffuseTexUnit;
+		GLint						normalTexUnit;
+		GLint						shadowTexUnit;
+
+		GLint						typeVar;
+		GLint						positionVar;
+		GLint						directionVar;
+		GLint						intensityVar;
+		GLint						radiusVar;
+		GLint						spotCosinesVar;
+		GLint						nFacesVar;
+		GLint						faceViewProjsVar;
+		GLint						faceRectsVar;
+		GLint						normalOffsetVar;
+	};
+}
+
+#endif
@@ -77,6 +77,7 @@ namespace glf
 		ssaoPass.radiusVar			= ssaoPass.program["Radius"].location;
 		ssaoPass.nSamplesVar		= ssaoPass.program["nSamples"].location;
 		ssaoPass.viewMatVar			= ssaoPass.program["View"].location;
+		ssaoPass.bakedTerrainVar	= ssaoPass.program["BakedTerrain"].location;
 		ssaoPass.nearVar			= ssaoPass.program["Near"].location;
 
 		ssaoPass.positionTexUnit	= ssaoPass.program["PositionTex"].unit;
@@ -118,7 +119,8 @@ namespace glf
 						float 			_sigma,
 						float 			_radius,
 						int 			_nSamples,
-						const RenderTarget& _renderTarget)
+						const RenderTarget& _renderTarget,
+						bool			_bakedTerrain)
 	{
 		glUseProgram(ssaoPass.program.id);
 		glProgramUniform1f(ssaoPass.program.id,			ssaoPass.nearVar,		_near);
@@ -128,6 +130,7 @@ namespace glf
 		glProgramUniform1f(ssaoPass.program.id,			ssaoPass.sigmaVar,		_sigma);
 		glProgramUniform1f(ssaoPass.program.id,			ssaoPass.radiusVar,		_radius);
 		glProgramUniform1i(ssaoPass.program.id,			ssaoPass.nSamplesVar,	_nSamples);
+		glProgramUniform1i(ssaoPass.program.id,			ssaoPass.bakedTerrainVar,_bakedTerrain?1:0);
 		glProgramUniformMatrix4fv(ssaoPass.program.id, 	ssaoPass.viewMatVar,	1, GL_FALSE, &_view[0][0]);
 
 		_gbuffer.positionTex.Bind(ssaoPass.positionTexUnit);
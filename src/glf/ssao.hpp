@@ -28,7 +28,8 @@ namespace glf
 									float			_sigma,
 									float			_radius,
 									int 			_nSamples,
-									const RenderTarget& _renderTarget);
+									const RenderTarget& _renderTarget,
+									bool			_bakedTerrain=false);
 
 		void 		Draw(			const Texture2D& _inputTex,
 									const Texture2D& _positionTex,
@@ -54,6 +55,7 @@ namespace glf
 			GLint					radiusVar;
 			GLint					nSamplesVar;
 			GLint					viewMatVar;
+			GLint					bakedTerrainVar;
 
 			Program 				program;
 		};
@@ -3,9 +3,100 @@
 //------------------------------------------------------------------------------
 #include <glf/terrain.hpp>
 #include <glf/geometry.hpp>
+#include <glf/debug.hpp>
+#include <glf/rng.hpp>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=1)
+	#define GLF_TERRAIN_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define GLF_TERRAIN_SSE 0
+#endif
+
+#ifdef _OPENMP
+	#include <omp.h>
+#endif
+
+//------------------------------------------------------------------------------
+// Constants
+//------------------------------------------------------------------------------
+#define TERRAIN_HORIZON_STEPS			12		// Marched texels per direction
 
 namespace glf
 {
+	namespace
+	{
+		//----------------------------------------------------------------------
+		// Distances of the marched texels, growing by about sqrt(2) up to
+		// TERRAIN_HORIZON_TEXELS
+		const int HorizonSteps[TERRAIN_HORIZON_STEPS] = {1,2,3,4,6,8,11,16,23,32,45,TERRAIN_HORIZON_TEXELS};
+		//----------------------------------------------------------------------
+		inline int Wrap(int _i, int _n)
+		{
+			return ((_i % _n) + _n) % _n;
+		}
+		//----------------------------------------------------------------------
+		inline int Clamp(int _i, int _n)
+		{
+			return std::min(std::max(_i,0),_n-1);
+		}
+		//----------------------------------------------------------------------
+		inline float SRGBToLinear(float _c)
+		{
+			return _c<=0.04045f ? _c/12.92f : powf((_c+0.055f)/1.055f,2.4f);
+		}
+		//----------------------------------------------------------------------
+		// Texels of the first level of a height texture, in [0,1]
+		void ReadHeights(	const Texture2D& _texture,
+							std::vector<float>& _heights)
+		{
+			_heights.resize(_texture.size.x*_texture.size.y);
+			glBindTexture(_texture.target,_texture.id);
+			glPixelStorei(GL_PACK_ALIGNMENT,1);
+			glGetTexImage(_texture.target,0,GL_RED,GL_FLOAT,&_heights[0]);
+			glPixelStorei(GL_PACK_ALIGNMENT,4);
+			glBindTexture(_texture.target,0);
+
+			// Texels are read back as stored, the lookups decode sRGB
+			if(_texture.format==GL_SRGB8 || _texture.format==GL_SRGB8_ALPHA8)
+				for(unsigned int i=0;i<_heights.size();++i)
+					_heights[i] = SRGBToLinear(_heights[i]);
+		}
+		//----------------------------------------------------------------------
+		// Sine of the elevation of a horizon tangent, quantized to 8 bits.
+		// Same operations as the SSE loop of BakeHorizons
+		inline unsigned char HorizonByte(float _tangent)
+		{
+			float sine = _tangent / sqrtf(1.f + _tangent*_tangent);
+			return (unsigned char)(sine*255.f + 0.5f);
+		}
+		//----------------------------------------------------------------------
+		// 0 : outside, 1 : intersecting, 2 : inside the frustum
+		int Classify(	const Frustum& _frustum,
+						const BBox& _bound)
+		{
+			int result = 2;
+			for(int i=0;i<6;++i)
+			{
+				const glm::vec4& plane = _frustum.planes[i];
+				glm::vec3 pVertex(	plane.x>0 ? _bound.pMax.x : _bound.pMin.x,
+									plane.y>0 ? _bound.pMax.y : _bound.pMin.y,
+									plane.z>0 ? _bound.pMax.z : _bound.pMin.z);
+				glm::vec3 nVertex(	plane.x>0 ? _bound.pMin.x : _bound.pMax.x,
+									plane.y>0 ? _bound.pMin.y : _bound.pMax.y,
+									plane.z>0 ? _bound.pMin.z : _bound.pMax.z);
+				if(glm::dot(glm::vec3(plane),pVertex) + plane.w < 0.f)
+					return 0;
+				if(glm::dot(glm::vec3(plane),nVertex) + plane.w < 0.f)
+					result = 1;
+			}
+			return result;
+		}
+	}
 	//--------------------------------------------------------------------------
 	TerrainBuilder::TerrainBuilder()
 	{
@@ -57,8 +148,15 @@ namespace glf
 	//--------------------------------------------------------------------------
 	void TerrainBuilder::BuildOcclusion(Texture2D* _heightTexture,
 										Texture2D* _occlusionTexture,
+										const glm::vec2& _terrainSize,
 										float _heightFactor)
 	{
+		assert(_occlusionTexture->size==_heightTexture->size);
+		std::vector<float> heights;
+		std::vector<unsigned char> horizons;
+		ReadHeights(*_heightTexture,heights);
+		BakeHorizons(heights,_heightTexture->size,_terrainSize/glm::vec2(_heightTexture->size),_heightFactor,horizons);
+		_occlusionTexture->Fill(GL_RGBA,GL_UNSIGNED_BYTE,&horizons[0]);
 
 		glf::CheckError("TerrainBuilder::BuildOcclusions");
 	}
@@ -72,12 +170,14 @@ namespace glf
 								float _roughness,
 								float _specularity,
 								int _tileResolution):
+	tileCount(0),
 	tileOffset(_terrainOffset),
 	terrainSize(_terrainSize),
 	tileFactor(_tileFactor),
 	diffuseTex(_diffuseTexture),
 	normalTex(_normalTexture),
 	heightTex(_heightTexture),
+	occlusionTex(NULL),
 	roughness(_roughness),
 	specularity(_specularity)
 	{
@@ -91,28 +191,514 @@ namespace glf
 									float _projFactor)
 	{
 		// Set LOD parameters
+		glm::ivec2 previousCount = tileCount;
 		tileCount 		= glm::ivec2(diffuseTex->size.x/_tileResolution,diffuseTex->size.y/_tileResolution);
 		tileSize  		= glm::vec2(terrainSize.x / float(tileCount.x),terrainSize.x / float(tileCount.y));
 		heightFactor	= _heightFactor;
 		tessFactor 		= _tessFactor;
 		projFactor 		= _projFactor;
+
+		// Heights of the pyramid are scaled by heightFactor when used
+		if(!heights.empty() && tileCount!=previousCount)
+			BuildPyramid();
+	}
+	//--------------------------------------------------------------------------
+	void TerrainMesh::UpdateHeights()
+	{
+		heightSize = heightTex->size;
+		ReadHeights(*heightTex,heights);
+		BuildPyramid();
+		glf::CheckError("TerrainMesh::UpdateHeights");
+	}
+	//--------------------------------------------------------------------------
+	void TerrainMesh::BuildPyramid()
+	{
+		pyramid.clear();
+		levelSizes.clear();
+		levelOffsets.clear();
+
+		// Level 0 : texels read by the bilinear lookups of each tile, the
+		// height texture repeats
+		glm::ivec2 size = tileCount;
+		levelSizes.push_back(size);
+		levelOffsets.push_back(0);
+		pyramid.resize(size.x*size.y);
+		for(int ty=0;ty<size.y;++ty)
+		{
+			int y0 = int(floorf(float(ty)  *heightSize.y/size.y - 0.5f));
+			int y1 = int(floorf(float(ty+1)*heightSize.y/size.y - 0.5f)) + 1;
+			for(int tx=0;tx<size.x;++tx)
+			{
+				int x0 = int(floorf(float(tx)  *heightSize.x/size.x - 0.5f));
+				int x1 = int(floorf(float(tx+1)*heightSize.x/size.x - 0.5f)) + 1;
+				glm::vec2 range(FLT_MAX,-FLT_MAX);
+				for(int y=y0;y<=y1;++y)
+				{
+					const float* row = &heights[Wrap(y,heightSize.y)*heightSize.x];
+					for(int x=x0;x<=x1;++x)
+					{
+						float h = row[Wrap(x,heightSize.x)];
+						range.x = std::min(range.x,h);
+						range.y = std::max(range.y,h);
+					}
+				}
+				pyramid[ty*size.x+tx] = range;
+			}
+		}
+
+		// Coarser levels merge 2x2 nodes, up to the root node
+		while(size.x>1 || size.y>1)
+		{
+			glm::ivec2 childSize = size;
+			int childOffset      = levelOffsets.back();
+			int offset           = int(pyramid.size());
+			size                 = glm::ivec2((size.x+1)/2,(size.y+1)/2);
+			levelSizes.push_back(size);
+			levelOffsets.push_back(offset);
+			pyramid.resize(offset+size.x*size.y);
+			for(int y=0;y<size.y;++y)
+			for(int x=0;x<size.x;++x)
+			{
+				glm::vec2 range(FLT_MAX,-FLT_MAX);
+				for(int cy=2*y;cy<std::min(2*y+2,childSize.y);++cy)
+				for(int cx=2*x;cx<std::min(2*x+2,childSize.x);++cx)
+				{
+					const glm::vec2& child = pyramid[childOffset+cy*childSize.x+cx];
+					range.x = std::min(range.x,child.x);
+					range.y = std::max(range.y,child.y);
+				}
+				pyramid[offset+y*size.x+x] = range;
+			}
+		}
+	}
+	//--------------------------------------------------------------------------
+	BBox TerrainMesh::TileBound(	int _level,
+									int _x,
+									int _y) const
+	{
+		assert(_level<int(levelSizes.size()));
+		glm::ivec2 t0(_x<<_level,_y<<_level);
+		glm::ivec2 t1(std::min((_x+1)<<_level,tileCount.x),std::min((_y+1)<<_level,tileCount.y));
+		const glm::vec2& range = pyramid[levelOffsets[_level] + _y*levelSizes[_level].x + _x];
+		float h0 = range.x * heightFactor;
+		float h1 = range.y * heightFactor;
+
+		BBox bound;
+		bound.pMin = tileOffset + glm::vec3(t0.x*tileSize.x,t0.y*tileSize.y,std::min(h0,h1));
+		bound.pMax = tileOffset + glm::vec3(t1.x*tileSize.x,t1.y*tileSize.y,std::max(h0,h1));
+		return bound;
+	}
+	//--------------------------------------------------------------------------
+	void TerrainMesh::AddTiles(		int _level,
+									int _x,
+									int _y,
+									std::vector<glm::ivec2>& _tiles) const
+	{
+		int x1 = std::min((_x+1)<<_level,tileCount.x);
+		int y1 = std::min((_y+1)<<_level,tileCount.y);
+		for(int y=_y<<_level;y<y1;++y)
+		for(int x=_x<<_level;x<x1;++x)
+			_tiles.push_back(glm::ivec2(x,y));
+	}
+	//--------------------------------------------------------------------------
+	void TerrainMesh::CullNode(		int _level,
+									int _x,
+									int _y,
+									const Frustum* _volumes,
+									int _mask,
+									std::vector<glm::ivec2>& _tiles) const
+	{
+		// Volumes still intersecting the node, the whole subtree is visible
+		// once it is inside one of them
+		BBox bound = TileBound(_level,_x,_y);
+		int mask   = 0;
+		for(int v=0;(_mask>>v)!=0;++v)
+		{
+			if((_mask & (1<<v))==0)
+				continue;
+			int c = Classify(_volumes[v],bound);
+			if(c==2)
+			{
+				AddTiles(_level,_x,_y,_tiles);
+				return;
+			}
+			if(c==1)
+				mask |= 1<<v;
+		}
+		if(mask==0)
+			return;
+		if(_level==0)
+		{
+			_tiles.push_back(glm::ivec2(_x,_y));
+			return;
+		}
+
+		const glm::ivec2& childSize = levelSizes[_level-1];
+		for(int y=2*_y;y<std::min(2*_y+2,childSize.y);++y)
+		for(int x=2*_x;x<std::min(2*_x+2,childSize.x);++x)
+			CullNode(_level-1,x,y,_volumes,mask,_tiles);
+	}
+	//--------------------------------------------------------------------------
+	int TerrainMesh::Cull(			const Frustum* _volumes,
+									int _nVolumes,
+									std::vector<glm::ivec2>& _tiles) const
+	{
+		int first = int(_tiles.size());
+		#if ENABLE_TERRAIN_CULLING
+		if(!pyramid.empty())
+		{
+			assert(_nVolumes>0 && _nVolumes<31);
+			CullNode(int(levelSizes.size())-1,0,0,_volumes,(1<<_nVolumes)-1,_tiles);
+			return int(_tiles.size()) - first;
+		}
+		#endif
+		for(int y=0;y<tileCount.y;++y)
+		for(int x=0;x<tileCount.x;++x)
+			_tiles.push_back(glm::ivec2(x,y));
+		return int(_tiles.size()) - first;
 	}
 	//--------------------------------------------------------------------------
-	void TerrainMesh::Draw() const
+	void TerrainMesh::Draw(			const VertexBuffer<glm::ivec2>::Buffer& _tiles,
+									int _first,
+									int _count) const
 	{
-		// TODO : Add frustum culling 
+		primitive->AddInstanced(_tiles,semantic::Tile,2,GL_INT,1,_first);
 		glPatchParameteri(GL_PATCH_VERTICES, 4);
-		primitive->Draw(GL_PATCHES, 4, 0, tileCount.x*tileCount.y);
+		primitive->Draw(GL_PATCHES, 4, 0, _count);
 
 		assert(glf::CheckError("TerrainMesh::Draw"));
 	}
 	//--------------------------------------------------------------------------
 	BBox TerrainMesh::Bound() const
 	{
+		if(!pyramid.empty())
+			return TileBound(int(levelSizes.size())-1,0,0);
+
 		BBox bound;
 		bound.pMin = tileOffset;
 		bound.pMax = tileOffset + glm::vec3(terrainSize,heightFactor);
 		return bound;
 	}
-}
+	//--------------------------------------------------------------------------
+	void BakeHorizons(				const std::vector<float>& _heights,
+									const glm::ivec2& _size,
+									const glm::vec2& _texelSize,
+									float _heightFactor,
+									std::vector<unsigned char>& _horizons,
+									bool _simd)
+	{
+		// Heights with their border texels repeated (the terrain does not
+		// tile), so that the marched texels of a row are at constant offsets
+		int pad = TERRAIN_HORIZON_TEXELS;
+		int w   = _size.x;
+		int h   = _size.y;
+		int pw  = w + 2*pad;
+		std::vector<float> padded(pw*(h+2*pad));
+		for(int y=0;y<h+2*pad;++y)
+		{
+			const float* src = &_heights[Clamp(y-pad,h)*w];
+			float* dst = &padded[y*pw];
+			for(int x=0;x<pw;++x)
+				dst[x] = src[Clamp(x-pad,w)];
+		}
+
+		// Offsets and height scales (over the distance) of the marched
+		// texels of each direction : +x, +y, -x, -y
+		const int directions[4][2] = {{1,0},{0,1},{-1,0},{0,-1}};
+		int   offsets[4][TERRAIN_HORIZON_STEPS];
+		float scales[4][TERRAIN_HORIZON_STEPS];
+		for(int d=0;d<4;++d)
+		{
+			float texel = directions[d][0]!=0 ? _texelSize.x : _texelSize.y;
+			for(int s=0;s<TERRAIN_HORIZON_STEPS;++s)
+			{
+				offsets[d][s] = (directions[d][1]*pw + directions[d][0]) * HorizonSteps[s];
+				scales[d][s]  = _heightFactor / (texel * HorizonSteps[s]);
+			}
+		}
+
+		_horizons.resize(4*w*h);
+		#pragma omp parallel for schedule(dynamic,16)
+		for(int y=0;y<h;++y)
+		{
+			const float* row   = &padded[(y+pad)*pw + pad];
+			unsigned char* out = &_horizons[4*y*w];
+			for(int d=0;d<4;++d)
+			{
+				int x = 0;
+				#if GLF_TERRAIN_SSE
+				if(_simd)
+				{
+					__m128 one   = _mm_set1_ps(1.f);
+					__m128 scale = _mm_set1_ps(255.f);
+					__m128 half  = _mm_set1_ps(0.5f);
+					for(;x+4<=w;x+=4)
+					{
+						__m128 hp = _mm_loadu_ps(row+x);
+						__m128 t  = _mm_setzero_ps();
+						for(int s=0;s<TERRAIN_HORIZON_STEPS;++s)
+						{
+							__m128 hq = _mm_loadu_ps(row+x+offsets[d][s]);
+							t = _mm_max_ps(t,_mm_mul_ps(_mm_sub_ps(hq,hp),_mm_set1_ps(scales[d][s])));
+						}
+						__m128 sine = _mm_div_ps(t,_mm_sqrt_ps(_mm_add_ps(one,_mm_mul_ps(t,t))));
+						float bytes[4];
+						_mm_storeu_ps(bytes,_mm_add_ps(_mm_mul_ps(sine,scale),half));
+						for(int k=0;k<4;++k)
+							out[4*(x+k)+d] = (unsigned char)bytes[k];
+					}
+				}
+				#endif
+				for(;x<w;++x)
+				{
+					float hp = row[x];
+					float t  = 0.f;
+					for(int s=0;s<TERRAIN_HORIZON_STEPS;++s)
+						t = std::max(t,(row[x+offsets[d][s]] - hp) * scales[d][s]);
+					out[4*x+d] = HorizonByte(t);
+				}
+			}
+		}
+	}
+	//--------------------------------------------------------------------------
+	bool BenchmarkHorizonBaker(		int _size)
+	{
+		// Rolling hills with some noise, 1 world unit per texel
+		RNG rng(23);
+		std::vector<float> heights(_size*_size);
+		for(int y=0;y<_size;++y)
+		for(int x=0;x<_size;++x)
+		{
+			float u = 2.f*float(M_PI)*x/_size;
+			float v = 2.f*float(M_PI)*y/_size;
+			heights[y*_size+x] = 0.5f + 0.2f*sinf(3.f*u)*cosf(2.f*v) + 0.1f*sinf(11.f*u+7.f*v) + 0.02f*rng.RandomFloat();
+		}
+		glm::ivec2 size(_size);
+		glm::vec2 texelSize(1.f);
+		float heightFactor = 100.f;
 
+		int nThreads = 1;
+		#ifdef _OPENMP
+		nThreads = omp_get_max_threads();
+		#endif
+		std::vector<unsigned char> scalar, simd, single;
+		double start = glfwGetTime();
+		BakeHorizons(heights,size,texelSize,heightFactor,scalar,false);
+		double scalarTime = glfwGetTime() - start;
+		start = glfwGetTime();
+		BakeHorizons(heights,size,texelSize,heightFactor,simd,true);
+		double simdTime = glfwGetTime() - start;
+		#ifdef _OPENMP
+		omp_set_num_threads(1);
+		#endif
+		start = glfwGetTime();
+		BakeHorizons(heights,size,texelSize,heightFactor,single,true);
+		double singleTime = glfwGetTime() - start;
+		#ifdef _OPENMP
+		omp_set_num_threads(nThreads);
+		#endif
+
+		bool identical = scalar==simd && simd==single;
+		glf::Info("Horizon baker   : %dx%d texels, %d directions, %d threads",_size,_size,4,nThreads);
+		glf::Info("Scalar          : %8.2f ms",scalarTime*1000.0);
+		glf::Info("SSE             : %8.2f ms (%6.2f Mtexels/s)",simdTime*1000.0,_size*double(_size)*1e-6/simdTime);
+		glf::Info("SSE, 1 thread   : %8.2f ms",singleTime*1000.0);
+		glf::Info("Identical output: %s",identical?"yes":"no");
+		return identical;
+	}
+	//--------------------------------------------------------------------------
+	int TerrainTiles::Cull(			const std::vector<TerrainMesh>& _terrains,
+									const Frustum* _volumes,
+									int _nVolumes)
+	{
+		int nTerrains = int(_terrains.size());
+		tiles.clear();
+		firsts.resize(nTerrains+1);
+		for(int i=0;i<nTerrains;++i)
+		{
+			firsts[i] = int(tiles.size());
+			if(_nVolumes>0)
+				_terrains[i].Cull(_volumes,_nVolumes,tiles);
+		}
+		firsts[nTerrains] = int(tiles.size());
+		Upload();
+		return int(tiles.size());
+	}
+	//--------------------------------------------------------------------------
+	void TerrainTiles::Upload()
+	{
+		// Respecified every frame, which orphans the previous storage
+		int nTiles = int(tiles.size());
+		if(nTiles>0)
+		{
+			if(buffer.count<nTiles)
+				buffer.Allocate(nTiles,GL_STREAM_DRAW);
+			buffer.Fill(&tiles[0],nTiles);
+		}
+	}
+	//--------------------------------------------------------------------------
+	int TerrainTiles::Difference(	const std::vector<TerrainMesh>& _terrains,
+									const TerrainTiles& _tiles,
+									const TerrainTiles& _excluded)
+	{
+		int nTerrains = int(_terrains.size());
+		tiles.clear();
+		firsts.resize(nTerrains+1);
+		for(int i=0;i<nTerrains;++i)
+		{
+			const glm::ivec2& tileCount = _terrains[i].tileCount;
+			flags.assign(tileCount.x*tileCount.y,0);
+			for(int t=_excluded.firsts[i];t<_excluded.firsts[i+1];++t)
+				flags[_excluded.tiles[t].y*tileCount.x + _excluded.tiles[t].x] = 1;
+
+			firsts[i] = int(tiles.size());
+			for(int t=_tiles.firsts[i];t<_tiles.firsts[i+1];++t)
+				if(!flags[_tiles.tiles[t].y*tileCount.x + _tiles.tiles[t].x])
+					tiles.push_back(_tiles.tiles[t]);
+		}
+		firsts[nTerrains] = int(tiles.size());
+		Upload();
+		return int(tiles.size());
+	}
+	//--------------------------------------------------------------------------
+	int TerrainTiles::Count(		int _terrain) const
+	{
+		return firsts[_terrain+1] - firsts[_terrain];
+	}
+	//--------------------------------------------------------------------------
+	void TerrainTiles::Draw(		const TerrainMesh& _mesh,
+									int _terrain) const
+	{
+		int count = Count(_terrain);
+		if(count>0)
+			_mesh.Draw(buffer,firsts[_terrain],count);
+	}
+	//--------------------------------------------------------------------------
+	TerrainCapture::TerrainCapture()
+	{
+		// Tessellation stages of the G-buffer, without rasterization
+		ProgramOptions options = ProgramOptions::CreateVSOptions();
+		options.AddDefine<int>("GBUFFER",1);
+		options.Include(LoadFile(directory::ShaderDirectory + "frame.glsl"));
+		capture.program.Compile(options.Append(LoadFile(directory::ShaderDirectory + "meshterrain.vs")),
+								options.Append(LoadFile(directory::ShaderDirectory + "meshterrain.cs")),
+								options.Append(LoadFile(directory::ShaderDirectory + "meshterrain.es")),
+								"");
+		const char* varyings[2] = {"ePosition","eTexCoord"};
+		capture.program.Feedback(varyings,2);
+
+		capture.heightTexUnit	= capture.program["HeightTex"].unit;
+		capture.tileSizeVar		= capture.program["TileSize"].location;
+		capture.tileCountVar	= capture.program["TileCount"].location;
+		capture.tileOffsetVar	= capture.program["TileOffset"].location;
+		capture.projFactorVar	= capture.program["ProjFactor"].location;
+		capture.tessFactorVar	= capture.program["TessFactor"].location;
+		capture.heightFactorVar	= capture.program["HeightFactor"].location;
+		glProgramUniform1i(capture.program.id, capture.program["HeightTex"].location, capture.heightTexUnit);
+
+		glf::CheckError("TerrainCapture::TerrainCapture");
+	}
+	//--------------------------------------------------------------------------
+	TerrainCapture::~TerrainCapture()
+	{
+		for(unsigned int i=0;i<streams.size();++i)
+		{
+			glDeleteTransformFeedbacks(1,&streams[i]->feedback);
+			delete streams[i];
+		}
+	}
+	//--------------------------------------------------------------------------
+	void TerrainCapture::CaptureStream(	Stream& _stream,
+										const TerrainMesh& _mesh,
+										const TerrainTiles& _tiles,
+										int _terrain,
+										float _tessFactor)
+	{
+		_stream.captured = false;
+		int nTiles = _tiles.Count(_terrain);
+		if(nTiles==0)
+			return;
+
+		// Worst case of the quads domain at the clamped level (64 at most)
+		int level        = int(ceilf(std::min(std::max(_tessFactor,1.f),64.f)));
+		int nVertices    = nTiles * 2*(level+1)*(level+1) * 3;
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK,_stream.feedback);
+		if(_stream.buffer.count<nVertices)
+		{
+			// Rebound to capture into the whole new storage
+			_stream.buffer.Allocate(nVertices,GL_DYNAMIC_COPY);
+			glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER,0,_stream.buffer.id);
+		}
+
+		glProgramUniform1f(capture.program.id, capture.tessFactorVar, _tessFactor);
+		glBeginTransformFeedback(GL_TRIANGLES);
+		_tiles.Draw(_mesh,_terrain);
+		glEndTransformFeedback();
+		_stream.captured = true;
+	}
+	//--------------------------------------------------------------------------
+	void TerrainCapture::Capture(	const std::vector<TerrainMesh>& _terrains,
+									const Frustum& _view,
+									const Frustum* _casterVolumes,
+									int _nCascades,
+									float _shadowScale)
+	{
+		int nTerrains = int(_terrains.size());
+		for(int i=int(streams.size());i<2*nTerrains;++i)
+		{
+			Stream* stream = new Stream();
+			glGenTransformFeedbacks(1,&stream->feedback);
+			stream->buffer.Allocate(1,GL_DYNAMIC_COPY);
+			stream->primitive.Add(stream->buffer,semantic::Position,3,GL_FLOAT,false,0);
+			stream->primitive.Add(stream->buffer,semantic::TexCoord,2,GL_FLOAT,false,sizeof(glm::vec3));
+			glBindTransformFeedback(GL_TRANSFORM_FEEDBACK,stream->feedback);
+			glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER,0,stream->buffer.id);
+			stream->captured = false;
+			streams.push_back(stream);
+		}
+
+		// Shadow only tiles are the caster tiles out of the view
+		int nViewTiles   = viewTiles.Cull(_terrains,&_view,1);
+		int nCasterTiles = casterTiles.Cull(_terrains,_casterVolumes,_nCascades);
+		shadowTiles.Difference(_terrains,casterTiles,viewTiles);
+		#if ENABLE_TERRAIN_CULLING
+		glf::manager::timings->SetCounter(counter::GbufferTerrainTiles,nViewTiles);
+		glf::manager::timings->SetCounter(counter::CsmTerrainTiles,nCasterTiles);
+		#endif
+
+		glUseProgram(capture.program.id);
+		glEnable(GL_RASTERIZER_DISCARD);
+		for(int i=0;i<nTerrains;++i)
+		{
+			const TerrainMesh& mesh = _terrains[i];
+			glProgramUniform3f(capture.program.id, capture.tileOffsetVar,	mesh.tileOffset.x, mesh.tileOffset.y, mesh.tileOffset.z);
+			glProgramUniform2i(capture.program.id, capture.tileCountVar,	mesh.tileCount.x, mesh.tileCount.y);
+			glProgramUniform2f(capture.program.id, capture.tileSizeVar,		mesh.tileSize.x, mesh.tileSize.y);
+			glProgramUniform1f(capture.program.id, capture.heightFactorVar,	mesh.heightFactor);
+			glProgramUniform1f(capture.program.id, capture.projFactorVar,	mesh.projFactor);
+			mesh.heightTex->Bind(capture.heightTexUnit);
+
+			CaptureStream(*streams[2*i+0],mesh,viewTiles,  i,mesh.tessFactor);
+			CaptureStream(*streams[2*i+1],mesh,shadowTiles,i,mesh.tessFactor*_shadowScale);
+		}
+		glDisable(GL_RASTERIZER_DISCARD);
+		glBindTransformFeedback(GL_TRANSFORM_FEEDBACK,0);
+
+		glf::CheckError("TerrainCapture::Capture");
+	}
+	//--------------------------------------------------------------------------
+	void TerrainCapture::Draw(		int _terrain,
+									bool _shadows) const
+	{
+		for(int s=0;s<(_shadows?2:1);++s)
+		{
+			const Stream& stream = *streams[2*_terrain+s];
+			if(!stream.captured)
+				continue;
+			glBindVertexArray(stream.primitive.id);
+			glDrawTransformFeedback(GL_TRIANGLES,stream.feedback);
+		}
+		glBindVertexArray(0);
+		assert(glf::CheckError("TerrainCapture::Draw"));
+	}
+}
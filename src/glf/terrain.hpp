@@ -9,6 +9,12 @@
 #include <glf/wrapper.hpp>
 #include <glf/texture.hpp>
 #include <glm/glm.hpp>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Constants
+//-----------------------------------------------------------------------------
+#define TERRAIN_HORIZON_TEXELS			64		// Horizon search distance of the baker
 
 namespace glf
 {
@@ -21,8 +27,11 @@ namespace glf
 											Texture2D* _normalTexture,
 											const glm::vec2& _terrainSize,
 											float _heightFactor=1.f);
+		// Bakes the horizon map of the height texture (see BakeHorizons)
+		// into _occlusionTexture, RGBA8 of the same size
 		void	BuildOcclusion(				Texture2D* _heightTexture,
 											Texture2D* _occlusionTexture,
+											const glm::vec2& _terrainSize,
 											float _heightFactor=1.f);
 	private:
 		struct NormalBuilder
@@ -40,6 +49,9 @@ namespace glf
 		NormalBuilder						normalBuilder;
 	};
 	//--------------------------------------------------------------------------
+	// Tessellated heightfield drawn as tileCount patches. Visible tiles are
+	// found by a quadtree walk over a min/max height pyramid of the tiles
+	// and read by the patches as a per instance attribute (ATTR_TILE)
 	class TerrainMesh
 	{
 	public:
@@ -52,12 +64,39 @@ namespace glf
 											float _roughness,
 											float _specularity,
 											int _tileResolution=32);
-		void 	Draw(						) const;
+		// Draws _count tiles read from _tiles, starting at _first
+		void 	Draw(						const VertexBuffer<glm::ivec2>::Buffer& _tiles,
+											int _first,
+											int _count) const;
 		void	Tesselation(				int   _tileResolution,
 											float _heightFactor,
 											float _tessFactor,
 											float _projFactor);
+		// Reads back the heights of heightTex and builds the height pyramid.
+		// Has to be called when the height texture changes
+		void	UpdateHeights(				);
+		// Appends the tiles overlapping at least one of the volumes (all the
+		// tiles without ENABLE_TERRAIN_CULLING) and returns their number
+		int		Cull(						const Frustum* _volumes,
+											int _nVolumes,
+											std::vector<glm::ivec2>& _tiles) const;
+		BBox	TileBound(					int _level,
+											int _x,
+											int _y) const;
+		// Bound of the heights, the whole height range without pyramid
 		BBox	Bound(						) const;
+	private:
+		void	BuildPyramid(				);
+		void	CullNode(					int _level,
+											int _x,
+											int _y,
+											const Frustum* _volumes,
+											int _mask,
+											std::vector<glm::ivec2>& _tiles) const;
+		void	AddTiles(					int _level,
+											int _x,
+											int _y,
+											std::vector<glm::ivec2>& _tiles) const;
 	public:
 		glf::VertexArray*					primitive;
 
@@ -74,9 +113,124 @@ namespace glf
 		glf::Texture2D*						diffuseTex;
 		glf::Texture2D*						normalTex;
 		glf::Texture2D*						heightTex;
+		glf::Texture2D*						occlusionTex;	// Horizon map, see TerrainBuilder::BuildOcclusion
 
 		float								roughness;
 		float								specularity;
+
+		// Heights of heightTex in [0,1], and their min/max per tile (level 0)
+		// then per 2x2 nodes up to a single root node
+		glm::ivec2							heightSize;
+		std::vector<float>					heights;
+		std::vector<glm::vec2>				pyramid;
+		std::vector<glm::ivec2>				levelSizes;
+		std::vector<int>					levelOffsets;
+	};
+	//--------------------------------------------------------------------------
+	// Horizon map of a heightfield of _size texels, _texelSize world units
+	// apart, whose heights in [0,1] are scaled by _heightFactor. For each
+	// texel, the sine of the horizon elevation toward +x, +y, -x and -y
+	// within TERRAIN_HORIZON_TEXELS texels, quantized to RGBA8. The
+	// heightfield repeats like its texture. Rows are baked in parallel
+	// (OpenMP), four texels at a time with SSE unless _simd is false
+	void	BakeHorizons(					const std::vector<float>& _heights,
+											const glm::ivec2& _size,
+											const glm::vec2& _texelSize,
+											float _heightFactor,
+											std::vector<unsigned char>& _horizons,
+											bool _simd=true);
+
+	// Bakes a synthetic _size x _size heightfield with the scalar and the
+	// SSE loops, on one and on all the threads. Returns false if the
+	// horizon maps differ
+	bool	BenchmarkHorizonBaker(			int _size);
+
+	//--------------------------------------------------------------------------
+	// Visible tiles of the terrains of a pass, streamed every frame into one
+	// buffer
+	class TerrainTiles
+	{
+	public:
+		// Returns the number of visible tiles of all the terrains
+		int		Cull(						const std::vector<TerrainMesh>& _terrains,
+											const Frustum* _volumes,
+											int _nVolumes);
+		// Tiles of _tiles which are not in _excluded
+		int		Difference(					const std::vector<TerrainMesh>& _terrains,
+											const TerrainTiles& _tiles,
+											const TerrainTiles& _excluded);
+		int		Count(						int _terrain) const;
+		void	Draw(						const TerrainMesh& _mesh,
+											int _terrain) const;
+	private:
+		void	Upload(						);
+		std::vector<glm::ivec2>				tiles;
+		std::vector<int>					firsts;			// First tile of each terrain
+		VertexBuffer<glm::ivec2>::Buffer	buffer;
+		std::vector<unsigned char>			flags;
+	};
+	//--------------------------------------------------------------------------
+	// Terrains tessellated once per frame and captured with transform
+	// feedback, then drawn without tessellation by the G-buffer and all the
+	// CSM cascades. Tiles of the view are tessellated at their tessFactor,
+	// tiles only seen by the shadow casters at a fraction of it. Each
+	// terrain has one capture of each kind, drawn with the vertex count
+	// kept by its transform feedback object
+	class TerrainCapture
+	{
+	public:
+		struct Vertex
+		{
+			glm::vec3						position;
+			glm::vec2						texCoord;
+		};
+
+											TerrainCapture(	);
+											~TerrainCapture(	);
+		void	Capture(					const std::vector<TerrainMesh>& _terrains,
+											const Frustum& _view,
+											const Frustum* _casterVolumes,
+											int _nCascades,
+											float _shadowScale);
+		// Draws the view tiles of the terrain, and the shadow only tiles
+		// with _shadows, on the bound program
+		void	Draw(						int _terrain,
+											bool _shadows) const;
+	private:
+											TerrainCapture(	const TerrainCapture&);
+		TerrainCapture&						operator=(		const TerrainCapture&);
+
+		struct Stream
+		{
+			GLuint							feedback;
+			VertexBuffer<Vertex>::Buffer	buffer;
+			VertexArray						primitive;
+			bool							captured;		// During the last frame
+		};
+		void	CaptureStream(				Stream& _stream,
+											const TerrainMesh& _mesh,
+											const TerrainTiles& _tiles,
+											int _terrain,
+											float _tessFactor);
+
+		struct CaptureProgram
+		{
+											CaptureProgram():program("TerrainCapture"){}
+			Program 						program;
+			GLint							heightTexUnit;
+			GLint 							tileSizeVar;
+			GLint 							tileCountVar;
+			GLint 							tileOffsetVar;
+			GLint 							projFactorVar;
+			GLint 							tessFactorVar;
+			GLint							heightFactorVar;
+		};
+
+		CaptureProgram						capture;
+		TerrainTiles						viewTiles;
+		TerrainTiles						casterTiles;
+		TerrainTiles						shadowTiles;	// Caster tiles out of the view
+		std::vector<Stream*>				streams;		// View then shadow stream of each terrain
 	};
 }
 
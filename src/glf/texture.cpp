@@ -245,7 +245,7 @@ namespace glf
 		bool setAlignment = _format==GL_RGB || _format==GL_BGR;
 		if(setAlignment) glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 		glBindTexture(GL_TEXTURE_2D,id);
-		glTexSubImage2D(GL_TEXTURE_2D,_level,0,0,size.x,size.y,_format,_type,_data); 
+		glTexSubImage2D(GL_TEXTURE_2D,_level,0,0,NextMipmapDimension(size.x,_level),NextMipmapDimension(size.y,_level),_format,_type,_data); 
 		if(setAlignment) glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	}
 	//-------------------------------------------------------------------------
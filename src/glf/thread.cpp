@@ -0,0 +1,139 @@
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <glf/thread.hpp>
+#include <cassert>
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	Mutex::Mutex()
+	{
+		#if defined(WIN32)
+		InitializeCriticalSection(&mutex);
+		#else
+		pthread_mutex_init(&mutex,NULL);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	Mutex::~Mutex()
+	{
+		#if defined(WIN32)
+		DeleteCriticalSection(&mutex);
+		#else
+		pthread_mutex_destroy(&mutex);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	void Mutex::Lock()
+	{
+		#if defined(WIN32)
+		EnterCriticalSection(&mutex);
+		#else
+		pthread_mutex_lock(&mutex);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	void Mutex::Unlock()
+	{
+		#if defined(WIN32)
+		LeaveCriticalSection(&mutex);
+		#else
+		pthread_mutex_unlock(&mutex);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	Condition::Condition()
+	{
+		#if defined(WIN32)
+		InitializeConditionVariable(&condition);
+		#else
+		pthread_cond_init(&condition,NULL);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	Condition::~Condition()
+	{
+		#if !defined(WIN32)
+		pthread_cond_destroy(&condition);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	void Condition::Wait(Mutex& _mutex)
+	{
+		#if defined(WIN32)
+		SleepConditionVariableCS(&condition,&_mutex.mutex,INFINITE);
+		#else
+		pthread_cond_wait(&condition,&_mutex.mutex);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	void Condition::Signal()
+	{
+		#if defined(WIN32)
+		WakeConditionVariable(&condition);
+		#else
+		pthread_cond_signal(&condition);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	void Condition::Broadcast()
+	{
+		#if defined(WIN32)
+		WakeAllConditionVariable(&condition);
+		#else
+		pthread_cond_broadcast(&condition);
+		#endif
+	}
+	//--------------------------------------------------------------------------
+	Thread::Thread():
+	started(false),
+	function(NULL),
+	data(NULL)
+	{
+
+	}
+	//--------------------------------------------------------------------------
+	Thread::~Thread()
+	{
+		Join();
+	}
+	//--------------------------------------------------------------------------
+	bool Thread::Start(Function _function, void* _data)
+	{
+		assert(!started);
+		function = _function;
+		data     = _data;
+		#if defined(WIN32)
+		thread   = CreateThread(NULL,0,Run,this,0,NULL);
+		started  = thread!=NULL;
+		#else
+		started  = pthread_create(&thread,NULL,Run,this)==0;
+		#endif
+		return started;
+	}
+	//--------------------------------------------------------------------------
+	void Thread::Join()
+	{
+		if(!started)
+			return;
+		#if defined(WIN32)
+		WaitForSingleObject(thread,INFINITE);
+		CloseHandle(thread);
+		#else
+		pthread_join(thread,NULL);
+		#endif
+		started = false;
+	}
+	//--------------------------------------------------------------------------
+	#if defined(WIN32)
+	DWORD WINAPI Thread::Run(LPVOID _thread)
+	#else
+	void* Thread::Run(void* _thread)
+	#endif
+	{
+		Thread* thread = (Thread*)_thread;
+		thread->function(thread->data);
+		return 0;
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef GLF_THREAD_HPP
+#define GLF_THREAD_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#if defined(WIN32)
+	#include <windows.h>
+#else
+	#include <pthread.h>
+#endif
+
+namespace glf
+{
+	//--------------------------------------------------------------------------
+	class Mutex
+	{
+	public:
+							Mutex();
+							~Mutex();
+		void				Lock();
+		void				Unlock();
+	private:
+							Mutex(const Mutex&);
+							Mutex& operator=(const Mutex&);
+		friend class		Condition;
+		#if defined(WIN32)
+		CRITICAL_SECTION	mutex;
+		#else
+		pthread_mutex_t		mutex;
+		#endif
+	};
+	//--------------------------------------------------------------------------
+	// Locks a mutex for the lifetime of the object
+	class ScopedLock
+	{
+	public:
+							ScopedLock(Mutex& _mutex):mutex(_mutex){ mutex.Lock(); }
+							~ScopedLock(){ mutex.Unlock(); }
+	private:
+							ScopedLock(const ScopedLock&);
+							ScopedLock& operator=(const ScopedLock&);
+		Mutex&				mutex;
+	};
+	//--------------------------------------------------------------------------
+	class Condition
+	{
+	public:
+							Condition();
+							~Condition();
+		// Releases the locked mutex while waiting, and locks it again
+		void				Wait(		Mutex& _mutex);
+		void				Signal();
+		void				Broadcast();
+	private:
+							Condition(const Condition&);
+							Condition& operator=(const Condition&);
+		#if defined(WIN32)
+		CONDITION_VARIABLE	condition;
+		#else
+		pthread_cond_t		condition;
+		#endif
+	};
+	//--------------------------------------------------------------------------
+	// Thread running _function(_data) until it returns
+	class Thread
+	{
+	public:
+		typedef void		(*Function)(void* _data);
+
+							Thread();
+							~Thread();		// Joins the thread
+		bool				Start(		Function _function,
+										void* _data);
+		void				Join();
+	private:
+							Thread(const Thread&);
+							Thread& operator=(const Thread&);
+		#if defined(WIN32)
+		static DWORD WINAPI	Run(		LPVOID _thread);
+		HANDLE				thread;
+		#else
+		static void*		Run(		void* _thread);
+		pthread_t			thread;
+		#endif
+		bool				started;
+		Function			function;
+		void*				data;
+	};
+}
+
+#endif
@@ -31,6 +31,7 @@ namespace glf
 	GPUSectionTimer::GPUSectionTimer()
 	{
 		glGenQueries(1, &id);
+		blocking= false;
 		waiting = false;
 		current = 0;
 	}
@@ -59,8 +60,9 @@ namespace glf
 
 		if(waiting)
 		{
-			GLint available = 0;
-			glGetQueryObjectiv(id, GL_QUERY_RESULT_AVAILABLE, &available);
+			GLint available = blocking ? 1 : 0;
+			if(!blocking)
+				glGetQueryObjectiv(id, GL_QUERY_RESULT_AVAILABLE, &available);
 
 			if(available)
 			{
@@ -129,6 +131,9 @@ namespace glf
 		int	Gbuffer				= 0;
 		int	CsmBuilder			= 0;
 		int	CsmRender			= 0;
+		int	CsmReduce			= 0;
+		int	ShadowAtlas			= 0;
+		int	LocalLights			= 0;
 		int	SkyRender			= 0;
 		int	SsaoRender			= 0;
 		int	SsaoBlur			= 0;
@@ -139,6 +144,31 @@ namespace glf
 		int	Frame				= 0;
 	}
 	//--------------------------------------------------------------------------
+	namespace counter
+	{
+		int	InvalidCounter		= -1;
+
+		int	GbufferVisible		= -1;
+		int	GbufferCulled		= -1;
+
+		int	CsmCasterLayers		= -1;
+
+		int	ElidedBinds			= -1;
+
+		int	GbufferTerrainTiles	= -1;
+		int	CsmTerrainTiles		= -1;
+
+		int	GbufferPagedNodes	= -1;
+		int	CsmPagedNodes		= -1;
+		int	PagedTerrainPages	= -1;
+
+		int	CsmRebuiltCascades	= -1;
+
+		int	ShadowAtlasFaces	= -1;
+		int	ShadowAtlasLights	= -1;
+		int	LocalLights			= -1;
+	}
+	//--------------------------------------------------------------------------
 	TimingManager::Ptr TimingManager::Create()
 	{
 		return Ptr(new TimingManager());
@@ -163,6 +193,13 @@ namespace glf
 			#endif 
 
 			AddSection(section::CsmRender,			"CSM Render",			true,false);
+			#if ENABLE_SDSM
+			AddSection(section::CsmReduce,			"CSM Reduce",			true,false);
+			#endif
+			#if ENABLE_SHADOW_ATLAS
+			AddSection(section::ShadowAtlas,		"Shadow Atlas",			true,false);
+			#endif
+			AddSection(section::LocalLights,		"Local Lights",			true,false);
 			AddSection(section::SkyRender,			"Sky Render",			true,false);
 			AddSection(section::SsaoRender,			"SSAO Render",			true,false);
 			AddSection(section::SsaoBlur,			"SSAO Blur",			true,false);
@@ -184,6 +221,34 @@ namespace glf
 		#else
 		AddSection(section::Frame,				"Frame",				false,true);
 		#endif
+
+		#if (ENABLE_FRUSTUM_CULLING && !ENABLE_GPU_CULLING)
+		AddCounter(counter::GbufferVisible,			"GBuffer visible meshes");
+		AddCounter(counter::GbufferCulled,			"GBuffer culled meshes");
+		#endif
+		#if (ENABLE_CASTER_CULLING && !ENABLE_GPU_CULLING)
+		AddCounter(counter::CsmCasterLayers,		"CSM caster layers");
+		#endif
+		#if ENABLE_RENDER_QUEUE
+		AddCounter(counter::ElidedBinds,			"Render queue elided binds");
+		#endif
+		#if ENABLE_TERRAIN_CULLING
+		AddCounter(counter::GbufferTerrainTiles,	"GBuffer terrain tiles");
+		AddCounter(counter::CsmTerrainTiles,		"CSM terrain tiles");
+		#endif
+		#if ENABLE_PAGED_TERRAIN
+		AddCounter(counter::GbufferPagedNodes,		"GBuffer paged terrain nodes");
+		AddCounter(counter::CsmPagedNodes,			"CSM paged terrain nodes");
+		AddCounter(counter::PagedTerrainPages,		"Paged terrain resident pages");
+		#endif
+		#if ENABLE_CSM_CACHE
+		AddCounter(counter::CsmRebuiltCascades,		"CSM rebuilt cascades");
+		#endif
+		#if ENABLE_SHADOW_ATLAS
+		AddCounter(counter::ShadowAtlasFaces,		"Shadow atlas rendered faces");
+		AddCounter(counter::ShadowAtlasLights,		"Shadow atlas shadowed lights");
+		#endif
+		AddCounter(counter::LocalLights,			"Local lights drawn");
 	}
 	//--------------------------------------------------------------------------
 	void TimingManager::AddSection(		int& _section,
@@ -216,6 +281,14 @@ namespace glf
 			_section = section::InvalidSection;
 	}
 	//--------------------------------------------------------------------------
+	void TimingManager::AddCounter(		int& _counter,
+										const std::string& _name)
+	{
+		_counter = int(counters.size());
+		counters.push_back(0);
+		strCounters.push_back(_name);
+	}
+	//--------------------------------------------------------------------------
 	TimingManager::~TimingManager()
 	{
 		for(unsigned int i=0;i<gpuTimers.size();++i)
@@ -258,6 +331,33 @@ namespace glf
 		return strTimers[section::ToIndex(_section)];
 	}
 	//--------------------------------------------------------------------------
+	void TimingManager::SetBlocking(bool _blocking)
+	{
+		for(unsigned int i=0;i<gpuTimers.size();++i)
+			if(gpuTimers[i]!=NULL)
+				gpuTimers[i]->blocking = _blocking;
+	}
+	//--------------------------------------------------------------------------
+	void TimingManager::SetCounter(int _counter, int _value)
+	{
+		if(_counter>=0)
+			counters[_counter] = _value;
+	}
+	//--------------------------------------------------------------------------
+	int TimingManager::Counter(int _counter) const
+	{
+		if(_counter>=0)
+			return counters[_counter];
+		else
+			return 0;
+	}
+	//--------------------------------------------------------------------------
+	const std::string& TimingManager::CounterName(int _counter) const
+	{
+		assert(_counter>=0 && _counter<int(strCounters.size()));
+		return strCounters[_counter];
+	}
+	//--------------------------------------------------------------------------
 	TimingRenderer::TimingRenderer(int _w, int _h):
 	font(),
 	fontRenderer(_w,_h)
@@ -289,6 +389,17 @@ namespace glf
 		fontRenderer.Draw(_x,_y,font,_buffer,_color);
 	}
 	//--------------------------------------------------------------------------
+	void TimingRenderer::DrawCounterLine(	const TimingManager& _timings,
+										int _counterID,
+										int _x,
+										int _y,
+										const glm::vec4& _color,
+										char* _buffer)
+	{
+		sprintf(_buffer,"[CNT] %s : %d",_timings.CounterName(_counterID).c_str(),_timings.Counter(_counterID));
+		fontRenderer.Draw(_x,_y,font,_buffer,_color);
+	}
+	//--------------------------------------------------------------------------
 	void TimingRenderer::Draw(			const TimingManager& _timings)
 	{
 		static char buffer[128];
@@ -300,6 +411,34 @@ namespace glf
 		y				= 20;
 		verticalOffset	= font.CharHeight('A') + 2;
 
+		DrawCounterLine(_timings,counter::LocalLights,		x,y,color,buffer); y+=verticalOffset;
+		#if ENABLE_SHADOW_ATLAS
+			DrawCounterLine(_timings,counter::ShadowAtlasLights,x,y,color,buffer); y+=verticalOffset;
+			DrawCounterLine(_timings,counter::ShadowAtlasFaces,	x,y,color,buffer); y+=verticalOffset;
+		#endif
+		#if ENABLE_CSM_CACHE
+			DrawCounterLine(_timings,counter::CsmRebuiltCascades,x,y,color,buffer); y+=verticalOffset;
+		#endif
+		#if ENABLE_PAGED_TERRAIN
+			DrawCounterLine(_timings,counter::PagedTerrainPages,x,y,color,buffer); y+=verticalOffset;
+			DrawCounterLine(_timings,counter::CsmPagedNodes,	x,y,color,buffer); y+=verticalOffset;
+			DrawCounterLine(_timings,counter::GbufferPagedNodes,x,y,color,buffer); y+=verticalOffset;
+		#endif
+		#if ENABLE_TERRAIN_CULLING
+			DrawCounterLine(_timings,counter::CsmTerrainTiles,	x,y,color,buffer); y+=verticalOffset;
+			DrawCounterLine(_timings,counter::GbufferTerrainTiles,x,y,color,buffer); y+=verticalOffset;
+		#endif
+		#if ENABLE_RENDER_QUEUE
+			DrawCounterLine(_timings,counter::ElidedBinds,		x,y,color,buffer); y+=verticalOffset;
+		#endif
+		#if (ENABLE_CASTER_CULLING && !ENABLE_GPU_CULLING)
+			DrawCounterLine(_timings,counter::CsmCasterLayers,	x,y,color,buffer); y+=verticalOffset;
+		#endif
+		#if (ENABLE_FRUSTUM_CULLING && !ENABLE_GPU_CULLING)
+			DrawCounterLine(_timings,counter::GbufferCulled,	x,y,color,buffer); y+=verticalOffset;
+			DrawCounterLine(_timings,counter::GbufferVisible,	x,y,color,buffer); y+=verticalOffset;
+		#endif
+
 		#if ENABLE_GPU_PASSES_TIMING
 			DrawGPULine(_timings,section::PostProcess,			x,y,color,buffer); y+=verticalOffset;
 
@@ -317,7 +456,14 @@ namespace glf
 			DrawGPULine(_timings,section::SsaoBlur,				x,y,color,buffer); y+=verticalOffset;
 			DrawGPULine(_timings,section::SsaoRender,			x,y,color,buffer); y+=verticalOffset;
 			DrawGPULine(_timings,section::SkyRender,			x,y,color,buffer); y+=verticalOffset;
+			DrawGPULine(_timings,section::LocalLights,			x,y,color,buffer); y+=verticalOffset;
 			DrawGPULine(_timings,section::CsmRender,			x,y,color,buffer); y+=verticalOffset;
+			#if ENABLE_SHADOW_ATLAS
+			DrawGPULine(_timings,section::ShadowAtlas,			x,y,color,buffer); y+=verticalOffset;
+			#endif
+			#if ENABLE_SDSM
+			DrawGPULine(_timings,section::CsmReduce,			x,y,color,buffer); y+=verticalOffset;
+			#endif
 
 			#if ENABLE_CSM_PASS_TIMING
 			DrawGPULine(_timings,section::CsmBuilderFilter,		x,y,color,buffer); y+=verticalOffset;
@@ -22,6 +22,9 @@ namespace glf
 		void		StartSection();	// Indicates the start of the section
 		void		EndSection();	// Indicates the end of the section
 		float		Timing() const;	// Return the average elapsed time into this section
+		// Waits for the result at the end of the section, instead of
+		// keeping the last one until the next result is available
+		bool		blocking;
 	private:
 		GLuint		id;
 		bool		waiting;
@@ -69,6 +72,9 @@ namespace glf
 		extern int	Gbuffer;
 		extern int	CsmBuilder;
 		extern int	CsmRender;
+		extern int	CsmReduce;		// Sample distribution of the view (SDSM)
+		extern int	ShadowAtlas;	// Shadow maps of the local lights
+		extern int	LocalLights;
 		extern int	SkyRender;
 		extern int	SsaoRender;
 		extern int	SsaoBlur;
@@ -79,6 +85,41 @@ namespace glf
 		extern int	Frame;
 	}
 	//--------------------------------------------------------------------------
+	// Per frame statistics set by the passes
+	namespace counter
+	{
+		extern int	InvalidCounter;
+
+		// G-buffer frustum culling of regular meshes
+		extern int	GbufferVisible;
+		extern int	GbufferCulled;
+
+		// CSM shadow caster culling : rendered (mesh,cascade) pairs
+		extern int	CsmCasterLayers;
+
+		// Binds skipped by the render queues, summed over the frame
+		extern int	ElidedBinds;
+
+		// Terrain tiles drawn by the G-buffer and the CSM passes
+		extern int	GbufferTerrainTiles;
+		extern int	CsmTerrainTiles;
+
+		// Paged terrain quadrants drawn by the G-buffer and the CSM passes,
+		// and resident pages of all the paged terrains
+		extern int	GbufferPagedNodes;
+		extern int	CsmPagedNodes;
+		extern int	PagedTerrainPages;
+
+		// Cascades rendered by the CSM builder, the others are reused
+		extern int	CsmRebuiltCascades;
+
+		// Shadow atlas faces rendered, visible lights with a shadow map and
+		// local lights drawn
+		extern int	ShadowAtlasFaces;
+		extern int	ShadowAtlasLights;
+		extern int	LocalLights;
+	}
+	//--------------------------------------------------------------------------
 	class TimingManager
 	{
 	public:
@@ -91,16 +132,26 @@ namespace glf
 		float 		GPUTiming(			int _section) const;
 		float 		CPUTiming(			int _section) const;
 		const std::string& Name(		int _section) const;
+		void		SetCounter(			int _counter,
+										int _value);
+		int			Counter(			int _counter) const;
+		const std::string& CounterName(	int _counter) const;
+		// GPU timings of every frame, waited for at the end of the sections
+		void		SetBlocking(		bool _blocking);
 
 	private:
 		void 		AddSection(			int& _sectionID, 
 										const std::string& _sectionName,
 										bool _addGPUSection, 
 										bool _addCPUSection);
+		void		AddCounter(			int& _counterID,
+										const std::string& _counterName);
 		std::vector<GPUSectionTimer*>	gpuTimers;
 		std::vector<CPUSectionTimer*>	cpuTimers;
 		std::vector<std::string>		strTimers;
 		int								counter;
+		std::vector<int>				counters;
+		std::vector<std::string>		strCounters;
 	};
 	//--------------------------------------------------------------------------
 	class TimingRenderer
@@ -122,6 +173,12 @@ namespace glf
 										int _y,
 										const glm::vec4& _color,
 										char* _buffer);
+		void 		DrawCounterLine(	const TimingManager& _timings,
+										int _counterID,
+										int _x,
+										int _y,
+										const glm::vec4& _color,
+										char* _buffer);
 	private:
 		Font							font;
 		FontRenderer 					fontRenderer;
@@ -43,6 +43,9 @@ namespace glf
 			case GLFW_KEY_F:
 				ctx::drawWire = !ctx::drawWire;
 				break;
+			case GLFW_KEY_P:
+				ctx::recordPath = !ctx::recordPath;
+				break;
 			case 27:
 				end();
 				exit(0);
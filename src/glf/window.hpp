@@ -82,6 +82,7 @@ namespace ctx
 	extern bool 				drawTimings;
 	extern bool 				drawHelpers;
 	extern bool 				drawWire;
+	extern bool 				recordPath;
 }
 
 #endif
@@ -93,6 +93,11 @@ namespace glf
 		options.AddDefine<int>("ATTR_TANGENT",	semantic::Tangent);
 		options.AddDefine<int>("ATTR_COLOR",	semantic::Color);
 		options.AddDefine<int>("ATTR_BITANGENT",semantic::Bitangent);
+		options.AddDefine<int>("ATTR_LAYER_MASK",semantic::LayerMask);
+		options.AddDefine<int>("ATTR_MODEL",	semantic::Model);
+		options.AddDefine<int>("ATTR_MATERIAL",	semantic::Material);
+		options.AddDefine<int>("ATTR_TILE",		semantic::Tile);
+		options.AddDefine<int>("ATTR_TERRAIN_NODE",semantic::TerrainNode);
 		return options;
 	}
 	//-------------------------------------------------------------------------
@@ -361,6 +366,16 @@ namespace glf
 		return index;
 	}
 	//-------------------------------------------------------------------------
+	void Program::Feedback(			const char** _varyings,
+									int _count)
+	{
+		glTransformFeedbackVaryings(id,_count,_varyings,GL_INTERLEAVED_ATTRIBS);
+		glLinkProgram(id);
+		assert(glf::CheckProgram(id));
+		variables.clear();
+		AnalyzeProgram(name,id,variables);
+	}
+	//-------------------------------------------------------------------------
 	std::string Program::ToString() const
 	{
 		std::stringstream out;
@@ -77,6 +77,10 @@ namespace glf
 								const std::string& _gFile,
 								const std::string& _fFile);
 		GLint 		Output(		const std::string& _outName) const;
+		// Captures the outputs of the last vertex processing stage with
+		// transform feedback, interleaved, and relinks the program
+		void		Feedback(	const char** _varyings,
+								int _count);
 
 		const Variable& 	operator[](const std::string& _varName) const;
 		std::string			ToString() const;
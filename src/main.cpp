@@ -8,6 +8,8 @@
 #include <glf/buffer.hpp>
 #include <glf/pass.hpp>
 #include <glf/csm.hpp>
+#include <glf/sdsm.hpp>
+#include <glf/shadowatlas.hpp>
 #include <glf/debug.hpp>
 #include <glf/sky.hpp>
 #include <glf/probe.hpp>
@@ -17,10 +19,15 @@
 #include <glf/dofprocessor.hpp>
 #include <glf/postprocessor.hpp>
 #include <glf/terrain.hpp>
+#include <glf/renderqueue.hpp>
+#include <glf/constants.hpp>
 #include <glf/utils.hpp>
 #include <glf/io/scene.hpp>
 #include <glf/io/image.hpp>
 #include <glf/io/config.hpp>
+#include <glf/io/model.hpp>
+#include <glf/io/camerapath.hpp>
+#include <GLFW/glfw3.h>
 #include <fstream>
 #include <cstring>
 #include <glm/glm.hpp>
@@ -49,6 +56,7 @@ namespace ctx
 	bool									drawTimings = false;
 	bool									drawUI      = true;
 	bool									drawWire    = false;
+	bool									recordPath  = false;
 }
 //-----------------------------------------------------------------------------
 namespace
@@ -76,6 +84,11 @@ namespace
 		float								aperture;
 		float								blendFactor;
 		float								cascadeAlpha;
+		bool								cacheCascades;		// Reuse the cascades of the static casters
+		float								guardBand;
+		int									filterRadius;		// Of the VSM/EVSM moment blur
+		int									technique;			// glf::shadow::Technique
+		bool								sampleDistribution;	// Splits and bounds from the visible samples (SDSM)
 	};
 
 	struct SSAOParams
@@ -113,6 +126,20 @@ namespace
 		std::vector<float>					depthFactors;
 		float								tessFactor;
 		float								projFactor;
+		float								shadowTessScale;	// Of the tiles only seen by the shadow casters
+		float								lodFactor;			// Of the paged terrains
+		int									gridResolution;
+		bool								bakedOcclusion;		// Horizon maps instead of terrain casters and SSAO
+	};
+
+	struct LightParams
+	{
+		int									atlasSize;
+		int									minTile;
+		int									maxTile;
+		int									budget;				// Shadow map faces rendered per frame
+		float								bias;				// Normal offset, in shadow map texels
+		bool								shadows;
 	};
 
 	struct Application
@@ -124,13 +151,15 @@ namespace
 											const CSMParams& _csmParams,
 											const SSAOParams& _ssaoParams,
 											const DOFParams& _dofParams,
-											const TerrainParams& _terrainParams);
+											const TerrainParams& _terrainParams,
+											const LightParams& _lightParams);
 		glf::ResourceManager				resources;
 		glf::SceneManager					scene;
 
 		glf::TimingRenderer					timingRenderer;
 		glf::HelperRenderer					helperRenderer;
 
+		glf::FrameConstants					frameConstants;
 		glf::GBuffer						gbuffer;
 		glf::RenderSurface					renderSurface;
 		glf::RenderTarget					renderTarget1;
@@ -140,10 +169,21 @@ namespace
 		glf::CSMLight						csmLight;
 		glf::CSMBuilder						csmBuilder;
 		glf::CSMRenderer					csmRenderer;
+		#if ENABLE_SDSM
+		glf::SampleDistribution				sampleDistribution;
+		#endif
+
+		#if ENABLE_SHADOW_ATLAS
+		glf::ShadowAtlas					shadowAtlas;
+		#endif
+		glf::LocalLightRenderer				localLightRenderer;
 
 		glf::CubeMap						cubeMap;
 		glf::SkyBuilder						skyBuilder;
 		glf::TerrainBuilder					terrainBuilder;
+		#if ENABLE_TERRAIN_CAPTURE
+		glf::TerrainCapture					terrainCapture;
+		#endif
 
 		glf::ProbeLight						probeLight;
 		glf::ProbeBuilder					probeBuilder;
@@ -160,6 +200,7 @@ namespace
 		SkyParams							skyParams;
 		DOFParams							dofParams;
 		TerrainParams						terrainParams;
+		LightParams							lightParams;
 
 		bool								updateTerrain;
 		bool								updateLighting;
@@ -167,6 +208,9 @@ namespace
 		int									activeBuffer;
 		int									activeMenu;
 
+		std::string							sceneFile;
+		std::vector<glf::io::CameraKey>		cameraPath;	// Recorded with P
+
 		#if ENABLE_BOKEH_STATISTICS
 		bool								bokehQuery;
 		bool								bokehRecord;
@@ -175,12 +219,32 @@ namespace
 	};
 	Application*							app;
 
+	// Replay of a recorded camera path with each shadow technique (see
+	// PBC --bench shadows). Each technique renders the first key for a few
+	// frames, so that its programs are compiled and the timings of the
+	// previous one are flushed, then every key once. The GPU timings are
+	// waited for every frame, so that each frame is one sample
+	struct ShadowBenchmark
+	{
+		bool								enable;
+		std::string							sceneName;
+		std::string							pathFile;	// Next to the scene if empty
+		std::vector<glf::io::CameraKey>		path;
+		glf::FlyingCamera*					camera;		// Owned by ctx::camera
+		int									technique;	// Being measured
+		int									frame;		// Of the technique, warm up frames first
+		int									nFrames;	// Measured
+		double								gpuTime;	// Of the shadow passes, in ms
+	};
+	ShadowBenchmark							shadowBenchmark;
+	const int								shadowWarmUpFrames = 8;
+
 	const char*								bokehNames[]	= {"Pentagonal","Hexagonal","Circle","Star"};
 	struct									bokehType		{ enum Type {BK_PENTAGONAL, BK_HEXAGONAL, BK_CIRCLE,BK_STAR,MAX }; };
 	const char*								bufferNames[]	= {"Composition","Position","Normal","Diffuse"};
 	struct									bufferType		{ enum Type {GB_COMPOSITION,GB_POSITION,GB_NORMAL,GB_DIFFUSE,MAX }; };
-	const char*								menuNames[]		= {"Tone","Sky","CSM","SSAO", "DoF", "Terrain" };
-	struct									menuType		{ enum Type {MN_TONE,MN_SKY,MN_CSM,MN_SSAO,MN_DOF,MN_TERRAIN,MAX }; };
+	const char*								menuNames[]		= {"Tone","Sky","CSM","SSAO", "DoF", "Terrain", "Lights" };
+	struct									menuType		{ enum Type {MN_TONE,MN_SKY,MN_CSM,MN_SSAO,MN_DOF,MN_TERRAIN,MN_LIGHTS,MAX }; };
 
 	Application::Application(				int _w, 
 											int _h,
@@ -189,16 +253,24 @@ namespace
 											const CSMParams& _csmParams,
 											const SSAOParams& _ssaoParams,
 											const DOFParams& _dofParams,
-											const TerrainParams& _terrainParams):
+											const TerrainParams& _terrainParams,
+											const LightParams& _lightParams):
 	timingRenderer(_w,_h),
 	gbuffer(_w,_h),
 	renderSurface(_w,_h),
 	renderTarget1(_w,_h),
 	renderTarget2(_w,_h),
 	renderTarget3(_w,_h),
-	csmLight(_csmParams.resolution,_csmParams.resolution,_csmParams.nCascades),
+	csmLight(_csmParams.resolution,_csmParams.resolution,_csmParams.nCascades,_csmParams.technique),
 	csmBuilder(),
 	csmRenderer(_w,_h),
+	#if ENABLE_SDSM
+	sampleDistribution(_w,_h),
+	#endif
+	#if ENABLE_SHADOW_ATLAS
+	shadowAtlas(_lightParams.atlasSize,_lightParams.minTile,_lightParams.maxTile),
+	#endif
+	localLightRenderer(),
 	cubeMap(),
 	skyBuilder(1024),
 	terrainBuilder(),
@@ -215,6 +287,7 @@ namespace
 		ssaoParams					= _ssaoParams;
 		dofParams					= _dofParams;
 		terrainParams				= _terrainParams;
+		lightParams					= _lightParams;
 
 		updateTerrain				= true;
 		updateLighting				= true;
@@ -288,6 +361,15 @@ bool begin()
 	csmParams.aperture 			= loader.GetFloat(csmNode,"aperture",0.f);
 	csmParams.cascadeAlpha 		= loader.GetFloat(csmNode,"cascadeAlpha",0.5f);
 	csmParams.blendFactor		= loader.GetFloat(csmNode,"blendFactor",1.0f);
+	csmParams.cacheCascades		= loader.GetBool(csmNode,"cacheCascades",true);
+	csmParams.guardBand			= loader.GetFloat(csmNode,"guardBand",0.2f);
+	csmParams.filterRadius		= loader.GetInt(csmNode,"filterRadius",2);
+	csmParams.sampleDistribution= loader.GetBool(csmNode,"sampleDistribution",true);
+	std::string technique		= loader.GetString(csmNode,"technique","EVSM");
+	csmParams.technique			= glf::shadow::EVSM;
+	for(int i=0;i<glf::shadow::MAX;++i)
+		if(technique==glf::shadow::Name(i))
+			csmParams.technique = i;
 
 	SSAOParams ssaoParams;
 	glf::io::ConfigNode*ssaoNode= loader.GetNode(root,"ssao");
@@ -306,8 +388,22 @@ bool begin()
 	terrainParams.tileResolution= loader.GetInt(terrainNode,"tileResolution",32);
 	terrainParams.tessFactor 	= loader.GetFloat(ssaoNode,"tessFactor",16.f);
 	terrainParams.projFactor 	= loader.GetFloat(ssaoNode,"projFactor",10.f);
-
-	ctx::camera 				= glf::Camera::Ptr(new glf::FlyingCamera());//glf::Camera::Ptr(new glf::OrbitCamera());
+	terrainParams.shadowTessScale= loader.GetFloat(terrainNode,"shadowTessScale",0.5f);
+	terrainParams.lodFactor		= loader.GetFloat(terrainNode,"lodFactor",2.f);
+	terrainParams.gridResolution= loader.GetInt(terrainNode,"gridResolution",32);
+	terrainParams.bakedOcclusion= loader.GetBool(terrainNode,"bakedOcclusion",false);
+
+	LightParams lightParams;
+	glf::io::ConfigNode*lightNode= loader.GetNode(root,"lights");
+	lightParams.atlasSize		= loader.GetInt(lightNode,"atlasSize",4096);
+	lightParams.minTile			= loader.GetInt(lightNode,"minTile",64);
+	lightParams.maxTile			= loader.GetInt(lightNode,"maxTile",1024);
+	lightParams.budget			= loader.GetInt(lightNode,"budget",24);
+	lightParams.bias			= loader.GetFloat(lightNode,"bias",1.5f);
+	lightParams.shadows			= loader.GetBool(lightNode,"shadows",true);
+
+	glf::FlyingCamera* camera	= new glf::FlyingCamera();
+	ctx::camera 				= glf::Camera::Ptr(camera);//glf::Camera::Ptr(new glf::OrbitCamera());
 	glf::manager::timings		= glf::TimingManager::Create();
 	glf::manager::helpers		= glf::HelperManager::Create();
 	app 						= new Application(	ctx::window.Size.x,
@@ -317,9 +413,11 @@ bool begin()
 													csmParams,
 													ssaoParams,
 													dofParams,
-													terrainParams);
+													terrainParams,
+													lightParams);
 
-	glf::io::LoadScene(	glf::directory::SceneDirectory + "tank.json",
+	app->sceneFile				= glf::directory::SceneDirectory + (shadowBenchmark.sceneName.empty() ? "tank.json" : shadowBenchmark.sceneName);
+	glf::io::LoadScene(	app->sceneFile,
 						app->resources,
 						app->scene,
 						true);
@@ -332,6 +430,23 @@ bool begin()
 	float farPlane = 2.f * glm::length(app->scene.wBound.pMax - app->scene.wBound.pMin);
 	ctx::camera->Perspective(45.f, ctx::window.Size.x, ctx::window.Size.y, 0.1f, farPlane);
 
+	if(shadowBenchmark.enable)
+	{
+		std::string pathFile = shadowBenchmark.pathFile.empty() ? glf::io::CameraPathFilename(app->sceneFile) : shadowBenchmark.pathFile;
+		if(!glf::io::LoadCameraPath(pathFile,shadowBenchmark.path) || shadowBenchmark.path.empty())
+		{
+			glf::Error("Unable to load camera path (%s), record one with P",pathFile.c_str());
+			return false;
+		}
+		glf::Info("Shadow benchmark : %d keys (%s), GPU timings waited for every frame",int(shadowBenchmark.path.size()),pathFile.c_str());
+		glf::manager::timings->SetBlocking(true);
+		shadowBenchmark.camera		= camera;
+		shadowBenchmark.technique	= 0;
+		shadowBenchmark.frame		= 0;
+		shadowBenchmark.nFrames		= 0;
+		shadowBenchmark.gpuTime		= 0;
+	}
+
 	app->renderTarget1.AttachDepthStencil(app->gbuffer.depthTex);
 	app->renderTarget2.AttachDepthStencil(app->gbuffer.depthTex);
 	app->renderTarget3.AttachDepthStencil(app->gbuffer.depthTex);
@@ -420,6 +535,15 @@ void gui()
 
 			if(app->activeMenu == menuType::MN_CSM)
 			{
+				// Only the textures of the technique are allocated, its
+				// programs are compiled on its first frame
+				for(int i=0;i<glf::shadow::MAX;++i)
+				{
+					bool active = i==app->csmParams.technique;
+					ctx::ui->CheckButton(none,glf::shadow::Name(i),&active);
+					app->csmParams.technique = active?i:app->csmParams.technique;
+				}
+
 				sprintf(labelBuffer,"BlendFactor: %f",app->csmParams.blendFactor);
 				ctx::ui->Label(none,labelBuffer);
 				update |= ctx::ui->HorizontalSlider(sliderRect,0.f,1.f,&app->csmParams.blendFactor);
@@ -441,6 +565,29 @@ void gui()
 				ctx::ui->Label(none,labelBuffer);
 				update |= ctx::ui->HorizontalSlider(sliderRect,1.f,32.f,&fnSamples);
 				app->csmParams.nSamples = int(fnSamples);
+
+				// Cached cascades are filtered again with the new radius
+				float fRadius = float(app->csmParams.filterRadius);
+				sprintf(labelBuffer,"Filter radius: %d",app->csmParams.filterRadius);
+				ctx::ui->Label(none,labelBuffer);
+				ctx::ui->HorizontalSlider(sliderRect,0.f,16.f,&fRadius);
+				if(int(fRadius)!=app->csmParams.filterRadius)
+				{
+					app->csmParams.filterRadius = int(fRadius);
+					app->csmLight.Invalidate();
+				}
+
+				#if ENABLE_SDSM
+				ctx::ui->CheckButton(none,"Sample distribution",&app->csmParams.sampleDistribution);
+				#endif
+
+				#if ENABLE_CSM_CACHE
+				ctx::ui->CheckButton(none,"Cache cascades",&app->csmParams.cacheCascades);
+
+				sprintf(labelBuffer,"Guard band : %f",app->csmParams.guardBand);
+				ctx::ui->Label(none,labelBuffer);
+				ctx::ui->HorizontalSlider(sliderRect,0.f,1.f,&app->csmParams.guardBand);
+				#endif
 			}
 
 
@@ -586,12 +733,60 @@ void gui()
 				ctx::ui->Label(none,labelBuffer);
 				update |= ctx::ui->HorizontalSlider(sliderRect,0.f,32.f,&app->terrainParams.projFactor);
 
+				ctx::ui->CheckButton(none,"Baked terrain occlusion",&app->terrainParams.bakedOcclusion);
+
+				#if ENABLE_TERRAIN_CAPTURE
+				sprintf(labelBuffer,"Shadow tesselation scale : %f",app->terrainParams.shadowTessScale);
+				ctx::ui->Label(none,labelBuffer);
+				// A zero tessellation factor would cull the shadow patches
+				ctx::ui->HorizontalSlider(sliderRect,0.1f,1.f,&app->terrainParams.shadowTessScale);
+				#endif
+
+				if(!app->scene.pagedTerrains.empty())
+				{
+					float gridExp = (float)floor(log2(app->terrainParams.gridResolution));
+					sprintf(labelBuffer,"Paged grid resolution : %d",app->terrainParams.gridResolution);
+					ctx::ui->Label(none,labelBuffer);
+					ctx::ui->HorizontalSlider(sliderRect,1.f,7.f,&gridExp);
+					app->terrainParams.gridResolution = int(pow(2.f,floor(gridExp)));
+
+					sprintf(labelBuffer,"Paged LOD factor : %f",app->terrainParams.lodFactor);
+					ctx::ui->Label(none,labelBuffer);
+					ctx::ui->HorizontalSlider(sliderRect,1.f,8.f,&app->terrainParams.lodFactor);
+				}
+
 				if(update)
 				{
 					app->updateTerrain = true;
 				}
 			}
 
+			if(app->activeMenu == menuType::MN_LIGHTS)
+			{
+				sprintf(labelBuffer,"Lights : %d",int(app->scene.lights.size()));
+				ctx::ui->Label(none,labelBuffer);
+
+				sprintf(labelBuffer,"Normal offset : %f",app->lightParams.bias);
+				ctx::ui->Label(none,labelBuffer);
+				ctx::ui->HorizontalSlider(sliderRect,0.f,4.f,&app->lightParams.bias);
+
+				#if ENABLE_SHADOW_ATLAS
+				ctx::ui->CheckButton(none,"Shadows",&app->lightParams.shadows);
+
+				float fBudget = float(app->lightParams.budget);
+				sprintf(labelBuffer,"Faces per frame : %d",app->lightParams.budget);
+				ctx::ui->Label(none,labelBuffer);
+				ctx::ui->HorizontalSlider(sliderRect,1.f,96.f,&fBudget);
+				app->lightParams.budget = int(fBudget);
+
+				const glf::ShadowAtlas& atlas = app->shadowAtlas;
+				sprintf(labelBuffer,"Atlas : %.1f%% used (%.1f MB)",
+						100.0*atlas.allocator.UsedTexels()/(double(atlas.depthTex.size.x)*atlas.depthTex.size.y),
+						atlas.MemoryBytes()/(1024.0*1024.0));
+				ctx::ui->Label(none,labelBuffer);
+				#endif
+			}
+
 			ctx::ui->EndFrame();
 		ctx::ui->EndGroup();
 	ctx::ui->End();
@@ -599,9 +794,71 @@ void gui()
 	glf::CheckError("Interface");
 }
 //------------------------------------------------------------------------------
+// GPU time of the shadow passes, from the last timed frame
+double shadowGPUTime()
+{
+	#if ENABLE_CSM_PASS_TIMING
+	return	glf::manager::timings->GPUTiming(glf::section::CsmBuilderRegular) +
+			glf::manager::timings->GPUTiming(glf::section::CsmBuilderTerrain) +
+			glf::manager::timings->GPUTiming(glf::section::CsmBuilderFilter) +
+			glf::manager::timings->GPUTiming(glf::section::CsmRender) +
+			glf::manager::timings->GPUTiming(glf::section::CsmReduce);
+	#else
+	return	glf::manager::timings->GPUTiming(glf::section::CsmBuilder) +
+			glf::manager::timings->GPUTiming(glf::section::CsmRender) +
+			glf::manager::timings->GPUTiming(glf::section::CsmReduce);
+	#endif
+}
+//------------------------------------------------------------------------------
+// Places the camera on the next key of the shadow benchmark, and switches
+// to the next technique at the end of the path. Closes the window once all
+// the techniques are measured
+void shadowBenchmarkStep()
+{
+	ShadowBenchmark& bench = shadowBenchmark;
+	int nKeys = int(bench.path.size());
+
+	// Timings of the previous frame
+	if(bench.frame>shadowWarmUpFrames)
+	{
+		bench.gpuTime += shadowGPUTime();
+		++bench.nFrames;
+	}
+	if(bench.frame==shadowWarmUpFrames+nKeys)
+	{
+		glf::Info("%-4s : %8.3f ms (GPU, shadow passes, %d frames waited) %8.2f MB",
+					glf::shadow::Name(bench.technique),
+					bench.gpuTime/std::max(bench.nFrames,1),
+					bench.nFrames,
+					app->csmLight.MemoryBytes()/(1024.0*1024.0));
+		bench.frame		= 0;
+		bench.nFrames	= 0;
+		bench.gpuTime	= 0;
+		if(++bench.technique==glf::shadow::MAX)
+		{
+			bench.enable = false;
+			glfwSetWindowShouldClose(glfwGetCurrentContext(),GL_TRUE);
+			return;
+		}
+	}
+	app->csmParams.technique = bench.technique;
+
+	// View basis of the key, from its view projection
+	const glf::io::CameraKey& key = bench.path[std::max(bench.frame-shadowWarmUpFrames,0)];
+	glm::mat4 view = glm::inverse(ctx::camera->Projection()) * key.viewProjection;
+	glm::vec3 direction(-view[0][2],-view[1][2],-view[2][2]);
+	glm::vec3 up(view[0][1],view[1][1],view[2][1]);
+	bench.camera->Place(key.eye,direction,up);
+	++bench.frame;
+}
+//------------------------------------------------------------------------------
 void display()
 {
 	glf::manager::timings->StartSection(glf::section::Frame);
+	glf::manager::timings->SetCounter(glf::counter::ElidedBinds,0);
+
+	if(shadowBenchmark.enable)
+		shadowBenchmarkStep();
 
 	// Optimize far plane
 	glm::mat4 projection		= ctx::camera->Projection();
@@ -609,6 +866,25 @@ void display()
 	float nearValue				= ctx::camera->Near();
 	glm::vec3 viewPos			= ctx::camera->Eye();
 
+	// Record the camera path, which is saved next to the scene once the
+	// recording stops (see PBC --bench clusters)
+	if(ctx::recordPath)
+	{
+		glf::io::CameraKey key;
+		key.eye						= viewPos;
+		key.viewProjection			= projection * view;
+		app->cameraPath.push_back(key);
+	}
+	else if(!app->cameraPath.empty())
+	{
+		std::string pathFile = glf::io::CameraPathFilename(app->sceneFile);
+		if(glf::io::SaveCameraPath(pathFile,app->cameraPath))
+			glf::Info("Camera path saved (%d keys, %s)",int(app->cameraPath.size()),pathFile.c_str());
+		else
+			glf::Warning("Unable to save camera path (%s)",pathFile.c_str());
+		app->cameraPath.clear();
+	}
+
 	// Update lighting if needed
 	glDisable(GL_BLEND);
 	glDisable(GL_DEPTH_TEST);
@@ -631,6 +907,13 @@ void display()
 		app->updateLighting = false;
 	}
 
+	// Frame block shared by the G-buffer, helper and sun light programs
+	app->frameConstants.Update(	projection,
+								view,
+								viewPos,
+								app->csmLight.direction,
+								app->csmLight.intensity);
+
 	// Update terrain if needed
 	if(app->updateTerrain)
 	{
@@ -644,24 +927,84 @@ void display()
 													app->scene.terrainMeshes[i].normalTex,
 													app->scene.terrainMeshes[i].terrainSize,
 													app->terrainParams.depthFactors[i]);
+			app->terrainBuilder.BuildOcclusion(		app->scene.terrainMeshes[i].heightTex,
+													app->scene.terrainMeshes[i].occlusionTex,
+													app->scene.terrainMeshes[i].terrainSize,
+													app->terrainParams.depthFactors[i]);
+			app->scene.tBounds[i] = app->scene.terrainMeshes[i].Bound();
 		}
+		app->scene.bvh.Refit(app->scene);
+		app->csmLight.Invalidate();
 
 		app->updateTerrain = false;
 	}
 
+	// Paged terrains select their nodes for the camera, both passes draw
+	// them. Pages loaded since the last frame are uploaded. Their geometry
+	// follows the camera, the cached cascades it changed are rebuilt
+	int nResidentPages = 0;
+	for(unsigned int i=0;i<app->scene.pagedTerrains.size();++i)
+	{
+		glf::PagedTerrain& terrain = *app->scene.pagedTerrains[i];
+		terrain.lodFactor = app->terrainParams.lodFactor;
+		terrain.SetGridResolution(app->terrainParams.gridResolution);
+		app->csmLight.Invalidate(terrain.Update(viewPos));
+		nResidentPages += terrain.ResidentPages();
+	}
+	#if ENABLE_PAGED_TERRAIN
+	glf::manager::timings->SetCounter(glf::counter::PagedTerrainPages,nResidentPages);
+	#endif
+
 	// Enable writting into the depth buffer
 	glDepthMask(true);
 	glEnable(GL_DEPTH_TEST);
 	glDisable(GL_STENCIL_TEST);
 
+	// Terrains are tessellated once by the CSM builder for both passes
+	#if ENABLE_TERRAIN_CAPTURE
+	glf::TerrainCapture* terrainCapture = &app->terrainCapture;
+	#else
+	glf::TerrainCapture* terrainCapture = NULL;
+	#endif
+
+	// Samples of a previous frame, if read back
+	const glf::SampleDistribution* samples = NULL;
+	#if ENABLE_SDSM
+	if(app->csmParams.sampleDistribution)
+	{
+		app->sampleDistribution.Fetch();
+		samples = &app->sampleDistribution;
+	}
+	#endif
+
 	glf::manager::timings->StartSection(glf::section::CsmBuilder);
+	app->csmLight.SetTechnique(app->csmParams.technique);
+	app->csmLight.caching	= app->csmParams.cacheCascades;
+	app->csmLight.guardBand	= app->csmParams.guardBand;
+	app->csmBuilder.filterRadius = app->csmParams.filterRadius;
 	app->csmBuilder.Draw(	app->csmLight,
 							*ctx::camera,
 							app->csmParams.cascadeAlpha,
 							app->csmParams.blendFactor,
-							app->scene);
+							app->scene,
+							terrainCapture,
+							app->terrainParams.shadowTessScale,
+							!app->terrainParams.bakedOcclusion,
+							samples);
 	glf::manager::timings->EndSection(glf::section::CsmBuilder);
 
+	// Local light shadows, a budget of faces per frame
+	#if ENABLE_SHADOW_ATLAS
+	if(app->lightParams.shadows)
+	{
+		glf::manager::timings->StartSection(glf::section::ShadowAtlas);
+		app->shadowAtlas.Update(app->scene,
+								*ctx::camera,
+								app->lightParams.budget);
+		glf::manager::timings->EndSection(glf::section::ShadowAtlas);
+	}
+	#endif
+
 	// Enable writting into the stencil buffer
 	glEnable(GL_STENCIL_TEST);
 	glStencilFunc(GL_ALWAYS, 1, 1);
@@ -671,13 +1014,24 @@ void display()
 	glf::manager::timings->StartSection(glf::section::Gbuffer);
 	app->gbuffer.Draw(		projection,
 							view,
-							app->scene);
+							app->scene,
+							terrainCapture);
 	glf::manager::timings->EndSection(glf::section::Gbuffer);
 	if(ctx::drawWire) glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
 
 	glDisable(GL_DEPTH_TEST);
 	glDepthMask(false);
 
+	// Visible samples for the cascades of the next frames
+	#if ENABLE_SDSM
+	if(app->csmParams.sampleDistribution)
+	{
+		glf::manager::timings->StartSection(glf::section::CsmReduce);
+		app->sampleDistribution.Reduce(app->gbuffer.positionTex,view,app->csmLight);
+		glf::manager::timings->EndSection(glf::section::CsmReduce);
+	}
+	#endif
+
 	// Disable writting into the stencil buffer
 	// And activate stencil comparison
 	glStencilFunc(GL_EQUAL, 1, 1);
@@ -720,7 +1074,8 @@ void display()
 										app->ssaoParams.sigma,
 										app->ssaoParams.radius,
 										app->ssaoParams.nSamples,
-										app->renderTarget2);
+										app->renderTarget2,
+										app->terrainParams.bakedOcclusion);
 				glf::manager::timings->EndSection(glf::section::SsaoRender);
 
 				glBindFramebuffer(GL_FRAMEBUFFER,app->renderTarget3.framebuffer);
@@ -759,12 +1114,29 @@ void display()
 				glf::manager::timings->StartSection(glf::section::CsmRender);
 				app->csmRenderer.Draw(	app->csmLight,
 										app->gbuffer,
-										viewPos,
 										app->csmParams.blendFactor,
 										app->csmParams.bias,
-										app->renderTarget1);
+										app->renderTarget1,
+										app->terrainParams.bakedOcclusion);
 				glf::manager::timings->EndSection(glf::section::CsmRender);
 
+				// Render spot/point lights pass
+				glf::manager::timings->StartSection(glf::section::LocalLights);
+				{
+					const glf::ShadowAtlas* atlas = NULL;
+					#if ENABLE_SHADOW_ATLAS
+					if(app->lightParams.shadows)
+						atlas = &app->shadowAtlas;
+					#endif
+					app->localLightRenderer.Draw(	app->scene,
+													atlas,
+													app->gbuffer,
+													projection*view,
+													app->lightParams.bias,
+													app->renderTarget1);
+				}
+				glf::manager::timings->EndSection(glf::section::LocalLights);
+
 				glBindFramebuffer(GL_FRAMEBUFFER,0);
 
 				glDisable(GL_STENCIL_TEST);
@@ -871,8 +1243,98 @@ void display()
 	glf::manager::timings->EndSection(glf::section::Frame);
 }
 //------------------------------------------------------------------------------
+// Offline benchmarks, run without any window : 
+//	PBC --bench [obj [files...] | weld [nTriangles] | clusters [scene [path]] | bvh [nObjects...] | queue [nDraws...] | horizon [sizes...]]
+// The shadow technique benchmark renders the camera path of the scene in
+// the window (see shadowBenchmarkStep) :
+//	PBC --bench shadows [scene [path]]
+//------------------------------------------------------------------------------
+int bench(int argc, char* argv[])
+{
+	glfwInit(); // Only needed for the timer
+
+	std::string mode = argc>2 ? argv[2] : "all";
+	std::vector<std::string> args;
+	for(int i=3;i<argc;++i)
+		args.push_back(argv[i]);
+
+	bool success = true;
+	if(mode=="all" || mode=="obj")
+	{
+		std::vector<std::string> files = args;
+		if(files.empty())
+		{
+			files.push_back(glf::directory::ModelDirectory+"barrel/barrel.obj");
+			files.push_back(glf::directory::ModelDirectory+"basics/sphere.obj");
+			files.push_back(glf::directory::ModelDirectory+"basics/quad.obj");
+		}
+		for(unsigned int i=0;i<files.size();++i)
+			success &= glf::io::BenchmarkModel(files[i]);
+	}
+	if(mode=="all" || mode=="weld")
+	{
+		int nTriangles = args.empty() ? 5000000 : atoi(args[0].c_str());
+		success &= glf::io::BenchmarkVertexWelding(nTriangles);
+	}
+	if(mode=="all" || mode=="clusters")
+	{
+		std::string sceneFile = glf::directory::SceneDirectory + (mode=="clusters" && args.size()>0 ? args[0] : "tank.json");
+		std::string pathFile  = mode=="clusters" && args.size()>1 ? args[1] : glf::io::CameraPathFilename(sceneFile);
+		success &= glf::io::BenchmarkClusters(sceneFile,pathFile);
+	}
+	if(mode=="all" || mode=="bvh")
+	{
+		std::vector<int> counts;
+		for(unsigned int i=0;mode=="bvh" && i<args.size();++i)
+			counts.push_back(atoi(args[i].c_str()));
+		if(counts.empty())
+		{
+			counts.push_back(1000);
+			counts.push_back(100000);
+			counts.push_back(1000000);
+		}
+		for(unsigned int i=0;i<counts.size();++i)
+			success &= glf::BenchmarkSceneBVH(counts[i]);
+	}
+	if(mode=="all" || mode=="queue")
+	{
+		std::vector<int> counts;
+		for(unsigned int i=0;mode=="queue" && i<args.size();++i)
+			counts.push_back(atoi(args[i].c_str()));
+		if(counts.empty())
+		{
+			counts.push_back(1000);
+			counts.push_back(100000);
+		}
+		for(unsigned int i=0;i<counts.size();++i)
+			success &= glf::BenchmarkRenderQueue(counts[i]);
+	}
+	if(mode=="all" || mode=="horizon")
+	{
+		std::vector<int> sizes;
+		for(unsigned int i=0;mode=="horizon" && i<args.size();++i)
+			sizes.push_back(atoi(args[i].c_str()));
+		if(sizes.empty())
+			sizes.push_back(2048);
+		for(unsigned int i=0;i<sizes.size();++i)
+			success &= glf::BenchmarkHorizonBaker(sizes[i]);
+	}
+
+	glfwTerminate();
+	return success ? 0 : 1;
+}
+//------------------------------------------------------------------------------
 int main(int argc, char* argv[])
 {
+	shadowBenchmark.enable = argc>2 && strcmp(argv[1],"--bench")==0 && strcmp(argv[2],"shadows")==0;
+	if(argc>1 && strcmp(argv[1],"--bench")==0 && !shadowBenchmark.enable)
+		return bench(argc,argv);
+	if(shadowBenchmark.enable)
+	{
+		shadowBenchmark.sceneName	= argc>3 ? argv[3] : "";
+		shadowBenchmark.pathFile	= argc>4 ? argv[4] : "";
+	}
+
 	glf::Info("Start");
 	if(glf::Run(argc, 
 				argv,